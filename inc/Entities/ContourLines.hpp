@@ -0,0 +1,83 @@
+#ifndef CONTOURLINES
+#define CONTOURLINES
+
+// MARE
+#include "Components/RenderPack.hpp"
+#include "Materials/BasicColorMaterial.hpp"
+#include "Meshes.hpp"
+#include "Systems/Rendering/PacketRenderer.hpp"
+
+// 3DH
+#include "Math/contours.hpp"
+
+using namespace mare;
+
+/**
+ * @brief Collects traced contours as world space line segments, to display
+ * them over the terrain.
+ * @see math_3dh::trace_contours()
+ */
+class ContourLineBuilder : public math_3dh::ContourSink {
+public:
+  /**
+   * @brief Construct an empty builder.
+   *
+   * @param upper_left The world space upper left corner of the contoured grid.
+   * @param scale The world space width and height of a cell.
+   * @param vert_exag The vertical exaggeration of the terrain.
+   */
+  ContourLineBuilder(glm::vec2 upper_left, glm::vec2 scale, float vert_exag)
+      : upper_left(upper_left), scale(scale), vert_exag(vert_exag) {}
+  void add_contour(float level, const std::vector<glm::vec2> &points,
+                   bool) override {
+    for (size_t i = 1; i < points.size(); i++) {
+      push_vertex(points[i - 1], level);
+      push_vertex(points[i], level);
+    }
+  }
+  std::vector<float> vertices{}; /**< x, y, z of two vertices per segment.*/
+
+private:
+  glm::vec2 upper_left;
+  glm::vec2 scale;
+  float vert_exag;
+  inline void push_vertex(glm::vec2 point, float level) {
+    vertices.push_back(upper_left.x + (point.x + 0.5f) * scale.x);
+    vertices.push_back(upper_left.y - (point.y + 0.5f) * scale.y);
+    vertices.push_back(level * vert_exag);
+  }
+};
+
+class ContourLineMesh : public SimpleMesh {
+public:
+  ContourLineMesh(const std::vector<float> &verts) {
+    set_draw_method(DrawMethod::LINES);
+    if (verts.empty()) {
+      return;
+    }
+    Scoped<Buffer<float>> vertex_buffer =
+        Renderer::gen_buffer<float>(&verts[0], verts.size() * sizeof(float));
+    vertex_buffer->set_format({{AttributeType::POSITION_3D, "position"}});
+
+    add_geometry_buffer(std::move(vertex_buffer));
+  }
+};
+
+/**
+ * @brief Contour lines rendered over the terrain.
+ * @see Terrain::build_contour_lines()
+ */
+class ContourLines : public RenderPack {
+public:
+  ContourLines(const std::vector<float> &verts, glm::vec4 color) {
+    mesh = gen_ref<ContourLineMesh>(verts);
+    material = gen_ref<BasicColorMaterial>();
+    material->set_color(color);
+    push_packet({mesh, material});
+    gen_system<PacketRenderer>();
+  }
+  Referenced<ContourLineMesh> mesh;
+  Referenced<BasicColorMaterial> material;
+};
+
+#endif
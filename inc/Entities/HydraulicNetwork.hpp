@@ -11,9 +11,14 @@ using namespace mare;
 
 // Standard Library
 #include <unordered_map>
+#include <vector>
 
 // 3DH
 class NodeLabelBillboards;
+class Terrain;
+namespace math_3dh {
+class OverlandFlow;
+}
 
 /**
  * @brief A Hydraulic Node in a Hydraulic Network.
@@ -31,7 +36,14 @@ public:
   double northing{0.0};
   float invert_elevation{0.0f};
   float node_depth{8.0f};
+  bool has_depth{true}; /**< False when node_depth is only a default value.*/
+  float head{0.0f};     /**< The water surface elevation, the hydraulic grade.*/
+  bool has_head{false}; /**< False until the network has been solved.*/
   std::string ID{""};
+  inline float rim_elevation() const { return invert_elevation + node_depth; }
+  inline bool is_surcharged() const {
+    return has_head && head > rim_elevation();
+  }
 };
 
 /**
@@ -47,13 +59,98 @@ public:
 class CylinderNodeMeshes {
 public:
   CylinderNodeMeshes(uint32_t max_nodes);
-  void add_node(CylinderNode *node);
+  /**
+   * @brief Add an instance for a node.
+   *
+   * @return false if every instance is already in use.
+   */
+  bool add_node(CylinderNode *node);
+  /**
+   * @brief Move the instance of a node after its position or size changed.
+   */
+  void update_node(CylinderNode *node);
   void render(Camera *camera);
+  inline uint32_t get_capacity() const { return capacity; }
 
 private:
+  glm::mat4 instance_transform(CylinderNode *node);
   Referenced<CylinderMesh> base_mesh;
   Referenced<InstancedMesh> main_mesh;
   Referenced<PhongMaterial> material;
+  uint32_t capacity;
+  uint32_t count = 0;
+  std::unordered_map<const CylinderNode *, uint32_t>
+      instances{}; /**< The instance index of each node.*/
+};
+
+/**
+ * @brief A Hydraulic Node whose rim elevation disagrees with the terrain.
+ */
+struct RimMismatch {
+  std::string ID{""};
+  float rim_elevation{0.0f};
+  float ground_elevation{0.0f};
+};
+
+/**
+ * @brief The result of HydraulicNetwork::drape_to_terrain().
+ * @details For the nodes in \p above_ground the rim elevation of the
+ * RimMismatch is their invert, which would have needed a negative depth.
+ */
+struct DrapeReport {
+  size_t filled{0};      /**< Nodes whose depth was set from the terrain.*/
+  size_t checked{0};     /**< Nodes whose rim was checked against the terrain.*/
+  size_t off_terrain{0}; /**< Nodes outside of the terrain or over no data.*/
+  std::vector<RimMismatch> mismatches{}; /**< Checked nodes out of tolerance.*/
+  std::vector<RimMismatch>
+      above_ground{}; /**< Nodes not filled, their invert is above ground.*/
+};
+
+/**
+ * @brief The area draining to a Hydraulic Node.
+ */
+struct Catchment {
+  std::string ID{""};
+  glm::dvec2 pour_point{0.0, 0.0}; /**< The snapped outlet, easting northing.*/
+  double area{0.0}; /**< The area draining to the node and no other node.*/
+};
+
+/**
+ * @brief A Hydraulic Node snapped onto the same cell as another node.
+ */
+struct SharedOutlet {
+  std::string ID{""};
+  std::string outlet_ID{""}; /**< The node whose catchment holds the cell.*/
+};
+
+/**
+ * @brief The result of HydraulicNetwork::delineate_watersheds().
+ */
+struct WatershedReport {
+  std::vector<Catchment> catchments{}; /**< One per outlet on the terrain.*/
+  std::vector<SharedOutlet>
+      shared_outlets{};  /**< Nodes without a catchment of their own.*/
+  size_t off_terrain{0}; /**< Nodes outside of the terrain.*/
+};
+
+/**
+ * @brief The flooding around a surcharged Hydraulic Node.
+ */
+struct FloodedNode {
+  std::string ID{""};
+  float head{0.0f};   /**< The water surface elevation of the flood, ft.*/
+  double area{0.0};   /**< The area flooded by the node and no higher node,
+                         in square units of the DEM.*/
+  double volume{0.0}; /**< The volume of water over that area, in cubic units
+                         of the DEM.*/
+};
+
+/**
+ * @brief The result of HydraulicNetwork::map_inundation().
+ */
+struct InundationReport {
+  std::vector<FloodedNode> flooded{}; /**< One per surcharged node.*/
+  size_t off_terrain{0}; /**< Surcharged nodes outside of the terrain.*/
 };
 
 /**
@@ -69,9 +166,122 @@ class HydraulicNetwork : public Entity {
 public:
   HydraulicNetwork();
   void add_node(Referenced<HydraulicNode> node);
+  /**
+   * @brief Make room to draw a number of nodes more, so a bulk import grows
+   * the node meshes once.
+   *
+   * @param count The number of nodes about to be added.
+   */
+  void reserve_nodes(size_t count);
+  /**
+   * @brief Get the projected coordinate of the world space origin.
+   * @details Nodes keep their projected easting and northing and are drawn
+   * relative to the world offset of the main scene, like the terrain. If
+   * nothing has set the world offset yet it is set to \p anchor, so a terrain
+   * loaded later lines up with the nodes.
+   *
+   * @param anchor The projected coordinate to use as the origin if there is
+   * none yet, e.g. the first imported node.
+   * @return The easting and northing of the world space origin.
+   */
+  glm::dvec2 get_offset(glm::dvec2 anchor = {0.0, 0.0});
+  /**
+   * @brief Get the world space position of a node, see get_offset().
+   */
+  glm::vec2 to_world(const HydraulicNode *node);
+  /**
+   * @brief Get the cell of the resident DEM of a terrain under a node.
+   *
+   * @return The column and row, or (-1, -1) if the node is off the grid.
+   */
+  glm::ivec2 to_grid(const HydraulicNode *node, Terrain *terrain);
+  /**
+   * @brief Drape every node of the network on a terrain in one parallel pass.
+   * @details The ground elevation under each node is bilinearly interpolated
+   * from the terrain and converted from the vertical unit of the DEM to the
+   * units of the network. Nodes without a known depth (or every node when \p
+   * fill_all is set) get their depth set so the rim meets the ground, unless
+   * their invert is above the ground, then they are left as they are and
+   * reported. The rims of the other nodes are checked against the ground.
+   *
+   * @param terrain The terrain to drape the nodes on.
+   * @param tolerance The largest allowed difference between the rim and the
+   * ground, in the units of the network.
+   * @param fill_all Set the depth of every node from the terrain.
+   * @return The number of filled and checked nodes and the nodes out of
+   * tolerance.
+   */
+  DrapeReport drape_to_terrain(Terrain *terrain, float tolerance,
+                               bool fill_all = false);
+  /**
+   * @brief Delineate the catchment of every node of the network in one pass.
+   * @details Every node is a pour point on the resident DEM of the terrain,
+   * snapped to the cell with the most flow accumulation within \p
+   * snap_radius. The DEM is conditioned, routed with D8 and every cell is
+   * labelled with the first node downstream of it, see
+   * math_3dh::label_watersheds(). Cells draining to no node are left out.
+   * When several nodes snap to the same cell only the first gets a catchment,
+   * the others are reported as sharing its outlet.
+   *
+   * @param terrain The terrain with the DEM to delineate on.
+   * @param snap_radius The world space distance nodes may move onto a flow
+   * path.
+   * @param filepath A vector dataset to write the catchment polygons to, empty
+   * to skip writing.
+   * @return The catchment of each node on the terrain.
+   */
+  WatershedReport delineate_watersheds(Terrain *terrain, float snap_radius,
+                                       std::string filepath = "");
+  /**
+   * @brief Add every node of the network on the terrain as a point inflow of
+   * an overland flow simulation over the resident DEM of the terrain.
+   * @details Sources start with no inflow, set the surcharge of a node with
+   * math_3dh::OverlandFlow::set_inflow().
+   *
+   * @param flow The simulation, over Terrain::get_elevation_grid() with the
+   * settings of math_3dh::flow_settings_for_unit() for
+   * Terrain::get_vertical_unit().
+   * @param terrain The terrain the simulation runs on.
+   * @return The index of the source of each node on the terrain, by ID.
+   */
+  std::unordered_map<std::string, size_t>
+  add_flow_sources(math_3dh::OverlandFlow &flow, Terrain *terrain);
+  /**
+   * @brief Map the flooding around every surcharged node of the network.
+   * @details Every node whose head is above its rim floods the cells of the
+   * resident DEM of the terrain connected to it up to its head, see
+   * math_3dh::map_inundation(). Where floods meet, the higher head wins. The
+   * heads are converted to the vertical unit of the DEM. Cells that stay dry
+   * are written as no data.
+   *
+   * @param terrain The terrain with the DEM to flood.
+   * @param heads The head of each node by ID, e.g. from a solution of the
+   * network, in the units of the network. Nodes without one use their own
+   * head if they have one.
+   * @param filepath A raster to write the flood depths to, empty to skip
+   * writing.
+   * @return The flooded area and volume of each surcharged node on the
+   * terrain.
+   */
+  InundationReport
+  map_inundation(Terrain *terrain,
+                 const std::unordered_map<std::string, float> &heads,
+                 std::string filepath = "");
+  /**
+   * @brief Get the factor converting a length to the units of the network.
+   * @details Every length and elevation of the nodes is in feet, imported
+   * values and terrain elevations are converted here and nowhere else.
+   *
+   * @param metres_per_unit The length of the unit to convert from in metres,
+   * see gdal_input::metres_per_unit().
+   * @return The number of feet in one unit.
+   */
+  static inline float from_units(double metres_per_unit) {
+    return static_cast<float>(metres_per_unit / UNIT);
+  }
+  static constexpr double UNIT = 0.3048; /**< The unit of the network in m.*/
   void render(Camera *camera);
   static Referenced<HydraulicNetwork> LoadedNetwork;
-  glm::dvec2 offset{0.0, 0.0};
 
 private:
   Referenced<CylinderNodeMeshes> cylinder_node_meshes;
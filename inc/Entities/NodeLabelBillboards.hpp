@@ -13,6 +13,7 @@ using namespace mare;
 #include "Entities/HydraulicNetwork.hpp"
 
 // Standard Library
+#include <unordered_map>
 #include <vector>
 
 class NodeLabelBillboardsRenderer;
@@ -30,23 +31,37 @@ public:
   }
   void add_label(HydraulicNode *node) {
     auto label = gen_ref<CharMesh>(node->ID, 1.0f / 17.0f, 2.0f / 17.0f);
-    auto network = HydraulicNetwork::LoadedNetwork.get();
-    glm::vec3 label_center = {
-        node->easting - network->offset.x, node->northing - network->offset.y,
-        node->invert_elevation + node->node_depth + 10.0f};
     label->set_scale(glm::vec3(10.0f));
-    label->set_center(label_center);
-    auto temp_pos = label->get_position();
-    temp_pos.z = label_center.z;
-    label->set_position(temp_pos);
+    place_label(label.get(), node);
+    label_index[node] = labels.size();
     labels.push_back(label);
     push_packet({label, material});
   }
+  /**
+   * @brief Move the label of a node after its position or depth changed.
+   */
+  void update_label(HydraulicNode *node) {
+    auto it = label_index.find(node);
+    if (it != label_index.end()) {
+      place_label(labels[it->second].get(), node);
+    }
+  }
 
   std::vector<Referenced<CharMesh>> labels;
 
 private:
+  void place_label(CharMesh *label, HydraulicNode *node) {
+    glm::vec2 world = HydraulicNetwork::LoadedNetwork->to_world(node);
+    glm::vec3 label_center = {world.x, world.y,
+                              node->invert_elevation + node->node_depth + 10.0f};
+    label->set_center(label_center);
+    auto temp_pos = label->get_position();
+    temp_pos.z = label_center.z;
+    label->set_position(temp_pos);
+  }
   Referenced<PhongMaterial> material;
+  std::unordered_map<const HydraulicNode *, size_t>
+      label_index{}; /**< The index in labels of each node's label.*/
 };
 
 class NodeLabelBillboardsRenderer : public RenderSystem<NodeLabelBillboards> {
@@ -30,6 +30,11 @@ public:
   static void import_nodes(NodeTool *tool);
   // Edit
   static void open_create_flyout(NodeTool *tool);
+  static void drape_nodes(NodeTool *tool);
+  static constexpr float rim_tolerance =
+      0.5f; /**< The largest rim to ground difference accepted by DRAPE, ft.*/
+  static constexpr size_t max_drape_nodes =
+      8; /**< The most nodes listed by name after a DRAPE.*/
   // Create
   static void on_create_shape_select(NodeTool *tool);
 
@@ -55,6 +60,9 @@ public:
   Referenced<Button<NodeTool>> select_button;
   Referenced<Button<NodeTool>> create_button;
   Referenced<Button<NodeTool>> move_button;
+  Referenced<Button<NodeTool>> drape_button;
+  std::vector<Referenced<Button<NodeTool>>>
+      drape_results{}; /**< The outcome of the last DRAPE, under its button.*/
   // Create Flyout
   Referenced<FlyoutGuide<NodeTool>> create_guide;
   Referenced<ImportSelection<NodeTool>> create_shape_selection;
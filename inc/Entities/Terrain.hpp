@@ -2,7 +2,9 @@
 #define TERRAIN
 
 // Standard Library
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 // MARE
 #include "Mare.hpp"
@@ -11,8 +13,22 @@
 #include "Systems/Controls/OrbitControls.hpp"
 
 // 3DH
+#include "Entities/ContourLines.hpp"
+#include "GDAL/clipmap_stream.hpp"
 #include "GDAL/gdal_io.hpp"
+#include "GDAL/raster_writer.hpp"
+#include "GDAL/terrain_cache.hpp"
+#include "GDAL/terrain_loader.hpp"
+#include "GDAL/vector_writer.hpp"
 #include "Materials/TerrainMaterial.hpp"
+#include "Math/bilinear_sampler.hpp"
+#include "Math/contours.hpp"
+#include "Math/depression_filling.hpp"
+#include "Math/elevation_mips.hpp"
+#include "Math/minmax_pyramid.hpp"
+#include "Math/quantized_grid.hpp"
+#include "Math/terrain_shading.hpp"
+#include "Math/tiled_grid.hpp"
 
 using namespace mare;
 using namespace gdal_input;
@@ -20,20 +36,186 @@ using namespace gdal_input;
 // forward declare rendering system
 class TerrainRenderer;
 
+/**
+ * @brief How a Terrain keeps its DEM and image on the GPU.
+ */
+enum class TerrainMode {
+  RESIDENT,    /**< The whole DEM and image are uploaded once.*/
+  PROGRESSIVE, /**< Like RESIDENT but loaded coarse to fine in the background.*/
+  STREAMING    /**< Camera centered windows of each clipmap level are streamed,
+                  without normals.*/
+};
+
 class Terrain : public Entity {
 public:
   /**
    * @brief Construct a new Terrain object
    *
    * @param filepath The filepath to a DEM used to construct the terrain.
+   * @param image The image draped on the DEM, or nullptr to drape a hillshade
+   * of the DEM.
    * @param k The clipmap power. n = 2^k-1 where n is the number of vertices in
    * both the horizontal and vertical dimensions for each clipmap level. 8 is a
    * good value.
    * @param L The number of levels used for the clipmap.
+   * @param mode TerrainMode::STREAMING keeps memory use constant for rasters
+   * too large to load, see gdal_input::ClipmapStream.
+   * TerrainMode::PROGRESSIVE returns immediately and shows the terrain coarse
+   * to fine as gdal_input::TerrainLoader decodes it.
+   * @param cache A terrain cache of \p dem and \p image to map instead of
+   * decoding them, used only if it is open and current. nullptr uses the
+   * cache next to the DEM, which is written when it is missing or stale.
+   * @details When the DEM can be memory mapped, CPU elevation lookups read the
+   * mapping, so \p dem must outlive the terrain. In streaming mode the CPU
+   * copy of the DEM is not built: without a mapping get_terrain_elevation(),
+   * get_terrain_elevations() and raycast() read the finest streamed ring that
+   * has the point loaded, and terrain analysis is unavailable (see
+   * get_elevation_grid()). No normals are streamed either, so a streamed
+   * image is drawn unshaded, without an image each strip is drawn as its own
+   * hillshade. Only a resident terrain is cached, with or without an image.
+   */
+  Terrain(RasterDataset *dem, RasterDataset *image, uint32_t k, uint32_t L,
+          TerrainMode mode = TerrainMode::RESIDENT,
+          TerrainCache *cache = nullptr);
+  /**
+   * @brief Construct a new resident Terrain object from a terrain cache.
+   * @details When the cache is valid nothing is decoded through GDAL and CPU
+   * elevation lookups read the mapped cache, so \p cache must outlive the
+   * terrain. A cache that could not be opened or was written from older
+   * versions of the rasters is ignored and the DEM and image are read
+   * instead.
+   *
+   * @param cache The terrain cache written for the DEM and image.
+   * @param dem The DEM the cache was written for.
+   * @param image The image the cache was written for, or nullptr to drape a
+   * hillshade of the DEM.
+   * @param k The clipmap power.
+   * @param L The number of levels used for the clipmap.
+   * @see TerrainCache::write()
+   */
+  Terrain(TerrainCache *cache, RasterDataset *dem, RasterDataset *image,
+          uint32_t k, uint32_t L);
+  /**
+   * @brief Construct a new Terrain object from mosaics of DEM and image tiles.
+   *
+   * @param dem The mosaic of DEM tiles.
+   * @param image The mosaic of image tiles, or nullptr to drape a hillshade of
+   * the DEM.
+   * @param k The clipmap power.
+   * @param L The number of levels used for the clipmap.
+   */
+  Terrain(RasterMosaic *dem, RasterMosaic *image, uint32_t k, uint32_t L);
+  /**
+   * @brief Get the elevation of the DEM cell under a world space coordinate.
+   *
+   * @param center The world space coordinate.
+   * @return The elevation relative to the world offset, or NaN for no data and
+   * coordinates outside of the DEM.
    */
-  Terrain(RasterDataset *dem, RasterDataset *image, uint32_t k, uint32_t L);
   float get_terrain_elevation(glm::vec2 center);
+  /**
+   * @brief Bilinearly interpolate the elevation of the DEM at a batch of world
+   * space coordinates.
+   * @see math_3dh::sample_bilinear()
+   *
+   * @param x The world space x coordinates.
+   * @param y The world space y coordinates.
+   * @param z Set to the elevations relative to the world offset, or NaN for no
+   * data and coordinates outside of the DEM.
+   * @param count The number of coordinates.
+   */
+  void get_terrain_elevations(const float *x, const float *y, float *z,
+                              size_t count);
+  /**
+   * @brief Intersect a world space ray with the terrain surface on the CPU.
+   * @details The surface is the bilinear interpolation of the DEM cell centers
+   * scaled by the vertical exaggeration, cells with no data are never hit.
+   *
+   * @param origin The origin of the ray in world space.
+   * @param direction The direction of the ray in world space.
+   * @param hit Set to the world space position of the first hit.
+   * @return true if the ray hits the terrain.
+   */
+  bool raycast(glm::vec3 origin, glm::vec3 direction, glm::vec3 &hit);
+  /**
+   * @brief Get the resident DEM decoded into a tiled grid for terrain analysis.
+   * @details The grid is decoded on first use and again after the DEM changes.
+   * Cells are get_grid_scale() apart, elevations are relative to the world
+   * offset and NaN for no data. The grid is empty in streaming mode and a
+   * warning is printed on first use, so analysis built on it finds nothing.
+   *
+   * @return The elevations of the resident DEM.
+   */
+  const math_3dh::TiledGrid<float> &get_elevation_grid();
+  /**
+   * @brief Get a copy of get_elevation_grid() conditioned for flow routing.
+   * @details Pits are first breached where a short, shallow channel reaches
+   * lower ground, then what remains is filled with a parallel priority-flood.
+   * Use gdal_input::fill_raster_depressions() for DEMs too large to load.
+   *
+   * @param epsilon The smallest rise between filled cells so every cell has a
+   * descending path out, 0 leaves filled depressions flat.
+   * @param breach_length The longest breach channel in cells, 0 only fills.
+   * @param breach_depth The deepest cut allowed along a breach channel.
+   * @return The conditioned elevations.
+   */
+  math_3dh::TiledGrid<float> condition_elevations(float epsilon = 1e-4f,
+                                                  int breach_length = 0,
+                                                  float breach_depth = 0.0f);
+  /**
+   * @brief Get where the grid of get_elevation_grid() sits in the spatial
+   * reference system of the DEM, to write analysis results through GDAL.
+   */
+  RasterGeoreference get_grid_georeference();
+  /**
+   * @brief Trace the contours of the resident DEM, see
+   * math_3dh::trace_contours().
+   * @details Contours are whole intervals of the absolute elevation, the sink
+   * receives their levels relative to the world offset.
+   *
+   * @param interval The elevation between contours, e.g. 0.5.
+   * @param sink Receives each contour when it is finished.
+   * @return The number of contours traced.
+   */
+  size_t trace_contours(float interval, math_3dh::ContourSink &sink);
+  /**
+   * @brief Trace the contours of the resident DEM into a vector dataset with
+   * their absolute elevations.
+   *
+   * @param filepath The filepath of the vector dataset, replaced if it exists.
+   * @param interval The elevation between contours.
+   * @param driver The short name of the GDAL driver.
+   * @return true if the contours were written.
+   */
+  bool write_contours(std::string filepath, float interval,
+                      std::string driver = "GPKG");
+  /**
+   * @brief Trace the contours of the resident DEM into lines to display over
+   * the terrain at its vertical exaggeration.
+   *
+   * @param interval The elevation between contours.
+   * @param color The color of the lines.
+   * @return The contour lines.
+   */
+  Referenced<ContourLines> build_contour_lines(float interval,
+                                               glm::vec4 color = glm::vec4(
+                                                   1.0f, 1.0f, 1.0f, 0.6f));
+  /**
+   * @brief Convert a world space coordinate to a column and row of the
+   * resident DEM, see get_elevation_grid().
+   *
+   * @param world The world space coordinate.
+   * @return The cell containing \p world, or (-1, -1) if it is outside of the
+   * grid.
+   */
+  glm::ivec2 world_to_grid(glm::vec2 world);
+  /**
+   * @brief Get the world space center of a cell of the resident DEM.
+   */
+  glm::vec2 grid_to_world(glm::ivec2 col_row);
   glm::dvec3 calc_offset(RasterDataset *dem, RasterDataset *image);
+  glm::dvec3 calc_offset(glm::dvec2 dem_upper_left,
+                         glm::dvec2 image_upper_left);
   void update_footprints(Camera *camera);
   /**
    * @brief Convert a world space coordinate to a column and row of the DEM.
@@ -42,14 +224,98 @@ public:
    * @return The column and row of the DEM.
    */
   glm::ivec2 world_to_dem(glm::vec2 world);
+  /**
+   * @brief Look up a DEM pixel from the mapping, the streamed rings or the
+   * resident grid, whichever the terrain has.
+   *
+   * @param col_row The column and row of the DEM pixel.
+   * @return The elevation relative to the world offset, or NaN for no data,
+   * pixels outside of the DEM and pixels that are not streamed in yet.
+   */
+  float get_dem_elevation(glm::ivec2 col_row);
+  /**
+   * @brief Intersect a ray with the streamed terrain by marching it one DEM
+   * pixel at a time over the part of it above the DEM.
+   * @see raycast()
+   */
+  bool raycast_stream(glm::vec3 origin, glm::vec3 direction, glm::vec3 &hit);
   void init_elevations(RasterDataset *dem);
+  void init_elevations(TerrainCache *cache);
+  void init_elevations(RasterMosaic *dem);
   void init_image(RasterDataset *image);
+  void init_image(TerrainCache *cache);
+  void init_image(RasterMosaic *image);
+  /**
+   * @brief Drape a hillshade of the resident DEM instead of an image.
+   */
+  void init_hillshade();
+  /**
+   * @brief Compute the normal of every cell of the resident DEM and upload
+   * them, so shading needs one fetch per vertex.
+   */
+  void init_normals();
+  /**
+   * @brief Upload the octahedral encoded normals of the resident DEM.
+   */
+  void upload_normals();
+  /**
+   * @brief Upload the quantized DEM to the GPU, 16-bit samples in one buffer
+   * and the per-tile bias and scale in another.
+   */
+  void upload_elevations();
+  /**
+   * @brief Build the averaged mip pyramid of the DEM sampled by the coarse
+   * clipmap levels and upload it to the GPU.
+   */
+  void init_elevation_mips();
+  /**
+   * @brief Upload the averaged mip pyramid of the DEM.
+   */
+  void upload_elevation_mips();
+  /**
+   * @brief Replace the DEM and image with a finer stage from the loader.
+   */
+  void apply_stage(std::unique_ptr<TerrainStage> stage);
+  /**
+   * @brief Get the world space size of a cell of the resident DEM, which is
+   * coarser than a DEM pixel until progressive loading finishes.
+   */
+  inline glm::vec2 get_grid_scale() {
+    return dem_pixel_scale * static_cast<float>(dem_grid_factor);
+  }
+  /**
+   * @brief Get the number of times the resident DEM is halved from full
+   * resolution.
+   */
+  inline int grid_level() {
+    int level = 0;
+    while ((1 << level) < dem_grid_factor) {
+      level++;
+    }
+    return level;
+  }
+  /**
+   * @brief Upload the rings of the clipmap stream.
+   * @details The ring buffers are created once, after that only the cells
+   * changed by the stream since the last frame and the origins are written.
+   */
+  void upload_stream();
   void render(Camera *camera);
+  /**
+   * @brief Get the length of the unit of the elevations of the DEM in metres,
+   * see RasterDataset::get_vertical_unit().
+   */
+  inline double get_vertical_unit() { return dem_vertical_unit; }
   inline void set_vert_exag(float value) { vert_exag = value; }
   inline float get_vert_exag() { return vert_exag; }
   inline void set_alpha(float value) { alpha = value; }
 
 private:
+  bool init_world_offset(glm::dvec2 dem_upper_left,
+                         glm::dvec2 image_upper_left);
+  TerrainCache *select_cache(TerrainCache *cache, RasterDataset *dem,
+                             RasterDataset *image);
+  void init_clipmap(uint32_t k);
   float vert_exag = 1.0f;
   float alpha = 1.0f;
   GLsync fence;
@@ -69,6 +335,8 @@ private:
   glm::vec2 dem_grid_offset;
   glm::ivec2 dem_pixels;
   float dem_no_data_value;
+  double dem_vertical_unit = 1.0; /**< The elevation unit in metres.*/
+  std::string dem_projection{};
 
   glm::vec2 image_upper_left_world_space;
   glm::vec2 image_pixel_scale;
@@ -79,10 +347,32 @@ private:
   uint32_t n;
   uint32_t m;
   glm::dvec3 offset;
-  Referenced<Buffer<float>> elev_buffer = nullptr;
-  Referenced<Buffer<float>> red_buffer = nullptr;
-  Referenced<Buffer<float>> green_buffer = nullptr;
-  Referenced<Buffer<float>> blue_buffer = nullptr;
+  Referenced<Buffer<uint16_t>> elev_buffer = nullptr;
+  Referenced<Buffer<math_3dh::QuantizedTile>> elev_tile_buffer = nullptr;
+  std::unique_ptr<MappedRasterBand> dem_mapping = nullptr;
+  std::unique_ptr<TerrainCache> owned_cache = nullptr; /**< Next to the DEM.*/
+  math_3dh::QuantizedGrid dem_grid{}; /**< CPU copy or view of the DEM.*/
+  float dem_grid_shift = 0.0f; /**< Subtracted from decoded elevations.*/
+  math_3dh::MinMaxPyramid dem_pyramid{}; /**< Accelerates raycasts.*/
+  math_3dh::TiledGrid<float> elevation_grid{}; /**< Decoded for analysis.*/
+  bool elevation_grid_stale = true;
+  math_3dh::ElevationMips dem_mips{}; /**< Sampled by the coarse levels.*/
+  math_3dh::TiledGrid<uint16_t> dem_normals{}; /**< Of the resident DEM.*/
+  Referenced<Buffer<uint16_t>> normal_buffer = nullptr;
+  bool has_image = true; /**< false when a hillshade is draped instead.*/
+  Referenced<Buffer<uint16_t>> elev_mip_buffer = nullptr;
+  Referenced<Buffer<math_3dh::QuantizedTile>> elev_mip_tile_buffer = nullptr;
+  Referenced<Buffer<math_3dh::MipInfo>> elev_mip_info_buffer = nullptr;
+  uint32_t interior_level = 0; /**< The clipmap level of the interior block.*/
+  std::unique_ptr<ClipmapStream> stream = nullptr; /**< Streaming mode only.*/
+  std::unique_ptr<TerrainLoader> loader = nullptr; /**< Progressive mode only.*/
+  int dem_grid_factor = 1;   /**< DEM pixels per cell of dem_grid.*/
+  int image_grid_factor = 1; /**< Image pixels per pixel of image_buffer.*/
+  glm::ivec2 image_grid_pixels = {0, 0};
+  Referenced<Buffer<float>> clip_elev_buffer = nullptr;
+  Referenced<Buffer<uint32_t>> clip_color_buffer = nullptr;
+  Referenced<Buffer<glm::ivec2>> clip_origin_buffer = nullptr;
+  Referenced<Buffer<uint32_t>> image_buffer = nullptr;
 };
 
 class TerrainRenderer : public RenderSystem<Terrain> {
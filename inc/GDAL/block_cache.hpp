@@ -0,0 +1,101 @@
+#ifndef BLOCK_CACHE
+#define BLOCK_CACHE
+
+// Standard Library
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace gdal_input {
+/**
+ * @brief Identifies one native block of a raster band at an overview level.
+ * @details Level 0 is the full resolution band and level i > 0 is overview i-1
+ * of the band.
+ */
+struct BlockKey {
+  int band = 1;
+  int level = 0;
+  int block_x = 0;
+  int block_y = 0;
+  bool operator==(const BlockKey &other) const {
+    return band == other.band && level == other.level &&
+           block_x == other.block_x && block_y == other.block_y;
+  }
+};
+/**
+ * @brief Hash for BlockKey so it can key an unordered_map.
+ */
+struct BlockKeyHash {
+  size_t operator()(const BlockKey &key) const {
+    uint64_t h = static_cast<uint32_t>(key.block_x);
+    h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(key.block_y);
+    h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(key.band);
+    h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(key.level);
+    return static_cast<size_t>(h ^ (h >> 32));
+  }
+};
+/**
+ * @brief A decoded raster block, row major with \p width columns and \p height
+ * rows. Edge blocks are only as large as the part of the band they cover.
+ */
+struct RasterBlock {
+  int width = 0;
+  int height = 0;
+  std::vector<float> data{};
+};
+/**
+ * @brief A thread-safe least recently used cache of decoded raster blocks
+ * bounded by the number of bytes of block data it holds.
+ * @details Only the bookkeeping of the cache is guarded, decoding the blocks
+ * that fill it is up to the owner, see RasterDataset::read_block().
+ */
+class BlockCache {
+public:
+  /**
+   * @brief Construct a new Block Cache object
+   *
+   * @param max_bytes The maximum number of bytes of block data to hold.
+   */
+  BlockCache(size_t max_bytes);
+  /**
+   * @brief Look up a block and mark it as most recently used.
+   *
+   * @param key The block to look up.
+   * @return The cached block or nullptr if it is not cached.
+   */
+  std::shared_ptr<const RasterBlock> get(const BlockKey &key);
+  /**
+   * @brief Insert a block, evicting the least recently used blocks until the
+   * cache fits in its byte budget again.
+   *
+   * @param key The key of the block.
+   * @param block The decoded block.
+   */
+  void put(const BlockKey &key, std::shared_ptr<const RasterBlock> block);
+  /**
+   * @brief Remove every block from the cache.
+   */
+  void clear();
+  /**
+   * @brief Change the byte budget of the cache, evicting blocks if needed.
+   *
+   * @param max_bytes The maximum number of bytes of block data to hold.
+   */
+  void set_max_bytes(size_t max_bytes);
+  inline size_t get_bytes() { return bytes; }
+
+private:
+  using Entry = std::pair<BlockKey, std::shared_ptr<const RasterBlock>>;
+  void evict();
+  std::mutex mutex;
+  std::list<Entry> entries{}; /**< Most recently used first.*/
+  std::unordered_map<BlockKey, std::list<Entry>::iterator, BlockKeyHash>
+      lookup{};
+  size_t max_bytes;
+  size_t bytes = 0;
+};
+} // namespace gdal_input
+#endif
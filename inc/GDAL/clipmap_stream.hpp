@@ -0,0 +1,148 @@
+#ifndef CLIPMAP_STREAM
+#define CLIPMAP_STREAM
+
+// Standard Library
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// EXT
+#include "glm.hpp"
+
+namespace gdal_input {
+/**
+ * @brief A rectangle of cells of one clipmap level, requested from or filled
+ * by the loader thread of a ClipmapStream.
+ */
+struct ClipmapStrip {
+  uint32_t level = 0;
+  int x0 = 0; /**< The first column in cells of the level.*/
+  int y0 = 0; /**< The first row in cells of the level.*/
+  int width = 0;
+  int height = 0;
+  std::vector<float> elevations{};
+  std::vector<uint32_t> colors{};
+};
+/**
+ * @brief Streams a DEM and an image into fixed size, camera centered ring
+ * buffers, one per clipmap level.
+ * @details Level l has one cell per 2^(L - l - 1) x 2^(L - l - 1) DEM pixels,
+ * matching the vertex spacing of the clipmap levels of Terrain, and holds a
+ * size x size window of cells. A cell at column x and row y of a level is
+ * stored at (x mod size, y mod size) of the level's ring, so when the window
+ * moves only the newly exposed L-shaped strips are invalidated and requested.
+ * The strips are read by a background thread with its own dataset handles,
+ * decimated through the overviews of the rasters, and copied into the rings on
+ * the render thread by ClipmapStream::poll(). Memory use depends only on the
+ * number of levels and the ring size, not on the size of the rasters.
+ */
+class ClipmapStream {
+public:
+  /**
+   * @brief Start streaming a DEM and an image.
+   *
+   * @param dem_path The filepath to the DEM.
+   * @param image_path The filepath to the image draped on the DEM, empty to
+   * drape a hillshade of each level.
+   * @param levels The number of clipmap levels.
+   * @param size The number of cells on each side of a level's ring.
+   * @param z_offset A value subtracted from every elevation.
+   */
+  ClipmapStream(std::string dem_path, std::string image_path, uint32_t levels,
+                int size, double z_offset);
+  /**
+   * @brief Stop the loader thread, pending strips are dropped.
+   */
+  ~ClipmapStream();
+  ClipmapStream(const ClipmapStream &other) = delete;
+  ClipmapStream &operator=(const ClipmapStream &other) = delete;
+  /**
+   * @brief Center the window of a level on a cell and request any cells that
+   * became visible.
+   *
+   * @param level The clipmap level, 0 is the coarsest.
+   * @param center The column and row of the center cell of the level.
+   */
+  void set_center(uint32_t level, glm::ivec2 center);
+  /**
+   * @brief Copy the strips finished by the loader thread into the rings.
+   *
+   * @return true if any cell of any ring changed.
+   */
+  bool poll();
+  /**
+   * @brief Take the rectangles of cells changed by set_center() and poll()
+   * since the last call, so copies of the rings can be updated in place.
+   *
+   * @return The changed rectangles, without elevations or colors.
+   */
+  std::vector<ClipmapStrip> take_changes();
+  /**
+   * @brief Get the index of a cell in get_elevations() and get_colors().
+   *
+   * @param level The clipmap level.
+   * @param x The column in cells of the level.
+   * @param y The row in cells of the level.
+   */
+  size_t ring_index(uint32_t level, int x, int y) const;
+  /**
+   * @brief Look up a DEM pixel in the finest level that has it loaded.
+   *
+   * @param pixel The column and row of the DEM pixel.
+   * @return The elevation of the cell covering the pixel, or NaN if no level
+   * has it loaded with data.
+   */
+  float get_elevation(glm::ivec2 pixel) const;
+  /**
+   * @brief Get the number of DEM pixels on each side of a cell of a level.
+   */
+  inline int get_cell_factor(uint32_t level) const {
+    return 1 << (levels - level - 1);
+  }
+  inline uint32_t get_level_count() const { return levels; }
+  inline int get_size() const { return size; }
+  /**
+   * @brief Get the elevations of every ring, level after level. Cells that
+   * have no data or are not loaded yet are NaN.
+   */
+  inline const std::vector<float> &get_elevations() const {
+    return elevations;
+  }
+  /**
+   * @brief Get the packed RGBA8 colors of every ring, level after level.
+   */
+  inline const std::vector<uint32_t> &get_colors() const { return colors; }
+  /**
+   * @brief Get the first column and row of the window of every level.
+   */
+  inline const std::vector<glm::ivec2> &get_origins() const {
+    return origins;
+  }
+
+private:
+  void request(uint32_t level, int x0, int y0, int width, int height);
+  void invalidate(uint32_t level, int x0, int y0, int width, int height);
+  void load(std::string dem_path, std::string image_path);
+  uint32_t levels;
+  int size;
+  double z_offset;
+  std::vector<float> elevations{};
+  std::vector<uint32_t> colors{};
+  std::vector<glm::ivec2> origins{};
+  std::vector<char> initialized{};
+  std::vector<ClipmapStrip> changes{}; /**< Render thread only.*/
+  std::mutex mutex{};
+  std::condition_variable wake{};
+  std::deque<ClipmapStrip> requests{};   /**< Guarded by mutex.*/
+  std::vector<ClipmapStrip> finished{};  /**< Guarded by mutex.*/
+  std::vector<glm::ivec2> loader_origins{}; /**< Guarded by mutex.*/
+  bool stopping = false;                 /**< Guarded by mutex.*/
+  std::thread loader{};
+};
+} // namespace gdal_input
+
+#endif
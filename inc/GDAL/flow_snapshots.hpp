@@ -0,0 +1,54 @@
+#ifndef FLOW_SNAPSHOTS
+#define FLOW_SNAPSHOTS
+
+// Standard Library
+#include <fstream>
+#include <string>
+
+// 3DH
+#include "GDAL/raster_writer.hpp"
+#include "Math/overland_flow.hpp"
+#include "Math/tiled_grid.hpp"
+
+namespace gdal_input {
+/**
+ * @brief Writes snapshots of an OverlandFlow simulation for replay.
+ * @details Each snapshot is written as three GeoTIFFs, the depth and the
+ * velocity towards increasing columns (u) and rows (v), named
+ * <prefix>_<snapshot>_depth.tif, _u.tif and _v.tif. Every snapshot is listed
+ * with its simulation time and water volume in <prefix>.csv so a replay can
+ * find the rasters in order. Cells with no data in the DEM are written as
+ * FlowSnapshotWriter::NO_DATA, dry cells as 0.
+ */
+class FlowSnapshotWriter {
+public:
+  static constexpr float NO_DATA = -9999.0f;
+  /**
+   * @brief Start a new series of snapshots, replacing the index of an old one.
+   *
+   * @param prefix The path and name that every file of the series starts with.
+   * @param georeference Where the simulated DEM sits.
+   */
+  FlowSnapshotWriter(std::string prefix,
+                     const RasterGeoreference &georeference);
+  /**
+   * @brief Write the current state of a simulation.
+   *
+   * @param flow The simulation.
+   * @return true if all rasters of the snapshot were written.
+   */
+  bool write(const math_3dh::OverlandFlow &flow);
+  inline size_t get_snapshot_count() const { return snapshot_count; }
+
+private:
+  std::string prefix;
+  RasterGeoreference georeference;
+  std::ofstream index{};
+  size_t snapshot_count = 0;
+  math_3dh::TiledGrid<float> depth{}; /**< Reused between snapshots.*/
+  math_3dh::TiledGrid<float> u{};
+  math_3dh::TiledGrid<float> v{};
+};
+} // namespace gdal_input
+
+#endif
@@ -2,11 +2,16 @@
 #define GDAL_IO
 
 // Standard Library
+#include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+// 3DH
+#include "GDAL/block_cache.hpp"
+
 // EXT
 #include "cpl_conv.h"
 #include "gdal_priv.h"
@@ -18,6 +23,72 @@ namespace gdal_input {
  * @brief The supported types of geometry for vector data.
  */
 enum class GeometryType { UNKNOWN = 0, POINT, POLYLINE };
+/**
+ * @brief The storage type of an attribute column read in bulk from a layer.
+ */
+enum class FieldType { UNKNOWN = 0, REAL, INTEGER, STRING };
+/**
+ * @brief A single attribute column of a FeatureBatch.
+ * @details Only the storage matching \p type is populated. String values are
+ * packed end to end in \p chars and delimited by \p offsets so a column costs
+ * a fixed number of allocations regardless of the number of features. A column
+ * whose field could not be found in the layer has type FieldType::UNKNOWN and
+ * no values.
+ */
+struct FieldColumn {
+  std::string name{};
+  int field_index = -1;
+  FieldType type = FieldType::UNKNOWN;
+  std::vector<double> reals{};
+  std::vector<int64_t> integers{};
+  std::vector<char> chars{};
+  std::vector<size_t> offsets{0};
+  /**
+   * @brief Read the value of a feature in the column as a double.
+   *
+   * @param i The index of the feature in the batch.
+   * @return The value interpreted as a double, 0.0 if it is not numeric.
+   */
+  double get_as_double(size_t i) const;
+  /**
+   * @brief Read the value of a feature in the column as a string.
+   *
+   * @param i The index of the feature in the batch.
+   * @return The value interpreted as a string.
+   */
+  std::string get_as_string(size_t i) const;
+};
+/**
+ * @brief A struct-of-arrays batch of features read from a layer in a single
+ * sequential pass.
+ * @details The vertices of every feature are stored contiguously in \p x, \p
+ * y and \p z. The vertices of feature i are the range [vertex_offsets[i],
+ * vertex_offsets[i+1]), which is exactly one vertex per feature for point
+ * layers.
+ */
+struct FeatureBatch {
+  GeometryType geometry_type = GeometryType::UNKNOWN;
+  std::vector<int64_t> fids{};
+  std::vector<double> x{};
+  std::vector<double> y{};
+  std::vector<double> z{};
+  std::vector<size_t> vertex_offsets{0};
+  std::vector<FieldColumn> columns{};
+  /**
+   * @brief Get the number of features in the batch.
+   *
+   * @return The number of features in the batch.
+   */
+  inline size_t size() const { return fids.size(); }
+  /**
+   * @brief Find a column of the batch by field name.
+   *
+   * @param name The field name of the column.
+   * @return A pointer to the column or nullptr if the field was not requested
+   * or does not exist in the layer.
+   */
+  const FieldColumn *get_column(const std::string &name) const;
+};
 /**
  * @brief An abstraction of OGR Vector datasets to simplify reading vector data.
  */
@@ -116,9 +187,167 @@ public:
    */
   std::string get_field_as_string(std::string layer_name, int64_t FID,
                                   std::string field_name);
+  /**
+   * @brief Read the geometry and the requested attributes of every feature in
+   * a layer in one sequential pass.
+   * @details The layer is looked up and the field names are resolved to field
+   * indices once, then the features are visited in order with
+   * OGRLayer::GetNextFeature() instead of one random access lookup per feature
+   * per field. Drivers with a native Arrow stream (e.g. GeoPackage, FileGDB)
+   * are read through ArrowStreamReader instead.
+   *
+   * @param layer_name The name of the layer to read from. The layer geometry
+   * type must be GeometryType::POINT or GeometryType::POLYLINE.
+   * @param field_names The field names to read, one column is returned for each
+   * in the same order.
+   * @return The features of the layer as a FeatureBatch.
+   */
+  FeatureBatch read_features(std::string layer_name,
+                             std::vector<std::string> field_names);
+  /**
+   * @brief Read the geometry and the requested attributes of every feature in
+   * a layer using several threads.
+   * @details GDALDataset handles are not thread-safe, so each worker opens its
+   * own read-only handle to the dataset and reads a contiguous range of
+   * feature indices. The partial batches are merged in range order, so the
+   * result is identical to VectorDataset::read_features(). Layers that are
+   * small, lack fast random access by index (OLCFastSetNextByIndex, e.g.
+   * shapefiles have it), have a native Arrow stream or whose FIDs are not
+   * dense (GetFeatureCount() features with consecutive FIDs in index order,
+   * e.g. deleted shapefile records break it) are read with
+   * VectorDataset::read_features() instead.
+   *
+   * @param layer_name The name of the layer to read from.
+   * @param field_names The field names to read, one column is returned for each
+   * in the same order.
+   * @param thread_count The number of workers, 0 uses the number of hardware
+   * threads.
+   * @return The features of the layer as a FeatureBatch.
+   */
+  FeatureBatch read_features_parallel(std::string layer_name,
+                                      std::vector<std::string> field_names,
+                                      unsigned int thread_count = 0);
 
 private:
   GDALDataset *dataset = nullptr;
+  std::string filepath{};
+};
+/**
+ * @brief Reads a layer through the columnar Arrow C stream interface of
+ * OGRLayer (GDAL 3.6+).
+ * @details Record batches are decoded directly into the column buffers of a
+ * FeatureBatch without materializing an OGRFeature per row. Geometries are
+ * decoded from the WKB column of each record batch. When GDAL is older than
+ * 3.6, a requested field has an Arrow type the reader does not decode or the
+ * stream reports an error, ArrowStreamReader::read() returns false and leaves
+ * the batch as it was so the caller can fall back to the feature iterator.
+ */
+class ArrowStreamReader {
+public:
+  /**
+   * @brief Construct a new Arrow Stream Reader object
+   *
+   * @param layer The layer to read from.
+   */
+  ArrowStreamReader(OGRLayer *layer);
+  /**
+   * @brief Check if the layer provides a native (fast) Arrow stream.
+   *
+   * @return true if GDAL supports Arrow streams and the driver of the layer
+   * implements them natively.
+   */
+  bool is_fast();
+  /**
+   * @brief Read every feature of the layer into a batch.
+   *
+   * @param batch The batch to append to. The geometry type and the columns of
+   * the batch must already be set up for the layer.
+   * @return true if the layer was read, false if the Arrow stream could not be
+   * used or failed partway, in which case nothing was appended.
+   */
+  bool read(FeatureBatch &batch);
+
+private:
+  OGRLayer *layer = nullptr;
+};
+/**
+ * @brief A raster band mapped into virtual memory.
+ * @details For uncompressed raw formats whose layout GDAL reports (ENVI, BIL,
+ * EHdr, uncompressed GeoTIFF) the band file itself is memory mapped by the
+ * operating system on every platform. Other formats fall back to
+ * GDALGetVirtualMemAuto, which only pages blocks in on demand on Linux. Either
+ * way only the rows that are touched are ever read, so lookups work on rasters
+ * larger than physical memory and mapping is nearly instant. The mapping must
+ * be destroyed before the RasterDataset it was created from.
+ */
+class MappedRasterBand {
+public:
+  /**
+   * @brief Construct a new Mapped Raster Band object
+   *
+   * @param memory The virtual memory object, owned by this object.
+   * @param type The data type of the pixels in \p memory.
+   * @param pixel_space The number of bytes between adjacent pixels in a row.
+   * @param line_space The number of bytes between adjacent rows.
+   * @param cols The number of columns in the band.
+   * @param rows The number of rows in the band.
+   * @param no_data_value The no data value of the band.
+   */
+  MappedRasterBand(CPLVirtualMem *memory, GDALDataType type, int pixel_space,
+                   GIntBig line_space, int cols, int rows,
+                   float no_data_value);
+  /**
+   * @brief Construct a new Mapped Raster Band object by mapping a raw band file
+   * with the operating system. Check is_open() afterwards.
+   *
+   * @param filepath The raw file holding the pixels, in native byte order.
+   * @param offset The byte offset of the first pixel in the file.
+   * @param type The data type of the pixels.
+   * @param pixel_space The number of bytes between adjacent pixels in a row.
+   * @param line_space The number of bytes between adjacent rows.
+   * @param cols The number of columns in the band.
+   * @param rows The number of rows in the band.
+   * @param no_data_value The no data value of the band.
+   */
+  MappedRasterBand(std::string filepath, uint64_t offset, GDALDataType type,
+                   int pixel_space, GIntBig line_space, int cols, int rows,
+                   float no_data_value);
+  /**
+   * @brief Destroy the Mapped Raster Band object and unmap the band.
+   */
+  ~MappedRasterBand();
+  MappedRasterBand(const MappedRasterBand &) = delete;
+  MappedRasterBand &operator=(const MappedRasterBand &) = delete;
+  /**
+   * @brief Read a pixel of the band as a float.
+   *
+   * @param col The column of the pixel.
+   * @param row The row of the pixel.
+   * @return The pixel value, or the no data value if \p col or \p row is out
+   * of bounds.
+   */
+  float get(int col, int row) const;
+  /**
+   * @brief Check that the band was mapped.
+   */
+  inline bool is_open() const { return base != nullptr; }
+  inline int get_cols() const { return cols; }
+  inline int get_rows() const { return rows; }
+  inline float get_no_data_value() const { return no_data_value; }
+
+private:
+  CPLVirtualMem *memory = nullptr;
+  const unsigned char *view = nullptr; /**< The raw file mapping, if any.*/
+  size_t view_size = 0;
+  void *file_handle = nullptr;
+  void *mapping_handle = nullptr;
+  const unsigned char *base = nullptr;
+  GDALDataType type;
+  int pixel_space;
+  GIntBig line_space;
+  int cols;
+  int rows;
+  float no_data_value;
 };
 /**
  * @brief An abstraction of GDAL Raster datasets to simplfy reading raster data.
@@ -172,8 +401,25 @@ public:
    */
   glm::dvec2 get_top_left_coord();
   /**
-   * @brief Reads floats from a raster band. If access is out of bounds, junk
-   * data is returned.
+   * @brief Get the spatial reference system of the raster dataset.
+   *
+   * @return The spatial reference as WKT, empty if the dataset has none.
+   */
+  std::string get_projection();
+  /**
+   * @brief Get the length of the unit of the values of a raster band.
+   * @details The unit type of the band is used when it is set, otherwise the
+   * vertical unit of a compound spatial reference, otherwise the linear unit
+   * of a projected one, as DEMs usually share it. Metres are assumed when none
+   * of them is known.
+   *
+   * @param band The band index starting at 1.
+   * @return The length of the unit in metres, e.g. 0.3048 for feet.
+   */
+  double get_vertical_unit(int band);
+  /**
+   * @brief Reads floats from a raster band. Pixels that are out of bounds are
+   * set to the no data value.
    *
    * @param band The band index to read from starting a 1.
    * @param x0 The first column of the raster band to read from.
@@ -189,8 +435,8 @@ public:
   std::vector<float> read_floats(int band, int x0, int xf, int y0, int yf,
                                  int n, int m, float offset = 0.0f);
   /**
-   * @brief Reads bytes from a raster band. If access is out of bounds, junk
-   * data is returned.
+   * @brief Reads bytes from a raster band. Pixels that are out of bounds are
+   * set to the no data value.
    *
    * @param band The band index to read from starting a 1.
    * @param x0 The first column of the raster band to read from.
@@ -205,11 +451,198 @@ public:
    */
   std::vector<unsigned char> read_bytes(int band, int x0, int xf, int y0,
                                         int yf, int n, int m);
+  /**
+   * @brief Reads floats from a raster band directly into a caller provided
+   * buffer (e.g. a mapped GPU buffer) without any intermediate copy.
+   * @details Parts of the window that are out of bounds are set to the no data
+   * value and the rest is decoded by a single RasterIO call straight into \p
+   * dst.
+   *
+   * @param band The band index to read from starting a 1.
+   * @param x0 The first column of the raster band to read from.
+   * @param xf The last column of the raster band to read from.
+   * @param y0 The first row of the raster band to read from.
+   * @param yf The last row of the raster band to read from.
+   * @param n The number of columns to report. Must be <= xf-x0+1.
+   * @param m The number of rows to report. Must be <= yf-y0+1.
+   * @param dst The buffer to write to, with room for \p m rows of \p
+   * line_stride floats.
+   * @param line_stride The number of floats from the start of one row of \p
+   * dst to the start of the next, must be >= \p n.
+   * @param offset A value subtracted from every pixel that is not out of
+   * bounds.
+   * @return true if the read succeeded.
+   */
+  bool read_floats(int band, int x0, int xf, int y0, int yf, int n, int m,
+                   float *dst, int64_t line_stride, float offset = 0.0f);
+  /**
+   * @brief Reads bytes from a raster band directly into a caller provided
+   * buffer without any intermediate copy.
+   * @see RasterDataset::read_floats(int, int, int, int, int, int, int, float *,
+   * int64_t, float)
+   *
+   * @param dst The buffer to write to, with room for \p m rows of \p
+   * line_stride bytes.
+   * @param line_stride The number of bytes from the start of one row of \p
+   * dst to the start of the next, must be >= \p n.
+   * @return true if the read succeeded.
+   */
+  bool read_bytes(int band, int x0, int xf, int y0, int yf, int n, int m,
+                  unsigned char *dst, int64_t line_stride);
+  /**
+   * @brief Reads the color bands of the raster as packed RGBA8 pixels in a
+   * single pixel-interleaved RasterIO call.
+   * @details Bands 1-3 are read as red, green and blue and band 4 as alpha if
+   * it exists, otherwise alpha is 255. Single band rasters are read as gray.
+   * Pixels that are out of bounds are transparent black. Each pixel packs red
+   * in its lowest byte, matching unpackUnorm4x8 in GLSL.
+   *
+   * @param x0 The first column of the raster to read from.
+   * @param xf The last column of the raster to read from.
+   * @param y0 The first row of the raster to read from.
+   * @param yf The last row of the raster to read from.
+   * @param n The number of columns to report. Must be <= xf-x0+1.
+   * @param m The number of rows to report. Must be <= yf-y0+1.
+   * @return The packed pixels. Left to right and up to down.
+   */
+  std::vector<uint32_t> read_rgba8(int x0, int xf, int y0, int yf, int n,
+                                   int m);
+  /**
+   * @brief Reads the color bands of the raster as packed RGBA8 pixels directly
+   * into a caller provided buffer.
+   * @see RasterDataset::read_rgba8(int, int, int, int, int, int)
+   *
+   * @param dst The buffer to write to, with room for \p m rows of \p
+   * line_stride pixels.
+   * @param line_stride The number of pixels from the start of one row of \p
+   * dst to the start of the next, must be >= \p n.
+   * @return true if the read succeeded.
+   */
+  bool read_rgba8(int x0, int xf, int y0, int yf, int n, int m, uint32_t *dst,
+                  int64_t line_stride);
   float get_no_data_float(int band);
+  /**
+   * @brief Get the size of the native blocks of a raster band.
+   *
+   * @param band The band index starting at 1.
+   * @param level The overview level, 0 is full resolution and i > 0 is
+   * overview i-1 of the band.
+   * @return The number of columns and rows of each block of the band.
+   */
+  glm::ivec2 get_block_size(int band, int level = 0);
+  /**
+   * @brief Read one whole native block of a raster band as floats.
+   * @details Blocks are served from the block cache of the dataset and only
+   * decoded on a cache miss. This and RasterDataset::read_floats_cached() may
+   * be called from several threads at once, misses are decoded one at a time
+   * as the GDAL handle is shared. The other reads of the dataset must still
+   * not overlap them.
+   *
+   * @param band The band index starting at 1.
+   * @param block_x The column of the block.
+   * @param block_y The row of the block.
+   * @param level The overview level, 0 is full resolution and i > 0 is
+   * overview i-1 of the band.
+   * @return The block or nullptr if it is outside of the band.
+   */
+  std::shared_ptr<const RasterBlock> read_block(int band, int block_x,
+                                                int block_y, int level = 0);
+  /**
+   * @brief Reads floats from a raster band by stitching whole native blocks
+   * from the block cache.
+   * @details Use this instead of RasterDataset::read_floats() when nearby
+   * windows are read repeatedly (elevation queries, profiles, clipmap refills)
+   * so compressed blocks are only decoded once. Pixels outside of the band are
+   * set to the no data value.
+   *
+   * @param band The band index to read from starting a 1.
+   * @param x0 The first column to read, in pixels of \p level.
+   * @param xf The last column to read, in pixels of \p level.
+   * @param y0 The first row to read, in pixels of \p level.
+   * @param yf The last row to read, in pixels of \p level.
+   * @param level The overview level, 0 is full resolution and i > 0 is
+   * overview i-1 of the band.
+   * @param offset A value subtracted from every pixel that is not out of
+   * bounds.
+   * @return The floats read from the band. Left to right and up to down.
+   */
+  std::vector<float> read_floats_cached(int band, int x0, int xf, int y0,
+                                        int yf, int level = 0,
+                                        float offset = 0.0f);
+  /**
+   * @brief Set the maximum number of bytes of decoded blocks kept by
+   * RasterDataset::read_block().
+   *
+   * @param max_bytes The byte budget of the block cache.
+   */
+  inline void set_block_cache_size(size_t max_bytes) {
+    block_cache.set_max_bytes(max_bytes);
+  }
+  /**
+   * @brief Get the number of overviews (reduced resolution copies) of a band.
+   *
+   * @param band The band index starting at 1.
+   * @return The number of overviews of the band.
+   */
+  int get_overview_count(int band);
+  /**
+   * @brief Pick the coarsest overview level that still has at least the
+   * requested output resolution for a window.
+   * @details RasterDataset::read_floats(), RasterDataset::read_bytes() and
+   * RasterDataset::read_rgba8() read from this level whenever fewer output
+   * pixels than window pixels are requested.
+   *
+   * @param band The band index starting at 1.
+   * @param cols The number of full resolution columns in the window.
+   * @param rows The number of full resolution rows in the window.
+   * @param n The number of output columns.
+   * @param m The number of output rows.
+   * @return The overview level, 0 is full resolution and i > 0 is overview i-1
+   * of the band.
+   */
+  int select_overview_level(int band, int cols, int rows, int n, int m);
+  /**
+   * @brief Build any missing overviews of the dataset into a sidecar .ovr file
+   * on a background thread.
+   * @details The build uses its own read-only handle, so this dataset can keep
+   * being read while it runs. Overview levels are powers of two until the
+   * longest side is at most 256 pixels. Reopen the dataset with
+   * RasterDataset::open_dataset() once the future is ready to start using
+   * them.
+   *
+   * @param resampling The GDAL resampling method (e.g. "AVERAGE", "NEAREST").
+   * @return A future that is true if the overviews were built or already
+   * existed.
+   */
+  std::future<bool> build_overviews_async(std::string resampling = "AVERAGE");
+  inline std::string get_filepath() { return filepath; }
+  /**
+   * @brief Map a band into virtual memory instead of reading it into RAM.
+   * @see MappedRasterBand
+   *
+   * @param band The band index starting at 1.
+   * @return The mapped band, or nullptr if the band is not stored raw and GDAL
+   * cannot map it on this platform.
+   */
+  std::unique_ptr<MappedRasterBand> map_band(int band);
 
 private:
+  GDALRasterBand *get_band(int band, int level);
+  GDALRasterBand *get_read_band(int band, int level, int &x0, int &y0,
+                                int &cols, int &rows);
+  std::string filepath{};
   GDALDataset *dataset = nullptr;
+  BlockCache block_cache{size_t(256) * 1024 * 1024};
+  std::mutex block_read_mutex{}; /**< Serializes block decoding.*/
 };
+/**
+ * @brief Get the length of a unit of length in metres.
+ *
+ * @param units The name of the unit, either as selected in the UI ("m", "ft",
+ * "in") or as reported by GDAL (e.g. "metre", "foot", "US survey foot").
+ * @return The length of the unit in metres, 0 if the unit is not known.
+ */
+double metres_per_unit(std::string units);
 /**
  * @brief Open the operating system's open file dialog box and return the
  * absolute path to the selected file.
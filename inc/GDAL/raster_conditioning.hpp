@@ -0,0 +1,67 @@
+#ifndef RASTER_CONDITIONING
+#define RASTER_CONDITIONING
+
+// Standard Library
+#include <mutex>
+#include <string>
+
+// 3DH
+#include "GDAL/gdal_io.hpp"
+#include "GDAL/raster_writer.hpp"
+#include "Math/depression_filling.hpp"
+
+namespace gdal_input {
+/**
+ * @brief A ChunkSource that reads a DEM from a raster dataset and writes the
+ * conditioned DEM to a new raster, so neither has to fit in RAM.
+ * @details GDAL datasets are not thread safe, reads and writes are serialized
+ * while the chunks are flooded in parallel. No data is read as NaN and written
+ * back as the no data value of the DEM. A failed read or write does not stop
+ * the flood, it is remembered and reported by has_failed().
+ */
+class RasterChunks : public math_3dh::ChunkSource {
+public:
+  /**
+   * @brief Construct chunks over a DEM and an output raster of the same size.
+   *
+   * @param dem The DEM to read from band 1 of.
+   * @param output The raster to write the conditioned DEM to.
+   */
+  RasterChunks(RasterDataset *dem, RasterWriter *output);
+  int get_cols() override { return cols; }
+  int get_rows() override { return rows; }
+  void read(int col, int row, int width, int height, float *dst) override;
+  void write(int col, int row, int width, int height,
+             const float *src) override;
+  /**
+   * @brief Check if any read or write of a chunk failed.
+   */
+  bool has_failed();
+
+private:
+  RasterDataset *dem;
+  RasterWriter *output;
+  int cols;
+  int rows;
+  float no_data_value;
+  std::mutex io_mutex{};
+  bool failed = false; /**< Guarded by io_mutex.*/
+};
+/**
+ * @brief Fill the depressions of a DEM on disk into a new raster.
+ * @details Only the chunks being flooded and the spill graph between them are
+ * held in RAM, see math_3dh::fill_depressions(). The output has the
+ * georeference and no data value of the DEM.
+ *
+ * @param dem_path The filepath of the DEM.
+ * @param output_path The filepath of the filled DEM, replaced if it exists.
+ * @param chunk_size The number of columns and rows of each chunk.
+ * @param driver The short name of the GDAL driver of the output.
+ * @return true if every chunk was read and the whole filled DEM was written.
+ */
+bool fill_raster_depressions(std::string dem_path, std::string output_path,
+                             int chunk_size = 1024,
+                             std::string driver = "GTiff");
+} // namespace gdal_input
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef RASTER_MOSAIC
+#define RASTER_MOSAIC
+
+// Standard Library
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 3DH
+#include "GDAL/gdal_io.hpp"
+#include "Math/rtree.hpp"
+
+namespace gdal_input {
+/**
+ * @brief The georeferencing of one raster of a RasterMosaic, read once when
+ * the mosaic is indexed.
+ */
+struct MosaicTile {
+  std::string filepath{};
+  math_3dh::Box2D bounds{};
+  glm::dvec2 top_left = {0.0, 0.0};
+  glm::dvec2 pixel_scale = {1.0, 1.0};
+  int cols = 0;
+  int rows = 0;
+  float no_data_value = 0.0f;
+};
+/**
+ * @brief Many georeferenced rasters (e.g. survey tiles) read as if they were
+ * one raster.
+ * @details The rasters are indexed by their bounds in an R-tree, so reads and
+ * elevation queries only touch the rasters that cover them. Datasets are
+ * opened lazily through a pool that keeps at most max_open_handles of them
+ * open, closing the least recently used, and the block caches of the open
+ * handles share one byte budget. The mosaic has the top left corner of the
+ * union of the rasters and the pixel scale of the first raster, rasters with
+ * another pixel scale or off the pixel grid of the first are skipped. Where
+ * rasters overlap the first one in \p filepaths with data wins. Like
+ * RasterDataset, a mosaic must only be read from one thread at a time, the
+ * pool of handles is not locked.
+ */
+class RasterMosaic {
+public:
+  /**
+   * @brief Index a set of rasters.
+   *
+   * @param filepaths The filepaths to the rasters, rasters that cannot be
+   * opened or do not line up with the first one are skipped.
+   * @param max_open_handles The largest number of datasets kept open.
+   * @param block_cache_bytes The block cache budget shared by the open
+   * datasets.
+   */
+  RasterMosaic(std::vector<std::string> filepaths,
+               size_t max_open_handles = 64,
+               size_t block_cache_bytes = size_t(256) * 1024 * 1024);
+  inline int get_cols() { return cols; }
+  inline int get_rows() { return rows; }
+  inline glm::dvec2 get_pixel_scale() { return pixel_scale; }
+  inline glm::dvec2 get_top_left_coord() { return top_left; }
+  inline float get_no_data_float(int /*band*/) { return no_data_value; }
+  /**
+   * @brief Get the length of the unit of the elevations of the first raster
+   * in metres, see RasterDataset::get_vertical_unit().
+   */
+  inline double get_vertical_unit() { return vertical_unit; }
+  /**
+   * @brief Get the spatial reference system of the first raster as WKT, see
+   * RasterDataset::get_projection().
+   */
+  inline std::string get_projection() { return projection; }
+  inline size_t get_tile_count() { return tiles.size(); }
+  inline const MosaicTile &get_tile(size_t tile) { return tiles[tile]; }
+  /**
+   * @brief Get the number of datasets that are currently open.
+   */
+  size_t get_open_handle_count();
+  /**
+   * @brief Get the elevation of the pixel under a coordinate.
+   *
+   * @param coord The coordinate in the spatial reference of the rasters.
+   * @return The elevation or NaN if no raster has data at \p coord.
+   */
+  float get_elevation(glm::dvec2 coord);
+  /**
+   * @brief Find the rasters that overlap a box.
+   *
+   * @param bounds The box in the spatial reference of the rasters.
+   * @return The indices of the rasters.
+   */
+  std::vector<size_t> find_tiles(const math_3dh::Box2D &bounds);
+  /**
+   * @brief Reads floats from a band of the mosaic into a caller provided
+   * buffer, pixels no raster covers are set to the no data value.
+   * @see RasterDataset::read_floats(int, int, int, int, int, int, int, float *,
+   * int64_t, float)
+   */
+  bool read_floats(int band, int x0, int xf, int y0, int yf, int n, int m,
+                   float *dst, int64_t line_stride);
+  /**
+   * @brief Reads floats from a band of the mosaic.
+   * @see RasterDataset::read_floats(int, int, int, int, int, int, int, float)
+   */
+  std::vector<float> read_floats(int band, int x0, int xf, int y0, int yf,
+                                 int n, int m);
+  /**
+   * @brief Reads the color bands of the mosaic as packed RGBA8 pixels into a
+   * caller provided buffer, pixels no raster covers are transparent black.
+   * @see RasterDataset::read_rgba8(int, int, int, int, int, int, uint32_t *,
+   * int64_t)
+   */
+  bool read_rgba8(int x0, int xf, int y0, int yf, int n, int m, uint32_t *dst,
+                  int64_t line_stride);
+  /**
+   * @brief Reads the color bands of the mosaic as packed RGBA8 pixels.
+   * @see RasterDataset::read_rgba8(int, int, int, int, int, int)
+   */
+  std::vector<uint32_t> read_rgba8(int x0, int xf, int y0, int yf, int n,
+                                   int m);
+
+private:
+  std::shared_ptr<RasterDataset> acquire(size_t tile);
+  template <typename T, typename Read, typename IsValid>
+  bool read_window(int x0, int xf, int y0, int yf, int n, int m, T *dst,
+                   int64_t line_stride, T fill, Read read, IsValid is_valid);
+  std::vector<MosaicTile> tiles{};
+  math_3dh::RTree index{};
+  glm::dvec2 top_left = {0.0, 0.0};
+  glm::dvec2 pixel_scale = {1.0, 1.0};
+  int cols = 0;
+  int rows = 0;
+  float no_data_value = 0.0f;
+  double vertical_unit = 1.0;
+  std::string projection{};
+  size_t max_open_handles;
+  size_t handle_cache_bytes;
+  std::list<size_t> recently_used{}; /**< Open tiles, most recent first.*/
+  struct OpenHandle {
+    std::shared_ptr<RasterDataset> dataset;
+    std::list<size_t>::iterator position;
+  };
+  std::unordered_map<size_t, OpenHandle> open_handles{};
+};
+} // namespace gdal_input
+
+#endif
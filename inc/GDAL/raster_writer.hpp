@@ -0,0 +1,160 @@
+#ifndef RASTER_WRITER
+#define RASTER_WRITER
+
+// Standard Library
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 3DH
+#include "Math/tiled_grid.hpp"
+
+// EXT
+#include "gdal_priv.h"
+#include "glm.hpp"
+
+namespace gdal_input {
+/**
+ * @brief Where a raster sits in its spatial reference system.
+ */
+struct RasterGeoreference {
+  glm::dvec2 top_left = {0.0, 0.0};    /**< The top left corner.*/
+  glm::dvec2 pixel_scale = {1.0, 1.0}; /**< The width and height of a pixel.*/
+  std::string projection{}; /**< The spatial reference as WKT, may be empty.*/
+};
+/**
+ * @brief The GDAL data type of a cell type.
+ */
+template <typename T> struct RasterType;
+template <> struct RasterType<uint8_t> {
+  static constexpr GDALDataType value = GDT_Byte;
+};
+template <> struct RasterType<uint16_t> {
+  static constexpr GDALDataType value = GDT_UInt16;
+};
+template <> struct RasterType<int16_t> {
+  static constexpr GDALDataType value = GDT_Int16;
+};
+template <> struct RasterType<uint32_t> {
+  static constexpr GDALDataType value = GDT_UInt32;
+};
+template <> struct RasterType<int32_t> {
+  static constexpr GDALDataType value = GDT_Int32;
+};
+template <> struct RasterType<float> {
+  static constexpr GDALDataType value = GDT_Float32;
+};
+template <> struct RasterType<double> {
+  static constexpr GDALDataType value = GDT_Float64;
+};
+/**
+ * @brief Creates a single band raster and writes it a band of rows at a time,
+ * e.g. the results of terrain analysis.
+ * @details GeoTIFFs are created tiled and deflate compressed, as BigTIFF when
+ * they might exceed 4 GB.
+ */
+class RasterWriter {
+public:
+  /**
+   * @brief Create a raster, replacing any existing file.
+   *
+   * @param filepath The filepath of the raster.
+   * @param cols The number of columns.
+   * @param rows The number of rows.
+   * @param type The data type of the band.
+   * @param georeference Where the raster sits.
+   * @param no_data_value The no data value of the band.
+   * @param driver The short name of the GDAL driver.
+   */
+  RasterWriter(std::string filepath, int cols, int rows, GDALDataType type,
+               const RasterGeoreference &georeference, double no_data_value,
+               std::string driver = "GTiff");
+  /**
+   * @brief Flush and close the raster.
+   */
+  ~RasterWriter();
+  RasterWriter(const RasterWriter &other) = delete;
+  RasterWriter &operator=(const RasterWriter &other) = delete;
+  inline bool is_open() const { return dataset != nullptr; }
+  /**
+   * @brief Get the band being written, e.g. to run GDAL algorithms on a
+   * raster created with the MEM driver.
+   *
+   * @return The band or nullptr if the raster is not open.
+   */
+  inline GDALRasterBand *get_band() {
+    return dataset ? dataset->GetRasterBand(1) : nullptr;
+  }
+  /**
+   * @brief Write rows of the band.
+   *
+   * @param first_row The first row to write.
+   * @param row_count The number of rows to write.
+   * @param src The row major rows, cols * row_count values of type \p type.
+   * @param type The data type of \p src, converted to the type of the band.
+   * @return true if the rows were written.
+   */
+  bool write_rows(int first_row, int row_count, const void *src,
+                  GDALDataType type);
+  /**
+   * @brief Write a window of the band.
+   *
+   * @param col The first column of the window.
+   * @param row The first row of the window.
+   * @param width The number of columns in the window.
+   * @param height The number of rows in the window.
+   * @param src The row major window, width * height values of type \p type.
+   * @param type The data type of \p src, converted to the type of the band.
+   * @return true if the window was written.
+   */
+  bool write_window(int col, int row, int width, int height, const void *src,
+                    GDALDataType type);
+  /**
+   * @brief Write a whole tiled grid one row of tiles at a time, so only one
+   * row of tiles is ever held row major.
+   *
+   * @param grid The grid, the same size as the raster.
+   * @return true if the grid was written.
+   */
+  template <typename T> bool write_grid(const math_3dh::TiledGrid<T> &grid) {
+    constexpr int T_SIZE = math_3dh::TiledGrid<T>::TILE_SIZE;
+    std::vector<T> rows(static_cast<size_t>(grid.get_cols()) * T_SIZE);
+    for (int row = 0; row < grid.get_rows(); row += T_SIZE) {
+      int count = std::min(T_SIZE, grid.get_rows() - row);
+      grid.read_rows(row, count, rows.data());
+      if (!write_rows(row, count, rows.data(), RasterType<T>::value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  GDALDataset *dataset = nullptr;
+  int cols = 0;
+  int rows = 0;
+};
+/**
+ * @brief Write a tiled grid to a new single band raster.
+ * @see RasterWriter
+ *
+ * @param filepath The filepath of the raster.
+ * @param grid The grid to write.
+ * @param georeference Where the grid sits.
+ * @param no_data_value The no data value of the band.
+ * @param driver The short name of the GDAL driver.
+ * @return true if the raster was written.
+ */
+template <typename T>
+bool write_raster(std::string filepath, const math_3dh::TiledGrid<T> &grid,
+                  const RasterGeoreference &georeference, double no_data_value,
+                  std::string driver = "GTiff") {
+  RasterWriter writer(filepath, grid.get_cols(), grid.get_rows(),
+                      RasterType<T>::value, georeference, no_data_value,
+                      driver);
+  return writer.is_open() && writer.write_grid(grid);
+}
+} // namespace gdal_input
+
+#endif
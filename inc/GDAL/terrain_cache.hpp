@@ -0,0 +1,149 @@
+#ifndef TERRAIN_CACHE
+#define TERRAIN_CACHE
+
+// Standard Library
+#include <cstdint>
+#include <string>
+
+// 3DH
+#include "GDAL/gdal_io.hpp"
+#include "Math/elevation_mips.hpp"
+#include "Math/quantized_grid.hpp"
+#include "Math/tiled_grid.hpp"
+
+namespace gdal_input {
+/**
+ * @brief The fixed size header at the start of a terrain cache file.
+ * @details All values are stored in the byte order of the machine that wrote
+ * the cache, a cache with a different byte order is rejected as stale.
+ */
+struct TerrainCacheHeader {
+  char magic[8] = {'3', 'D', 'H', 'T', 'E', 'R', 'R', '\0'};
+  uint32_t version = 3;
+  uint32_t tile_size = 64;
+  int32_t dem_cols = 0;
+  int32_t dem_rows = 0;
+  double dem_top_left[2] = {0.0, 0.0};
+  double dem_pixel_scale[2] = {0.0, 0.0};
+  float dem_no_data_value = 0.0f;
+  float dem_vertical_unit = 1.0f; /**< The elevation unit in metres.*/
+  double z_offset = 0.0; /**< Already subtracted from every elevation.*/
+  int32_t image_cols = 0; /**< 0 when the cache was written without an image.*/
+  int32_t image_rows = 0;
+  double image_top_left[2] = {0.0, 0.0};
+  double image_pixel_scale[2] = {0.0, 0.0};
+  uint64_t dem_source_size = 0;
+  int64_t dem_source_time = 0;
+  uint64_t image_source_size = 0;
+  int64_t image_source_time = 0;
+  uint64_t tiles_offset = 0;   /**< Offset of the QuantizedTile table.*/
+  uint64_t samples_offset = 0; /**< Offset of the tiled uint16 samples.*/
+  uint64_t image_offset = 0;   /**< Offset of the packed RGBA8 image.*/
+  int32_t mip_levels = 0; /**< The largest number of mip levels requested.*/
+  int32_t mip_level_count = 0; /**< The number of mip levels built.*/
+  uint64_t mip_tile_count = 0;
+  uint64_t mip_infos_offset = 0;   /**< Offset of the math_3dh::MipInfo table.*/
+  uint64_t mip_tiles_offset = 0;   /**< Offset of the mip QuantizedTile table.*/
+  uint64_t mip_samples_offset = 0; /**< Offset of the tiled mip samples.*/
+  uint64_t normals_offset = 0; /**< Offset of the tiled octahedral normals.*/
+  uint64_t file_size = 0;
+};
+/**
+ * @brief A memory mapped terrain cache file written next to the source DEM.
+ * @details The cache holds the DEM as a math_3dh::QuantizedGrid (64x64 tiles,
+ * 16-bit samples with a per-tile bias and scale, world offset already applied)
+ * and the image as packed RGBA8 rows, so reopening a project only maps the file
+ * instead of decoding both rasters through GDAL. The mip pyramid and normals of
+ * the DEM are stored too so they are not rebuilt on every open. Pages of the
+ * file are read by the operating system as they are touched.
+ */
+class TerrainCache {
+public:
+  /**
+   * @brief Map an existing terrain cache file.
+   *
+   * @param filepath The path to the cache file.
+   */
+  TerrainCache(std::string filepath);
+  /**
+   * @brief Destroy the Terrain Cache object and unmap the file.
+   */
+  ~TerrainCache();
+  TerrainCache(const TerrainCache &) = delete;
+  TerrainCache &operator=(const TerrainCache &) = delete;
+  /**
+   * @brief Write a terrain cache for a DEM and image.
+   * @details The DEM is read and quantized one row of tiles at a time and the
+   * image a strip of rows at a time. The mips and normals are then built from
+   * the mapped DEM section and appended. A failed read removes the file.
+   *
+   * @param filepath The path of the cache file to write.
+   * @param dem The DEM to cache.
+   * @param image The image to cache, or nullptr for a DEM only cache.
+   * @param z_offset The world offset subtracted from every elevation.
+   * @param mip_levels The largest number of mip levels to build, L - 1 for a
+   * terrain with L clipmap levels.
+   * @return true if the cache was written.
+   */
+  static bool write(std::string filepath, RasterDataset *dem,
+                    RasterDataset *image, double z_offset, int mip_levels);
+  /**
+   * @brief Get the default path of the cache file for a DEM, next to it.
+   *
+   * @param dem The DEM.
+   * @return The path of the cache file.
+   */
+  static std::string get_cache_path(RasterDataset *dem);
+  /**
+   * @brief Check that the cache was mapped and is valid.
+   */
+  inline bool is_open() const { return header != nullptr; }
+  /**
+   * @brief Check that the cache was written from the current versions of the
+   * source rasters.
+   *
+   * @param dem The source DEM.
+   * @param image The source image, or nullptr for a DEM only cache.
+   * @return true if the sizes and modification times of the sources match.
+   */
+  bool is_current(RasterDataset *dem, RasterDataset *image) const;
+  inline const TerrainCacheHeader &get_header() const { return *header; }
+  /**
+   * @brief Get the DEM as a view over the mapped file.
+   */
+  math_3dh::QuantizedGrid get_elevations() const;
+  /**
+   * @brief Get the packed RGBA8 image pixels in the mapped file.
+   *
+   * @return The pixels, or nullptr for a DEM only cache.
+   */
+  const uint32_t *get_image() const;
+  /**
+   * @brief Copy the stored mip pyramid of the DEM.
+   *
+   * @param mip_levels The largest number of mip levels the caller needs.
+   * @param mips The pyramid, unchanged when false is returned.
+   * @return true if the cache holds a pyramid built for \p mip_levels.
+   */
+  bool get_mips(int mip_levels, math_3dh::ElevationMips &mips) const;
+  /**
+   * @brief Copy the stored normals of the DEM.
+   *
+   * @param normals The normals, unchanged when false is returned.
+   * @return true if the cache holds normals.
+   */
+  bool get_normals(math_3dh::TiledGrid<uint16_t> &normals) const;
+
+private:
+  /**
+   * @brief Build the mips and normals of a written cache and append them.
+   */
+  static bool append_derived(const std::string &filepath, int mip_levels);
+  const TerrainCacheHeader *header = nullptr;
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+  void *file_handle = nullptr;
+  void *mapping_handle = nullptr;
+};
+} // namespace gdal_input
+#endif
@@ -0,0 +1,110 @@
+#ifndef TERRAIN_LOADER
+#define TERRAIN_LOADER
+
+// Standard Library
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 3DH
+#include "GDAL/gdal_io.hpp"
+#include "GDAL/raster_mosaic.hpp"
+#include "Math/elevation_mips.hpp"
+#include "Math/quantized_grid.hpp"
+#include "Math/spsc_queue.hpp"
+#include "Math/terrain_shading.hpp"
+
+namespace gdal_input {
+/**
+ * @brief One resolution of a DEM and image decoded by a TerrainLoader, ready
+ * to be uploaded.
+ */
+struct TerrainStage {
+  int dem_factor = 1; /**< DEM pixels on each side of a cell of elevations.*/
+  math_3dh::QuantizedGrid elevations{};
+  math_3dh::ElevationMips mips{}; /**< Coarser levels of elevations.*/
+  math_3dh::TiledGrid<uint16_t> normals{}; /**< Encoded per cell normals.*/
+  int image_factor = 1; /**< Image pixels on each side of a pixel of image.*/
+  glm::ivec2 image_pixels = {0, 0};
+  std::vector<uint32_t> image{}; /**< Packed RGBA8, a hillshade if no image.*/
+  bool is_final = false;         /**< Both rasters are at full resolution.*/
+};
+/**
+ * @brief Decodes a DEM and an image on a background thread, coarsest first.
+ * @details The first stage is decimated until the longest side of the DEM is
+ * at most 512 cells and of the image at most 1024 pixels, which only reads
+ * the coarse overviews of the rasters, so it is ready almost immediately. Each
+ * later stage halves the decimation until both rasters are at full
+ * resolution. Finished stages are handed to the render thread through a
+ * lock-free queue and picked up with TerrainLoader::poll().
+ */
+class TerrainLoader {
+public:
+  /**
+   * @brief Start loading a DEM and an image.
+   *
+   * @param dem_path The filepath to the DEM.
+   * @param image_path The filepath to the image draped on the DEM, empty to
+   * drape a hillshade of the DEM at the resolution of each stage.
+   * @param mip_levels The number of mip levels to build above a full
+   * resolution stage, coarser stages build fewer.
+   */
+  TerrainLoader(std::string dem_path, std::string image_path, int mip_levels);
+  /**
+   * @brief Cancel loading and wait for the worker to stop.
+   */
+  ~TerrainLoader();
+  TerrainLoader(const TerrainLoader &other) = delete;
+  TerrainLoader &operator=(const TerrainLoader &other) = delete;
+  /**
+   * @brief Take the finest stage finished since the last poll, render thread
+   * only.
+   *
+   * @return The stage or nullptr if no new stage is ready.
+   */
+  std::unique_ptr<TerrainStage> poll();
+  /**
+   * @brief Check if the final, full resolution stage has been taken.
+   */
+  inline bool is_done() const { return done; }
+  /**
+   * @brief Read a DEM into a quantized grid one row of tiles at a time, so the
+   * full float DEM never exists.
+   *
+   * @param dem The DEM.
+   * @param factor The decimation, each cell covers factor x factor pixels.
+   * @return The grid of raw elevations.
+   */
+  static math_3dh::QuantizedGrid read_elevations(RasterDataset *dem,
+                                                 int factor);
+  /**
+   * @brief Read a DEM mosaic into a quantized grid.
+   * @see TerrainLoader::read_elevations(RasterDataset *, int)
+   */
+  static math_3dh::QuantizedGrid read_elevations(RasterMosaic *dem,
+                                                 int factor);
+  /**
+   * @brief Read an image as packed RGBA8.
+   *
+   * @param image The image.
+   * @param factor The decimation, each output pixel covers factor x factor
+   * pixels.
+   * @param pixels Set to the number of output columns and rows.
+   * @return The packed pixels.
+   */
+  static std::vector<uint32_t> read_image(RasterDataset *image, int factor,
+                                          glm::ivec2 &pixels);
+
+private:
+  void load(std::string dem_path, std::string image_path, int mip_levels);
+  math_3dh::SpscQueue<std::unique_ptr<TerrainStage>> stages{16};
+  std::atomic<bool> cancelled{false};
+  bool done = false;
+  std::thread worker{};
+};
+} // namespace gdal_input
+
+#endif
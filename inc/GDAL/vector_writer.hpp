@@ -0,0 +1,142 @@
+#ifndef VECTOR_WRITER
+#define VECTOR_WRITER
+
+// Standard Library
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 3DH
+#include "GDAL/raster_writer.hpp"
+#include "Math/contours.hpp"
+#include "Math/tiled_grid.hpp"
+
+// EXT
+#include "gdal_priv.h"
+#include <ogrsf_frmts.h>
+
+namespace gdal_input {
+/**
+ * @brief The name and type of an attribute field of a new layer.
+ */
+struct VectorField {
+  std::string name{};
+  OGRFieldType type = OFTReal;
+};
+/**
+ * @brief Creates a vector dataset and writes layers of features to it, e.g.
+ * the polygons and lines produced by terrain analysis.
+ * @details All features are written in one transaction when the driver
+ * supports it, which is much faster for GeoPackages. The transaction is
+ * committed when the writer is destroyed.
+ */
+class VectorWriter {
+public:
+  /**
+   * @brief Create a vector dataset, replacing any existing file.
+   *
+   * @param filepath The filepath of the dataset, may be empty for the Memory
+   * driver.
+   * @param driver The short name of the GDAL driver.
+   */
+  VectorWriter(std::string filepath, std::string driver = "GPKG");
+  /**
+   * @brief Commit the features and close the dataset.
+   */
+  ~VectorWriter();
+  VectorWriter(const VectorWriter &other) = delete;
+  VectorWriter &operator=(const VectorWriter &other) = delete;
+  inline bool is_open() const { return dataset != nullptr; }
+  /**
+   * @brief Create a layer in the dataset.
+   *
+   * @param layer_name The name of the layer.
+   * @param geometry_type The type of geometry of the features.
+   * @param projection The spatial reference as WKT, may be empty.
+   * @param fields The attribute fields of the features, in order.
+   * @return The layer or nullptr if it could not be created.
+   */
+  OGRLayer *create_layer(std::string layer_name,
+                         OGRwkbGeometryType geometry_type,
+                         const std::string &projection,
+                         const std::vector<VectorField> &fields);
+
+private:
+  GDALDataset *dataset = nullptr;
+  bool in_transaction = false;
+};
+/**
+ * @brief Streams contours into a line layer of a vector dataset as they are
+ * traced, see math_3dh::trace_contours().
+ * @details The layer has the field "elevation". Grid coordinates are placed
+ * with the georeference of the DEM.
+ */
+class ContourLayerWriter : public math_3dh::ContourSink {
+public:
+  /**
+   * @brief Create the contour layer.
+   *
+   * @param writer The dataset to create the layer in, must outlive this.
+   * @param georeference Where the contoured grid sits.
+   * @param elevation_offset Added to the level of each contour, e.g. the
+   * world offset of the terrain.
+   * @param layer_name The name of the layer.
+   */
+  ContourLayerWriter(VectorWriter &writer,
+                     const RasterGeoreference &georeference,
+                     double elevation_offset = 0.0,
+                     std::string layer_name = "contours");
+  void add_contour(float level, const std::vector<glm::vec2> &points,
+                   bool closed) override;
+  inline bool is_open() const { return layer != nullptr; }
+  inline size_t get_error_count() const { return error_count; }
+
+private:
+  OGRLayer *layer = nullptr;
+  RasterGeoreference georeference{};
+  double elevation_offset = 0.0;
+  size_t error_count = 0;
+};
+/**
+ * @brief Trace the contours of a grid straight into a new vector dataset.
+ * @see ContourLayerWriter
+ *
+ * @param filepath The filepath of the vector dataset, replaced if it exists.
+ * @param elevations The grid to contour, NaN for no data.
+ * @param georeference Where the grid sits.
+ * @param interval The elevation between contours.
+ * @param elevation_offset Added to the grid to get elevations, the contours
+ * are whole intervals of the offset elevations.
+ * @param driver The short name of the GDAL driver.
+ * @return true if the contours were written.
+ */
+bool write_contours(std::string filepath,
+                    const math_3dh::TiledGrid<float> &elevations,
+                    const RasterGeoreference &georeference, float interval,
+                    double elevation_offset = 0.0,
+                    std::string driver = "GPKG");
+/**
+ * @brief Write the watersheds of a label grid as polygons.
+ * @details The labels are polygonized with 8-connected cells by GDAL and the
+ * pieces of each watershed are dissolved into one multipolygon, written to a
+ * layer named "watersheds" with the fields "node_id", "label" and "area".
+ * Cells labelled with a negative value are skipped.
+ *
+ * @param filepath The filepath of the vector dataset, replaced if it exists.
+ * @param labels The index of the watershed of each cell, see
+ * math_3dh::label_watersheds().
+ * @param georeference Where the grid sits.
+ * @param names The name of each watershed, e.g. the ID of its pour point.
+ * @param areas The area of each watershed, the total of all of its pieces.
+ * @param driver The short name of the GDAL driver.
+ * @return true if the polygons were written.
+ */
+bool write_watershed_polygons(std::string filepath,
+                              const math_3dh::TiledGrid<int32_t> &labels,
+                              const RasterGeoreference &georeference,
+                              const std::vector<std::string> &names,
+                              const std::vector<double> &areas,
+                              std::string driver = "GPKG");
+} // namespace gdal_input
+
+#endif
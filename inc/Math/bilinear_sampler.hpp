@@ -0,0 +1,50 @@
+#ifndef BILINEAR_SAMPLER
+#define BILINEAR_SAMPLER
+
+// Standard Library
+#include <cstddef>
+
+// 3DH
+#include "Math/quantized_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief An axis aligned map from world coordinates to grid coordinates, u = x
+ * * scale_x + offset_x and v = y * scale_y + offset_y. Integer grid
+ * coordinates are the centers of the grid cells.
+ */
+struct GridTransform {
+  float scale_x = 1.0f;
+  float offset_x = 0.0f;
+  float scale_y = 1.0f;
+  float offset_y = 0.0f;
+};
+/**
+ * @brief The instruction sets a batch kernel can be dispatched to.
+ */
+enum class SimdLevel { SCALAR, AVX2, NEON };
+/**
+ * @brief Get the instruction set used by sample_bilinear() on this CPU.
+ */
+SimdLevel get_simd_level();
+/**
+ * @brief Bilinearly interpolate a grid at a batch of points.
+ * @details Points within half a cell of the grid edge are clamped to the edge
+ * cells. The result is NaN for points outside of the grid and for points where
+ * any of the four surrounding cells has no data. The kernel is vectorized with
+ * AVX2 or NEON when the CPU supports it.
+ *
+ * @param grid The grid to sample.
+ * @param shift A value subtracted from every interpolated value.
+ * @param transform The map from the coordinates of the points to the grid.
+ * @param x The x coordinates of the points.
+ * @param y The y coordinates of the points.
+ * @param z Set to the interpolated value at each point.
+ * @param count The number of points.
+ */
+void sample_bilinear(const QuantizedGrid &grid, float shift,
+                     const GridTransform &transform, const float *x,
+                     const float *y, float *z, size_t count);
+} // namespace math_3dh
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef CONTOURS
+#define CONTOURS
+
+// Standard Library
+#include <vector>
+
+// External Libraries
+#include "glm.hpp"
+
+// 3DH
+#include "Math/tiled_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief Where trace_contours() streams the contours it finishes, e.g. a GDAL
+ * layer or a line mesh.
+ * @details Contours are added from the calling thread of trace_contours(), one
+ * at a time.
+ */
+class ContourSink {
+public:
+  virtual ~ContourSink() = default;
+  /**
+   * @brief Receive a finished contour.
+   *
+   * @param level The elevation of the contour.
+   * @param points The vertices in grid coordinates, x is the column and y the
+   * row with cell centers at whole numbers. Higher ground is on the left,
+   * which is on the right once the rows are flipped to point north.
+   * @param closed true if the contour is a ring, its last point repeats its
+   * first.
+   */
+  virtual void add_contour(float level, const std::vector<glm::vec2> &points,
+                           bool closed) = 0;
+};
+/**
+ * @brief Trace the contours of a DEM with marching squares.
+ * @details The squares between cell centers are traced one row of tiles at a
+ * time, the tiles of a row in parallel. The segments of each tile are joined
+ * into polylines, then the polylines are stitched across the tile seams by the
+ * grid edge they cross. A contour is passed to the sink as soon as it can not
+ * grow any more, so only the contours crossing the bottom of the current row
+ * of tiles are held and memory follows the size of a tile, not the length of
+ * the output. Saddles are resolved by the average of the square. Squares with
+ * a NaN corner are skipped, so contours end at no data and the edges of the
+ * DEM.
+ *
+ * @param elevations The DEM, NaN for no data.
+ * @param interval The elevation between contours.
+ * @param sink Receives each contour when it is finished.
+ * @param base An elevation that has a contour, the others are whole intervals
+ * above or below it.
+ * @param thread_count The number of threads, 0 uses the number of hardware
+ * threads.
+ * @return The number of contours traced.
+ */
+size_t trace_contours(const TiledGrid<float> &elevations, float interval,
+                      ContourSink &sink, double base = 0.0,
+                      unsigned int thread_count = 0);
+} // namespace math_3dh
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef DEPRESSION_FILLING
+#define DEPRESSION_FILLING
+
+// Standard Library
+#include <cstdint>
+
+// 3DH
+#include "Math/tiled_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief Where fill_depressions() reads and writes the chunks of a DEM, so a
+ * DEM too large for RAM can stay on disk.
+ * @details Chunks are read and written from several threads, implementations
+ * must serialize access to anything that is not thread safe.
+ */
+class ChunkSource {
+public:
+  virtual ~ChunkSource() = default;
+  virtual int get_cols() = 0;
+  virtual int get_rows() = 0;
+  /**
+   * @brief Read a window of the DEM.
+   *
+   * @param col The first column of the window, may be outside of the DEM.
+   * @param row The first row of the window, may be outside of the DEM.
+   * @param width The number of columns in the window.
+   * @param height The number of rows in the window.
+   * @param dst The row major window, NaN for no data and cells outside of the
+   * DEM.
+   */
+  virtual void read(int col, int row, int width, int height, float *dst) = 0;
+  /**
+   * @brief Write a window of the conditioned DEM, always inside the DEM.
+   * @see ChunkSource::read()
+   */
+  virtual void write(int col, int row, int width, int height,
+                     const float *src) = 0;
+};
+/**
+ * @brief A ChunkSource over a tiled grid in RAM, conditioned in place.
+ */
+class TiledGridChunks : public ChunkSource {
+public:
+  TiledGridChunks(TiledGrid<float> *grid) : grid(grid) {}
+  int get_cols() override { return grid->get_cols(); }
+  int get_rows() override { return grid->get_rows(); }
+  void read(int col, int row, int width, int height, float *dst) override;
+  void write(int col, int row, int width, int height,
+             const float *src) override;
+
+private:
+  TiledGrid<float> *grid;
+};
+/**
+ * @brief Fill the depressions of a DEM with a parallel priority-flood.
+ * @details The DEM is split into chunks that are flooded in parallel from
+ * their borders, labelling every cell with the watershed it was flooded from
+ * and recording the lowest spill elevation between watersheds. Only these
+ * spill edges are kept, so the graph of watersheds is small enough to
+ * priority-flood serially from the edge of the DEM, which gives the water level
+ * of every watershed. A second parallel pass floods each chunk again and
+ * raises its cells to the water level of their watershed. Nothing but the
+ * spill graph is kept between passes, so a ChunkSource on disk keeps memory
+ * bounded by the chunk size. Cells bordering the edge of the DEM or no data
+ * are outlets.
+ *
+ * @param dem The DEM to condition.
+ * @param chunk_size The number of columns and rows of each chunk.
+ * @param thread_count The number of threads, 0 uses the number of hardware
+ * threads.
+ */
+void fill_depressions(ChunkSource &dem, int chunk_size = 512,
+                      unsigned int thread_count = 0);
+/**
+ * @brief Fill the depressions of a DEM in RAM.
+ * @details With a positive \p epsilon a serial priority-flood over the filled
+ * DEM then raises every flat cell by at least \p epsilon over the cell it
+ * drains to, so D8 routing finds a strictly descending path out of every
+ * filled depression and flat (Barnes 2014).
+ *
+ * @param elevations The DEM, NaN for no data, conditioned in place.
+ * @param epsilon The smallest rise between a flat cell and its receiver, 0
+ * leaves filled depressions flat.
+ * @param thread_count The number of threads, 0 uses the number of hardware
+ * threads.
+ */
+void fill_depressions(TiledGrid<float> &elevations, float epsilon = 0.0f,
+                      unsigned int thread_count = 0);
+/**
+ * @brief Breach depressions by carving the least cost channel from each pit
+ * to a lower cell, the cost being the total depth cut (Lindsay 2016).
+ * @details Pits are breached one at a time from the lowest up, a pit whose
+ * channel would be longer or deeper than the limits is left for filling. The
+ * channel descends linearly from the pit to the lower cell and no cell of it,
+ * including those below the pit, is cut deeper than \p max_depth. Run
+ * fill_depressions() afterwards to remove what remains.
+ *
+ * @param elevations The DEM, NaN for no data, conditioned in place.
+ * @param max_length The longest channel in cells.
+ * @param max_depth The deepest cut allowed at any cell of a channel.
+ * @return The number of pits that were breached.
+ */
+size_t breach_depressions(TiledGrid<float> &elevations, int max_length,
+                          float max_depth);
+} // namespace math_3dh
+
+#endif
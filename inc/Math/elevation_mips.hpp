@@ -0,0 +1,94 @@
+#ifndef ELEVATION_MIPS
+#define ELEVATION_MIPS
+
+// Standard Library
+#include <cstdint>
+#include <vector>
+
+// 3DH
+#include "Math/quantized_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief How the 2x2 cells of a mip level are reduced to one cell of the next.
+ */
+enum class MipReduction { AVERAGE, MIN, MAX };
+/**
+ * @brief The layout of one mip level in the packed storage of ElevationMips,
+ * laid out as two ivec4 for a std430 shader storage buffer.
+ */
+struct MipInfo {
+  int32_t cols = 0;
+  int32_t rows = 0;
+  int32_t tiles_x = 0;
+  int32_t tile_size = 0;
+  int32_t tile_offset = 0; /**< The first tile of the level.*/
+  int32_t word_offset = 0; /**< The first sample of the level / 2.*/
+  int32_t reserved[2] = {0, 0};
+};
+/**
+ * @brief A mip pyramid of a QuantizedGrid.
+ * @details Level k (k >= 1) has one cell per 2^k x 2^k cells of the base grid,
+ * reduced from the 2x2 cells of level k - 1 while ignoring no data. A cell is
+ * no data only when all of the cells it covers are. Every level is a
+ * QuantizedGrid with the tile size of the base grid, and the tiles and samples
+ * of all levels are packed into one array each so they can be uploaded to the
+ * GPU as single buffers.
+ */
+class ElevationMips {
+public:
+  /**
+   * @brief Construct an empty pyramid with no levels.
+   */
+  ElevationMips() = default;
+  /**
+   * @brief Build the pyramid of a grid, one level at a time with the tiles of
+   * each level reduced in parallel.
+   *
+   * @param grid The base grid, level 0 of the pyramid.
+   * @param max_levels The largest number of levels to build above the base,
+   * fewer are built once a level is a single cell.
+   * @param reduction How cells are combined.
+   */
+  ElevationMips(const QuantizedGrid &grid, int max_levels,
+                MipReduction reduction = MipReduction::AVERAGE);
+  /**
+   * @brief Construct a pyramid from packed storage built earlier, e.g. read
+   * back from a terrain cache.
+   *
+   * @param infos The layout of each level.
+   * @param tiles The tiles of all levels.
+   * @param samples The samples of all levels.
+   */
+  ElevationMips(std::vector<MipInfo> infos, std::vector<QuantizedTile> tiles,
+                std::vector<uint16_t> samples);
+  ElevationMips(const ElevationMips &other) = delete;
+  ElevationMips &operator=(const ElevationMips &other) = delete;
+  ElevationMips(ElevationMips &&other) = default;
+  ElevationMips &operator=(ElevationMips &&other) = default;
+  /**
+   * @brief Get the number of levels above the base grid.
+   */
+  inline int get_level_count() const { return static_cast<int>(levels.size()); }
+  /**
+   * @brief Get a level of the pyramid.
+   *
+   * @param level The level, 1 to get_level_count().
+   * @return A view of the level.
+   */
+  inline const QuantizedGrid &get_level(int level) const {
+    return levels[level - 1];
+  }
+  inline const std::vector<MipInfo> &get_infos() const { return infos; }
+  inline const std::vector<QuantizedTile> &get_tiles() const { return tiles; }
+  inline const std::vector<uint16_t> &get_samples() const { return samples; }
+
+private:
+  std::vector<QuantizedGrid> levels{}; /**< Views into tiles and samples.*/
+  std::vector<MipInfo> infos{};
+  std::vector<QuantizedTile> tiles{};
+  std::vector<uint16_t> samples{};
+};
+} // namespace math_3dh
+
+#endif
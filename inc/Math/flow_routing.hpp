@@ -0,0 +1,85 @@
+#ifndef FLOW_ROUTING
+#define FLOW_ROUTING
+
+// Standard Library
+#include <cstdint>
+
+// External Libraries
+#include "glm.hpp"
+
+// 3DH
+#include "Math/tiled_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief The D8 direction of a cell with no lower neighbour, a pit or a flat.
+ */
+constexpr uint8_t FLOW_NONE = 255;
+/**
+ * @brief The D8 direction of a cell with no data, it never receives flow.
+ */
+constexpr uint8_t FLOW_NO_DATA = 254;
+/**
+ * @brief The D-infinity angle of a cell with no lower neighbour.
+ */
+constexpr float DINF_NONE = -1.0f;
+/**
+ * @brief Compute the D8 flow direction of every cell of a DEM in parallel
+ * tiles.
+ * @details Each cell drains to the neighbour with the steepest drop per unit
+ * distance, the first in D8_DX order on ties. A cell with no lower neighbour
+ * drains off the DEM if it borders the edge or no data, otherwise it is
+ * FLOW_NONE. Condition the DEM with fill_depressions() first so that only
+ * real outlets remain.
+ *
+ * @param elevations The DEM, NaN for no data.
+ * @param cell_size The world space width and height of a cell.
+ * @return The index into D8_DX and D8_DY of the receiver of each cell,
+ * FLOW_NONE or FLOW_NO_DATA.
+ */
+TiledGrid<uint8_t> compute_d8(const TiledGrid<float> &elevations,
+                              glm::vec2 cell_size);
+/**
+ * @brief Compute the D-infinity flow angle of every cell of a DEM in parallel
+ * tiles.
+ * @details The angle is the steepest descent over the eight triangular facets
+ * around the cell (Tarboton 1997). It is measured in radians clockwise from
+ * east in raster space (rows grow southwards) so that angle / (pi / 4) lies
+ * between the D8 directions that share the flow, unlike the counter clockwise
+ * convention of TauDEM.
+ *
+ * @param elevations The DEM, NaN for no data.
+ * @param cell_size The world space width and height of a cell.
+ * @return The flow angle of each cell, DINF_NONE for cells with no lower
+ * neighbour and NaN for no data.
+ */
+TiledGrid<float> compute_dinf(const TiledGrid<float> &elevations,
+                              glm::vec2 cell_size);
+/**
+ * @brief Accumulate D8 flow in parallel tiles.
+ * @details Each tile is accumulated on its own while recording where flow
+ * leaves it. The paths between tiles form a much smaller graph over the cells
+ * where flow crosses a tile border, which is accumulated serially, and a last
+ * parallel pass adds the inflow from other tiles to the cells downstream of
+ * where it enters. Each pass reads a tile at a time, so the work scales with
+ * the cores and the cache.
+ *
+ * @param directions The D8 flow directions from compute_d8().
+ * @return The number of cells draining through each cell including itself, 0
+ * for no data. Multiply by the cell area for the contributing area.
+ */
+TiledGrid<uint32_t> accumulate_d8(const TiledGrid<uint8_t> &directions);
+/**
+ * @brief Accumulate D-infinity flow, splitting the flow of each cell between
+ * its two receivers by angle.
+ * @details Only compute_dinf() runs in parallel, the accumulation is a single
+ * topological sweep over the grid in tiled order.
+ *
+ * @param angles The D-infinity flow angles from compute_dinf().
+ * @return The number of cells draining through each cell including itself, 0
+ * for no data.
+ */
+TiledGrid<float> accumulate_dinf(const TiledGrid<float> &angles);
+} // namespace math_3dh
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef INUNDATION
+#define INUNDATION
+
+// Standard Library
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// External Libraries
+#include "glm.hpp"
+
+// 3DH
+#include "Math/tiled_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief A cell that floods the cells connected to it up to a water level.
+ */
+struct FloodSeed {
+  int col = 0;
+  int row = 0;
+  float level = 0.0f; /**< The water surface elevation.*/
+};
+/**
+ * @brief The extent of the flooding attributed to one seed.
+ */
+struct FloodStats {
+  size_t cells = 0;   /**< The number of flooded cells.*/
+  double area = 0.0;  /**< The flooded area.*/
+  double volume = 0.0; /**< The volume of water above the ground.*/
+};
+/**
+ * @brief The flood depths of a DEM, only stored for the tiles that flooded.
+ * @see map_inundation()
+ */
+class InundationMap {
+public:
+  InundationMap() = default;
+  /**
+   * @brief Get the depth of water over a cell, 0 where it is dry.
+   */
+  float get_depth(int col, int row) const;
+  /**
+   * @brief Get the index of the seed that floods a cell, -1 where it is dry.
+   */
+  int32_t get_seed(int col, int row) const;
+  /**
+   * @brief Copy rows of depths into a row major raster, e.g. to write them
+   * through GDAL.
+   *
+   * @param first_row The first row to copy.
+   * @param row_count The number of rows to copy.
+   * @param dst The row major raster, get_cols() * row_count values.
+   */
+  void read_depth_rows(int first_row, int row_count, float *dst) const;
+  inline const std::vector<FloodStats> &get_stats() const { return stats; }
+  inline int get_cols() const { return cols; }
+  inline int get_rows() const { return rows; }
+  /**
+   * @brief Get the number of tiles holding water, memory grows with it.
+   */
+  size_t get_flooded_tile_count() const;
+
+private:
+  /**
+   * @brief The water of one flooded tile, in the layout of a TiledGrid tile.
+   */
+  struct Tile {
+    float depth[TiledGrid<float>::TILE_SIZE * TiledGrid<float>::TILE_SIZE];
+    int32_t seed[TiledGrid<float>::TILE_SIZE * TiledGrid<float>::TILE_SIZE];
+  };
+  int cols = 0;
+  int rows = 0;
+  int tiles_x = 0;
+  std::vector<std::unique_ptr<Tile>> tiles{}; /**< nullptr for dry tiles.*/
+  std::vector<FloodStats> stats{};
+  friend InundationMap map_inundation(const TiledGrid<float> &,
+                                      const std::vector<FloodSeed> &,
+                                      glm::vec2, unsigned int);
+};
+/**
+ * @brief Flood the cells connected to each seed up to its water level.
+ * @details A cell floods to the highest level of any seed that reaches it
+ * through edge-connected cells below that level, and is attributed to that
+ * seed (the first seed on ties). The seeds are flooded together by a tile
+ * parallel fill, levels highest first: each tile floods the water that reached
+ * it with a breadth first search and passes the water that reaches its border
+ * to the neighbouring tiles, which flood in the next round. Lower water only
+ * starts once the higher water has stopped spreading, so almost every cell is
+ * flooded once. Only tiles that the water reaches are allocated or visited,
+ * so the cost follows the flooded area, not the size of the DEM.
+ *
+ * @param elevations The DEM, NaN cells never flood.
+ * @param seeds The cells and water levels to flood from.
+ * @param cell_size The world space width and height of a cell.
+ * @param thread_count The number of threads, 0 uses the number of hardware
+ * threads.
+ * @return The flood depths and the flooded area and volume of each seed.
+ */
+InundationMap map_inundation(const TiledGrid<float> &elevations,
+                             const std::vector<FloodSeed> &seeds,
+                             glm::vec2 cell_size,
+                             unsigned int thread_count = 0);
+} // namespace math_3dh
+
+#endif
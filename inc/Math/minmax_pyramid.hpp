@@ -0,0 +1,67 @@
+#ifndef MINMAX_PYRAMID
+#define MINMAX_PYRAMID
+
+// Standard Library
+#include <vector>
+
+// External Libraries
+#include "glm.hpp"
+
+// 3DH
+#include "Math/quantized_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief A min/max elevation pyramid over a DEM used to intersect rays with
+ * the terrain on the CPU.
+ * @details The terrain surface is the bilinear interpolation of the DEM cell
+ * centers. The pyramid works in grid space, where u and v are the column and
+ * row of a cell center and h is the elevation times the vertical exaggeration.
+ * Level 0 stores the elevation range of each block_size x block_size block of
+ * bilinear patches and each higher level merges 2x2 nodes of the level below,
+ * so a ray only descends into nodes whose bounding box it actually passes
+ * through.
+ */
+class MinMaxPyramid {
+public:
+  /**
+   * @brief Construct an empty pyramid that never reports a hit.
+   */
+  MinMaxPyramid() = default;
+  /**
+   * @brief Build the pyramid over a DEM.
+   *
+   * @param grid The DEM, which must outlive the pyramid.
+   * @param shift A value subtracted from every decoded elevation.
+   * @param block_size The number of patches on each side of a level 0 node.
+   */
+  MinMaxPyramid(const QuantizedGrid *grid, float shift, int block_size = 8);
+  /**
+   * @brief Find the first intersection of a ray with the bilinear surface.
+   *
+   * @param origin The origin of the ray in grid space.
+   * @param direction The direction of the ray in grid space, need not be
+   * normalized.
+   * @param vert_exag The vertical exaggeration applied to the elevations.
+   * @param t Set to the ray parameter of the hit, the hit point is origin + t *
+   * direction.
+   * @return true if the ray hits the surface.
+   */
+  bool intersect(glm::vec3 origin, glm::vec3 direction, float vert_exag,
+                 float &t) const;
+
+private:
+  float corner(int i, int j) const;
+  bool intersect_patch(int i, int j, glm::vec3 origin, glm::vec3 direction,
+                       float vert_exag, float t_max, float &t) const;
+  const QuantizedGrid *grid = nullptr;
+  float shift = 0.0f;
+  int block_size = 8;
+  int patches_x = 0;
+  int patches_y = 0;
+  std::vector<std::vector<glm::vec2>> levels{}; /**< (min, max) per node.*/
+  std::vector<glm::ivec2> level_dims{};
+};
+} // namespace math_3dh
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef OVERLAND_FLOW
+#define OVERLAND_FLOW
+
+// Standard Library
+#include <cstdint>
+#include <vector>
+
+// External Libraries
+#include "glm.hpp"
+
+// 3DH
+#include "Math/tiled_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief The parameters of an OverlandFlow simulation.
+ * @details The defaults are for a DEM in metres. Every length of the
+ * simulation is in the units of the DEM, use flow_settings_for_unit() for a
+ * DEM in other units.
+ */
+struct OverlandFlowSettings {
+  float roughness = 0.03f;      /**< Manning's n of the ground.*/
+  float cfl = 0.7f;             /**< The fraction of the stable time step.*/
+  float max_time_step = 1.0f;   /**< The longest time step in seconds.*/
+  float dry_depth = 0.001f;     /**< Shallower water does not flow.*/
+  float gravity = 9.81f;        /**< In units per second squared.*/
+  float manning_factor = 1.0f;  /**< The unit factor of Manning's equation,
+                                   1 in metres and 1.49 in feet.*/
+  unsigned int thread_count = 0; /**< 0 uses the hardware threads.*/
+};
+/**
+ * @brief Get the default OverlandFlowSettings for a DEM whose horizontal and
+ * vertical unit is not the metre.
+ * @details Gravity and the dry depth are converted to the unit and Manning's
+ * unit factor becomes (1 m / unit)^(1/3), 1.486 for feet.
+ *
+ * @param metres_per_unit The length of the unit of the DEM in metres, see
+ * gdal_input::metres_per_unit().
+ * @return The settings, with the roughness of the defaults.
+ */
+OverlandFlowSettings flow_settings_for_unit(double metres_per_unit);
+/**
+ * @brief A point inflow of an OverlandFlow simulation, e.g. a surcharging
+ * manhole.
+ */
+struct FlowSource {
+  int col = 0;
+  int row = 0;
+  float discharge = 0.0f; /**< The inflow in cubic units per second.*/
+};
+/**
+ * @brief An explicit 2D local-inertial shallow water solver over a DEM (Bates
+ * et al. 2010, de Almeida et al. 2012).
+ * @details Depths are stored at cells and unit discharges at the east and
+ * south faces of each cell, all in 64x64 tiles like TiledGrid. Each step first
+ * updates the discharge of every face from the water surface slope with
+ * semi-implicit Manning friction, then the depth of every cell from the
+ * discharges through its faces. Every tile owns the faces on its east and
+ * south sides, so both passes run tile parallel without locks and the rows of
+ * a tile are updated with AVX2 or NEON when the CPU supports it. Only tiles
+ * holding water and their neighbours are updated, so a flood spreading over a
+ * large dry DEM costs as much as its wet area. The time step adapts to the
+ * deepest water to keep the gravity wave Courant number below the CFL.
+ * Cells with no data and the edges of the DEM are walls.
+ */
+class OverlandFlow {
+public:
+  /**
+   * @brief Construct a dry simulation over a DEM.
+   *
+   * @param elevations The DEM, NaN for no data.
+   * @param cell_size The world space width and height of a cell, in the unit
+   * of the elevations.
+   * @param settings The parameters of the simulation, in the same unit.
+   */
+  OverlandFlow(const TiledGrid<float> &elevations, glm::vec2 cell_size,
+               OverlandFlowSettings settings = {});
+  /**
+   * @brief Add a point inflow.
+   *
+   * @param col The column of the cell the water enters.
+   * @param row The row of the cell the water enters.
+   * @param discharge The inflow in cubic units per second.
+   * @return The index of the source for set_inflow().
+   */
+  size_t add_source(int col, int row, float discharge = 0.0f);
+  /**
+   * @brief Change the inflow of a source, e.g. from the network solution.
+   */
+  void set_inflow(size_t source, float discharge);
+  /**
+   * @brief Advance the simulation by one adaptive time step.
+   *
+   * @param max_step The longest step to take in seconds.
+   * @return The length of the step in seconds.
+   */
+  float step(float max_step);
+  /**
+   * @brief Advance the simulation by a duration, clipping the last step.
+   *
+   * @param duration The time to simulate in seconds.
+   * @return The number of steps taken.
+   */
+  size_t advance(float duration);
+  /**
+   * @brief Compute the depth averaged velocity at each cell from the
+   * discharges through its faces.
+   *
+   * @param u Set to the velocity towards increasing columns.
+   * @param v Set to the velocity towards increasing rows, southwards.
+   */
+  void compute_velocity(TiledGrid<float> &u, TiledGrid<float> &v) const;
+  /**
+   * @brief Set the cells that are walls, no data in the DEM, to a value.
+   *
+   * @param grid A grid the size of the DEM, e.g. a copy of get_depth().
+   * @param value The value of the walls, e.g. a no data value.
+   */
+  void mask_walls(TiledGrid<float> &grid, float value) const;
+  /**
+   * @brief Get the total volume of water on the DEM.
+   */
+  double get_volume() const;
+  inline const TiledGrid<float> &get_depth() const { return depths; }
+  inline double get_time() const { return time; }
+  inline size_t get_active_tile_count() const { return active_tiles.size(); }
+  inline const std::vector<FlowSource> &get_sources() const { return sources; }
+
+private:
+  TiledGrid<float> elevations{}; /**< Walls are raised to WALL.*/
+  TiledGrid<float> depths{};
+  TiledGrid<float> flux_x{}; /**< The discharge through the east faces.*/
+  TiledGrid<float> flux_y{}; /**< The discharge through the south faces.*/
+  glm::vec2 cell_size{1.0f, 1.0f};
+  OverlandFlowSettings settings{};
+  std::vector<FlowSource> sources{};
+  std::vector<uint8_t> wet{};    /**< Tiles holding water or inflow.*/
+  std::vector<uint8_t> active{}; /**< Wet tiles and their neighbours.*/
+  std::vector<uint32_t> active_tiles{};
+  std::vector<float> tile_max_depth{};
+  double time = 0.0;
+  void update_active_tiles();
+  void update_fluxes(size_t tile, float dt);
+  void update_depths(size_t tile, float dt);
+};
+} // namespace math_3dh
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef PARALLEL
+#define PARALLEL
+
+// Standard Library
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace math_3dh {
+/**
+ * @brief Get the number of worker threads to use for parallel loops.
+ *
+ * @param thread_count The requested number of threads, 0 uses the number of
+ * hardware threads.
+ * @return The number of threads, at least 1.
+ */
+inline unsigned int worker_count(unsigned int thread_count = 0) {
+  if (thread_count == 0) {
+    thread_count = std::thread::hardware_concurrency();
+  }
+  return std::max(thread_count, 1u);
+}
+/**
+ * @brief Call \p f(i) for every i in [\p begin, \p end) across several
+ * threads.
+ * @details The range is split into one contiguous chunk per thread, so \p f
+ * should do a similar amount of work for each i (e.g. one row or one tile). The
+ * calling thread works on the first chunk and returns once all chunks are done.
+ *
+ * @param begin The first index.
+ * @param end One past the last index.
+ * @param f The function to call with each index.
+ * @param thread_count The number of threads, 0 uses the number of hardware
+ * threads.
+ */
+template <typename F>
+void parallel_for(size_t begin, size_t end, F &&f,
+                  unsigned int thread_count = 0) {
+  if (end <= begin) {
+    return;
+  }
+  size_t count = end - begin;
+  size_t workers = std::min<size_t>(worker_count(thread_count), count);
+  auto run_chunk = [&](size_t w) {
+    size_t chunk_begin = begin + count * w / workers;
+    size_t chunk_end = begin + count * (w + 1) / workers;
+    for (size_t i = chunk_begin; i < chunk_end; i++) {
+      f(i);
+    }
+  };
+  std::vector<std::thread> threads{};
+  for (size_t w = 1; w < workers; w++) {
+    threads.emplace_back(run_chunk, w);
+  }
+  run_chunk(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+} // namespace math_3dh
+
+#endif
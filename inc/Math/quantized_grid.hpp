@@ -0,0 +1,127 @@
+#ifndef QUANTIZED_GRID
+#define QUANTIZED_GRID
+
+// Standard Library
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace math_3dh {
+/**
+ * @brief The dequantization parameters of one tile of a QuantizedGrid. A
+ * sample q of the tile decodes to bias + q * scale.
+ */
+struct QuantizedTile {
+  float bias = 0.0f;
+  float scale = 0.0f;
+};
+/**
+ * @brief A grid of floats stored as 16-bit samples with a bias and scale per
+ * square tile.
+ * @details Samples are stored tile by tile (row major within each tile, tiles
+ * in row major order) and every tile holds tile_size * tile_size samples, edge
+ * tiles are padded with QuantizedGrid::NO_DATA. Over a 600 m relief range a
+ * tile is precise to about a centimetre. The grid either owns its storage or is
+ * a view over storage owned by someone else (e.g. a memory mapped file).
+ */
+class QuantizedGrid {
+public:
+  /**
+   * @brief The sample value reserved for cells with no data.
+   */
+  static constexpr uint16_t NO_DATA = 65535;
+  /**
+   * @brief Construct an empty grid.
+   */
+  QuantizedGrid() = default;
+  /**
+   * @brief Construct a grid that owns its storage. All cells start as no data.
+   *
+   * @param cols The number of columns in the grid.
+   * @param rows The number of rows in the grid.
+   * @param tile_size The number of columns and rows in each tile.
+   */
+  QuantizedGrid(int cols, int rows, int tile_size = 64);
+  /**
+   * @brief Construct a grid that views storage owned by someone else.
+   *
+   * @param cols The number of columns in the grid.
+   * @param rows The number of rows in the grid.
+   * @param tile_size The number of columns and rows in each tile.
+   * @param tiles The dequantization parameters of each tile.
+   * @param samples The samples of each tile.
+   */
+  QuantizedGrid(int cols, int rows, int tile_size, const QuantizedTile *tiles,
+                const uint16_t *samples);
+  QuantizedGrid(const QuantizedGrid &other);
+  QuantizedGrid &operator=(const QuantizedGrid &other);
+  QuantizedGrid(QuantizedGrid &&other) = default;
+  QuantizedGrid &operator=(QuantizedGrid &&other) = default;
+  /**
+   * @brief Quantize a block of floats into tile storage.
+   *
+   * @param src The first float of the block.
+   * @param width The number of columns in the block, <= \p tile_size.
+   * @param height The number of rows in the block, <= \p tile_size.
+   * @param line_stride The number of floats between rows of \p src.
+   * @param no_data_value Values of \p src equal to this (or NaN) are stored as
+   * QuantizedGrid::NO_DATA.
+   * @param tile_size The number of columns and rows in the tile.
+   * @param dst The tile_size * tile_size samples of the tile.
+   * @return The dequantization parameters of the tile.
+   */
+  static QuantizedTile encode_tile(const float *src, int width, int height,
+                                   int64_t line_stride, float no_data_value,
+                                   int tile_size, uint16_t *dst);
+  /**
+   * @brief Quantize a block of floats into the tile at \p tile_x, \p tile_y of
+   * an owning grid.
+   * @see QuantizedGrid::encode_tile()
+   */
+  void set_tile(int tile_x, int tile_y, const float *src, int64_t line_stride,
+                float no_data_value);
+  /**
+   * @brief Decode a cell of the grid.
+   *
+   * @param col The column of the cell.
+   * @param row The row of the cell.
+   * @return The decoded value or NaN if the cell has no data or is out of
+   * bounds.
+   */
+  float get(int col, int row) const;
+  /**
+   * @brief Get the index of the sample of a cell in the tiled sample storage.
+   */
+  inline size_t sample_index(int col, int row) const {
+    size_t tile = static_cast<size_t>(row / tile_size) * tiles_x + col / tile_size;
+    return tile * tile_size * tile_size +
+           static_cast<size_t>(row % tile_size) * tile_size + col % tile_size;
+  }
+  inline int get_cols() const { return cols; }
+  inline int get_rows() const { return rows; }
+  inline int get_tile_size() const { return tile_size; }
+  inline int get_tiles_x() const { return tiles_x; }
+  inline int get_tiles_y() const { return tiles_y; }
+  inline size_t get_tile_count() const {
+    return static_cast<size_t>(tiles_x) * tiles_y;
+  }
+  inline size_t get_sample_count() const {
+    return get_tile_count() * tile_size * tile_size;
+  }
+  inline const QuantizedTile *get_tiles() const { return tiles; }
+  inline const uint16_t *get_samples() const { return samples; }
+
+private:
+  int cols = 0;
+  int rows = 0;
+  int tile_size = 64;
+  int tiles_x = 0;
+  int tiles_y = 0;
+  std::vector<QuantizedTile> owned_tiles{};
+  std::vector<uint16_t> owned_samples{};
+  const QuantizedTile *tiles = nullptr;
+  const uint16_t *samples = nullptr;
+};
+} // namespace math_3dh
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef RTREE
+#define RTREE
+
+// Standard Library
+#include <cstddef>
+#include <vector>
+
+// External Libraries
+#include "glm.hpp"
+
+namespace math_3dh {
+/**
+ * @brief An axis aligned 2D box.
+ */
+struct Box2D {
+  glm::dvec2 min = {0.0, 0.0};
+  glm::dvec2 max = {0.0, 0.0};
+  inline bool intersects(const Box2D &other) const {
+    return min.x <= other.max.x && other.min.x <= max.x &&
+           min.y <= other.max.y && other.min.y <= max.y;
+  }
+  inline bool contains(glm::dvec2 point) const {
+    return point.x >= min.x && point.x <= max.x && point.y >= min.y &&
+           point.y <= max.y;
+  }
+};
+/**
+ * @brief A static R-tree over 2D boxes, bulk loaded with Sort-Tile-Recursive
+ * packing.
+ * @details Every node except the last of each level holds exactly node_size
+ * children, so the tree is as shallow as possible and queries only descend
+ * into nodes whose bounds overlap the query.
+ */
+class RTree {
+public:
+  /**
+   * @brief Construct an empty tree.
+   */
+  RTree() = default;
+  /**
+   * @brief Build the tree.
+   *
+   * @param boxes The boxes to index, a query reports the index of each box
+   * that matches.
+   * @param node_size The number of children of each node.
+   */
+  RTree(const std::vector<Box2D> &boxes, int node_size = 16);
+  /**
+   * @brief Find the boxes that overlap a box.
+   *
+   * @param box The query box.
+   * @param result The indices of the matching boxes are appended to this.
+   */
+  void query(const Box2D &box, std::vector<size_t> &result) const;
+  /**
+   * @brief Find the boxes that contain a point.
+   *
+   * @param point The query point.
+   * @param result The indices of the matching boxes are appended to this.
+   */
+  void query(glm::dvec2 point, std::vector<size_t> &result) const;
+
+private:
+  struct Node {
+    Box2D bounds{};
+    size_t first = 0; /**< First child node, or first item of a leaf.*/
+    size_t count = 0;
+  };
+  std::vector<std::vector<Node>> levels{}; /**< Leaves first.*/
+  std::vector<size_t> items{};             /**< Box indices in leaf order.*/
+  std::vector<Box2D> boxes{};
+};
+} // namespace math_3dh
+
+#endif
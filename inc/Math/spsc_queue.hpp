@@ -0,0 +1,67 @@
+#ifndef SPSC_QUEUE
+#define SPSC_QUEUE
+
+// Standard Library
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace math_3dh {
+/**
+ * @brief A bounded lock-free queue for handing values from exactly one
+ * producer thread to exactly one consumer thread.
+ * @details The queue is a ring of capacity + 1 slots. The producer only writes
+ * the tail and the consumer only writes the head, so neither side ever waits
+ * on the other.
+ */
+template <typename T> class SpscQueue {
+public:
+  /**
+   * @brief Construct an empty queue.
+   *
+   * @param capacity The largest number of values held at once.
+   */
+  explicit SpscQueue(size_t capacity) : slots(capacity + 1) {}
+  SpscQueue(const SpscQueue &other) = delete;
+  SpscQueue &operator=(const SpscQueue &other) = delete;
+  /**
+   * @brief Push a value, producer thread only.
+   *
+   * @param value The value, left untouched if the queue is full.
+   * @return false if the queue is full.
+   */
+  bool push(T &value) {
+    size_t tail_index = tail.load(std::memory_order_relaxed);
+    size_t next = (tail_index + 1) % slots.size();
+    if (next == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    slots[tail_index] = std::move(value);
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+  /**
+   * @brief Pop the oldest value, consumer thread only.
+   *
+   * @param value Set to the popped value.
+   * @return false if the queue is empty.
+   */
+  bool pop(T &value) {
+    size_t head_index = head.load(std::memory_order_relaxed);
+    if (head_index == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = std::move(slots[head_index]);
+    head.store((head_index + 1) % slots.size(), std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::vector<T> slots;
+  std::atomic<size_t> head{0}; /**< The next slot to pop.*/
+  std::atomic<size_t> tail{0}; /**< The next slot to push.*/
+};
+} // namespace math_3dh
+
+#endif
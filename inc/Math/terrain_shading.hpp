@@ -0,0 +1,90 @@
+#ifndef TERRAIN_SHADING
+#define TERRAIN_SHADING
+
+// Standard Library
+#include <cstdint>
+#include <vector>
+
+// External Libraries
+#include "glm.hpp"
+
+// 3DH
+#include "Math/tiled_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief Encode a unit normal with an octahedral mapping into two signed
+ * normalized 8-bit components, x in the low byte and y in the high byte.
+ * @details The mapping spreads its precision evenly over the sphere, so two
+ * bytes are accurate to about a degree, which is plenty for shading. The bytes
+ * decode with unpackSnorm4x8() in GLSL and a flat cell is exactly up.
+ *
+ * @param normal The unit normal.
+ * @return The encoded normal.
+ */
+uint16_t encode_normal(glm::vec3 normal);
+/**
+ * @brief Decode a normal encoded by encode_normal().
+ *
+ * @param encoded The encoded normal.
+ * @return The unit normal.
+ */
+glm::vec3 decode_normal(uint16_t encoded);
+/**
+ * @brief Compute the normal of every cell of a DEM in parallel tiles.
+ * @details Normals come from central differences of the neighbouring cells,
+ * one sided where a neighbour has no data or is outside of the grid. Cells
+ * with no data point straight up. The normals are of the unexaggerated surface,
+ * for a vertical exaggeration e renormalize (x, y, z / e).
+ *
+ * @param elevations The DEM, NaN for no data.
+ * @param cell_size The world space width and height of a cell.
+ * @return The octahedral encoded normals in the tiled layout of the DEM.
+ */
+TiledGrid<uint16_t> compute_normals(const TiledGrid<float> &elevations,
+                                    glm::vec2 cell_size);
+/**
+ * @brief Compute the normals of a quantized DEM, decoding each tile with a one
+ * cell border as it is shaded instead of the whole DEM at once.
+ * @see compute_normals(const TiledGrid<float> &, glm::vec2)
+ *
+ * @param elevations The quantized DEM.
+ * @param cell_size The world space width and height of a cell.
+ * @return The octahedral encoded normals in the tiled layout of the DEM.
+ */
+TiledGrid<uint16_t> compute_normals(const QuantizedGrid &elevations,
+                                    glm::vec2 cell_size);
+/**
+ * @brief Compute a hillshade from the normals of a DEM in parallel tiles.
+ *
+ * @param normals The normals from compute_normals().
+ * @param azimuth The direction of the light in degrees clockwise from north.
+ * @param altitude The angle of the light above the horizon in degrees.
+ * @return The brightness of each cell, 0 to 255.
+ */
+TiledGrid<uint8_t> compute_hillshade(const TiledGrid<uint16_t> &normals,
+                                     float azimuth = 315.0f,
+                                     float altitude = 45.0f);
+/**
+ * @brief Expand a hillshade to a row major grey image of packed RGBA8 pixels,
+ * the format of the draped image of a Terrain.
+ *
+ * @param hillshade The hillshade.
+ * @return The pixels of the image.
+ */
+std::vector<uint32_t> hillshade_to_rgba(const TiledGrid<uint8_t> &hillshade);
+/**
+ * @brief Shade a row major block of elevations into grey RGBA8 pixels.
+ * @see compute_normals(), compute_hillshade()
+ *
+ * @param elevations The elevations, NaN for no data.
+ * @param width The number of columns in the block.
+ * @param height The number of rows in the block.
+ * @param cell_size The world space width and height of a cell.
+ * @return The pixels of the block.
+ */
+std::vector<uint32_t> shade_block(const float *elevations, int width,
+                                  int height, glm::vec2 cell_size);
+} // namespace math_3dh
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef TILED_GRID
+#define TILED_GRID
+
+// Standard Library
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+// 3DH
+#include "Math/parallel.hpp"
+#include "Math/quantized_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief The column offsets of the eight neighbours of a cell, clockwise from
+ * east. Direction d and (d + 4) % 8 are opposite.
+ */
+constexpr int D8_DX[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+/**
+ * @brief The row offsets of the eight neighbours of a cell, clockwise from
+ * east. Rows grow southwards as in a raster.
+ */
+constexpr int D8_DY[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+/**
+ * @brief The cells of one tile of a TiledGrid.
+ */
+struct TileRect {
+  int col = 0;    /**< The column of the first cell of the tile.*/
+  int row = 0;    /**< The row of the first cell of the tile.*/
+  int width = 0;  /**< The number of columns, less than TILE_SIZE at the edge.*/
+  int height = 0; /**< The number of rows, less than TILE_SIZE at the edge.*/
+};
+/**
+ * @brief The 3x3 cells around a cell, row major from the north west corner so
+ * the center is at index 4.
+ */
+template <typename T> struct Neighbourhood {
+  T cells[9];
+  inline T center() const { return cells[4]; }
+  /**
+   * @brief Get the neighbour in a D8 direction.
+   * @see D8_DX
+   */
+  inline T neighbour(int direction) const {
+    return cells[(D8_DY[direction] + 1) * 3 + D8_DX[direction] + 1];
+  }
+  inline T at(int dx, int dy) const { return cells[(dy + 1) * 3 + dx + 1]; }
+};
+/**
+ * @brief A grid of cells stored in square 64x64 tiles for the neighbourhood
+ * operations of terrain analysis.
+ * @details Cells are stored tile by tile, row major within each tile and tiles
+ * in row major order, the same layout as QuantizedGrid. A 3x3 neighbourhood
+ * touches at most four tiles instead of three whole rows of the raster, and
+ * rows of a tile are only 256 bytes apart for floats, so flood fills, ray
+ * marches and profiles that wander in any direction keep hitting the same few
+ * cache lines. Edge tiles are padded to the full tile size. Work is split by
+ * tile with for_each_tile(), which also keeps threads writing to separate
+ * cache lines.
+ */
+template <typename T> class TiledGrid {
+public:
+  static constexpr int TILE_SHIFT = 6;
+  static constexpr int TILE_SIZE = 1 << TILE_SHIFT;
+  static constexpr int TILE_MASK = TILE_SIZE - 1;
+  /**
+   * @brief Construct an empty grid.
+   */
+  TiledGrid() = default;
+  /**
+   * @brief Construct a grid with every cell set to a value.
+   *
+   * @param cols The number of columns in the grid.
+   * @param rows The number of rows in the grid.
+   * @param fill The value of every cell, including the padding.
+   */
+  TiledGrid(int cols, int rows, T fill = T{})
+      : cols(cols), rows(rows), tiles_x((cols + TILE_MASK) >> TILE_SHIFT),
+        tiles_y((rows + TILE_MASK) >> TILE_SHIFT),
+        cells(get_tile_count() * TILE_SIZE * TILE_SIZE, fill) {}
+  /**
+   * @brief A cell visited by a TiledGrid iterator.
+   */
+  template <typename V> struct Cell {
+    int col;
+    int row;
+    V &value;
+  };
+  /**
+   * @brief Visits the cells of a grid in storage order, tile by tile, skipping
+   * the padding of edge tiles.
+   */
+  template <typename G, typename V> class basic_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Cell<V>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Cell<V>;
+    basic_iterator() = default;
+    basic_iterator(G *grid, size_t tile) : grid(grid), tile(tile) {
+      if (grid && tile < grid->get_tile_count()) {
+        rect = grid->get_tile_rect(tile);
+      }
+    }
+    inline reference operator*() const {
+      return {rect.col + i, rect.row + j,
+              grid->cells[(tile << (2 * TILE_SHIFT)) + (j << TILE_SHIFT) + i]};
+    }
+    basic_iterator &operator++() {
+      if (++i < rect.width) {
+        return *this;
+      }
+      i = 0;
+      if (++j < rect.height) {
+        return *this;
+      }
+      j = 0;
+      if (++tile < grid->get_tile_count()) {
+        rect = grid->get_tile_rect(tile);
+      }
+      return *this;
+    }
+    basic_iterator operator++(int) {
+      basic_iterator previous = *this;
+      ++*this;
+      return previous;
+    }
+    inline bool operator==(const basic_iterator &other) const {
+      return tile == other.tile && i == other.i && j == other.j;
+    }
+    inline bool operator!=(const basic_iterator &other) const {
+      return !(*this == other);
+    }
+
+  private:
+    G *grid = nullptr;
+    size_t tile = 0;
+    TileRect rect{};
+    int i = 0;
+    int j = 0;
+  };
+  using iterator = basic_iterator<TiledGrid, T>;
+  using const_iterator = basic_iterator<const TiledGrid, const T>;
+  inline iterator begin() { return {this, 0}; }
+  inline iterator end() { return {this, get_tile_count()}; }
+  inline const_iterator begin() const { return {this, 0}; }
+  inline const_iterator end() const { return {this, get_tile_count()}; }
+  /**
+   * @brief Get the index of a cell in the tiled storage.
+   */
+  inline size_t index(int col, int row) const {
+    size_t tile = static_cast<size_t>(row >> TILE_SHIFT) * tiles_x +
+                  (col >> TILE_SHIFT);
+    return (tile << (2 * TILE_SHIFT)) +
+           static_cast<size_t>(((row & TILE_MASK) << TILE_SHIFT) |
+                               (col & TILE_MASK));
+  }
+  /**
+   * @brief Get the column and row of an index into the tiled storage.
+   */
+  inline void get_cell(size_t index, int &col, int &row) const {
+    size_t tile = index >> (2 * TILE_SHIFT);
+    col = static_cast<int>(tile % tiles_x) * TILE_SIZE +
+          static_cast<int>(index & TILE_MASK);
+    row = static_cast<int>(tile / tiles_x) * TILE_SIZE +
+          static_cast<int>((index >> TILE_SHIFT) & TILE_MASK);
+  }
+  inline bool contains(int col, int row) const {
+    return col >= 0 && col < cols && row >= 0 && row < rows;
+  }
+  inline T &operator()(int col, int row) { return cells[index(col, row)]; }
+  inline const T &operator()(int col, int row) const {
+    return cells[index(col, row)];
+  }
+  /**
+   * @brief Get a cell, or a fallback for coordinates outside of the grid.
+   */
+  inline T get(int col, int row, T outside) const {
+    return contains(col, row) ? cells[index(col, row)] : outside;
+  }
+  inline void set(int col, int row, T value) { cells[index(col, row)] = value; }
+  /**
+   * @brief Gather the 3x3 cells around a cell.
+   * @details Cells away from the tile border are read with fixed offsets from
+   * the center, only border cells pay for the general index calculation.
+   *
+   * @param col The column of the center cell.
+   * @param row The row of the center cell.
+   * @param outside The value of neighbours outside of the grid.
+   * @return The neighbourhood of the cell.
+   */
+  Neighbourhood<T> neighbourhood(int col, int row, T outside) const {
+    Neighbourhood<T> result;
+    int i = col & TILE_MASK;
+    int j = row & TILE_MASK;
+    if (i > 0 && i < TILE_MASK && j > 0 && j < TILE_MASK && col + 1 < cols &&
+        row + 1 < rows) {
+      const T *center = &cells[index(col, row)];
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+          result.cells[(dy + 1) * 3 + dx + 1] = center[dy * TILE_SIZE + dx];
+        }
+      }
+      return result;
+    }
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        result.cells[(dy + 1) * 3 + dx + 1] = get(col + dx, row + dy, outside);
+      }
+    }
+    return result;
+  }
+  /**
+   * @brief Call \p f(col, row) for each neighbour of a cell inside the grid.
+   *
+   * @param col The column of the cell.
+   * @param row The row of the cell.
+   * @param f The function to call with each neighbour and its D8 direction,
+   * f(int col, int row, int direction).
+   */
+  template <typename F> void for_each_neighbour(int col, int row, F &&f) const {
+    for (int d = 0; d < 8; d++) {
+      int c = col + D8_DX[d];
+      int r = row + D8_DY[d];
+      if (contains(c, r)) {
+        f(c, r, d);
+      }
+    }
+  }
+  /**
+   * @brief Call \p f(rect) for every tile of the grid across several threads.
+   *
+   * @param f The function to call with the TileRect of each tile.
+   * @param thread_count The number of threads, 0 uses the number of hardware
+   * threads.
+   */
+  template <typename F>
+  void for_each_tile(F &&f, unsigned int thread_count = 0) const {
+    parallel_for(
+        0, get_tile_count(), [&](size_t tile) { f(get_tile_rect(tile)); },
+        thread_count);
+  }
+  /**
+   * @brief Copy rows of the grid into a row major raster, e.g. to write them
+   * through GDAL.
+   *
+   * @param first_row The first row to copy.
+   * @param row_count The number of rows to copy.
+   * @param dst The row major raster, get_cols() * row_count values.
+   */
+  void read_rows(int first_row, int row_count, T *dst) const {
+    for (int j = 0; j < row_count; j++) {
+      for (int tx = 0; tx < tiles_x; tx++) {
+        int col = tx << TILE_SHIFT;
+        int width = std::min(TILE_SIZE, cols - col);
+        const T *src = &cells[index(col, first_row + j)];
+        std::copy(src, src + width, dst + static_cast<size_t>(j) * cols + col);
+      }
+    }
+  }
+  /**
+   * @brief Copy rows of a row major raster into the grid.
+   *
+   * @param first_row The first row to write.
+   * @param row_count The number of rows to write.
+   * @param src The row major raster, get_cols() * row_count values.
+   */
+  void write_rows(int first_row, int row_count, const T *src) {
+    for (int j = 0; j < row_count; j++) {
+      for (int tx = 0; tx < tiles_x; tx++) {
+        int col = tx << TILE_SHIFT;
+        int width = std::min(TILE_SIZE, cols - col);
+        const T *row_src = src + static_cast<size_t>(j) * cols + col;
+        std::copy(row_src, row_src + width, &cells[index(col, first_row + j)]);
+      }
+    }
+  }
+  inline TileRect get_tile_rect(size_t tile) const {
+    int col = static_cast<int>(tile % tiles_x) << TILE_SHIFT;
+    int row = static_cast<int>(tile / tiles_x) << TILE_SHIFT;
+    return {col, row, std::min(TILE_SIZE, cols - col),
+            std::min(TILE_SIZE, rows - row)};
+  }
+  inline int get_cols() const { return cols; }
+  inline int get_rows() const { return rows; }
+  inline int get_tiles_x() const { return tiles_x; }
+  inline int get_tiles_y() const { return tiles_y; }
+  inline size_t get_tile_count() const {
+    return static_cast<size_t>(tiles_x) * tiles_y;
+  }
+  inline size_t get_cell_count() const {
+    return static_cast<size_t>(cols) * rows;
+  }
+  inline T *data() { return cells.data(); }
+  inline const T *data() const { return cells.data(); }
+
+private:
+  int cols = 0;
+  int rows = 0;
+  int tiles_x = 0;
+  int tiles_y = 0;
+  std::vector<T> cells{};
+};
+/**
+ * @brief Decode a quantized DEM into a tiled grid of floats.
+ * @details Tiles are decoded in parallel, directly tile to tile when the
+ * quantized grid uses the same tile size.
+ *
+ * @param grid The quantized DEM.
+ * @param shift A value subtracted from every decoded elevation.
+ * @return The elevations, NaN for cells with no data.
+ */
+TiledGrid<float> decode_elevations(const QuantizedGrid &grid, float shift);
+} // namespace math_3dh
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef WATERSHED
+#define WATERSHED
+
+// Standard Library
+#include <cstdint>
+#include <vector>
+
+// External Libraries
+#include "glm.hpp"
+
+// 3DH
+#include "Math/tiled_grid.hpp"
+
+namespace math_3dh {
+/**
+ * @brief The watershed label of a cell that drains to no pour point.
+ */
+constexpr int32_t WATERSHED_NONE = -1;
+/**
+ * @brief Move pour points onto the cell with the most flow accumulation within
+ * a radius, so points placed a few cells off the flow path still catch it.
+ * @details Points are snapped in parallel. A point only moves to a cell with
+ * strictly more accumulation than its own, among equal cells the first in row
+ * major order wins. Points outside of the grid are returned unchanged.
+ *
+ * @param accumulation The D8 flow accumulation from accumulate_d8().
+ * @param points The columns and rows of the pour points.
+ * @param radius The search radius in cells.
+ * @return The snapped columns and rows, in the order of \p points.
+ */
+std::vector<glm::ivec2>
+snap_pour_points(const TiledGrid<uint32_t> &accumulation,
+                 const std::vector<glm::ivec2> &points, int radius);
+/**
+ * @brief Label every cell with the first pour point downstream of it.
+ * @details All pour points are delineated in one pass instead of one trace
+ * each. Flow directions form a forest whose roots are the pour points and
+ * outlets, so labelling is a union-find over the cells. Each tile first links
+ * its cells to a root or to the cell where their path leaves the tile, with
+ * path compression, in parallel. The links between tiles only start at tile
+ * borders and are resolved serially, then a last parallel pass replaces every
+ * link with its root. Nested pour points split the watershed, each cell gets
+ * the nearest pour point downstream.
+ *
+ * @param directions The D8 flow directions from compute_d8().
+ * @param pour_points The columns and rows of the pour points, the first of
+ * several at the same cell wins it.
+ * @param thread_count The number of threads, 0 uses the number of hardware
+ * threads.
+ * @return The index into \p pour_points that each cell drains to, or
+ * WATERSHED_NONE.
+ */
+TiledGrid<int32_t> label_watersheds(const TiledGrid<uint8_t> &directions,
+                                    const std::vector<glm::ivec2> &pour_points,
+                                    unsigned int thread_count = 0);
+/**
+ * @brief Count the cells of each watershed.
+ *
+ * @param labels The watershed labels from label_watersheds().
+ * @param watershed_count The number of pour points.
+ * @return The number of cells labelled with each pour point.
+ */
+std::vector<size_t> count_watershed_cells(const TiledGrid<int32_t> &labels,
+                                          size_t watershed_count);
+} // namespace math_3dh
+
+#endif
@@ -3,10 +3,13 @@
 // Output
 out vec4 color;
 uniform float alpha = 1.0;
+uniform int shade;
+// towards the sun, north west and 45 degrees up like a standard hillshade
+const vec3 light_direction = vec3(-0.5, 0.5, 0.70710678);
 
 // Input from vertex shader
 // in vec4 P;
-// in vec3 N;
+in vec3 N;
 in vec3 amb_color;
 
 // Matrices
@@ -52,5 +55,10 @@ void main(void) {
   // vec3 scattered_light = ambient + diffuse * attenuation;
   // vec3 reflected_light = vec3(light_ambient) * specular * attenuation;
   // vec3 rgb = min(scattered_light + reflected_light, vec3(1.0));
-  color = vec4(amb_color, alpha);
+  vec3 rgb = amb_color;
+  if (shade == 1) {
+    float diffuse = max(dot(normalize(N), light_direction), 0.0);
+    rgb *= 0.4 + 0.6 * diffuse;
+  }
+  color = vec4(rgb, alpha);
 }
\ No newline at end of file
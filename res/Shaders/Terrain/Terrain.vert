@@ -9,21 +9,44 @@ uniform vec2 dem_upper_left;
 uniform vec2 dem_scale;
 uniform int dem_n;
 uniform int dem_m;
+uniform int dem_tile_size;
+uniform int dem_tiles_x;
+uniform int grid_level;
+uniform float elev_shift;
+uniform int mip_count;
+uniform int clipmap_levels;
+uniform int first_level;
+uniform int level_instances;
+uniform int streaming;
+uniform int clip_size;
 uniform vec2 image_upper_left;
 uniform vec2 image_scale;
 uniform int image_n;
 uniform int image_m;
 uniform float vert_exag = 7.0;
+uniform int shade;
 
 //out vec4 P;
-//out vec3 N;
+out vec3 N;
 out vec3 amb_color;
 
 layout(std430) buffer model_instances { mat4 models[]; };
-layout(std430) buffer elevations { float elev[]; };
-layout(std430) buffer reds { float r[]; };
-layout(std430) buffer greens { float g[]; };
-layout(std430) buffer blues { float b[]; };
+// 16-bit quantized samples packed two per uint, tiled
+layout(std430) buffer elevations { uint elev[]; };
+// bias and scale of each tile
+layout(std430) buffer elevation_tiles { vec2 elev_tiles[]; };
+// coarser levels of the DEM, packed one after another
+layout(std430) buffer elevation_mips { uint mip_elev[]; };
+layout(std430) buffer elevation_mip_tiles { vec2 mip_tiles[]; };
+// two per mip: (cols, rows, tiles_x, tile_size), (tile_offset, word_offset)
+layout(std430) buffer elevation_mip_info { ivec4 mip_info[]; };
+layout(std430) buffer image { uint rgba[]; };
+// octahedral encoded normals packed two per uint, tiled 64x64 like the DEM
+layout(std430) buffer normals { uint normal[]; };
+// streaming mode, a clip_size^2 ring of cells per clipmap level
+layout(std430) buffer clip_elevations { float clip_elev[]; };
+layout(std430) buffer clip_colors { uint clip_rgba[]; };
+layout(std430) buffer clip_origins { ivec2 clip_origin[]; };
 
 vec3 calc_color(vec2 world) {
   int x, y;
@@ -33,43 +56,125 @@ vec3 calc_color(vec2 world) {
     return vec3(0.0, 0.0, 0.0);
   }
   int image_index = y * image_n + x;
-  return vec3(r[image_index] / 255.0, g[image_index] / 255.0,
-              b[image_index] / 255.0);
+  return unpackUnorm4x8(rgba[image_index]).rgb;
 }
 
-vec3 calc_elevation(vec3 world) {
+const uint NO_DATA = 65535u;
+
+vec3 calc_mip_elevation(vec3 world, int mip) {
+  ivec4 dims = mip_info[2 * (mip - 1)];
+  ivec4 offsets = mip_info[2 * (mip - 1) + 1];
+  float cell = float(1 << mip);
+  int x, y;
+  x = int((world.x - dem_upper_left.x) / (dem_scale.x * cell));
+  y = int((dem_upper_left.y - world.y) / (dem_scale.y * cell));
+  if (x < 0 || x >= dims.x || y < 0 || y >= dims.y) {
+    return world;
+  }
+  int tile_size = dims.w;
+  int tile = (y / tile_size) * dims.z + x / tile_size;
+  int mip_index = tile * tile_size * tile_size + (y % tile_size) * tile_size +
+                  x % tile_size;
+  uint sample = (mip_elev[offsets.y + (mip_index >> 1)] >>
+                 ((mip_index & 1) * 16)) & 0xFFFFu;
+  if (sample == NO_DATA) {
+    return world;
+  }
+  vec2 bias_scale = mip_tiles[offsets.x + tile];
+  world.z = (bias_scale.x + float(sample) * bias_scale.y - elev_shift) *
+            vert_exag;
+  return world;
+}
+
+vec3 calc_elevation(vec3 world, int mip) {
+  if (mip > 0) {
+    return calc_mip_elevation(world, mip);
+  }
   int x, y;
   x = int((world.x - dem_upper_left.x) / dem_scale.x);
   y = int((dem_upper_left.y - world.y) / dem_scale.y);
   if (x < 0 || x >= dem_n || y < 0 || y >= dem_m) {
     return world;
   }
-  int dem_index = y * dem_n + x;
-  world.z = elev[dem_index] * vert_exag;
+  int tile = (y / dem_tile_size) * dem_tiles_x + x / dem_tile_size;
+  int dem_index = tile * dem_tile_size * dem_tile_size +
+                  (y % dem_tile_size) * dem_tile_size + x % dem_tile_size;
+  uint sample = (elev[dem_index >> 1] >> ((dem_index & 1) * 16)) & 0xFFFFu;
+  if (sample == NO_DATA) {
+    return world;
+  }
+  vec2 bias_scale = elev_tiles[tile];
+  world.z = (bias_scale.x + float(sample) * bias_scale.y - elev_shift) *
+            vert_exag;
+  return world;
+}
+
+int calc_clip_index(vec2 world, int level) {
+  float cell = float(1 << (clipmap_levels - level - 1));
+  ivec2 xy = ivec2(floor((world.x - dem_upper_left.x) / (dem_scale.x * cell)),
+                   floor((dem_upper_left.y - world.y) / (dem_scale.y * cell)));
+  ivec2 local = xy - clip_origin[level];
+  if (any(lessThan(local, ivec2(0))) ||
+      any(greaterThanEqual(local, ivec2(clip_size)))) {
+    return -1;
+  }
+  ivec2 ring = ivec2(mod(vec2(xy), float(clip_size)));
+  return (level * clip_size + ring.y) * clip_size + ring.x;
+}
+
+vec3 calc_clip_elevation(vec3 world, int level) {
+  int index = calc_clip_index(world.xy, level);
+  // cells that are not loaded yet are NaN
+  if (index < 0 || isnan(clip_elev[index])) {
+    return world;
+  }
+  world.z = clip_elev[index] * vert_exag;
   return world;
 }
 
-vec3 calc_normal(vec3 center) {
-  vec3 top = vec3(center.x, center.y + dem_scale.y, 0.0);
-  top = calc_elevation(top);
-  vec3 right = vec3(center.x + dem_scale.x, center.y, 0.0);
-  right = calc_elevation(right);
-  vec3 bot = vec3(center.x, center.y - dem_scale.y, 0.0);
-  bot = calc_elevation(bot);
-  vec3 left = vec3(center.x - dem_scale.x, center.y, 0.0);
-  left = calc_elevation(left);
-  vec3 tl = normalize(cross(top - center, left - center));
-  vec3 tr = normalize(cross(right - center, top - center));
-  vec3 br = normalize(cross(bot - center, right - center));
-  vec3 bl = normalize(cross(left - center, bot - center));
-  return (tl + tr + br + bl) / 4.0;
+vec3 calc_clip_color(vec2 world, int level) {
+  int index = calc_clip_index(world, level);
+  if (index < 0) {
+    return vec3(0.0, 0.0, 0.0);
+  }
+  return unpackUnorm4x8(clip_rgba[index]).rgb;
+}
+
+vec3 calc_normal(vec3 world) {
+  int x, y;
+  x = int((world.x - dem_upper_left.x) / dem_scale.x);
+  y = int((dem_upper_left.y - world.y) / dem_scale.y);
+  if (shade == 0 || x < 0 || x >= dem_n || y < 0 || y >= dem_m) {
+    return vec3(0.0, 0.0, 1.0);
+  }
+  int tile = (y >> 6) * ((dem_n + 63) >> 6) + (x >> 6);
+  int normal_index = (tile << 12) + ((y & 63) << 6) + (x & 63);
+  uint encoded =
+      (normal[normal_index >> 1] >> ((normal_index & 1) * 16)) & 0xFFFFu;
+  vec2 f = unpackSnorm4x8(encoded).xy;
+  vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+  if (n.z < 0.0) {
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x < 0.0 ? -1.0 : 1.0,
+                                     n.y < 0.0 ? -1.0 : 1.0);
+  }
+  // the normals are of the unexaggerated surface
+  return normalize(vec3(n.xy, n.z / vert_exag));
 }
 
 void main() {
   vec4 world_pos = model * models[gl_InstanceID] * position;
-  world_pos = vec4(calc_elevation(world_pos.xyz), world_pos.w);
-  // N = calc_normal(world_pos.xyz);
+  // clipmap level l has 2^(L - l - 1) DEM cells per vertex
+  int level = first_level + gl_InstanceID / level_instances;
+  if (streaming == 1) {
+    world_pos = vec4(calc_clip_elevation(world_pos.xyz, level), world_pos.w);
+    amb_color = calc_clip_color(world_pos.xy, level);
+  } else {
+    // the resident DEM may itself be grid_level halvings below full resolution
+    int mip = clamp(clipmap_levels - 1 - level - grid_level, 0, mip_count);
+    world_pos = vec4(calc_elevation(world_pos.xyz, mip), world_pos.w);
+    amb_color = calc_color(world_pos.xy);
+  }
+  N = calc_normal(world_pos.xyz);
   // P = view * world_pos;
-  amb_color = calc_color(world_pos.xy);
   gl_Position = projection * view * world_pos;
 }
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "GDAL/block_cache.hpp"
+
+namespace gdal_input {
+namespace {
+size_t block_bytes(const RasterBlock &block) {
+  return block.data.size() * sizeof(float);
+}
+} // namespace
+
+BlockCache::BlockCache(size_t max_bytes) : max_bytes(max_bytes) {}
+std::shared_ptr<const RasterBlock> BlockCache::get(const BlockKey &key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = lookup.find(key);
+  if (it == lookup.end()) {
+    return nullptr;
+  }
+  entries.splice(entries.begin(), entries, it->second);
+  return it->second->second;
+}
+void BlockCache::put(const BlockKey &key,
+                     std::shared_ptr<const RasterBlock> block) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = lookup.find(key);
+  if (it != lookup.end()) {
+    bytes -= block_bytes(*it->second->second);
+    entries.erase(it->second);
+    lookup.erase(it);
+  }
+  bytes += block_bytes(*block);
+  entries.emplace_front(key, std::move(block));
+  lookup[key] = entries.begin();
+  evict();
+}
+void BlockCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  lookup.clear();
+  bytes = 0;
+}
+void BlockCache::set_max_bytes(size_t max_bytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->max_bytes = max_bytes;
+  evict();
+}
+void BlockCache::evict() {
+  // always keep the most recent block, even if it alone is over budget
+  while (bytes > max_bytes && entries.size() > 1) {
+    bytes -= block_bytes(*entries.back().second);
+    lookup.erase(entries.back().first);
+    entries.pop_back();
+  }
+}
+} // namespace gdal_input
@@ -0,0 +1,251 @@
+#include "GDAL/clipmap_stream.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+// 3DH
+#include "GDAL/gdal_io.hpp"
+#include "Math/terrain_shading.hpp"
+
+namespace gdal_input {
+namespace {
+int positive_mod(int value, int divisor) {
+  int result = value % divisor;
+  return result < 0 ? result + divisor : result;
+}
+/**
+ * @brief Clip a strip to the window of its level.
+ *
+ * @return false if nothing of the strip is left.
+ */
+bool clip_to_window(ClipmapStrip &strip, glm::ivec2 origin, int size) {
+  int x1 = std::min(strip.x0 + strip.width, origin.x + size);
+  int y1 = std::min(strip.y0 + strip.height, origin.y + size);
+  strip.x0 = std::max(strip.x0, origin.x);
+  strip.y0 = std::max(strip.y0, origin.y);
+  strip.width = x1 - strip.x0;
+  strip.height = y1 - strip.y0;
+  return strip.width > 0 && strip.height > 0;
+}
+} // namespace
+
+ClipmapStream::ClipmapStream(std::string dem_path, std::string image_path,
+                             uint32_t levels, int size, double z_offset)
+    : levels(levels), size(size), z_offset(z_offset),
+      elevations(static_cast<size_t>(levels) * size * size,
+                 std::numeric_limits<float>::quiet_NaN()),
+      colors(static_cast<size_t>(levels) * size * size, 0),
+      origins(levels, glm::ivec2(0)), initialized(levels, 0),
+      loader_origins(levels, glm::ivec2(0)) {
+  loader = std::thread(&ClipmapStream::load, this, dem_path, image_path);
+}
+ClipmapStream::~ClipmapStream() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    requests.clear();
+  }
+  wake.notify_all();
+  if (loader.joinable()) {
+    loader.join();
+  }
+}
+void ClipmapStream::set_center(uint32_t level, glm::ivec2 center) {
+  glm::ivec2 origin = center - glm::ivec2(size / 2);
+  glm::ivec2 old_origin = origins[level];
+  if (initialized[level] && origin == old_origin) {
+    return;
+  }
+  origins[level] = origin;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    loader_origins[level] = origin;
+  }
+  glm::ivec2 delta = origin - old_origin;
+  if (!initialized[level] || std::abs(delta.x) >= size ||
+      std::abs(delta.y) >= size) {
+    // nothing of the old window is still visible
+    initialized[level] = 1;
+    invalidate(level, origin.x, origin.y, size, size);
+    request(level, origin.x, origin.y, size, size);
+    return;
+  }
+  // the exposed columns span every row of the window, the exposed rows only
+  // span the columns that were already visible
+  int keep_x0 = std::max(origin.x, old_origin.x);
+  int keep_x1 = std::min(origin.x, old_origin.x) + size;
+  if (delta.x != 0) {
+    int x0 = delta.x > 0 ? old_origin.x + size : origin.x;
+    invalidate(level, x0, origin.y, std::abs(delta.x), size);
+    request(level, x0, origin.y, std::abs(delta.x), size);
+  }
+  if (delta.y != 0) {
+    int y0 = delta.y > 0 ? old_origin.y + size : origin.y;
+    invalidate(level, keep_x0, y0, keep_x1 - keep_x0, std::abs(delta.y));
+    request(level, keep_x0, y0, keep_x1 - keep_x0, std::abs(delta.y));
+  }
+}
+bool ClipmapStream::poll() {
+  std::vector<ClipmapStrip> strips{};
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    strips.swap(finished);
+  }
+  bool changed = false;
+  for (ClipmapStrip &strip : strips) {
+    // the cells of a strip never change, only copy those still in the window
+    int x_begin = strip.x0, y_begin = strip.y0;
+    int stride = strip.width;
+    if (!clip_to_window(strip, origins[strip.level], size)) {
+      continue;
+    }
+    for (int y = strip.y0; y < strip.y0 + strip.height; y++) {
+      for (int x = strip.x0; x < strip.x0 + strip.width; x++) {
+        size_t src = static_cast<size_t>(y - y_begin) * stride + (x - x_begin);
+        size_t dst = ring_index(strip.level, x, y);
+        elevations[dst] = strip.elevations[src];
+        colors[dst] = strip.colors[src];
+      }
+    }
+    changes.push_back(
+        {strip.level, strip.x0, strip.y0, strip.width, strip.height});
+    changed = true;
+  }
+  return changed;
+}
+std::vector<ClipmapStrip> ClipmapStream::take_changes() {
+  std::vector<ClipmapStrip> taken{};
+  taken.swap(changes);
+  return taken;
+}
+void ClipmapStream::request(uint32_t level, int x0, int y0, int width,
+                            int height) {
+  ClipmapStrip strip{};
+  strip.level = level;
+  strip.x0 = x0;
+  strip.y0 = y0;
+  strip.width = width;
+  strip.height = height;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    requests.push_back(std::move(strip));
+  }
+  wake.notify_one();
+}
+void ClipmapStream::invalidate(uint32_t level, int x0, int y0, int width,
+                               int height) {
+  for (int y = y0; y < y0 + height; y++) {
+    for (int x = x0; x < x0 + width; x++) {
+      size_t index = ring_index(level, x, y);
+      elevations[index] = std::numeric_limits<float>::quiet_NaN();
+      colors[index] = 0;
+    }
+  }
+  changes.push_back({level, x0, y0, width, height});
+}
+size_t ClipmapStream::ring_index(uint32_t level, int x, int y) const {
+  return (static_cast<size_t>(level) * size + positive_mod(y, size)) * size +
+         positive_mod(x, size);
+}
+float ClipmapStream::get_elevation(glm::ivec2 pixel) const {
+  if (pixel.x < 0 || pixel.y < 0) {
+    return std::numeric_limits<float>::quiet_NaN();
+  }
+  for (uint32_t level = levels; level-- > 0;) {
+    if (!initialized[level]) {
+      continue;
+    }
+    glm::ivec2 cell = pixel / get_cell_factor(level);
+    glm::ivec2 local = cell - origins[level];
+    if (local.x < 0 || local.y < 0 || local.x >= size || local.y >= size) {
+      continue;
+    }
+    float elevation = elevations[ring_index(level, cell.x, cell.y)];
+    if (!std::isnan(elevation)) {
+      return elevation;
+    }
+  }
+  return std::numeric_limits<float>::quiet_NaN();
+}
+void ClipmapStream::load(std::string dem_path, std::string image_path) {
+  // GDAL handles are not thread safe, the loader opens its own
+  RasterDataset dem(dem_path);
+  std::unique_ptr<RasterDataset> image = nullptr;
+  glm::dvec2 dem_top_left = dem.get_top_left_coord();
+  glm::dvec2 dem_scale = dem.get_pixel_scale();
+  glm::dvec2 image_top_left = dem_top_left;
+  glm::dvec2 image_scale = dem_scale;
+  if (!image_path.empty()) {
+    image = std::make_unique<RasterDataset>(image_path);
+    image_top_left = image->get_top_left_coord();
+    image_scale = image->get_pixel_scale();
+  }
+  float no_data_value = dem.get_no_data_float(1);
+  while (true) {
+    ClipmapStrip strip{};
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this]() { return stopping || !requests.empty(); });
+      if (stopping) {
+        return;
+      }
+      strip = std::move(requests.front());
+      requests.pop_front();
+      // skip whatever the window already moved past
+      if (!clip_to_window(strip, loader_origins[strip.level], size)) {
+        continue;
+      }
+    }
+    int f = get_cell_factor(strip.level);
+    int x0 = strip.x0 * f;
+    int y0 = strip.y0 * f;
+    int xf = (strip.x0 + strip.width) * f - 1;
+    int yf = (strip.y0 + strip.height) * f - 1;
+    size_t count = static_cast<size_t>(strip.width) * strip.height;
+    strip.elevations.resize(count);
+    dem.read_floats(1, x0, xf, y0, yf, strip.width, strip.height,
+                    strip.elevations.data(), strip.width);
+    for (float &elevation : strip.elevations) {
+      elevation = elevation == no_data_value || std::isnan(elevation)
+                      ? std::numeric_limits<float>::quiet_NaN()
+                      : static_cast<float>(elevation - z_offset);
+    }
+    if (!image) {
+      // shade the strip itself, its edges fall back to one sided slopes
+      strip.colors = math_3dh::shade_block(
+          strip.elevations.data(), strip.width, strip.height,
+          glm::vec2(dem_scale) * static_cast<float>(f));
+      std::lock_guard<std::mutex> lock(mutex);
+      finished.push_back(std::move(strip));
+      continue;
+    }
+    // the same ground footprint in pixels of the image
+    glm::dvec2 world_min = {dem_top_left.x + x0 * dem_scale.x,
+                            dem_top_left.y - (yf + 1) * dem_scale.y};
+    glm::dvec2 world_max = {dem_top_left.x + (xf + 1) * dem_scale.x,
+                            dem_top_left.y - y0 * dem_scale.y};
+    int ix0 = static_cast<int>(
+        std::floor((world_min.x - image_top_left.x) / image_scale.x));
+    int iy0 = static_cast<int>(
+        std::floor((image_top_left.y - world_max.y) / image_scale.y));
+    int ixf = std::max(ix0, static_cast<int>(std::ceil(
+                                (world_max.x - image_top_left.x) /
+                                image_scale.x)) -
+                                1);
+    int iyf = std::max(iy0, static_cast<int>(std::ceil(
+                                (image_top_left.y - world_min.y) /
+                                image_scale.y)) -
+                                1);
+    strip.colors.assign(count, 0);
+    image->read_rgba8(ix0, ixf, iy0, iyf, strip.width, strip.height,
+                     strip.colors.data(), strip.width);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      finished.push_back(std::move(strip));
+    }
+  }
+}
+} // namespace gdal_input
@@ -0,0 +1,44 @@
+#include "GDAL/flow_snapshots.hpp"
+
+// Standard Library
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace gdal_input {
+FlowSnapshotWriter::FlowSnapshotWriter(std::string prefix,
+                                       const RasterGeoreference &georeference)
+    : prefix(prefix), georeference(georeference),
+      index(prefix + ".csv", std::ios::trunc) {
+  if (!index) {
+    std::cerr << "Error: Could not create snapshot index: " << prefix
+              << ".csv" << std::endl;
+    return;
+  }
+  index << "snapshot,time,volume,depth,u,v" << std::endl;
+}
+bool FlowSnapshotWriter::write(const math_3dh::OverlandFlow &flow) {
+  std::ostringstream name;
+  name << prefix << "_" << std::setw(5) << std::setfill('0') << snapshot_count;
+  std::string depth_path = name.str() + "_depth.tif";
+  std::string u_path = name.str() + "_u.tif";
+  std::string v_path = name.str() + "_v.tif";
+  flow.compute_velocity(u, v);
+  // walls have no water, they are written as no data
+  depth = flow.get_depth();
+  flow.mask_walls(depth, NO_DATA);
+  flow.mask_walls(u, NO_DATA);
+  flow.mask_walls(v, NO_DATA);
+  bool written = write_raster(depth_path, depth, georeference, NO_DATA) &&
+                 write_raster(u_path, u, georeference, NO_DATA) &&
+                 write_raster(v_path, v, georeference, NO_DATA);
+  if (!written) {
+    return false;
+  }
+  index << snapshot_count << "," << std::setprecision(9) << flow.get_time()
+        << "," << flow.get_volume() << "," << depth_path << "," << u_path
+        << "," << v_path << std::endl;
+  snapshot_count++;
+  return true;
+}
+} // namespace gdal_input
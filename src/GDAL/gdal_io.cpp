@@ -1,20 +1,469 @@
 #include "GDAL/gdal_io.hpp"
 // Standard Library
 #include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <thread>
 
 // EXT
 #include "nfd.h"
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 6, 0)
+#define GDAL_HAS_ARROW_STREAM
+#include "ogr_recordbatch.h"
+#endif
+#if GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3, 1, 0)
+#define GDAL_HAS_RAW_LAYOUT
+#endif
+
+// OS
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace gdal_input {
+namespace {
+GeometryType to_geometry_type(OGRwkbGeometryType wkb_type) {
+  switch (wkbFlatten(wkb_type)) {
+  case wkbPoint:
+    return GeometryType::POINT;
+  case wkbLineString:
+    return GeometryType::POLYLINE;
+  default:
+    return GeometryType::UNKNOWN;
+  }
+}
+FieldType to_field_type(OGRFieldType ogr_type) {
+  switch (ogr_type) {
+  case OFTReal:
+    return FieldType::REAL;
+  case OFTInteger:
+  case OFTInteger64:
+    return FieldType::INTEGER;
+  default:
+    return FieldType::STRING;
+  }
+}
+/**
+ * @brief Create the empty columns of a batch, resolving each field name to its
+ * field index in the layer.
+ */
+std::vector<FieldColumn> make_columns(OGRLayer *layer,
+                                      const std::vector<std::string> &names) {
+  std::vector<FieldColumn> columns(names.size());
+  OGRFeatureDefn *defn = layer->GetLayerDefn();
+  for (size_t i = 0; i < names.size(); i++) {
+    columns[i].name = names[i];
+    columns[i].field_index = defn->GetFieldIndex(names[i].c_str());
+    if (columns[i].field_index >= 0) {
+      columns[i].type =
+          to_field_type(defn->GetFieldDefn(columns[i].field_index)->GetType());
+    }
+  }
+  return columns;
+}
+void reserve_batch(FeatureBatch &batch, int64_t count) {
+  if (count <= 0) {
+    return;
+  }
+  size_t n = static_cast<size_t>(count);
+  batch.fids.reserve(n);
+  batch.vertex_offsets.reserve(n + 1);
+  if (batch.geometry_type == GeometryType::POINT) {
+    batch.x.reserve(n);
+    batch.y.reserve(n);
+    batch.z.reserve(n);
+  }
+  for (auto &column : batch.columns) {
+    switch (column.type) {
+    case FieldType::REAL:
+      column.reals.reserve(n);
+      break;
+    case FieldType::INTEGER:
+      column.integers.reserve(n);
+      break;
+    case FieldType::STRING:
+      column.offsets.reserve(n + 1);
+      break;
+    default:
+      break;
+    }
+  }
+}
+void push_vertex(FeatureBatch &batch, double x, double y, double z) {
+  batch.x.push_back(x);
+  batch.y.push_back(y);
+  batch.z.push_back(z);
+}
+/**
+ * @brief Move the features of \p src to the end of \p dst. Both batches must
+ * have been read with the same columns.
+ */
+void append_batch(FeatureBatch &dst, FeatureBatch &&src) {
+  size_t vertex_base = dst.x.size();
+  dst.fids.insert(dst.fids.end(), src.fids.begin(), src.fids.end());
+  dst.x.insert(dst.x.end(), src.x.begin(), src.x.end());
+  dst.y.insert(dst.y.end(), src.y.begin(), src.y.end());
+  dst.z.insert(dst.z.end(), src.z.begin(), src.z.end());
+  for (size_t i = 1; i < src.vertex_offsets.size(); i++) {
+    dst.vertex_offsets.push_back(vertex_base + src.vertex_offsets[i]);
+  }
+  for (size_t c = 0; c < dst.columns.size(); c++) {
+    FieldColumn &to = dst.columns[c];
+    FieldColumn &from = src.columns[c];
+    to.reals.insert(to.reals.end(), from.reals.begin(), from.reals.end());
+    to.integers.insert(to.integers.end(), from.integers.begin(),
+                       from.integers.end());
+    size_t char_base = to.chars.size();
+    to.chars.insert(to.chars.end(), from.chars.begin(), from.chars.end());
+    for (size_t i = 1; i < from.offsets.size(); i++) {
+      to.offsets.push_back(char_base + from.offsets[i]);
+    }
+  }
+  src = FeatureBatch{};
+}
+/**
+ * @brief Append the geometry and requested attributes of a feature to the end
+ * of a batch.
+ */
+void append_feature(FeatureBatch &batch, OGRFeature *feature) {
+  batch.fids.push_back(feature->GetFID());
+  OGRGeometry *geometry = feature->GetGeometryRef();
+  if (geometry) {
+    if (batch.geometry_type == GeometryType::POINT) {
+      OGRPoint *point = geometry->toPoint();
+      push_vertex(batch, point->getX(), point->getY(), point->getZ());
+    } else if (batch.geometry_type == GeometryType::POLYLINE) {
+      OGRLineString *polyline = geometry->toLineString();
+      for (int i = 0; i < polyline->getNumPoints(); i++) {
+        push_vertex(batch, polyline->getX(i), polyline->getY(i),
+                    polyline->getZ(i));
+      }
+    }
+  } else if (batch.geometry_type == GeometryType::POINT) {
+    // keep one vertex per feature for point layers
+    push_vertex(batch, 0.0, 0.0, 0.0);
+  }
+  batch.vertex_offsets.push_back(batch.x.size());
+  for (auto &column : batch.columns) {
+    int index = column.field_index;
+    switch (column.type) {
+    case FieldType::REAL:
+      column.reals.push_back(feature->GetFieldAsDouble(index));
+      break;
+    case FieldType::INTEGER:
+      column.integers.push_back(feature->GetFieldAsInteger64(index));
+      break;
+    case FieldType::STRING: {
+      const char *str = feature->GetFieldAsString(index);
+      column.chars.insert(column.chars.end(), str, str + std::strlen(str));
+      column.offsets.push_back(column.chars.size());
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+/**
+ * @brief Check that the features of a layer have the dense FIDs first_fid to
+ * first_fid + count - 1 in index order, so ranges of feature indices can be
+ * read independently with SetNextByIndex() and nothing is skipped or read
+ * twice.
+ */
+bool has_dense_fids(OGRLayer *layer, int64_t count, int64_t &first_fid) {
+  if (count <= 0) {
+    return false;
+  }
+  layer->ResetReading();
+  OGRFeature *first = layer->GetNextFeature();
+  if (!first) {
+    return false;
+  }
+  first_fid = first->GetFID();
+  OGRFeature::DestroyFeature(first);
+  bool dense = false;
+  if (layer->SetNextByIndex(count - 1) == OGRERR_NONE) {
+    OGRFeature *last = layer->GetNextFeature();
+    OGRFeature *extra = last ? layer->GetNextFeature() : nullptr;
+    dense = last && !extra && last->GetFID() - first_fid + 1 == count;
+    OGRFeature::DestroyFeature(last);
+    OGRFeature::DestroyFeature(extra);
+  }
+  layer->ResetReading();
+  return dense;
+}
+
+/**
+ * @brief The part of a requested raster window that lies inside of the raster
+ * and where it lands in the n by m output.
+ */
+struct WindowRead {
+  int x0 = 0, y0 = 0;         /**< First column and row read from the band.*/
+  int cols = 0, rows = 0;     /**< Size of the window read from the band.*/
+  int u = 0, v = 0;           /**< First output column and row written.*/
+  int read_n = 0, read_m = 0; /**< Output columns and rows written.*/
+};
+WindowRead clamp_window(int band_cols, int band_rows, int x0, int xf, int y0,
+                        int yf, int n, int m) {
+  WindowRead read{};
+  // calc resolution scale
+  int sx = std::max((xf - x0 + 1) / n, 1);
+  int sy = std::max((yf - y0 + 1) / m, 1);
+  // clamp row and column to raster bounds
+  read.x0 = std::max(x0, 0);
+  read.y0 = std::max(y0, 0);
+  int cxf = std::min(xf, band_cols - 1);
+  int cyf = std::min(yf, band_rows - 1);
+  if (read.x0 > cxf || read.y0 > cyf) {
+    // the window does not overlap the raster
+    return read;
+  }
+  read.cols = cxf - read.x0 + 1;
+  read.rows = cyf - read.y0 + 1;
+  // calculate out of bounds offset in output pixels
+  read.u = std::min((read.x0 - x0) / sx, n);
+  read.v = std::min((read.y0 - y0) / sy, m);
+  read.read_n = std::min(read.cols / sx, n - read.u);
+  read.read_m = std::min(read.rows / sy, m - read.v);
+  return read;
+}
+/**
+ * @brief Set every output pixel that the window read will not write to the no
+ * data value.
+ */
+template <typename T>
+void fill_outside_window(T *dst, int64_t line_stride, int n, int m,
+                         const WindowRead &read, T no_data_value) {
+  for (int j = 0; j < m; j++) {
+    T *row = dst + j * line_stride;
+    if (j < read.v || j >= read.v + read.read_m) {
+      std::fill(row, row + n, no_data_value);
+    } else {
+      std::fill(row, row + read.u, no_data_value);
+      std::fill(row + read.u + read.read_n, row + n, no_data_value);
+    }
+  }
+}
+#ifdef GDAL_HAS_ARROW_STREAM
+/**
+ * @brief A cursor over a WKB blob that swaps the byte order of each value when
+ * the blob was not written in the byte order of the host.
+ */
+class WkbCursor {
+public:
+  WkbCursor(const uint8_t *data, size_t size) : data(data), end(data + size) {}
+  bool read_header(uint32_t &type, bool &has_z, bool &has_m) {
+    if (end - data < 5) {
+      return false;
+    }
+    uint16_t probe = 1;
+    bool host_little = *reinterpret_cast<uint8_t *>(&probe) == 1;
+    swap = (data[0] == 1) != host_little;
+    data++;
+    uint32_t code = read_uint32();
+    // EWKB/25D flag Z, M and an embedded SRID in the high bits
+    has_z = (code & 0x80000000u) != 0;
+    has_m = (code & 0x40000000u) != 0;
+    bool has_srid = (code & 0x20000000u) != 0;
+    code &= 0x1FFFFFFFu;
+    // ISO adds 1000 for Z, 2000 for M and 3000 for ZM
+    uint32_t iso_dims = (code % 10000) / 1000;
+    has_z = has_z || iso_dims == 1 || iso_dims == 3;
+    has_m = has_m || iso_dims == 2 || iso_dims == 3;
+    type = code % 1000;
+    if (has_srid) {
+      if (!has_bytes(4)) {
+        return false;
+      }
+      read_uint32();
+    }
+    return true;
+  }
+  uint32_t read_uint32() {
+    uint32_t value = 0;
+    read_raw(&value, sizeof(value));
+    return value;
+  }
+  double read_double() {
+    double value = 0.0;
+    read_raw(&value, sizeof(value));
+    return value;
+  }
+  bool has_bytes(size_t n) { return static_cast<size_t>(end - data) >= n; }
+
+private:
+  void read_raw(void *value, size_t n) {
+    if (!has_bytes(n)) {
+      data = end;
+      return;
+    }
+    uint8_t *bytes = static_cast<uint8_t *>(value);
+    std::memcpy(bytes, data, n);
+    if (swap) {
+      std::reverse(bytes, bytes + n);
+    }
+    data += n;
+  }
+  const uint8_t *data;
+  const uint8_t *end;
+  bool swap = false;
+};
+void append_wkb_geometry(FeatureBatch &batch, const uint8_t *wkb,
+                         size_t size) {
+  WkbCursor cursor(wkb, size);
+  uint32_t type = 0;
+  bool has_z = false;
+  bool has_m = false;
+  if (cursor.read_header(type, has_z, has_m)) {
+    // an XYM vertex has three values too, the third one is M and not Z
+    size_t dims = 2 + (has_z ? 1 : 0) + (has_m ? 1 : 0);
+    auto read_vertex = [&]() {
+      double x = cursor.read_double();
+      double y = cursor.read_double();
+      double z = has_z ? cursor.read_double() : 0.0;
+      if (has_m) {
+        cursor.read_double(); // skip M
+      }
+      push_vertex(batch, x, y, z);
+    };
+    if (type == wkbPoint && batch.geometry_type == GeometryType::POINT) {
+      read_vertex();
+    } else if (type == wkbLineString &&
+               batch.geometry_type == GeometryType::POLYLINE) {
+      uint32_t count = cursor.read_uint32();
+      for (uint32_t i = 0; i < count && cursor.has_bytes(dims * 8); i++) {
+        read_vertex();
+      }
+    }
+  }
+  if (batch.geometry_type == GeometryType::POINT &&
+      batch.x.size() == batch.vertex_offsets.back()) {
+    // keep one vertex per feature for point layers
+    push_vertex(batch, 0.0, 0.0, 0.0);
+  }
+  batch.vertex_offsets.push_back(batch.x.size());
+}
+bool is_numeric_format(const char *format) {
+  return std::strlen(format) == 1 && std::strchr("cCsSiIlLfg", format[0]);
+}
+bool is_string_format(const char *format) {
+  return std::strcmp(format, "u") == 0 || std::strcmp(format, "U") == 0;
+}
+bool is_binary_format(const char *format) {
+  return std::strcmp(format, "z") == 0 || std::strcmp(format, "Z") == 0;
+}
+bool is_valid(const ArrowArray *array, int64_t i) {
+  const uint8_t *validity = static_cast<const uint8_t *>(array->buffers[0]);
+  return !validity || (validity[i >> 3] >> (i & 7)) & 1;
+}
+template <typename T>
+T read_numeric(const char *format, const ArrowArray *array, int64_t i) {
+  if (!is_valid(array, i)) {
+    return T{};
+  }
+  switch (format[0]) {
+  case 'c':
+    return static_cast<T>(static_cast<const int8_t *>(array->buffers[1])[i]);
+  case 'C':
+    return static_cast<T>(static_cast<const uint8_t *>(array->buffers[1])[i]);
+  case 's':
+    return static_cast<T>(static_cast<const int16_t *>(array->buffers[1])[i]);
+  case 'S':
+    return static_cast<T>(static_cast<const uint16_t *>(array->buffers[1])[i]);
+  case 'i':
+    return static_cast<T>(static_cast<const int32_t *>(array->buffers[1])[i]);
+  case 'I':
+    return static_cast<T>(static_cast<const uint32_t *>(array->buffers[1])[i]);
+  case 'l':
+    return static_cast<T>(static_cast<const int64_t *>(array->buffers[1])[i]);
+  case 'L':
+    return static_cast<T>(static_cast<const uint64_t *>(array->buffers[1])[i]);
+  case 'f':
+    return static_cast<T>(static_cast<const float *>(array->buffers[1])[i]);
+  case 'g':
+    return static_cast<T>(static_cast<const double *>(array->buffers[1])[i]);
+  default:
+    return T{};
+  }
+}
+/**
+ * @brief Get the byte range of a value in a variable length (string or binary)
+ * Arrow array.
+ */
+void variable_value(const char *format, const ArrowArray *array, int64_t i,
+                    const uint8_t *&data, size_t &size) {
+  data = static_cast<const uint8_t *>(array->buffers[2]);
+  size = 0;
+  if (!is_valid(array, i)) {
+    return;
+  }
+  int64_t begin, end;
+  if (format[0] == 'U' || format[0] == 'Z') {
+    const int64_t *offsets = static_cast<const int64_t *>(array->buffers[1]);
+    begin = offsets[i];
+    end = offsets[i + 1];
+  } else {
+    const int32_t *offsets = static_cast<const int32_t *>(array->buffers[1]);
+    begin = offsets[i];
+    end = offsets[i + 1];
+  }
+  data += begin;
+  size = static_cast<size_t>(end - begin);
+}
+#endif
+} // namespace
+
+double FieldColumn::get_as_double(size_t i) const {
+  switch (type) {
+  case FieldType::REAL:
+    return reals[i];
+  case FieldType::INTEGER:
+    return static_cast<double>(integers[i]);
+  case FieldType::STRING:
+    return std::atof(get_as_string(i).c_str());
+  default:
+    return 0.0;
+  }
+}
+std::string FieldColumn::get_as_string(size_t i) const {
+  switch (type) {
+  case FieldType::REAL:
+    return std::to_string(reals[i]);
+  case FieldType::INTEGER:
+    return std::to_string(integers[i]);
+  case FieldType::STRING:
+    return std::string(chars.data() + offsets[i], offsets[i + 1] - offsets[i]);
+  default:
+    return "";
+  }
+}
+const FieldColumn *FeatureBatch::get_column(const std::string &name) const {
+  for (const auto &column : columns) {
+    if (column.name == name) {
+      return column.type == FieldType::UNKNOWN ? nullptr : &column;
+    }
+  }
+  return nullptr;
+}
+
 VectorDataset::VectorDataset(std::string filepath) { open_dataset(filepath); }
 VectorDataset::~VectorDataset() { GDALClose(dataset); }
 void VectorDataset::open_dataset(std::string filepath) {
   if (dataset) {
     GDALClose(dataset);
   }
+  this->filepath = filepath;
   dataset = static_cast<GDALDataset *>(
       GDALOpenEx(filepath.c_str(), GDAL_OF_VECTOR, NULL, NULL, NULL));
   if (dataset == nullptr) {
@@ -54,18 +503,7 @@ GeometryType VectorDataset::get_layer_geometry_type(std::string layer_name) {
     OGRLayer *layer;
     layer = dataset->GetLayerByName(layer_name.c_str());
     if (layer) {
-      OGRwkbGeometryType wkb_type = wkbFlatten(layer->GetGeomType());
-      switch (wkb_type) {
-      case wkbPoint:
-        geo_type = GeometryType::POINT;
-        break;
-      case wkbLineString:
-        geo_type = GeometryType::POLYLINE;
-        break;
-      default:
-        geo_type = GeometryType::UNKNOWN;
-        break;
-      }
+      geo_type = to_geometry_type(layer->GetGeomType());
     }
   }
   return geo_type;
@@ -144,6 +582,384 @@ std::string VectorDataset::get_field_as_string(std::string layer_name,
   }
   return result;
 }
+FeatureBatch VectorDataset::read_features(std::string layer_name,
+                                          std::vector<std::string> field_names) {
+  FeatureBatch batch{};
+  if (!dataset) {
+    return batch;
+  }
+  OGRLayer *layer = dataset->GetLayerByName(layer_name.c_str());
+  if (!layer) {
+    return batch;
+  }
+  batch.geometry_type = to_geometry_type(layer->GetGeomType());
+  if (batch.geometry_type == GeometryType::UNKNOWN) {
+    return batch;
+  }
+  batch.columns = make_columns(layer, field_names);
+  ArrowStreamReader arrow_reader(layer);
+  if (arrow_reader.is_fast() && arrow_reader.read(batch)) {
+    return batch;
+  }
+  // only reserve when the driver can count without a scan of its own
+  if (layer->TestCapability(OLCFastFeatureCount)) {
+    reserve_batch(batch, layer->GetFeatureCount());
+  }
+  layer->ResetReading();
+  OGRFeature *feature;
+  while ((feature = layer->GetNextFeature()) != nullptr) {
+    append_feature(batch, feature);
+    OGRFeature::DestroyFeature(feature);
+  }
+  return batch;
+}
+FeatureBatch
+VectorDataset::read_features_parallel(std::string layer_name,
+                                      std::vector<std::string> field_names,
+                                      unsigned int thread_count) {
+  // features per worker below which a thread is not worth its dataset handle
+  const int64_t min_features_per_thread = 8192;
+  if (!dataset) {
+    return FeatureBatch{};
+  }
+  OGRLayer *layer = dataset->GetLayerByName(layer_name.c_str());
+  if (!layer || !layer->TestCapability(OLCFastSetNextByIndex) ||
+      ArrowStreamReader(layer).is_fast()) {
+    return read_features(layer_name, field_names);
+  }
+  if (thread_count == 0) {
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+  int64_t feature_count = layer->GetFeatureCount();
+  int64_t workers = std::min(static_cast<int64_t>(thread_count),
+                             feature_count / min_features_per_thread);
+  int64_t first_fid = 0;
+  if (workers <= 1 || !has_dense_fids(layer, feature_count, first_fid)) {
+    return read_features(layer_name, field_names);
+  }
+  std::vector<FeatureBatch> partials(workers);
+  std::vector<char> succeeded(workers, 0);
+  std::vector<std::thread> threads{};
+  for (int64_t w = 0; w < workers; w++) {
+    int64_t begin = feature_count * w / workers;
+    int64_t end = feature_count * (w + 1) / workers;
+    threads.emplace_back([&, w, begin, end]() {
+      GDALDataset *handle = static_cast<GDALDataset *>(
+          GDALOpenEx(filepath.c_str(), GDAL_OF_VECTOR | GDAL_OF_READONLY, NULL,
+                     NULL, NULL));
+      if (!handle) {
+        return;
+      }
+      OGRLayer *worker_layer = handle->GetLayerByName(layer_name.c_str());
+      if (worker_layer) {
+        FeatureBatch &batch = partials[w];
+        batch.geometry_type = to_geometry_type(worker_layer->GetGeomType());
+        batch.columns = make_columns(worker_layer, field_names);
+        reserve_batch(batch, end - begin);
+        worker_layer->ResetReading();
+        if (worker_layer->SetNextByIndex(begin) == OGRERR_NONE) {
+          OGRFeature *feature;
+          for (int64_t i = begin; i < end; i++) {
+            if ((feature = worker_layer->GetNextFeature()) == nullptr) {
+              break;
+            }
+            append_feature(batch, feature);
+            OGRFeature::DestroyFeature(feature);
+          }
+          // with dense FIDs each range is exactly its own FIDs
+          succeeded[w] = batch.size() == static_cast<size_t>(end - begin) &&
+                         batch.fids.front() == first_fid + begin &&
+                         batch.fids.back() == first_fid + end - 1;
+        }
+      }
+      GDALClose(handle);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (std::find(succeeded.begin(), succeeded.end(), 0) != succeeded.end()) {
+    // a worker could not read its range, read the layer on this thread instead
+    return read_features(layer_name, field_names);
+  }
+  // merge in range order so the result matches a sequential read
+  FeatureBatch batch = std::move(partials[0]);
+  for (int64_t w = 1; w < workers; w++) {
+    append_batch(batch, std::move(partials[w]));
+  }
+  return batch;
+}
+
+ArrowStreamReader::ArrowStreamReader(OGRLayer *layer) : layer(layer) {}
+bool ArrowStreamReader::is_fast() {
+#ifdef GDAL_HAS_ARROW_STREAM
+  return layer && layer->TestCapability(OLCFastGetArrowStream);
+#else
+  return false;
+#endif
+}
+bool ArrowStreamReader::read(FeatureBatch &batch) {
+#ifdef GDAL_HAS_ARROW_STREAM
+  if (!layer) {
+    return false;
+  }
+  struct ArrowArrayStream stream;
+  char **options = CSLSetNameValue(nullptr, "INCLUDE_FID", "YES");
+  layer->ResetReading();
+  bool opened = layer->GetArrowStream(&stream, options);
+  CSLDestroy(options);
+  if (!opened) {
+    return false;
+  }
+  struct ArrowSchema schema;
+  if (stream.get_schema(&stream, &schema) != 0) {
+    stream.release(&stream);
+    return false;
+  }
+  std::string fid_name = layer->GetFIDColumn();
+  if (fid_name.empty()) {
+    fid_name = "OGC_FID";
+  }
+  std::string geometry_name = layer->GetGeometryColumn();
+  if (geometry_name.empty()) {
+    geometry_name = "wkb_geometry";
+  }
+  // resolve each column of the batch to a child of the record batch schema
+  int64_t fid_child = -1;
+  int64_t geometry_child = -1;
+  std::vector<int64_t> column_children(batch.columns.size(), -1);
+  std::vector<const char *> column_formats(batch.columns.size(), nullptr);
+  bool supported = true;
+  for (int64_t i = 0; i < schema.n_children; i++) {
+    const ArrowSchema *child = schema.children[i];
+    if (fid_name == child->name && is_numeric_format(child->format)) {
+      fid_child = i;
+    } else if (geometry_name == child->name &&
+               is_binary_format(child->format)) {
+      geometry_child = i;
+    }
+    for (size_t c = 0; c < batch.columns.size(); c++) {
+      if (batch.columns[c].name == child->name) {
+        column_children[c] = i;
+        column_formats[c] = child->format;
+        if (batch.columns[c].type == FieldType::STRING) {
+          supported = supported && is_string_format(child->format);
+        } else {
+          supported = supported && is_numeric_format(child->format);
+        }
+      }
+    }
+  }
+  for (size_t c = 0; c < batch.columns.size(); c++) {
+    if (batch.columns[c].type != FieldType::UNKNOWN && column_children[c] < 0) {
+      supported = false;
+    }
+  }
+  if (!supported || geometry_child < 0) {
+    schema.release(&schema);
+    stream.release(&stream);
+    return false;
+  }
+  const char *fid_format =
+      fid_child >= 0 ? schema.children[fid_child]->format : nullptr;
+  const char *geometry_format = schema.children[geometry_child]->format;
+  // read into a copy so a stream that breaks partway leaves batch untouched
+  FeatureBatch read_batch = batch;
+  // reserve once up front, reserving the exact size of every batch would copy
+  // the whole batch each time instead of growing it geometrically
+  if (layer->TestCapability(OLCFastFeatureCount)) {
+    reserve_batch(read_batch, static_cast<int64_t>(read_batch.size()) +
+                                  layer->GetFeatureCount());
+  }
+  bool failed = false;
+  struct ArrowArray array;
+  while (true) {
+    if (stream.get_next(&stream, &array) != 0) {
+      failed = true;
+      break;
+    }
+    if (!array.release) {
+      // the end of the stream
+      break;
+    }
+    int64_t length = array.length;
+    const ArrowArray *geometries = array.children[geometry_child];
+    for (int64_t i = 0; i < length; i++) {
+      if (fid_format) {
+        const ArrowArray *fids = array.children[fid_child];
+        read_batch.fids.push_back(
+            read_numeric<int64_t>(fid_format, fids, fids->offset + i));
+      } else {
+        read_batch.fids.push_back(
+            static_cast<int64_t>(read_batch.fids.size()));
+      }
+      const uint8_t *wkb;
+      size_t wkb_size;
+      variable_value(geometry_format, geometries, geometries->offset + i, wkb,
+                     wkb_size);
+      append_wkb_geometry(read_batch, wkb, wkb_size);
+    }
+    for (size_t c = 0; c < read_batch.columns.size(); c++) {
+      FieldColumn &column = read_batch.columns[c];
+      if (column.type == FieldType::UNKNOWN) {
+        continue;
+      }
+      const ArrowArray *values = array.children[column_children[c]];
+      const char *format = column_formats[c];
+      for (int64_t i = 0; i < length; i++) {
+        int64_t k = values->offset + i;
+        if (column.type == FieldType::REAL) {
+          column.reals.push_back(read_numeric<double>(format, values, k));
+        } else if (column.type == FieldType::INTEGER) {
+          column.integers.push_back(read_numeric<int64_t>(format, values, k));
+        } else {
+          const uint8_t *str;
+          size_t str_size;
+          variable_value(format, values, k, str, str_size);
+          column.chars.insert(column.chars.end(), str, str + str_size);
+          column.offsets.push_back(column.chars.size());
+        }
+      }
+    }
+    array.release(&array);
+  }
+  schema.release(&schema);
+  stream.release(&stream);
+  if (failed) {
+    return false;
+  }
+  batch = std::move(read_batch);
+  return true;
+#else
+  return false;
+#endif
+}
+
+MappedRasterBand::MappedRasterBand(CPLVirtualMem *memory, GDALDataType type,
+                                   int pixel_space, GIntBig line_space,
+                                   int cols, int rows, float no_data_value)
+    : memory(memory), type(type), pixel_space(pixel_space),
+      line_space(line_space), cols(cols), rows(rows),
+      no_data_value(no_data_value) {
+  base = static_cast<const unsigned char *>(CPLVirtualMemGetAddr(memory));
+}
+MappedRasterBand::MappedRasterBand(std::string filepath, uint64_t offset,
+                                   GDALDataType type, int pixel_space,
+                                   GIntBig line_space, int cols, int rows,
+                                   float no_data_value)
+    : type(type), pixel_space(pixel_space), line_space(line_space), cols(cols),
+      rows(rows), no_data_value(no_data_value) {
+  if (cols <= 0 || rows <= 0 || pixel_space <= 0 || line_space <= 0) {
+    return;
+  }
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  LARGE_INTEGER file_size;
+  HANDLE mapping = GetFileSizeEx(file, &file_size)
+                       ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0,
+                                            NULL)
+                       : NULL;
+  void *mapped = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)
+                         : nullptr;
+  if (!mapped) {
+    if (mapping) {
+      CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    return;
+  }
+  file_handle = file;
+  mapping_handle = mapping;
+  view_size = static_cast<size_t>(file_size.QuadPart);
+#else
+  int fd = open(filepath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+  void *mapped =
+      mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED,
+           fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return;
+  }
+  view_size = static_cast<size_t>(st.st_size);
+#endif
+  view = static_cast<const unsigned char *>(mapped);
+  // the last pixel of the band has to lie inside the file
+  uint64_t last = offset + static_cast<uint64_t>(rows - 1) * line_space +
+                  static_cast<uint64_t>(cols - 1) * pixel_space +
+                  GDALGetDataTypeSizeBytes(type);
+  if (last <= view_size) {
+    base = view + offset;
+  }
+}
+MappedRasterBand::~MappedRasterBand() {
+  if (memory) {
+    CPLVirtualMemFree(memory);
+  }
+  if (!view) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(view);
+  CloseHandle(static_cast<HANDLE>(mapping_handle));
+  CloseHandle(static_cast<HANDLE>(file_handle));
+#else
+  munmap(const_cast<unsigned char *>(view), view_size);
+#endif
+}
+float MappedRasterBand::get(int col, int row) const {
+  if (col < 0 || col >= cols || row < 0 || row >= rows) {
+    return no_data_value;
+  }
+  const unsigned char *pixel = base + row * line_space + col * pixel_space;
+  switch (type) {
+  case GDT_Byte:
+    return *pixel;
+  case GDT_UInt16: {
+    uint16_t value;
+    std::memcpy(&value, pixel, sizeof(value));
+    return value;
+  }
+  case GDT_Int16: {
+    int16_t value;
+    std::memcpy(&value, pixel, sizeof(value));
+    return value;
+  }
+  case GDT_UInt32: {
+    uint32_t value;
+    std::memcpy(&value, pixel, sizeof(value));
+    return static_cast<float>(value);
+  }
+  case GDT_Int32: {
+    int32_t value;
+    std::memcpy(&value, pixel, sizeof(value));
+    return static_cast<float>(value);
+  }
+  case GDT_Float32: {
+    float value;
+    std::memcpy(&value, pixel, sizeof(value));
+    return value;
+  }
+  case GDT_Float64: {
+    double value;
+    std::memcpy(&value, pixel, sizeof(value));
+    return static_cast<float>(value);
+  }
+  default:
+    return no_data_value;
+  }
+}
 
 RasterDataset::RasterDataset(std::string filepath) { open_dataset(filepath); }
 RasterDataset::~RasterDataset() { GDALClose(dataset); }
@@ -151,6 +967,8 @@ void RasterDataset::open_dataset(std::string filepath) {
   if (dataset) {
     GDALClose(dataset);
   }
+  block_cache.clear();
+  this->filepath = filepath;
   dataset = static_cast<GDALDataset *>(GDALOpen(filepath.c_str(), GA_ReadOnly));
   if (dataset == nullptr) {
     std::cerr << "Error: Could not open raster dataset: " << filepath
@@ -185,90 +1003,423 @@ glm::dvec2 RasterDataset::get_top_left_coord() {
   }
   return top_left;
 }
+std::string RasterDataset::get_projection() {
+  if (dataset && dataset->GetProjectionRef()) {
+    return dataset->GetProjectionRef();
+  }
+  return "";
+}
+double RasterDataset::get_vertical_unit(int band) {
+  GDALRasterBand *raster_band = get_band(band, 0);
+  if (raster_band && raster_band->GetUnitType()) {
+    double unit = metres_per_unit(raster_band->GetUnitType());
+    if (unit > 0.0) {
+      return unit;
+    }
+  }
+  std::string projection = get_projection();
+  OGRSpatialReference srs;
+  if (projection.empty() ||
+      srs.importFromWkt(projection.c_str()) != OGRERR_NONE) {
+    return 1.0;
+  }
+  if (srs.IsCompound() || srs.IsVertical()) {
+    return srs.GetTargetLinearUnits("VERT_CS");
+  }
+  if (srs.IsProjected()) {
+    return srs.GetLinearUnits();
+  }
+  return 1.0;
+}
 std::vector<float> RasterDataset::read_floats(int band, int x0, int xf, int y0,
                                               int yf, int n, int m,
                                               float offset) {
-  // calculate out of bounds offset
-  int u = -std::min(x0, 0);
-  int v = -std::min(y0, 0);
-  // calc resolution scale
-  int sx = (xf - x0 + 1) / n;
-  int sy = (yf - y0 + 1) / m;
-  // clamp row and column to raster bounds
-  x0 = glm::clamp(x0, 0, get_cols() - 1);
-  xf = glm::clamp(xf, 0, get_cols() - 1);
-  y0 = glm::clamp(y0, 0, get_rows() - 1);
-  yf = glm::clamp(yf, 0, get_rows() - 1);
-  int cols = xf - x0 + 1;
-  int rows = yf - y0 + 1;
-  int read_n = cols / sx;
-  int read_m = rows / sy;
-  GDALRasterBand *raster_band = dataset->GetRasterBand(band);
-  float no_data_value = raster_band->GetNoDataValue();
-  float *data;
-  data = (float *)CPLMalloc(sizeof(float) * read_n * read_m);
-  auto err = raster_band->RasterIO(GF_Read, x0, y0, cols, rows, data, read_n,
-                                   read_m, GDT_Float32, 0, 0);
-  std::vector<float> data_vec{};
-  int k = 0;
-  for (int j = 0; j < m; j++) {
-    for (int i = 0; i < n; i++) {
-      if ((i >= u) && (i < read_n + u) && (j >= v) && (j < read_m + v)) {
-        data_vec.push_back(data[k] - offset);
-        k++;
-      } else {
-        data_vec.push_back(no_data_value);
-      }
-    }
-  }
-  CPLFree(data);
+  std::vector<float> data_vec(static_cast<size_t>(n) * m);
+  read_floats(band, x0, xf, y0, yf, n, m, data_vec.data(), n, offset);
   return data_vec;
 }
 std::vector<unsigned char> RasterDataset::read_bytes(int band, int x0, int xf,
                                                      int y0, int yf, int n,
                                                      int m) {
-  // calculate out of bounds offset
-  int u = -std::min(x0, 0);
-  int v = -std::min(y0, 0);
-  // calc resolution scale
-  int sx = (xf - x0 + 1) / n;
-  int sy = (yf - y0 + 1) / m;
-  // clamp row and column to raster bounds
-  x0 = glm::clamp(x0, 0, get_cols() - 1);
-  xf = glm::clamp(xf, 0, get_cols() - 1);
-  y0 = glm::clamp(y0, 0, get_rows() - 1);
-  yf = glm::clamp(yf, 0, get_rows() - 1);
-  int cols = xf - x0 + 1;
-  int rows = yf - y0 + 1;
-  int read_n = cols / sx;
-  int read_m = rows / sy;
-  GDALRasterBand *raster_band = dataset->GetRasterBand(band);
-  unsigned char no_data_value = raster_band->GetNoDataValue();
-  unsigned char *data;
-  data = (unsigned char *)CPLMalloc(sizeof(unsigned char) * read_n * read_m);
-  auto err = raster_band->RasterIO(GF_Read, x0, y0, cols, rows, data, read_n,
-                                   read_m, GDT_Byte, 0, 0);
-  std::vector<unsigned char> data_vec{};
-  int k = 0;
-  for (int j = 0; j < m; j++) {
-    for (int i = 0; i < n; i++) {
-      if ((i >= u) && (i < read_n + u) && (j >= v) && (j < read_m + v)) {
-        data_vec.push_back(data[k]);
-        k++;
-      } else {
-        data_vec.push_back(no_data_value);
+  std::vector<unsigned char> data_vec(static_cast<size_t>(n) * m);
+  read_bytes(band, x0, xf, y0, yf, n, m, data_vec.data(), n);
+  return data_vec;
+}
+bool RasterDataset::read_floats(int band, int x0, int xf, int y0, int yf,
+                                int n, int m, float *dst, int64_t line_stride,
+                                float offset) {
+  WindowRead read = clamp_window(get_cols(), get_rows(), x0, xf, y0, yf, n, m);
+  GDALRasterBand *raster_band = get_band(band, 0);
+  if (!raster_band) {
+    return false;
+  }
+  float no_data_value = raster_band->GetNoDataValue();
+  fill_outside_window(dst, line_stride, n, m, read, no_data_value);
+  if (read.read_n <= 0 || read.read_m <= 0) {
+    return true;
+  }
+  raster_band =
+      get_read_band(band,
+                    select_overview_level(band, read.cols, read.rows,
+                                          read.read_n, read.read_m),
+                    read.x0, read.y0, read.cols, read.rows);
+  float *origin = dst + read.v * line_stride + read.u;
+  auto err = raster_band->RasterIO(
+      GF_Read, read.x0, read.y0, read.cols, read.rows, origin, read.read_n,
+      read.read_m, GDT_Float32, sizeof(float), line_stride * sizeof(float));
+  if (offset != 0.0f) {
+    for (int j = 0; j < read.read_m; j++) {
+      float *row = origin + j * line_stride;
+      for (int i = 0; i < read.read_n; i++) {
+        row[i] -= offset;
       }
     }
   }
-  CPLFree(data);
+  return err == CE_None;
+}
+bool RasterDataset::read_bytes(int band, int x0, int xf, int y0, int yf, int n,
+                               int m, unsigned char *dst,
+                               int64_t line_stride) {
+  WindowRead read = clamp_window(get_cols(), get_rows(), x0, xf, y0, yf, n, m);
+  GDALRasterBand *raster_band = get_band(band, 0);
+  if (!raster_band) {
+    return false;
+  }
+  unsigned char no_data_value = raster_band->GetNoDataValue();
+  fill_outside_window(dst, line_stride, n, m, read, no_data_value);
+  if (read.read_n <= 0 || read.read_m <= 0) {
+    return true;
+  }
+  raster_band =
+      get_read_band(band,
+                    select_overview_level(band, read.cols, read.rows,
+                                          read.read_n, read.read_m),
+                    read.x0, read.y0, read.cols, read.rows);
+  unsigned char *origin = dst + read.v * line_stride + read.u;
+  auto err = raster_band->RasterIO(GF_Read, read.x0, read.y0, read.cols,
+                                   read.rows, origin, read.read_n, read.read_m,
+                                   GDT_Byte, 1, line_stride);
+  return err == CE_None;
+}
+std::vector<uint32_t> RasterDataset::read_rgba8(int x0, int xf, int y0, int yf,
+                                                int n, int m) {
+  std::vector<uint32_t> data_vec(static_cast<size_t>(n) * m);
+  read_rgba8(x0, xf, y0, yf, n, m, data_vec.data(), n);
   return data_vec;
 }
+bool RasterDataset::read_rgba8(int x0, int xf, int y0, int yf, int n, int m,
+                               uint32_t *dst, int64_t line_stride) {
+  WindowRead read = clamp_window(get_cols(), get_rows(), x0, xf, y0, yf, n, m);
+  fill_outside_window(dst, line_stride, n, m, read, uint32_t(0));
+  if (!dataset || dataset->GetRasterCount() < 1) {
+    return false;
+  }
+  if (read.read_n <= 0 || read.read_m <= 0) {
+    return true;
+  }
+  int band_count = std::min(dataset->GetRasterCount(), 4);
+  int band_map[4] = {1, 2, 3, 4};
+  if (band_count < 3) {
+    // gray
+    band_map[1] = 1;
+    band_map[2] = 1;
+    band_count = 3;
+  }
+  int level = select_overview_level(1, read.cols, read.rows, read.read_n,
+                                    read.read_m);
+  uint32_t *origin = dst + read.v * line_stride + read.u;
+  if (band_count == 3) {
+    // opaque alpha, RasterIO only writes the first three bytes of each pixel
+    for (int j = 0; j < read.read_m; j++) {
+      uint32_t *row = origin + j * line_stride;
+      std::fill(row, row + read.read_n, 0u);
+      for (int i = 0; i < read.read_n; i++) {
+        reinterpret_cast<unsigned char *>(row + i)[3] = 255;
+      }
+    }
+  }
+  if (level > 0) {
+    // interleave the overview bands one at a time
+    bool ok = true;
+    unsigned char *bytes = reinterpret_cast<unsigned char *>(origin);
+    for (int b = 0; b < band_count; b++) {
+      int x = read.x0, y = read.y0, cols = read.cols, rows = read.rows;
+      GDALRasterBand *raster_band =
+          get_read_band(band_map[b], level, x, y, cols, rows);
+      ok = ok && raster_band &&
+           raster_band->RasterIO(GF_Read, x, y, cols, rows, bytes + b,
+                                 read.read_n, read.read_m, GDT_Byte,
+                                 sizeof(uint32_t),
+                                 line_stride * sizeof(uint32_t)) == CE_None;
+    }
+    return ok;
+  }
+  auto err = dataset->RasterIO(GF_Read, read.x0, read.y0, read.cols, read.rows,
+                               origin, read.read_n, read.read_m, GDT_Byte,
+                               band_count, band_map, sizeof(uint32_t),
+                               line_stride * sizeof(uint32_t), 1);
+  return err == CE_None;
+}
 
 float RasterDataset::get_no_data_float(int band) {
   GDALRasterBand *raster_band = dataset->GetRasterBand(band);
   return raster_band->GetNoDataValue();
 }
+GDALRasterBand *RasterDataset::get_band(int band, int level) {
+  if (!dataset || band < 1 || band > dataset->GetRasterCount()) {
+    return nullptr;
+  }
+  GDALRasterBand *raster_band = dataset->GetRasterBand(band);
+  if (level > 0) {
+    if (level > raster_band->GetOverviewCount()) {
+      return nullptr;
+    }
+    return raster_band->GetOverview(level - 1);
+  }
+  return raster_band;
+}
+glm::ivec2 RasterDataset::get_block_size(int band, int level) {
+  glm::ivec2 block_size{};
+  if (GDALRasterBand *raster_band = get_band(band, level)) {
+    raster_band->GetBlockSize(&block_size.x, &block_size.y);
+  }
+  return block_size;
+}
+std::shared_ptr<const RasterBlock>
+RasterDataset::read_block(int band, int block_x, int block_y, int level) {
+  BlockKey key{band, level, block_x, block_y};
+  if (auto cached = block_cache.get(key)) {
+    return cached;
+  }
+  // the dataset handle is shared, so misses are decoded one at a time
+  std::lock_guard<std::mutex> lock(block_read_mutex);
+  if (auto cached = block_cache.get(key)) {
+    // another thread decoded it while this one waited
+    return cached;
+  }
+  GDALRasterBand *raster_band = get_band(band, level);
+  if (!raster_band) {
+    return nullptr;
+  }
+  int block_w, block_h;
+  raster_band->GetBlockSize(&block_w, &block_h);
+  int x0 = block_x * block_w;
+  int y0 = block_y * block_h;
+  if (block_x < 0 || block_y < 0 || x0 >= raster_band->GetXSize() ||
+      y0 >= raster_band->GetYSize()) {
+    return nullptr;
+  }
+  auto block = std::make_shared<RasterBlock>();
+  // edge blocks only cover the part of the band that exists
+  block->width = std::min(block_w, raster_band->GetXSize() - x0);
+  block->height = std::min(block_h, raster_band->GetYSize() - y0);
+  block->data.resize(static_cast<size_t>(block->width) * block->height);
+  auto err = raster_band->RasterIO(GF_Read, x0, y0, block->width,
+                                   block->height, block->data.data(),
+                                   block->width, block->height, GDT_Float32,
+                                   0, 0);
+  if (err != CE_None) {
+    return nullptr;
+  }
+  block_cache.put(key, block);
+  return block;
+}
+std::vector<float> RasterDataset::read_floats_cached(int band, int x0, int xf,
+                                                     int y0, int yf, int level,
+                                                     float offset) {
+  int n = xf - x0 + 1;
+  int m = yf - y0 + 1;
+  float no_data_value;
+  int block_w, block_h, band_cols, band_rows;
+  {
+    std::lock_guard<std::mutex> lock(block_read_mutex);
+    GDALRasterBand *raster_band = get_band(band, level);
+    if (!raster_band || n <= 0 || m <= 0) {
+      return {};
+    }
+    no_data_value = raster_band->GetNoDataValue();
+    raster_band->GetBlockSize(&block_w, &block_h);
+    band_cols = raster_band->GetXSize();
+    band_rows = raster_band->GetYSize();
+  }
+  std::vector<float> data_vec(static_cast<size_t>(n) * m, no_data_value);
+  // clamp the window to the band
+  int cx0 = std::max(x0, 0);
+  int cy0 = std::max(y0, 0);
+  int cxf = std::min(xf, band_cols - 1);
+  int cyf = std::min(yf, band_rows - 1);
+  if (cx0 > cxf || cy0 > cyf) {
+    return data_vec;
+  }
+  for (int by = cy0 / block_h; by <= cyf / block_h; by++) {
+    for (int bx = cx0 / block_w; bx <= cxf / block_w; bx++) {
+      auto block = read_block(band, bx, by, level);
+      if (!block) {
+        continue;
+      }
+      // intersection of the block and the window in band pixels
+      int ix0 = std::max(cx0, bx * block_w);
+      int ixf = std::min(cxf, bx * block_w + block->width - 1);
+      int iy0 = std::max(cy0, by * block_h);
+      int iyf = std::min(cyf, by * block_h + block->height - 1);
+      for (int y = iy0; y <= iyf; y++) {
+        const float *src = &block->data[static_cast<size_t>(y - by * block_h) *
+                                            block->width +
+                                        (ix0 - bx * block_w)];
+        float *dst = &data_vec[static_cast<size_t>(y - y0) * n + (ix0 - x0)];
+        for (int x = 0; x <= ixf - ix0; x++) {
+          dst[x] = src[x] - offset;
+        }
+      }
+    }
+  }
+  return data_vec;
+}
+int RasterDataset::get_overview_count(int band) {
+  GDALRasterBand *raster_band = get_band(band, 0);
+  return raster_band ? raster_band->GetOverviewCount() : 0;
+}
+int RasterDataset::select_overview_level(int band, int cols, int rows, int n,
+                                         int m) {
+  GDALRasterBand *raster_band = get_band(band, 0);
+  if (!raster_band || (n >= cols && m >= rows)) {
+    return 0;
+  }
+  double full_cols = raster_band->GetXSize();
+  double full_rows = raster_band->GetYSize();
+  // overviews are ordered from finest to coarsest
+  for (int level = raster_band->GetOverviewCount(); level > 0; level--) {
+    GDALRasterBand *overview = raster_band->GetOverview(level - 1);
+    if (!overview) {
+      continue;
+    }
+    double ov_cols = cols * overview->GetXSize() / full_cols;
+    double ov_rows = rows * overview->GetYSize() / full_rows;
+    if (ov_cols >= n && ov_rows >= m) {
+      return level;
+    }
+  }
+  return 0;
+}
+GDALRasterBand *RasterDataset::get_read_band(int band, int level, int &x0,
+                                             int &y0, int &cols, int &rows) {
+  GDALRasterBand *raster_band = get_band(band, 0);
+  GDALRasterBand *overview = get_band(band, level);
+  if (level == 0 || !overview) {
+    return raster_band;
+  }
+  // map the full resolution window onto the overview grid
+  double sx = static_cast<double>(overview->GetXSize()) / raster_band->GetXSize();
+  double sy = static_cast<double>(overview->GetYSize()) / raster_band->GetYSize();
+  int ox0 = static_cast<int>(std::floor(x0 * sx));
+  int oy0 = static_cast<int>(std::floor(y0 * sy));
+  int oxf = static_cast<int>(std::ceil((x0 + cols) * sx));
+  int oyf = static_cast<int>(std::ceil((y0 + rows) * sy));
+  x0 = std::min(ox0, overview->GetXSize() - 1);
+  y0 = std::min(oy0, overview->GetYSize() - 1);
+  cols = std::max(std::min(oxf, overview->GetXSize()) - x0, 1);
+  rows = std::max(std::min(oyf, overview->GetYSize()) - y0, 1);
+  return overview;
+}
+std::future<bool> RasterDataset::build_overviews_async(std::string resampling) {
+  int cols = get_cols();
+  int rows = get_rows();
+  bool has_overviews = get_overview_count(1) > 0;
+  std::string path = filepath;
+  return std::async(std::launch::async, [=]() {
+    if (has_overviews) {
+      return true;
+    }
+    if (path.empty() || cols <= 0 || rows <= 0) {
+      return false;
+    }
+    std::vector<int> factors{};
+    for (int factor = 2; std::max(cols, rows) / (factor / 2) > 256;
+         factor *= 2) {
+      factors.push_back(factor);
+    }
+    if (factors.empty()) {
+      return true;
+    }
+    // opened read-only so GDAL writes the overviews to a sidecar .ovr file
+    GDALDataset *handle =
+        static_cast<GDALDataset *>(GDALOpen(path.c_str(), GA_ReadOnly));
+    if (!handle) {
+      return false;
+    }
+    auto err = handle->BuildOverviews(
+        resampling.c_str(), static_cast<int>(factors.size()), factors.data(),
+        0, nullptr, GDALDummyProgress, nullptr);
+    GDALClose(handle);
+    return err == CE_None;
+  });
+}
+std::unique_ptr<MappedRasterBand> RasterDataset::map_band(int band) {
+  GDALRasterBand *raster_band = get_band(band, 0);
+  if (!raster_band) {
+    return nullptr;
+  }
+  float no_data_value = static_cast<float>(raster_band->GetNoDataValue());
+#ifdef GDAL_HAS_RAW_LAYOUT
+  // map a raw band file directly, which works on every platform
+  GDALDataset::RawBinaryLayout layout;
+  const uint16_t byte_order = 1;
+  bool little_endian = *reinterpret_cast<const uint8_t *>(&byte_order) == 1;
+  if (dataset->GetRawBinaryLayout(layout) &&
+      layout.bLittleEndianOrder == little_endian &&
+      layout.osRawFilename.rfind("/vsi", 0) != 0 && layout.nPixelOffset > 0 &&
+      layout.nLineOffset > 0 && layout.nBandOffset >= 0) {
+    auto mapped = std::make_unique<MappedRasterBand>(
+        layout.osRawFilename,
+        layout.nImageOffset + static_cast<uint64_t>(band - 1) *
+                                  layout.nBandOffset,
+        layout.eDataType, static_cast<int>(layout.nPixelOffset),
+        layout.nLineOffset, raster_band->GetXSize(), raster_band->GetYSize(),
+        no_data_value);
+    if (mapped->is_open()) {
+      return mapped;
+    }
+  }
+#endif
+  // otherwise GDAL pages blocks in on demand, on Linux only
+  int pixel_space = 0;
+  GIntBig line_space = 0;
+  CPLVirtualMem *memory = GDALGetVirtualMemAuto(
+      raster_band, GF_Read, &pixel_space, &line_space, nullptr);
+  if (!memory) {
+    return nullptr;
+  }
+  return std::make_unique<MappedRasterBand>(
+      memory, raster_band->GetRasterDataType(), pixel_space, line_space,
+      raster_band->GetXSize(), raster_band->GetYSize(), no_data_value);
+}
 
+double metres_per_unit(std::string units) {
+  std::transform(units.begin(), units.end(), units.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (units == "m" || units == "metre" || units == "meter" ||
+      units == "metres" || units == "meters") {
+    return 1.0;
+  }
+  if (units == "ft" || units == "foot" || units == "feet" ||
+      units == "international foot") {
+    return 0.3048;
+  }
+  if (units == "us-ft" || units == "ftus" || units == "us survey foot" ||
+      units == "foot_us") {
+    return 1200.0 / 3937.0;
+  }
+  if (units == "in" || units == "inch" || units == "inches") {
+    return 0.0254;
+  }
+  if (units == "cm") {
+    return 0.01;
+  }
+  if (units == "mm") {
+    return 0.001;
+  }
+  return 0.0;
+}
 std::string open_file_dialog(const char *extension) {
   nfdchar_t *filepath = NULL;
   nfdresult_t result = NFD_OpenDialog(extension, NULL, &filepath);
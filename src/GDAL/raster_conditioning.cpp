@@ -0,0 +1,71 @@
+#include "GDAL/raster_conditioning.hpp"
+
+// Standard Library
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace gdal_input {
+RasterChunks::RasterChunks(RasterDataset *dem, RasterWriter *output)
+    : dem(dem), output(output), cols(dem->get_cols()), rows(dem->get_rows()),
+      no_data_value(dem->get_no_data_float(1)) {}
+bool RasterChunks::has_failed() {
+  std::lock_guard<std::mutex> lock(io_mutex);
+  return failed;
+}
+void RasterChunks::read(int col, int row, int width, int height, float *dst) {
+  {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    if (!dem->read_floats(1, col, col + width - 1, row, row + height - 1,
+                          width, height, dst, width)) {
+      failed = true;
+    }
+  }
+  size_t count = static_cast<size_t>(width) * height;
+  for (size_t i = 0; i < count; i++) {
+    if (dst[i] == no_data_value) {
+      dst[i] = std::numeric_limits<float>::quiet_NaN();
+    }
+  }
+}
+void RasterChunks::write(int col, int row, int width, int height,
+                         const float *src) {
+  std::vector<float> window(src, src + static_cast<size_t>(width) * height);
+  for (float &z : window) {
+    if (std::isnan(z)) {
+      z = no_data_value;
+    }
+  }
+  std::lock_guard<std::mutex> lock(io_mutex);
+  if (!output->write_window(col, row, width, height, window.data(),
+                            GDT_Float32)) {
+    failed = true;
+  }
+}
+bool fill_raster_depressions(std::string dem_path, std::string output_path,
+                             int chunk_size, std::string driver) {
+  RasterDataset dem(dem_path);
+  if (dem.get_cols() <= 0 || dem.get_rows() <= 0) {
+    std::cerr << "Error: Could not read DEM: " << dem_path << std::endl;
+    return false;
+  }
+  RasterGeoreference georeference;
+  georeference.top_left = dem.get_top_left_coord();
+  georeference.pixel_scale = dem.get_pixel_scale();
+  georeference.projection = dem.get_projection();
+  RasterWriter output(output_path, dem.get_cols(), dem.get_rows(), GDT_Float32,
+                      georeference, dem.get_no_data_float(1), driver);
+  if (!output.is_open()) {
+    return false;
+  }
+  RasterChunks chunks(&dem, &output);
+  math_3dh::fill_depressions(chunks, chunk_size);
+  if (chunks.has_failed()) {
+    std::cerr << "Error: Could not read the DEM or write the filled DEM: "
+              << output_path << std::endl;
+    return false;
+  }
+  return true;
+}
+} // namespace gdal_input
@@ -0,0 +1,242 @@
+#include "GDAL/raster_mosaic.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace gdal_input {
+namespace {
+/**
+ * @brief Check that a raster has the pixel scale of another and that its
+ * corner falls on a pixel corner of the other, so it covers whole pixels of
+ * the mosaic.
+ */
+bool lines_up(const MosaicTile &first, const MosaicTile &tile) {
+  constexpr double tolerance = 1e-6;
+  glm::dvec2 scale = tile.pixel_scale / first.pixel_scale;
+  glm::dvec2 shift = (tile.top_left - first.top_left) / first.pixel_scale;
+  return std::abs(scale.x - 1.0) < tolerance &&
+         std::abs(scale.y - 1.0) < tolerance &&
+         std::abs(shift.x - std::round(shift.x)) < tolerance &&
+         std::abs(shift.y - std::round(shift.y)) < tolerance;
+}
+} // namespace
+
+RasterMosaic::RasterMosaic(std::vector<std::string> filepaths,
+                           size_t max_open_handles, size_t block_cache_bytes)
+    : max_open_handles(std::max<size_t>(max_open_handles, 1)),
+      handle_cache_bytes(block_cache_bytes /
+                         std::max<size_t>(max_open_handles, 1)) {
+  std::vector<math_3dh::Box2D> bounds{};
+  for (const std::string &filepath : filepaths) {
+    // only the georeferencing is read, the handle is closed right away
+    RasterDataset dataset(filepath);
+    if (dataset.get_cols() == 0 || dataset.get_rows() == 0) {
+      continue;
+    }
+    MosaicTile tile{};
+    tile.filepath = filepath;
+    tile.top_left = dataset.get_top_left_coord();
+    tile.pixel_scale = dataset.get_pixel_scale();
+    tile.cols = dataset.get_cols();
+    tile.rows = dataset.get_rows();
+    tile.no_data_value = dataset.get_no_data_float(1);
+    if (tiles.empty()) {
+      vertical_unit = dataset.get_vertical_unit(1);
+      projection = dataset.get_projection();
+    } else if (!lines_up(tiles[0], tile)) {
+      std::cerr << "Warning: " << filepath
+                << " is skipped, it is not on the pixel grid of "
+                << tiles[0].filepath << "." << std::endl;
+      continue;
+    }
+    tile.bounds.min = {tile.top_left.x,
+                       tile.top_left.y - tile.rows * tile.pixel_scale.y};
+    tile.bounds.max = {tile.top_left.x + tile.cols * tile.pixel_scale.x,
+                       tile.top_left.y};
+    tiles.push_back(tile);
+    bounds.push_back(tile.bounds);
+  }
+  if (tiles.empty()) {
+    std::cerr << "Error: No rasters of the mosaic could be opened."
+              << std::endl;
+    return;
+  }
+  index = math_3dh::RTree(bounds);
+  pixel_scale = tiles[0].pixel_scale;
+  no_data_value = tiles[0].no_data_value;
+  glm::dvec2 bottom_right = {tiles[0].bounds.max.x, tiles[0].bounds.min.y};
+  top_left = {tiles[0].bounds.min.x, tiles[0].bounds.max.y};
+  for (const MosaicTile &tile : tiles) {
+    top_left.x = std::min(top_left.x, tile.bounds.min.x);
+    top_left.y = std::max(top_left.y, tile.bounds.max.y);
+    bottom_right.x = std::max(bottom_right.x, tile.bounds.max.x);
+    bottom_right.y = std::min(bottom_right.y, tile.bounds.min.y);
+  }
+  cols = static_cast<int>(
+      std::ceil((bottom_right.x - top_left.x) / pixel_scale.x - 1e-6));
+  rows = static_cast<int>(
+      std::ceil((top_left.y - bottom_right.y) / pixel_scale.y - 1e-6));
+}
+size_t RasterMosaic::get_open_handle_count() {
+  return open_handles.size();
+}
+std::shared_ptr<RasterDataset> RasterMosaic::acquire(size_t tile) {
+  auto it = open_handles.find(tile);
+  if (it != open_handles.end()) {
+    recently_used.splice(recently_used.begin(), recently_used,
+                         it->second.position);
+    return it->second.dataset;
+  }
+  while (open_handles.size() >= max_open_handles) {
+    // a closed handle still in use by a reader stays alive until released
+    open_handles.erase(recently_used.back());
+    recently_used.pop_back();
+  }
+  auto dataset = std::make_shared<RasterDataset>(tiles[tile].filepath);
+  dataset->set_block_cache_size(handle_cache_bytes);
+  recently_used.push_front(tile);
+  open_handles[tile] = {dataset, recently_used.begin()};
+  return dataset;
+}
+std::vector<size_t> RasterMosaic::find_tiles(const math_3dh::Box2D &bounds) {
+  std::vector<size_t> result{};
+  index.query(bounds, result);
+  // the order of filepaths decides which overlapping raster wins
+  std::sort(result.begin(), result.end());
+  return result;
+}
+float RasterMosaic::get_elevation(glm::dvec2 coord) {
+  for (size_t t : find_tiles({coord, coord})) {
+    const MosaicTile &tile = tiles[t];
+    int x = static_cast<int>(
+        std::floor((coord.x - tile.top_left.x) / tile.pixel_scale.x));
+    int y = static_cast<int>(
+        std::floor((tile.top_left.y - coord.y) / tile.pixel_scale.y));
+    if (x < 0 || x >= tile.cols || y < 0 || y >= tile.rows) {
+      continue;
+    }
+    float value = acquire(t)->read_floats_cached(1, x, x, y, y)[0];
+    if (value != tile.no_data_value && !std::isnan(value)) {
+      return value;
+    }
+  }
+  return std::numeric_limits<float>::quiet_NaN();
+}
+template <typename T, typename Read, typename IsValid>
+bool RasterMosaic::read_window(int x0, int xf, int y0, int yf, int n, int m,
+                               T *dst, int64_t line_stride, T fill, Read read,
+                               IsValid is_valid) {
+  for (int j = 0; j < m; j++) {
+    std::fill(dst + j * line_stride, dst + j * line_stride + n, fill);
+  }
+  std::vector<char> written(static_cast<size_t>(n) * m, 0);
+  double pixels_per_col = static_cast<double>(xf - x0 + 1) / n;
+  double pixels_per_row = static_cast<double>(yf - y0 + 1) / m;
+  math_3dh::Box2D bounds{
+      {top_left.x + x0 * pixel_scale.x, top_left.y - (yf + 1) * pixel_scale.y},
+      {top_left.x + (xf + 1) * pixel_scale.x, top_left.y - y0 * pixel_scale.y}};
+  bool succeeded = true;
+  for (size_t t : find_tiles(bounds)) {
+    const MosaicTile &tile = tiles[t];
+    // the tile in whole mosaic pixels, every tile is on the mosaic's grid
+    int tile_x0 = static_cast<int>(
+        std::round((tile.top_left.x - top_left.x) / pixel_scale.x));
+    int tile_y0 = static_cast<int>(
+        std::round((top_left.y - tile.top_left.y) / pixel_scale.y));
+    // the output pixels whose centers fall on the tile
+    int i0 = std::max(static_cast<int>(std::ceil(
+                          (tile_x0 - x0) / pixels_per_col - 0.5)),
+                      0);
+    int i1 = std::min(static_cast<int>(std::ceil(
+                          (tile_x0 + tile.cols - x0) / pixels_per_col - 0.5)) -
+                          1,
+                      n - 1);
+    int j0 = std::max(static_cast<int>(std::ceil(
+                          (tile_y0 - y0) / pixels_per_row - 0.5)),
+                      0);
+    int j1 = std::min(static_cast<int>(std::ceil(
+                          (tile_y0 + tile.rows - y0) / pixels_per_row - 0.5)) -
+                          1,
+                      m - 1);
+    if (i1 < i0 || j1 < j0) {
+      continue;
+    }
+    // their footprint in pixels of the tile, computed in double and clamped
+    // to the tile so the dataset never shifts a window that runs off it
+    int tx0 = std::max(static_cast<int>(std::floor(
+                           x0 + i0 * pixels_per_col - tile_x0 + 1e-6)),
+                       0);
+    int txf = std::min(static_cast<int>(std::ceil(
+                           x0 + (i1 + 1) * pixels_per_col - tile_x0 - 1e-6)),
+                       tile.cols) -
+              1;
+    int ty0 = std::max(static_cast<int>(std::floor(
+                           y0 + j0 * pixels_per_row - tile_y0 + 1e-6)),
+                       0);
+    int tyf = std::min(static_cast<int>(std::ceil(
+                           y0 + (j1 + 1) * pixels_per_row - tile_y0 - 1e-6)),
+                       tile.rows) -
+              1;
+    int tile_n = i1 - i0 + 1;
+    int tile_m = j1 - j0 + 1;
+    std::vector<T> buffer(static_cast<size_t>(tile_n) * tile_m);
+    std::shared_ptr<RasterDataset> dataset = acquire(t);
+    if (!read(*dataset, tx0, txf, ty0, tyf, tile_n, tile_m, buffer.data())) {
+      succeeded = false;
+      continue;
+    }
+    for (int j = 0; j < tile_m; j++) {
+      for (int i = 0; i < tile_n; i++) {
+        size_t out = static_cast<size_t>(j0 + j) * n + (i0 + i);
+        T value = buffer[static_cast<size_t>(j) * tile_n + i];
+        if (!written[out] && is_valid(tile, value)) {
+          dst[(j0 + j) * line_stride + (i0 + i)] = value;
+          written[out] = 1;
+        }
+      }
+    }
+  }
+  return succeeded;
+}
+bool RasterMosaic::read_floats(int band, int x0, int xf, int y0, int yf, int n,
+                               int m, float *dst, int64_t line_stride) {
+  return read_window<float>(
+      x0, xf, y0, yf, n, m, dst, line_stride, no_data_value,
+      [band](RasterDataset &dataset, int tx0, int txf, int ty0, int tyf,
+             int tile_n, int tile_m, float *buffer) {
+        return dataset.read_floats(band, tx0, txf, ty0, tyf, tile_n, tile_m,
+                                   buffer, tile_n);
+      },
+      [](const MosaicTile &tile, float value) {
+        return value != tile.no_data_value && !std::isnan(value);
+      });
+}
+std::vector<float> RasterMosaic::read_floats(int band, int x0, int xf, int y0,
+                                             int yf, int n, int m) {
+  std::vector<float> result(static_cast<size_t>(n) * m);
+  read_floats(band, x0, xf, y0, yf, n, m, result.data(), n);
+  return result;
+}
+bool RasterMosaic::read_rgba8(int x0, int xf, int y0, int yf, int n, int m,
+                              uint32_t *dst, int64_t line_stride) {
+  return read_window<uint32_t>(
+      x0, xf, y0, yf, n, m, dst, line_stride, 0u,
+      [](RasterDataset &dataset, int tx0, int txf, int ty0, int tyf,
+         int tile_n, int tile_m, uint32_t *buffer) {
+        return dataset.read_rgba8(tx0, txf, ty0, tyf, tile_n, tile_m, buffer,
+                                  tile_n);
+      },
+      [](const MosaicTile &, uint32_t value) {
+        // pixels outside of a tile are transparent
+        return (value >> 24) != 0;
+      });
+}
+std::vector<uint32_t> RasterMosaic::read_rgba8(int x0, int xf, int y0, int yf,
+                                               int n, int m) {
+  std::vector<uint32_t> result(static_cast<size_t>(n) * m);
+  read_rgba8(x0, xf, y0, yf, n, m, result.data(), n);
+  return result;
+}
+} // namespace gdal_input
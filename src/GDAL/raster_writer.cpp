@@ -0,0 +1,79 @@
+#include "GDAL/raster_writer.hpp"
+
+// Standard Library
+#include <iostream>
+
+namespace gdal_input {
+RasterWriter::RasterWriter(std::string filepath, int cols, int rows,
+                           GDALDataType type,
+                           const RasterGeoreference &georeference,
+                           double no_data_value, std::string driver)
+    : cols(cols), rows(rows) {
+  GDALDriver *gdal_driver =
+      GetGDALDriverManager()->GetDriverByName(driver.c_str());
+  if (!gdal_driver) {
+    std::cerr << "Error: No GDAL driver named " << driver << std::endl;
+    return;
+  }
+  char **options = nullptr;
+  if (driver == "GTiff") {
+    options = CSLSetNameValue(options, "TILED", "YES");
+    options = CSLSetNameValue(options, "COMPRESS", "DEFLATE");
+    options = CSLSetNameValue(options, "BIGTIFF", "IF_SAFER");
+  }
+  dataset = gdal_driver->Create(filepath.c_str(), cols, rows, 1, type, options);
+  CSLDestroy(options);
+  if (!dataset) {
+    std::cerr << "Error: Could not create raster dataset: " << filepath
+              << std::endl;
+    return;
+  }
+  double transform[6] = {georeference.top_left.x,
+                         georeference.pixel_scale.x,
+                         0.0,
+                         georeference.top_left.y,
+                         0.0,
+                         -georeference.pixel_scale.y};
+  dataset->SetGeoTransform(transform);
+  if (!georeference.projection.empty()) {
+    dataset->SetProjection(georeference.projection.c_str());
+  }
+  dataset->GetRasterBand(1)->SetNoDataValue(no_data_value);
+}
+RasterWriter::~RasterWriter() {
+  if (dataset) {
+    GDALClose(dataset);
+  }
+}
+bool RasterWriter::write_rows(int first_row, int row_count, const void *src,
+                              GDALDataType type) {
+  if (!dataset || first_row < 0 || first_row + row_count > rows) {
+    return false;
+  }
+  auto err = dataset->GetRasterBand(1)->RasterIO(
+      GF_Write, 0, first_row, cols, row_count, const_cast<void *>(src), cols,
+      row_count, type, 0, 0);
+  if (err != CE_None) {
+    std::cerr << "Error: Could not write raster rows: " << CPLGetLastErrorMsg()
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+bool RasterWriter::write_window(int col, int row, int width, int height,
+                                const void *src, GDALDataType type) {
+  if (!dataset || col < 0 || row < 0 || col + width > cols ||
+      row + height > rows) {
+    return false;
+  }
+  auto err = dataset->GetRasterBand(1)->RasterIO(
+      GF_Write, col, row, width, height, const_cast<void *>(src), width,
+      height, type, 0, 0);
+  if (err != CE_None) {
+    std::cerr << "Error: Could not write raster window: "
+              << CPLGetLastErrorMsg() << std::endl;
+    return false;
+  }
+  return true;
+}
+} // namespace gdal_input
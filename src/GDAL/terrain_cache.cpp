@@ -0,0 +1,433 @@
+#include "GDAL/terrain_cache.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+// OS
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 3DH
+#include "Math/terrain_shading.hpp"
+
+namespace gdal_input {
+namespace {
+const uint64_t alignment = 64;
+uint64_t align(uint64_t offset) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+void source_stamp(const std::string &path, uint64_t &size, int64_t &time) {
+  std::error_code ec;
+  size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    size = 0;
+  }
+  auto write_time = std::filesystem::last_write_time(path, ec);
+  time = ec ? 0 : static_cast<int64_t>(write_time.time_since_epoch().count());
+}
+void pad_to(std::ofstream &file, uint64_t offset) {
+  uint64_t position = static_cast<uint64_t>(file.tellp());
+  if (offset > position) {
+    std::vector<char> zeros(offset - position, 0);
+    file.write(zeros.data(), zeros.size());
+  }
+}
+bool abandon(std::ofstream &file, const std::string &filepath) {
+  std::cerr << "Error: Could not write terrain cache: " << filepath
+            << std::endl;
+  file.close();
+  std::error_code ec;
+  std::filesystem::remove(filepath, ec);
+  return false;
+}
+bool in_file(uint64_t offset, uint64_t bytes, uint64_t file_size) {
+  return offset <= file_size && bytes <= file_size - offset;
+}
+} // namespace
+
+TerrainCache::TerrainCache(std::string filepath) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  LARGE_INTEGER file_size;
+  GetFileSizeEx(file, &file_size);
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapping) {
+    CloseHandle(file);
+    return;
+  }
+  void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return;
+  }
+  file_handle = file;
+  mapping_handle = mapping;
+  size = static_cast<size_t>(file_size.QuadPart);
+#else
+  int fd = open(filepath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+  size = static_cast<size_t>(st.st_size);
+  void *view = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    size = 0;
+    return;
+  }
+#endif
+  data = static_cast<const unsigned char *>(view);
+  // validate the header before exposing anything
+  const TerrainCacheHeader expected{};
+  const TerrainCacheHeader *mapped =
+      reinterpret_cast<const TerrainCacheHeader *>(data);
+  if (size < sizeof(TerrainCacheHeader) ||
+      std::memcmp(mapped->magic, expected.magic, sizeof(expected.magic)) != 0 ||
+      mapped->version != expected.version || mapped->file_size != size ||
+      mapped->tile_size != expected.tile_size || mapped->dem_cols <= 0 ||
+      mapped->dem_rows <= 0 || mapped->image_cols < 0 ||
+      mapped->image_rows < 0) {
+    std::cerr << "Error: Invalid terrain cache: " << filepath << std::endl;
+    return;
+  }
+  // every section has to lie inside the file
+  uint64_t T = mapped->tile_size;
+  uint64_t tile_count = (mapped->dem_cols + T - 1) / T *
+                        ((mapped->dem_rows + T - 1) / T);
+  uint64_t image_bytes = static_cast<uint64_t>(mapped->image_cols) *
+                         mapped->image_rows * sizeof(uint32_t);
+  bool valid =
+      in_file(mapped->tiles_offset,
+              tile_count * sizeof(math_3dh::QuantizedTile), size) &&
+      in_file(mapped->samples_offset, tile_count * T * T * sizeof(uint16_t),
+              size) &&
+      in_file(mapped->image_offset, image_bytes, size) &&
+      mapped->tiles_offset % alignof(math_3dh::QuantizedTile) == 0 &&
+      mapped->samples_offset % alignof(uint16_t) == 0 &&
+      mapped->image_offset % alignof(uint32_t) == 0;
+  if (valid && mapped->normals_offset != 0) {
+    using Normals = math_3dh::TiledGrid<uint16_t>;
+    uint64_t normal_tiles =
+        static_cast<uint64_t>((mapped->dem_cols + Normals::TILE_MASK) >>
+                              Normals::TILE_SHIFT) *
+        ((mapped->dem_rows + Normals::TILE_MASK) >> Normals::TILE_SHIFT);
+    uint64_t normal_cells =
+        normal_tiles * Normals::TILE_SIZE * Normals::TILE_SIZE;
+    uint64_t mip_tiles = mapped->mip_tile_count;
+    valid =
+        mapped->mip_level_count >= 0 && mapped->mip_level_count <= 32 &&
+        in_file(mapped->mip_infos_offset,
+                mapped->mip_level_count * sizeof(math_3dh::MipInfo), size) &&
+        in_file(mapped->mip_tiles_offset,
+                mip_tiles * sizeof(math_3dh::QuantizedTile), size) &&
+        mip_tiles <= size && // keeps the sample count from overflowing
+        in_file(mapped->mip_samples_offset,
+                mip_tiles * T * T * sizeof(uint16_t), size) &&
+        in_file(mapped->normals_offset, normal_cells * sizeof(uint16_t),
+                size) &&
+        mapped->mip_infos_offset % alignof(math_3dh::MipInfo) == 0 &&
+        mapped->mip_tiles_offset % alignof(math_3dh::QuantizedTile) == 0 &&
+        mapped->mip_samples_offset % alignof(uint16_t) == 0 &&
+        mapped->normals_offset % alignof(uint16_t) == 0;
+  }
+  if (!valid) {
+    std::cerr << "Error: Invalid terrain cache: " << filepath << std::endl;
+    return;
+  }
+  header = mapped;
+}
+TerrainCache::~TerrainCache() {
+  if (!data) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+  CloseHandle(static_cast<HANDLE>(mapping_handle));
+  CloseHandle(static_cast<HANDLE>(file_handle));
+#else
+  munmap(const_cast<unsigned char *>(data), size);
+#endif
+}
+bool TerrainCache::write(std::string filepath, RasterDataset *dem,
+                         RasterDataset *image, double z_offset,
+                         int mip_levels) {
+  TerrainCacheHeader header{};
+  int T = static_cast<int>(header.tile_size);
+  header.dem_cols = dem->get_cols();
+  header.dem_rows = dem->get_rows();
+  glm::dvec2 dem_top_left = dem->get_top_left_coord();
+  glm::dvec2 dem_scale = dem->get_pixel_scale();
+  header.dem_top_left[0] = dem_top_left.x;
+  header.dem_top_left[1] = dem_top_left.y;
+  header.dem_pixel_scale[0] = dem_scale.x;
+  header.dem_pixel_scale[1] = dem_scale.y;
+  header.dem_no_data_value = dem->get_no_data_float(1);
+  header.dem_vertical_unit = static_cast<float>(dem->get_vertical_unit(1));
+  header.z_offset = z_offset;
+  source_stamp(dem->get_filepath(), header.dem_source_size,
+               header.dem_source_time);
+  if (image) {
+    header.image_cols = image->get_cols();
+    header.image_rows = image->get_rows();
+    glm::dvec2 image_top_left = image->get_top_left_coord();
+    glm::dvec2 image_scale = image->get_pixel_scale();
+    header.image_top_left[0] = image_top_left.x;
+    header.image_top_left[1] = image_top_left.y;
+    header.image_pixel_scale[0] = image_scale.x;
+    header.image_pixel_scale[1] = image_scale.y;
+    source_stamp(image->get_filepath(), header.image_source_size,
+                 header.image_source_time);
+  }
+  if (header.dem_cols <= 0 || header.dem_rows <= 0) {
+    return false;
+  }
+
+  int tiles_x = (header.dem_cols + T - 1) / T;
+  int tiles_y = (header.dem_rows + T - 1) / T;
+  size_t tile_count = static_cast<size_t>(tiles_x) * tiles_y;
+  header.tiles_offset = align(sizeof(TerrainCacheHeader));
+  header.samples_offset =
+      align(header.tiles_offset + tile_count * sizeof(math_3dh::QuantizedTile));
+  header.image_offset = align(header.samples_offset +
+                              tile_count * T * T * sizeof(uint16_t));
+  header.file_size =
+      header.image_offset + static_cast<uint64_t>(header.image_cols) *
+                                header.image_rows * sizeof(uint32_t);
+
+  std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    std::cerr << "Error: Could not write terrain cache: " << filepath
+              << std::endl;
+    return false;
+  }
+  // write a placeholder header, it is rewritten once everything succeeded
+  TerrainCacheHeader placeholder{};
+  placeholder.version = 0;
+  file.write(reinterpret_cast<const char *>(&placeholder), sizeof(placeholder));
+
+  // quantize the DEM one row of tiles at a time
+  std::vector<math_3dh::QuantizedTile> tiles(tile_count);
+  std::vector<float> strip(static_cast<size_t>(header.dem_cols) * T);
+  std::vector<uint16_t> samples(static_cast<size_t>(T) * T);
+  pad_to(file, header.samples_offset);
+  for (int ty = 0; ty < tiles_y; ty++) {
+    int y0 = ty * T;
+    int height = std::min(T, header.dem_rows - y0);
+    if (!dem->read_floats(1, 0, header.dem_cols - 1, y0, y0 + height - 1,
+                          header.dem_cols, height, strip.data(),
+                          header.dem_cols)) {
+      return abandon(file, filepath);
+    }
+    for (int tx = 0; tx < tiles_x; tx++) {
+      int x0 = tx * T;
+      int width = std::min(T, header.dem_cols - x0);
+      math_3dh::QuantizedTile tile = math_3dh::QuantizedGrid::encode_tile(
+          &strip[x0], width, height, header.dem_cols, header.dem_no_data_value,
+          T, samples.data());
+      // pre-apply the world offset
+      tile.bias -= static_cast<float>(z_offset);
+      tiles[static_cast<size_t>(ty) * tiles_x + tx] = tile;
+      file.write(reinterpret_cast<const char *>(samples.data()),
+                 samples.size() * sizeof(uint16_t));
+    }
+  }
+
+  // copy the image as packed RGBA8 a strip of rows at a time
+  pad_to(file, header.image_offset);
+  const int image_strip_rows = 256;
+  std::vector<uint32_t> pixels(static_cast<size_t>(header.image_cols) *
+                               image_strip_rows);
+  for (int y0 = 0; y0 < header.image_rows; y0 += image_strip_rows) {
+    int height = std::min(image_strip_rows, header.image_rows - y0);
+    if (!image->read_rgba8(0, header.image_cols - 1, y0, y0 + height - 1,
+                           header.image_cols, height, pixels.data(),
+                           header.image_cols)) {
+      return abandon(file, filepath);
+    }
+    file.write(reinterpret_cast<const char *>(pixels.data()),
+               static_cast<size_t>(header.image_cols) * height *
+                   sizeof(uint32_t));
+  }
+
+  file.seekp(static_cast<std::streamoff>(header.tiles_offset));
+  file.write(reinterpret_cast<const char *>(tiles.data()),
+             tiles.size() * sizeof(math_3dh::QuantizedTile));
+  if (!file) {
+    return abandon(file, filepath);
+  }
+  // only a complete file gets the real header
+  file.seekp(0);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.close();
+  if (!file || !append_derived(filepath, mip_levels)) {
+    return abandon(file, filepath);
+  }
+  return true;
+}
+bool TerrainCache::append_derived(const std::string &filepath,
+                                  int mip_levels) {
+  TerrainCacheHeader header;
+  math_3dh::ElevationMips mips;
+  math_3dh::TiledGrid<uint16_t> normals;
+  {
+    // built from the mapped DEM section, unmapped again before appending
+    TerrainCache cache(filepath);
+    if (!cache.is_open()) {
+      return false;
+    }
+    header = cache.get_header();
+    math_3dh::QuantizedGrid grid = cache.get_elevations();
+    mips = math_3dh::ElevationMips(grid, mip_levels);
+    normals = math_3dh::compute_normals(
+        grid, {static_cast<float>(header.dem_pixel_scale[0]),
+               static_cast<float>(header.dem_pixel_scale[1])});
+  }
+  const auto &infos = mips.get_infos();
+  const auto &tiles = mips.get_tiles();
+  const auto &samples = mips.get_samples();
+  size_t normal_count = normals.get_tile_count() *
+                        math_3dh::TiledGrid<uint16_t>::TILE_SIZE *
+                        math_3dh::TiledGrid<uint16_t>::TILE_SIZE;
+  header.mip_levels = mip_levels;
+  header.mip_level_count = mips.get_level_count();
+  header.mip_tile_count = tiles.size();
+  header.mip_infos_offset = align(header.file_size);
+  header.mip_tiles_offset = align(header.mip_infos_offset +
+                                  infos.size() * sizeof(math_3dh::MipInfo));
+  header.mip_samples_offset = align(
+      header.mip_tiles_offset + tiles.size() * sizeof(math_3dh::QuantizedTile));
+  header.normals_offset =
+      align(header.mip_samples_offset + samples.size() * sizeof(uint16_t));
+  header.file_size = header.normals_offset + normal_count * sizeof(uint16_t);
+
+  std::ofstream file(filepath, std::ios::binary | std::ios::in |
+                                   std::ios::out | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  pad_to(file, header.mip_infos_offset);
+  file.write(reinterpret_cast<const char *>(infos.data()),
+             infos.size() * sizeof(math_3dh::MipInfo));
+  pad_to(file, header.mip_tiles_offset);
+  file.write(reinterpret_cast<const char *>(tiles.data()),
+             tiles.size() * sizeof(math_3dh::QuantizedTile));
+  pad_to(file, header.mip_samples_offset);
+  file.write(reinterpret_cast<const char *>(samples.data()),
+             samples.size() * sizeof(uint16_t));
+  pad_to(file, header.normals_offset);
+  file.write(reinterpret_cast<const char *>(normals.data()),
+             normal_count * sizeof(uint16_t));
+  if (!file) {
+    return false;
+  }
+  file.seekp(0);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.close();
+  return static_cast<bool>(file);
+}
+std::string TerrainCache::get_cache_path(RasterDataset *dem) {
+  return dem->get_filepath() + ".3dhc";
+}
+bool TerrainCache::is_current(RasterDataset *dem, RasterDataset *image) const {
+  if (!header) {
+    return false;
+  }
+  uint64_t dem_size, image_size = 0;
+  int64_t dem_time, image_time = 0;
+  source_stamp(dem->get_filepath(), dem_size, dem_time);
+  if (image) {
+    source_stamp(image->get_filepath(), image_size, image_time);
+  } else if (header->image_cols != 0) {
+    return false;
+  }
+  return dem_size == header->dem_source_size &&
+         dem_time == header->dem_source_time &&
+         image_size == header->image_source_size &&
+         image_time == header->image_source_time;
+}
+math_3dh::QuantizedGrid TerrainCache::get_elevations() const {
+  if (!header) {
+    return math_3dh::QuantizedGrid();
+  }
+  return math_3dh::QuantizedGrid(
+      header->dem_cols, header->dem_rows, static_cast<int>(header->tile_size),
+      reinterpret_cast<const math_3dh::QuantizedTile *>(data +
+                                                        header->tiles_offset),
+      reinterpret_cast<const uint16_t *>(data + header->samples_offset));
+}
+const uint32_t *TerrainCache::get_image() const {
+  if (!header || header->image_cols == 0) {
+    return nullptr;
+  }
+  return reinterpret_cast<const uint32_t *>(data + header->image_offset);
+}
+bool TerrainCache::get_mips(int mip_levels,
+                            math_3dh::ElevationMips &mips) const {
+  if (!header || header->normals_offset == 0 ||
+      header->mip_levels != mip_levels) {
+    return false;
+  }
+  const auto *infos = reinterpret_cast<const math_3dh::MipInfo *>(
+      data + header->mip_infos_offset);
+  const auto *tiles = reinterpret_cast<const math_3dh::QuantizedTile *>(
+      data + header->mip_tiles_offset);
+  const auto *samples =
+      reinterpret_cast<const uint16_t *>(data + header->mip_samples_offset);
+  uint64_t T = header->tile_size;
+  for (int32_t l = 0; l < header->mip_level_count; l++) {
+    // every level has to view tiles inside the stored table
+    const math_3dh::MipInfo &info = infos[l];
+    if (info.tile_size != static_cast<int32_t>(T) || info.cols <= 0 ||
+        info.rows <= 0 || info.tile_offset < 0) {
+      return false;
+    }
+    uint64_t level_end = info.tile_offset + (info.cols + T - 1) / T *
+                                                ((info.rows + T - 1) / T);
+    if (level_end > header->mip_tile_count) {
+      return false;
+    }
+  }
+  mips = math_3dh::ElevationMips(
+      std::vector<math_3dh::MipInfo>(infos, infos + header->mip_level_count),
+      std::vector<math_3dh::QuantizedTile>(tiles,
+                                           tiles + header->mip_tile_count),
+      std::vector<uint16_t>(samples, samples + header->mip_tile_count * T * T));
+  return true;
+}
+bool TerrainCache::get_normals(math_3dh::TiledGrid<uint16_t> &normals) const {
+  if (!header || header->normals_offset == 0) {
+    return false;
+  }
+  math_3dh::TiledGrid<uint16_t> stored(header->dem_cols, header->dem_rows);
+  std::memcpy(stored.data(), data + header->normals_offset,
+              sizeof(uint16_t) * stored.get_tile_count() *
+                  math_3dh::TiledGrid<uint16_t>::TILE_SIZE *
+                  math_3dh::TiledGrid<uint16_t>::TILE_SIZE);
+  normals = std::move(stored);
+  return true;
+}
+} // namespace gdal_input
@@ -0,0 +1,143 @@
+#include "GDAL/terrain_loader.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <chrono>
+
+namespace gdal_input {
+namespace {
+/**
+ * @brief Get the smallest power of two decimation that fits a raster in \p
+ * max_size pixels on its longest side.
+ */
+int coarse_factor(int cols, int rows, int max_size) {
+  int factor = 1;
+  while (std::max(cols, rows) / factor > max_size) {
+    factor *= 2;
+  }
+  return factor;
+}
+int decimated(int pixels, int factor) { return (pixels + factor - 1) / factor; }
+/**
+ * @brief Quantize a DEM one row of tiles at a time from any source with the
+ * read interface of RasterDataset.
+ */
+template <typename Source>
+math_3dh::QuantizedGrid read_quantized(Source *dem, int factor) {
+  int cols = dem->get_cols();
+  int rows = dem->get_rows();
+  float no_data_value = dem->get_no_data_float(1);
+  math_3dh::QuantizedGrid grid(decimated(cols, factor),
+                               decimated(rows, factor));
+  int T = grid.get_tile_size();
+  std::vector<float> strip(static_cast<size_t>(grid.get_cols()) * T);
+  for (int ty = 0; ty < grid.get_tiles_y(); ty++) {
+    int y0 = ty * T;
+    int height = std::min(T, grid.get_rows() - y0);
+    dem->read_floats(1, 0, cols - 1, y0 * factor,
+                     std::min((y0 + height) * factor, rows) - 1,
+                     grid.get_cols(), height, strip.data(), grid.get_cols());
+    for (int tx = 0; tx < grid.get_tiles_x(); tx++) {
+      grid.set_tile(tx, ty, &strip[tx * T], grid.get_cols(), no_data_value);
+    }
+  }
+  return grid;
+}
+} // namespace
+
+TerrainLoader::TerrainLoader(std::string dem_path, std::string image_path,
+                             int mip_levels) {
+  worker = std::thread(&TerrainLoader::load, this, dem_path, image_path,
+                       mip_levels);
+}
+TerrainLoader::~TerrainLoader() {
+  cancelled = true;
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+std::unique_ptr<TerrainStage> TerrainLoader::poll() {
+  // a stage superseded by a finer one is never uploaded
+  std::unique_ptr<TerrainStage> stage = nullptr;
+  std::unique_ptr<TerrainStage> next = nullptr;
+  while (stages.pop(next)) {
+    stage = std::move(next);
+  }
+  if (stage && stage->is_final) {
+    done = true;
+  }
+  return stage;
+}
+math_3dh::QuantizedGrid TerrainLoader::read_elevations(RasterDataset *dem,
+                                                       int factor) {
+  return read_quantized(dem, factor);
+}
+math_3dh::QuantizedGrid TerrainLoader::read_elevations(RasterMosaic *dem,
+                                                       int factor) {
+  return read_quantized(dem, factor);
+}
+std::vector<uint32_t> TerrainLoader::read_image(RasterDataset *image,
+                                                int factor,
+                                                glm::ivec2 &pixels) {
+  pixels = {decimated(image->get_cols(), factor),
+            decimated(image->get_rows(), factor)};
+  return image->read_rgba8(0, image->get_cols() - 1, 0, image->get_rows() - 1,
+                           pixels.x, pixels.y);
+}
+void TerrainLoader::load(std::string dem_path, std::string image_path,
+                         int mip_levels) {
+  // GDAL handles are not thread safe, the worker opens its own
+  RasterDataset dem(dem_path);
+  std::unique_ptr<RasterDataset> image = nullptr;
+  if (!image_path.empty()) {
+    image = std::make_unique<RasterDataset>(image_path);
+  }
+  glm::vec2 dem_scale = dem.get_pixel_scale();
+  int dem_factor = coarse_factor(dem.get_cols(), dem.get_rows(), 512);
+  int image_factor =
+      image ? coarse_factor(image->get_cols(), image->get_rows(), 1024) : 1;
+  while (!cancelled) {
+    auto stage = std::make_unique<TerrainStage>();
+    stage->dem_factor = dem_factor;
+    stage->elevations = read_elevations(&dem, dem_factor);
+    // a stage at factor 2^c stands in for the first c mip levels
+    int coarse_levels = 0;
+    while ((1 << coarse_levels) < dem_factor) {
+      coarse_levels++;
+    }
+    stage->mips = math_3dh::ElevationMips(
+        stage->elevations, std::max(mip_levels - coarse_levels, 0));
+    if (cancelled) {
+      return;
+    }
+    stage->normals = math_3dh::compute_normals(
+        stage->elevations, dem_scale * static_cast<float>(dem_factor));
+    if (cancelled) {
+      return;
+    }
+    if (image) {
+      stage->image_factor = image_factor;
+      stage->image = read_image(image.get(), image_factor, stage->image_pixels);
+    } else {
+      // the hillshade is drawn on the grid of the stage's DEM
+      stage->image_factor = dem_factor;
+      stage->image_pixels = {stage->elevations.get_cols(),
+                             stage->elevations.get_rows()};
+      stage->image = math_3dh::hillshade_to_rgba(
+          math_3dh::compute_hillshade(stage->normals));
+    }
+    stage->is_final = dem_factor == 1 && image_factor == 1;
+    while (!stages.push(stage)) {
+      if (cancelled) {
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (dem_factor == 1 && image_factor == 1) {
+      return;
+    }
+    dem_factor = std::max(dem_factor / 2, 1);
+    image_factor = std::max(image_factor / 2, 1);
+  }
+}
+} // namespace gdal_input
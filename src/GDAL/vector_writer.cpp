@@ -0,0 +1,186 @@
+#include "GDAL/vector_writer.hpp"
+
+// Standard Library
+#include <iostream>
+#include <map>
+#include <memory>
+
+// EXT
+#include "gdal_alg.h"
+#include "ogr_spatialref.h"
+
+namespace gdal_input {
+VectorWriter::VectorWriter(std::string filepath, std::string driver) {
+  GDALDriver *gdal_driver =
+      GetGDALDriverManager()->GetDriverByName(driver.c_str());
+  if (!gdal_driver) {
+    std::cerr << "Error: No GDAL driver named " << driver << std::endl;
+    return;
+  }
+  dataset = gdal_driver->Create(filepath.c_str(), 0, 0, 0, GDT_Unknown,
+                                nullptr);
+  if (!dataset) {
+    std::cerr << "Error: Could not create vector dataset: " << filepath
+              << std::endl;
+    return;
+  }
+  in_transaction = dataset->StartTransaction() == OGRERR_NONE;
+}
+VectorWriter::~VectorWriter() {
+  if (dataset) {
+    if (in_transaction) {
+      dataset->CommitTransaction();
+    }
+    GDALClose(dataset);
+  }
+}
+OGRLayer *VectorWriter::create_layer(std::string layer_name,
+                                     OGRwkbGeometryType geometry_type,
+                                     const std::string &projection,
+                                     const std::vector<VectorField> &fields) {
+  if (!dataset) {
+    return nullptr;
+  }
+  OGRSpatialReference srs;
+  bool has_srs =
+      !projection.empty() && srs.importFromWkt(projection.c_str()) ==
+                                 OGRERR_NONE;
+  OGRLayer *layer = dataset->CreateLayer(
+      layer_name.c_str(), has_srs ? &srs : nullptr, geometry_type, nullptr);
+  if (!layer) {
+    std::cerr << "Error: Could not create layer: " << layer_name << std::endl;
+    return nullptr;
+  }
+  for (auto &field : fields) {
+    OGRFieldDefn defn(field.name.c_str(), field.type);
+    if (layer->CreateField(&defn) != OGRERR_NONE) {
+      std::cerr << "Error: Could not create field: " << field.name
+                << std::endl;
+      return nullptr;
+    }
+  }
+  return layer;
+}
+
+ContourLayerWriter::ContourLayerWriter(VectorWriter &writer,
+                                       const RasterGeoreference &georeference,
+                                       double elevation_offset,
+                                       std::string layer_name)
+    : georeference(georeference), elevation_offset(elevation_offset) {
+  layer = writer.create_layer(layer_name, wkbLineString,
+                              georeference.projection,
+                              {{"elevation", OFTReal}});
+}
+void ContourLayerWriter::add_contour(float level,
+                                     const std::vector<glm::vec2> &points,
+                                     bool /*closed*/) {
+  if (!layer) {
+    return;
+  }
+  // rings repeat their first point, so they close as line strings
+  OGRLineString line;
+  line.setNumPoints(static_cast<int>(points.size()));
+  for (size_t i = 0; i < points.size(); i++) {
+    line.setPoint(static_cast<int>(i),
+                  georeference.top_left.x +
+                      (points[i].x + 0.5) * georeference.pixel_scale.x,
+                  georeference.top_left.y -
+                      (points[i].y + 0.5) * georeference.pixel_scale.y);
+  }
+  OGRFeature *feature = OGRFeature::CreateFeature(layer->GetLayerDefn());
+  feature->SetGeometry(&line);
+  feature->SetField(0, level + elevation_offset);
+  if (layer->CreateFeature(feature) != OGRERR_NONE) {
+    if (error_count++ == 0) {
+      std::cerr << "Error: Could not write contour." << std::endl;
+    }
+  }
+  OGRFeature::DestroyFeature(feature);
+}
+
+bool write_contours(std::string filepath,
+                    const math_3dh::TiledGrid<float> &elevations,
+                    const RasterGeoreference &georeference, float interval,
+                    double elevation_offset, std::string driver) {
+  VectorWriter output(filepath, driver);
+  ContourLayerWriter contours(output, georeference, elevation_offset);
+  if (!contours.is_open()) {
+    return false;
+  }
+  math_3dh::trace_contours(elevations, interval, contours, -elevation_offset);
+  return contours.get_error_count() == 0;
+}
+
+bool write_watershed_polygons(std::string filepath,
+                              const math_3dh::TiledGrid<int32_t> &labels,
+                              const RasterGeoreference &georeference,
+                              const std::vector<std::string> &names,
+                              const std::vector<double> &areas,
+                              std::string driver) {
+  // polygonize in memory, then copy the polygons out with their attributes
+  RasterWriter raster("", labels.get_cols(), labels.get_rows(), GDT_Int32,
+                      georeference, -1.0, "MEM");
+  VectorWriter polygons("", "Memory");
+  OGRLayer *polygon_layer = polygons.create_layer(
+      "polygons", wkbPolygon, georeference.projection,
+      {{"label", OFTInteger}});
+  if (!raster.is_open() || !polygon_layer || !raster.write_grid(labels)) {
+    return false;
+  }
+  char **options = CSLSetNameValue(nullptr, "8CONNECTED", "8");
+  GDALRasterBand *band = raster.get_band();
+  CPLErr err = GDALPolygonize(GDALRasterBand::ToHandle(band),
+                              GDALRasterBand::ToHandle(band->GetMaskBand()),
+                              OGRLayer::ToHandle(polygon_layer), 0, options,
+                              nullptr, nullptr);
+  CSLDestroy(options);
+  if (err != CE_None) {
+    std::cerr << "Error: Could not polygonize watersheds: "
+              << CPLGetLastErrorMsg() << std::endl;
+    return false;
+  }
+  // a watershed split into pieces is dissolved into one multipolygon
+  std::map<int, std::unique_ptr<OGRMultiPolygon>> watersheds{};
+  polygon_layer->ResetReading();
+  OGRFeature *polygon;
+  while ((polygon = polygon_layer->GetNextFeature()) != nullptr) {
+    int label = static_cast<int>(polygon->GetFieldAsInteger64(0));
+    OGRGeometry *piece = polygon->StealGeometry();
+    OGRFeature::DestroyFeature(polygon);
+    if (label < 0 || !piece) {
+      delete piece;
+      continue;
+    }
+    auto &watershed = watersheds[label];
+    if (!watershed) {
+      watershed = std::make_unique<OGRMultiPolygon>();
+    }
+    watershed->addGeometryDirectly(piece);
+  }
+  VectorWriter output(filepath, driver);
+  OGRLayer *layer = output.create_layer(
+      "watersheds", wkbMultiPolygon, georeference.projection,
+      {{"node_id", OFTString}, {"label", OFTInteger}, {"area", OFTReal}});
+  if (!layer) {
+    return false;
+  }
+  for (auto &[label, watershed] : watersheds) {
+    OGRFeature *feature = OGRFeature::CreateFeature(layer->GetLayerDefn());
+    feature->SetGeometryDirectly(watershed.release());
+    if (static_cast<size_t>(label) < names.size()) {
+      feature->SetField(0, names[label].c_str());
+    }
+    feature->SetField(1, label);
+    if (static_cast<size_t>(label) < areas.size()) {
+      feature->SetField(2, areas[label]);
+    }
+    OGRErr feature_err = layer->CreateFeature(feature);
+    OGRFeature::DestroyFeature(feature);
+    if (feature_err != OGRERR_NONE) {
+      std::cerr << "Error: Could not write watershed polygon." << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace gdal_input
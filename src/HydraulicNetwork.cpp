@@ -2,6 +2,19 @@
 #include "Scenes/MainScene.hpp"
 #include "Systems/Rendering/RenderSystemForwarder.hpp"
 #include "Entities/NodeLabelBillboards.hpp"
+#include "Entities/Terrain.hpp"
+#include "GDAL/vector_writer.hpp"
+#include "Math/flow_routing.hpp"
+#include "Math/inundation.hpp"
+#include "Math/overland_flow.hpp"
+#include "Math/parallel.hpp"
+#include "Math/watershed.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
 
 Referenced<HydraulicNetwork> HydraulicNetwork::LoadedNetwork = nullptr;
 
@@ -9,7 +22,8 @@ Referenced<HydraulicNetwork> HydraulicNetwork::LoadedNetwork = nullptr;
 HydraulicNode::~HydraulicNode() {}
 
 // Clyinder Nodes
-CylinderNodeMeshes::CylinderNodeMeshes(uint32_t max_nodes) {
+CylinderNodeMeshes::CylinderNodeMeshes(uint32_t max_nodes)
+    : capacity(max_nodes) {
   base_mesh = gen_ref<CylinderMesh>(0.0f, 2.0f * math::PI, 24);
   main_mesh = gen_ref<InstancedMesh>(max_nodes);
   main_mesh->set_mesh(base_mesh);
@@ -20,16 +34,30 @@ CylinderNodeMeshes::CylinderNodeMeshes(uint32_t max_nodes) {
   material->set_light(light);
 }
 
-void CylinderNodeMeshes::add_node(CylinderNode *node) {
-  HydraulicNetwork *network = HydraulicNetwork::LoadedNetwork.get();
-  glm::vec3 position = {node->easting - network->offset.x,
-                        node->northing - network->offset.y,
-                        node->invert_elevation};
+glm::mat4 CylinderNodeMeshes::instance_transform(CylinderNode *node) {
+  glm::vec2 world = HydraulicNetwork::LoadedNetwork->to_world(node);
+  glm::vec3 position = {world.x, world.y, node->invert_elevation};
   glm::mat4 scale =
       glm::scale(glm::mat4(1.0f), {node->inner_diameter, node->inner_diameter,
                                    node->node_depth});
   glm::mat4 trans = glm::translate(glm::mat4(1.0f), position);
-  main_mesh->push_instance(trans * scale);
+  return trans * scale;
+}
+
+bool CylinderNodeMeshes::add_node(CylinderNode *node) {
+  if (count == capacity) {
+    return false;
+  }
+  main_mesh->push_instance(instance_transform(node));
+  instances[node] = count++;
+  return true;
+}
+
+void CylinderNodeMeshes::update_node(CylinderNode *node) {
+  auto it = instances.find(node);
+  if (it != instances.end()) {
+    (*main_mesh)[it->second] = instance_transform(node);
+  }
 }
 
 void CylinderNodeMeshes::render(Camera *camera) {
@@ -53,11 +81,274 @@ HydraulicNetwork::HydraulicNetwork() {
 void HydraulicNetwork::add_node(Referenced<HydraulicNode> node) {
   nodes_.insert_or_assign(node->ID, node);
   if (auto n = std::dynamic_pointer_cast<CylinderNode>(node)) {
-    cylinder_node_meshes->add_node(n.get());
+    if (!cylinder_node_meshes->add_node(n.get())) {
+      // the new node is in nodes_, so the rebuilt meshes include it
+      reserve_nodes(cylinder_node_meshes->get_capacity());
+    }
   }
   node_labels->add_label(node.get());
 }
 
+void HydraulicNetwork::reserve_nodes(size_t count) {
+  size_t needed = nodes_.size() + count;
+  if (needed <= cylinder_node_meshes->get_capacity()) {
+    return;
+  }
+  cylinder_node_meshes =
+      gen_ref<CylinderNodeMeshes>(static_cast<uint32_t>(needed));
+  for (auto &[ID, node] : nodes_) {
+    if (auto n = std::dynamic_pointer_cast<CylinderNode>(node)) {
+      cylinder_node_meshes->add_node(n.get());
+    }
+  }
+}
+
+glm::dvec2 HydraulicNetwork::get_offset(glm::dvec2 anchor) {
+  auto main_scene = dynamic_cast<MainScene *>(Renderer::get_info().scene);
+  if (!main_scene) {
+    return anchor;
+  }
+  if (std::isnan(main_scene->get_world_offset().x)) {
+    main_scene->set_world_offset({anchor.x, anchor.y, 0.0});
+  }
+  glm::dvec3 world_offset = main_scene->get_world_offset();
+  return {world_offset.x, world_offset.y};
+}
+
+glm::vec2 HydraulicNetwork::to_world(const HydraulicNode *node) {
+  glm::dvec2 offset = get_offset();
+  return {static_cast<float>(node->easting - offset.x),
+          static_cast<float>(node->northing - offset.y)};
+}
+
+glm::ivec2 HydraulicNetwork::to_grid(const HydraulicNode *node,
+                                     Terrain *terrain) {
+  return terrain->world_to_grid(to_world(node));
+}
+
+DrapeReport HydraulicNetwork::drape_to_terrain(Terrain *terrain,
+                                               float tolerance, bool fill_all) {
+  enum class DrapeStatus : uint8_t {
+    OFF_TERRAIN,
+    FILLED,
+    ABOVE_GROUND,
+    CHECKED,
+    MISMATCH
+  };
+  DrapeReport report{};
+  auto main_scene = dynamic_cast<MainScene *>(Renderer::get_info().scene);
+  if (!terrain || !main_scene) {
+    return report;
+  }
+  glm::dvec3 world_offset = main_scene->get_world_offset();
+  float to_network = from_units(terrain->get_vertical_unit());
+  std::vector<HydraulicNode *> nodes{};
+  nodes.reserve(nodes_.size());
+  for (auto &[ID, node] : nodes_) {
+    nodes.push_back(node.get());
+  }
+  std::vector<float> ground(nodes.size());
+  std::vector<DrapeStatus> status(nodes.size());
+  // each chunk is sampled as one batch and every node is written by one thread
+  const size_t chunk_size = 4096;
+  size_t chunk_count = (nodes.size() + chunk_size - 1) / chunk_size;
+  math_3dh::parallel_for(0, chunk_count, [&](size_t chunk) {
+    size_t begin = chunk * chunk_size;
+    size_t count = std::min(chunk_size, nodes.size() - begin);
+    std::vector<float> x(count), y(count);
+    for (size_t i = 0; i < count; i++) {
+      glm::vec2 world = to_world(nodes[begin + i]);
+      x[i] = world.x;
+      y[i] = world.y;
+    }
+    terrain->get_terrain_elevations(x.data(), y.data(), &ground[begin], count);
+    for (size_t i = begin; i < begin + count; i++) {
+      HydraulicNode *node = nodes[i];
+      // absolute elevation in the units of the network
+      ground[i] = (ground[i] + static_cast<float>(world_offset.z)) * to_network;
+      if (std::isnan(ground[i])) {
+        status[i] = DrapeStatus::OFF_TERRAIN;
+      } else if ((fill_all || !node->has_depth) &&
+                 ground[i] < node->invert_elevation) {
+        status[i] = DrapeStatus::ABOVE_GROUND;
+      } else if (fill_all || !node->has_depth) {
+        node->node_depth = ground[i] - node->invert_elevation;
+        node->has_depth = true;
+        status[i] = DrapeStatus::FILLED;
+      } else if (std::abs(node->rim_elevation() - ground[i]) > tolerance) {
+        status[i] = DrapeStatus::MISMATCH;
+      } else {
+        status[i] = DrapeStatus::CHECKED;
+      }
+    }
+  });
+  for (size_t i = 0; i < nodes.size(); i++) {
+    switch (status[i]) {
+    case DrapeStatus::OFF_TERRAIN:
+      report.off_terrain++;
+      break;
+    case DrapeStatus::FILLED:
+      report.filled++;
+      // the instance was sized from the old depth
+      if (auto n = dynamic_cast<CylinderNode *>(nodes[i])) {
+        cylinder_node_meshes->update_node(n);
+      }
+      node_labels->update_label(nodes[i]);
+      break;
+    case DrapeStatus::ABOVE_GROUND:
+      report.above_ground.push_back(
+          {nodes[i]->ID, nodes[i]->invert_elevation, ground[i]});
+      break;
+    case DrapeStatus::MISMATCH:
+      report.mismatches.push_back(
+          {nodes[i]->ID, nodes[i]->rim_elevation(), ground[i]});
+      report.checked++;
+      break;
+    case DrapeStatus::CHECKED:
+      report.checked++;
+      break;
+    }
+  }
+  return report;
+}
+
+WatershedReport HydraulicNetwork::delineate_watersheds(Terrain *terrain,
+                                                      float snap_radius,
+                                                      std::string filepath) {
+  WatershedReport report{};
+  if (!terrain) {
+    return report;
+  }
+  glm::dvec2 offset = get_offset();
+  math_3dh::TiledGrid<float> elevations = terrain->condition_elevations();
+  glm::vec2 scale = terrain->get_grid_scale();
+  auto directions = math_3dh::compute_d8(elevations, scale);
+  auto accumulation = math_3dh::accumulate_d8(directions);
+  std::vector<HydraulicNode *> nodes{};
+  std::vector<glm::ivec2> pour_points{};
+  for (auto &[ID, node] : nodes_) {
+    glm::ivec2 col_row = to_grid(node.get(), terrain);
+    if (!elevations.contains(col_row.x, col_row.y)) {
+      report.off_terrain++;
+      continue;
+    }
+    nodes.push_back(node.get());
+    pour_points.push_back(col_row);
+  }
+  int radius = static_cast<int>(snap_radius / std::min(scale.x, scale.y));
+  pour_points = math_3dh::snap_pour_points(accumulation, pour_points, radius);
+  auto labels = math_3dh::label_watersheds(directions, pour_points);
+  auto counts = math_3dh::count_watershed_cells(labels, pour_points.size());
+  // the first node at a cell wins it, see math_3dh::label_watersheds()
+  std::map<std::pair<int, int>, size_t> outlets{};
+  std::vector<std::string> names(nodes.size());
+  std::vector<double> areas(nodes.size());
+  report.catchments.reserve(nodes.size());
+  for (size_t i = 0; i < nodes.size(); i++) {
+    auto outlet_node =
+        outlets.emplace(std::make_pair(pour_points[i].x, pour_points[i].y), i);
+    if (!outlet_node.second) {
+      report.shared_outlets.push_back(
+          {nodes[i]->ID, nodes[outlet_node.first->second]->ID});
+      continue;
+    }
+    glm::vec2 outlet = terrain->grid_to_world(pour_points[i]);
+    names[i] = nodes[i]->ID;
+    areas[i] = static_cast<double>(counts[i]) * scale.x * scale.y;
+    report.catchments.push_back(
+        {names[i],
+         {outlet.x + offset.x, outlet.y + offset.y},
+         areas[i]});
+  }
+  if (!filepath.empty()) {
+    write_watershed_polygons(filepath, labels,
+                             terrain->get_grid_georeference(), names, areas);
+  }
+  return report;
+}
+
+std::unordered_map<std::string, size_t>
+HydraulicNetwork::add_flow_sources(math_3dh::OverlandFlow &flow,
+                                   Terrain *terrain) {
+  std::unordered_map<std::string, size_t> sources{};
+  if (!terrain) {
+    return sources;
+  }
+  const auto &depth = flow.get_depth();
+  for (auto &[ID, node] : nodes_) {
+    glm::ivec2 col_row = to_grid(node.get(), terrain);
+    if (depth.contains(col_row.x, col_row.y)) {
+      sources[ID] = flow.add_source(col_row.x, col_row.y);
+    }
+  }
+  return sources;
+}
+
+InundationReport HydraulicNetwork::map_inundation(
+    Terrain *terrain, const std::unordered_map<std::string, float> &heads,
+    std::string filepath) {
+  constexpr float NO_DATA = -9999.0f;
+  InundationReport report{};
+  auto main_scene = dynamic_cast<MainScene *>(Renderer::get_info().scene);
+  if (!terrain || !main_scene) {
+    return report;
+  }
+  glm::dvec3 world_offset = main_scene->get_world_offset();
+  double to_network = from_units(terrain->get_vertical_unit());
+  const auto &elevations = terrain->get_elevation_grid();
+  std::vector<HydraulicNode *> nodes{};
+  std::vector<float> node_heads{};
+  std::vector<math_3dh::FloodSeed> seeds{};
+  for (auto &[ID, node] : nodes_) {
+    auto given = heads.find(ID);
+    if (given == heads.end() && !node->has_head) {
+      continue;
+    }
+    float head = given != heads.end() ? given->second : node->head;
+    if (head <= node->rim_elevation()) {
+      continue;
+    }
+    glm::ivec2 col_row = to_grid(node.get(), terrain);
+    if (!elevations.contains(col_row.x, col_row.y)) {
+      report.off_terrain++;
+      continue;
+    }
+    nodes.push_back(node.get());
+    node_heads.push_back(head);
+    // the DEM is relative to the world offset and in its own unit
+    seeds.push_back({col_row.x, col_row.y,
+                     static_cast<float>(head / to_network - world_offset.z)});
+  }
+  auto flood = math_3dh::map_inundation(elevations, seeds,
+                                        terrain->get_grid_scale());
+  const auto &stats = flood.get_stats();
+  report.flooded.reserve(nodes.size());
+  for (size_t i = 0; i < nodes.size(); i++) {
+    report.flooded.push_back(
+        {nodes[i]->ID, node_heads[i], stats[i].area, stats[i].volume});
+  }
+  if (!filepath.empty()) {
+    // stream the depths a row of tiles at a time
+    constexpr int BAND_ROWS = math_3dh::TiledGrid<float>::TILE_SIZE;
+    RasterWriter writer(filepath, flood.get_cols(), flood.get_rows(),
+                        GDT_Float32, terrain->get_grid_georeference(),
+                        NO_DATA);
+    std::vector<float> band(static_cast<size_t>(flood.get_cols()) * BAND_ROWS);
+    for (int row = 0; writer.is_open() && row < flood.get_rows();
+         row += BAND_ROWS) {
+      int count = std::min(BAND_ROWS, flood.get_rows() - row);
+      flood.read_depth_rows(row, count, band.data());
+      for (float &depth : band) {
+        depth = depth > 0.0f ? depth : NO_DATA;
+      }
+      if (!writer.write_rows(row, count, band.data(), GDT_Float32)) {
+        break;
+      }
+    }
+  }
+  return report;
+}
+
 void HydraulicNetwork::render(Camera *camera) {
   cylinder_node_meshes->render(camera);
 }
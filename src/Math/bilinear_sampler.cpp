@@ -0,0 +1,311 @@
+#include "Math/bilinear_sampler.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BILINEAR_SAMPLER_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BILINEAR_SAMPLER_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(BILINEAR_SAMPLER_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace math_3dh {
+namespace {
+static_assert(sizeof(QuantizedTile) == 2 * sizeof(float),
+              "QuantizedTile must be two packed floats");
+using SampleKernel = void (*)(const QuantizedGrid &, float,
+                              const GridTransform &, const float *,
+                              const float *, float *, size_t, size_t);
+float decode(const QuantizedGrid &grid, int col, int row) {
+  uint16_t sample = grid.get_samples()[grid.sample_index(col, row)];
+  if (sample == QuantizedGrid::NO_DATA) {
+    return std::numeric_limits<float>::quiet_NaN();
+  }
+  int T = grid.get_tile_size();
+  const QuantizedTile &tile =
+      grid.get_tiles()[static_cast<size_t>(row / T) * grid.get_tiles_x() +
+                       col / T];
+  return tile.bias + static_cast<float>(sample) * tile.scale;
+}
+/**
+ * @brief Interpolate the grid at grid coordinates already clamped to the cell
+ * centers.
+ */
+float interpolate(const QuantizedGrid &grid, float u, float v) {
+  int i0 = std::max(std::min(static_cast<int>(u), grid.get_cols() - 2), 0);
+  int j0 = std::max(std::min(static_cast<int>(v), grid.get_rows() - 2), 0);
+  int i1 = std::min(i0 + 1, grid.get_cols() - 1);
+  int j1 = std::min(j0 + 1, grid.get_rows() - 1);
+  float fu = u - static_cast<float>(i0);
+  float fv = v - static_cast<float>(j0);
+  // no data corners propagate NaN
+  float h0 = decode(grid, i0, j0) +
+             fu * (decode(grid, i1, j0) - decode(grid, i0, j0));
+  float h1 = decode(grid, i0, j1) +
+             fu * (decode(grid, i1, j1) - decode(grid, i0, j1));
+  return h0 + fv * (h1 - h0);
+}
+void sample_scalar(const QuantizedGrid &grid, float shift,
+                   const GridTransform &transform, const float *x,
+                   const float *y, float *z, size_t begin, size_t end) {
+  float u_max = static_cast<float>(grid.get_cols() - 1);
+  float v_max = static_cast<float>(grid.get_rows() - 1);
+  for (size_t i = begin; i < end; i++) {
+    float u = x[i] * transform.scale_x + transform.offset_x;
+    float v = y[i] * transform.scale_y + transform.offset_y;
+    if (!(u >= -0.5f && u <= u_max + 0.5f && v >= -0.5f &&
+          v <= v_max + 0.5f)) {
+      z[i] = std::numeric_limits<float>::quiet_NaN();
+      continue;
+    }
+    u = std::min(std::max(u, 0.0f), u_max);
+    v = std::min(std::max(v, 0.0f), v_max);
+    z[i] = interpolate(grid, u, v) - shift;
+  }
+}
+/**
+ * @brief Check if the vector kernels can address the grid, they need a power
+ * of two tile size to find samples with shifts and 32-bit sample indices.
+ */
+bool is_vectorizable(const QuantizedGrid &grid) {
+  int T = grid.get_tile_size();
+  return T >= 2 && (T & (T - 1)) == 0 && grid.get_cols() >= 2 &&
+         grid.get_rows() >= 2 &&
+         grid.get_sample_count() <=
+             static_cast<size_t>(std::numeric_limits<int32_t>::max());
+}
+int log2_tile_size(const QuantizedGrid &grid) {
+  int shift = 0;
+  while ((1 << shift) < grid.get_tile_size()) {
+    shift++;
+  }
+  return shift;
+}
+
+#if defined(BILINEAR_SAMPLER_X86)
+bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  bool os_saves_ymm = (info[2] & (1 << 27)) && ((_xgetbv(0) & 0x6) == 0x6);
+  __cpuidex(info, 7, 0);
+  return os_saves_ymm && (info[1] & (1 << 5));
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+/**
+ * @brief Decode the corner cells at 8 columns and rows with gathers.
+ */
+TARGET_AVX2 __m256 decode_avx2(const QuantizedGrid &grid, __m256i col,
+                               __m256i row, int tile_shift) {
+  __m256i mask = _mm256_set1_epi32(grid.get_tile_size() - 1);
+  __m256i tile = _mm256_add_epi32(
+      _mm256_mullo_epi32(_mm256_srli_epi32(row, tile_shift),
+                         _mm256_set1_epi32(grid.get_tiles_x())),
+      _mm256_srli_epi32(col, tile_shift));
+  __m256i index = _mm256_add_epi32(
+      _mm256_slli_epi32(tile, 2 * tile_shift),
+      _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(row, mask), tile_shift),
+                       _mm256_and_si256(col, mask)));
+  // gather the 32-bit word holding each sample, the sample count is even so
+  // this never reads past the end of the samples
+  __m256i words = _mm256_i32gather_epi32(
+      reinterpret_cast<const int *>(grid.get_samples()),
+      _mm256_srli_epi32(index, 1), 4);
+  __m256i odd = _mm256_slli_epi32(
+      _mm256_and_si256(index, _mm256_set1_epi32(1)), 4);
+  __m256i sample = _mm256_and_si256(_mm256_srlv_epi32(words, odd),
+                                    _mm256_set1_epi32(0xFFFF));
+  const float *tiles = reinterpret_cast<const float *>(grid.get_tiles());
+  __m256i tile_offset = _mm256_slli_epi32(tile, 1);
+  __m256 bias = _mm256_i32gather_ps(tiles, tile_offset, 4);
+  __m256 scale = _mm256_i32gather_ps(
+      tiles, _mm256_add_epi32(tile_offset, _mm256_set1_epi32(1)), 4);
+  __m256 value = _mm256_add_ps(
+      bias, _mm256_mul_ps(_mm256_cvtepi32_ps(sample), scale));
+  __m256 no_data = _mm256_castsi256_ps(
+      _mm256_cmpeq_epi32(sample, _mm256_set1_epi32(QuantizedGrid::NO_DATA)));
+  return _mm256_blendv_ps(
+      value, _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN()), no_data);
+}
+TARGET_AVX2 void sample_avx2(const QuantizedGrid &grid, float shift,
+                             const GridTransform &transform, const float *x,
+                             const float *y, float *z, size_t begin,
+                             size_t end) {
+  int tile_shift = log2_tile_size(grid);
+  float u_max = static_cast<float>(grid.get_cols() - 1);
+  float v_max = static_cast<float>(grid.get_rows() - 1);
+  __m256 scale_x = _mm256_set1_ps(transform.scale_x);
+  __m256 offset_x = _mm256_set1_ps(transform.offset_x);
+  __m256 scale_y = _mm256_set1_ps(transform.scale_y);
+  __m256 offset_y = _mm256_set1_ps(transform.offset_y);
+  __m256 zero = _mm256_setzero_ps();
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 u_hi = _mm256_set1_ps(u_max);
+  __m256 v_hi = _mm256_set1_ps(v_max);
+  __m256i one = _mm256_set1_epi32(1);
+  __m256i zero_i = _mm256_setzero_si256();
+  __m256i i_max = _mm256_set1_epi32(grid.get_cols() - 2);
+  __m256i j_max = _mm256_set1_epi32(grid.get_rows() - 2);
+  __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  __m256 shift_v = _mm256_set1_ps(shift);
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 u = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(x + i), scale_x),
+                             offset_x);
+    __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(y + i), scale_y),
+                             offset_y);
+    // ordered compares are false for NaN coordinates
+    __m256 inside = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(u, _mm256_sub_ps(zero, half), _CMP_GE_OQ),
+                      _mm256_cmp_ps(u, _mm256_add_ps(u_hi, half), _CMP_LE_OQ)),
+        _mm256_and_ps(_mm256_cmp_ps(v, _mm256_sub_ps(zero, half), _CMP_GE_OQ),
+                      _mm256_cmp_ps(v, _mm256_add_ps(v_hi, half), _CMP_LE_OQ)));
+    // max returns its second operand for NaN so the clamped value never is
+    u = _mm256_min_ps(_mm256_max_ps(u, zero), u_hi);
+    v = _mm256_min_ps(_mm256_max_ps(v, zero), v_hi);
+    __m256i i0 = _mm256_max_epi32(
+        _mm256_min_epi32(_mm256_cvttps_epi32(u), i_max), zero_i);
+    __m256i j0 = _mm256_max_epi32(
+        _mm256_min_epi32(_mm256_cvttps_epi32(v), j_max), zero_i);
+    __m256i i1 = _mm256_add_epi32(i0, one);
+    __m256i j1 = _mm256_add_epi32(j0, one);
+    __m256 fu = _mm256_sub_ps(u, _mm256_cvtepi32_ps(i0));
+    __m256 fv = _mm256_sub_ps(v, _mm256_cvtepi32_ps(j0));
+    __m256 h00 = decode_avx2(grid, i0, j0, tile_shift);
+    __m256 h10 = decode_avx2(grid, i1, j0, tile_shift);
+    __m256 h01 = decode_avx2(grid, i0, j1, tile_shift);
+    __m256 h11 = decode_avx2(grid, i1, j1, tile_shift);
+    __m256 h0 = _mm256_add_ps(h00, _mm256_mul_ps(fu, _mm256_sub_ps(h10, h00)));
+    __m256 h1 = _mm256_add_ps(h01, _mm256_mul_ps(fu, _mm256_sub_ps(h11, h01)));
+    __m256 h = _mm256_sub_ps(
+        _mm256_add_ps(h0, _mm256_mul_ps(fv, _mm256_sub_ps(h1, h0))), shift_v);
+    _mm256_storeu_ps(z + i, _mm256_blendv_ps(nan, h, inside));
+  }
+  sample_scalar(grid, shift, transform, x, y, z, i, end);
+}
+#endif
+
+#if defined(BILINEAR_SAMPLER_NEON)
+/**
+ * @brief NEON has no gathers, the coordinate math and the interpolation are
+ * vectorized and the corner cells are decoded one lane at a time.
+ */
+void sample_neon(const QuantizedGrid &grid, float shift,
+                 const GridTransform &transform, const float *x,
+                 const float *y, float *z, size_t begin, size_t end) {
+  float u_max = static_cast<float>(grid.get_cols() - 1);
+  float v_max = static_cast<float>(grid.get_rows() - 1);
+  float32x4_t zero = vdupq_n_f32(0.0f);
+  float32x4_t u_hi = vdupq_n_f32(u_max);
+  float32x4_t v_hi = vdupq_n_f32(v_max);
+  int32x4_t i_max = vdupq_n_s32(grid.get_cols() - 2);
+  int32x4_t j_max = vdupq_n_s32(grid.get_rows() - 2);
+  float32x4_t nan = vdupq_n_f32(std::numeric_limits<float>::quiet_NaN());
+  size_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    float32x4_t u = vmlaq_n_f32(vdupq_n_f32(transform.offset_x),
+                                vld1q_f32(x + i), transform.scale_x);
+    float32x4_t v = vmlaq_n_f32(vdupq_n_f32(transform.offset_y),
+                                vld1q_f32(y + i), transform.scale_y);
+    uint32x4_t inside = vandq_u32(
+        vandq_u32(vcgeq_f32(u, vdupq_n_f32(-0.5f)),
+                  vcleq_f32(u, vdupq_n_f32(u_max + 0.5f))),
+        vandq_u32(vcgeq_f32(v, vdupq_n_f32(-0.5f)),
+                  vcleq_f32(v, vdupq_n_f32(v_max + 0.5f))));
+    // vmaxnm returns the number when one operand is NaN
+    u = vminq_f32(vmaxnmq_f32(u, zero), u_hi);
+    v = vminq_f32(vmaxnmq_f32(v, zero), v_hi);
+    int32x4_t i0 =
+        vmaxq_s32(vminq_s32(vcvtq_s32_f32(u), i_max), vdupq_n_s32(0));
+    int32x4_t j0 =
+        vmaxq_s32(vminq_s32(vcvtq_s32_f32(v), j_max), vdupq_n_s32(0));
+    float32x4_t fu = vsubq_f32(u, vcvtq_f32_s32(i0));
+    float32x4_t fv = vsubq_f32(v, vcvtq_f32_s32(j0));
+    int cols[4], rows[4];
+    vst1q_s32(cols, i0);
+    vst1q_s32(rows, j0);
+    float c00[4], c10[4], c01[4], c11[4];
+    for (int lane = 0; lane < 4; lane++) {
+      c00[lane] = decode(grid, cols[lane], rows[lane]);
+      c10[lane] = decode(grid, cols[lane] + 1, rows[lane]);
+      c01[lane] = decode(grid, cols[lane], rows[lane] + 1);
+      c11[lane] = decode(grid, cols[lane] + 1, rows[lane] + 1);
+    }
+    float32x4_t h00 = vld1q_f32(c00);
+    float32x4_t h10 = vld1q_f32(c10);
+    float32x4_t h01 = vld1q_f32(c01);
+    float32x4_t h11 = vld1q_f32(c11);
+    float32x4_t h0 = vmlaq_f32(h00, fu, vsubq_f32(h10, h00));
+    float32x4_t h1 = vmlaq_f32(h01, fu, vsubq_f32(h11, h01));
+    float32x4_t h = vsubq_f32(vmlaq_f32(h0, fv, vsubq_f32(h1, h0)),
+                              vdupq_n_f32(shift));
+    vst1q_f32(z + i, vbslq_f32(inside, h, nan));
+  }
+  sample_scalar(grid, shift, transform, x, y, z, i, end);
+}
+#endif
+
+SimdLevel detect_simd_level() {
+#if defined(BILINEAR_SAMPLER_X86)
+  if (cpu_has_avx2()) {
+    return SimdLevel::AVX2;
+  }
+#elif defined(BILINEAR_SAMPLER_NEON)
+  return SimdLevel::NEON;
+#endif
+  return SimdLevel::SCALAR;
+}
+SampleKernel select_kernel(SimdLevel level) {
+  switch (level) {
+#if defined(BILINEAR_SAMPLER_X86)
+  case SimdLevel::AVX2:
+    return sample_avx2;
+#elif defined(BILINEAR_SAMPLER_NEON)
+  case SimdLevel::NEON:
+    return sample_neon;
+#endif
+  default:
+    return sample_scalar;
+  }
+}
+} // namespace
+
+SimdLevel get_simd_level() {
+  static const SimdLevel level = detect_simd_level();
+  return level;
+}
+void sample_bilinear(const QuantizedGrid &grid, float shift,
+                     const GridTransform &transform, const float *x,
+                     const float *y, float *z, size_t count) {
+  static const SampleKernel kernel = select_kernel(get_simd_level());
+  if (grid.get_cols() == 0 || grid.get_rows() == 0) {
+    std::fill(z, z + count, std::numeric_limits<float>::quiet_NaN());
+    return;
+  }
+  if (!is_vectorizable(grid)) {
+    sample_scalar(grid, shift, transform, x, y, z, 0, count);
+    return;
+  }
+  kernel(grid, shift, transform, x, y, z, 0, count);
+}
+} // namespace math_3dh
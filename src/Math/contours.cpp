@@ -0,0 +1,396 @@
+#include "Math/contours.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <unordered_map>
+
+// 3DH
+#include "Math/parallel.hpp"
+
+namespace math_3dh {
+namespace {
+constexpr int TS = TiledGrid<float>::TILE_SIZE;
+constexpr uint64_t EDGE_MASK = 0xffffffffull;
+constexpr uint32_t NONE = 0xffffffffu;
+/**
+ * @brief A contour piece inside one square, from the edge where the walk
+ * around the square rises through the level to the edge where it falls.
+ */
+struct ContourSegment {
+  uint64_t head;
+  uint64_t tail;
+  glm::vec2 a;
+  glm::vec2 b;
+  float level;
+  uint16_t square; /**< The square in the tile, row major.*/
+  uint8_t exit;    /**< The edge of the square the segment leaves through.*/
+};
+/**
+ * @brief The segments of one tile joined into a polyline.
+ * @details The ends are keyed by the level and the grid edge they lie on, the
+ * same key in the neighbouring tile continues the polyline.
+ */
+struct ContourChain {
+  float level;
+  uint64_t head;
+  uint64_t tail;
+  bool closed;
+  size_t begin; /**< The first point in TileContours::points.*/
+  size_t end;
+};
+/**
+ * @brief The contours of one tile, reused by the tiles of a column so tracing
+ * only allocates while the tiles get busier.
+ */
+struct TileContours {
+  std::vector<float> z{};
+  std::vector<int> k_of{};
+  std::vector<ContourSegment> segments{};
+  std::vector<uint32_t> first{};
+  std::vector<uint32_t> next{};
+  std::vector<uint8_t> has_prev{};
+  std::vector<uint8_t> used{};
+  std::vector<ContourChain> chains{};
+  std::vector<glm::vec2> points{};
+};
+/**
+ * @brief A contour crossing the tile seams, grown at both ends as the tiles
+ * around it are traced.
+ */
+struct OpenContour {
+  float level = 0.0f;
+  uint64_t head = 0;
+  uint64_t tail = 0;
+  std::deque<glm::vec2> points{};
+};
+/**
+ * @brief The key of a grid edge crossed by the contour of level \p k.
+ * @details The edge from a cell center to the next column is 2 * cell, to the
+ * next row 2 * cell + 1.
+ */
+inline uint64_t edge_key(int k, uint64_t edge) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(k)) << 32) | edge;
+}
+inline float level_of(int k, double base, double interval) {
+  return static_cast<float>(base + k * interval);
+}
+/**
+ * @brief Get the index of the highest level at or below an elevation, so the
+ * corner is above level k exactly when k is at most its index.
+ */
+inline int level_index(float elevation, double base, double interval) {
+  int k = static_cast<int>(std::floor((elevation - base) / interval));
+  while (level_of(k + 1, base, interval) <= elevation) {
+    k++;
+  }
+  while (level_of(k, base, interval) > elevation) {
+    k--;
+  }
+  return k;
+}
+/**
+ * @brief Trace the squares whose top left corner is in a tile and join their
+ * segments into polylines.
+ */
+void trace_tile(const TiledGrid<float> &elevations, TileRect rect,
+                double interval, double base, TileContours &out) {
+  constexpr int W = TS + 1;
+  int cols = elevations.get_cols();
+  out.segments.clear();
+  out.chains.clear();
+  out.points.clear();
+  // the squares of the tile and the corners around them
+  int width = std::min(rect.width, cols - 1 - rect.col);
+  int height = std::min(rect.height, elevations.get_rows() - 1 - rect.row);
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  out.z.resize(W * W);
+  out.k_of.resize(W * W);
+  for (int j = 0; j <= height; j++) {
+    for (int i = 0; i <= width; i++) {
+      float elevation = elevations(rect.col + i, rect.row + j);
+      out.z[j * W + i] = elevation;
+      out.k_of[j * W + i] =
+          std::isnan(elevation) ? 0 : level_index(elevation, base, interval);
+    }
+  }
+  auto &segments = out.segments;
+  auto &first = out.first;
+  first.assign(TS * TS + 1, 0);
+  for (int j = 0; j < height; j++) {
+    for (int i = 0; i < width; i++) {
+      int square = j * TS + i;
+      first[square] = static_cast<uint32_t>(segments.size());
+      // corners clockwise from the top left
+      int corner = j * W + i;
+      int at[4] = {corner, corner + 1, corner + W + 1, corner + W};
+      float v[4] = {out.z[at[0]], out.z[at[1]], out.z[at[2]], out.z[at[3]]};
+      int k[4] = {out.k_of[at[0]], out.k_of[at[1]], out.k_of[at[2]],
+                  out.k_of[at[3]]};
+      int k_min = std::min(std::min(k[0], k[1]), std::min(k[2], k[3]));
+      int k_max = std::max(std::max(k[0], k[1]), std::max(k[2], k[3]));
+      if (k_min == k_max || std::isnan(v[0]) || std::isnan(v[1]) ||
+          std::isnan(v[2]) || std::isnan(v[3])) {
+        continue;
+      }
+      int c = rect.col + i;
+      int r = rect.row + j;
+      uint64_t cell = static_cast<uint64_t>(r) * cols + c;
+      // edges clockwise from the top, edge e joins corners e and e + 1
+      uint64_t edges[4] = {2 * cell, 2 * (cell + 1) + 1, 2 * (cell + cols),
+                           2 * cell + 1};
+      for (int level_k = k_min + 1; level_k <= k_max; level_k++) {
+        float level = level_of(level_k, base, interval);
+        bool high[4] = {k[0] >= level_k, k[1] >= level_k, k[2] >= level_k,
+                        k[3] >= level_k};
+        // points are interpolated from the top or left end of their edge, so
+        // the squares on both sides of an edge agree exactly
+        auto point = [&](int e) -> glm::vec2 {
+          float x = static_cast<float>(c);
+          float y = static_cast<float>(r);
+          switch (e) {
+          case 0:
+            return {x + (level - v[0]) / (v[1] - v[0]), y};
+          case 1:
+            return {x + 1.0f, y + (level - v[1]) / (v[2] - v[1])};
+          case 2:
+            return {x + (level - v[3]) / (v[2] - v[3]), y + 1.0f};
+          default:
+            return {x, y + (level - v[0]) / (v[3] - v[0])};
+          }
+        };
+        auto add = [&](int from, int to) {
+          segments.push_back({edge_key(level_k, edges[from]),
+                              edge_key(level_k, edges[to]), point(from),
+                              point(to), level, static_cast<uint16_t>(square),
+                              static_cast<uint8_t>(to)});
+        };
+        int rises[2];
+        int rise_count = 0;
+        int fall = 0;
+        for (int e = 0; e < 4; e++) {
+          if (!high[e] && high[(e + 1) & 3]) {
+            rises[rise_count++] = e;
+          } else if (high[e] && !high[(e + 1) & 3]) {
+            fall = e;
+          }
+        }
+        if (rise_count == 1) {
+          add(rises[0], fall);
+        } else {
+          // a saddle, the average decides whether the high corners connect
+          bool center_high = (v[0] + v[1] + v[2] + v[3]) * 0.25f >= level;
+          for (int e : rises) {
+            add(e, center_high ? (e + 3) & 3 : (e + 1) & 3);
+          }
+        }
+      }
+    }
+    for (int i = width; i < TS; i++) {
+      first[j * TS + i] = static_cast<uint32_t>(segments.size());
+    }
+  }
+  std::fill(first.begin() + height * TS, first.end(),
+            static_cast<uint32_t>(segments.size()));
+  // the next segment is in the square across the exit edge
+  auto &next = out.next;
+  auto &has_prev = out.has_prev;
+  next.assign(segments.size(), NONE);
+  has_prev.assign(segments.size(), 0);
+  for (uint32_t s = 0; s < segments.size(); s++) {
+    int i = segments[s].square & (TS - 1);
+    int j = segments[s].square / TS;
+    switch (segments[s].exit) {
+    case 0:
+      j--;
+      break;
+    case 1:
+      i++;
+      break;
+    case 2:
+      j++;
+      break;
+    default:
+      i--;
+    }
+    if (i < 0 || i >= width || j < 0 || j >= height) {
+      continue;
+    }
+    int square = j * TS + i;
+    for (uint32_t t = first[square]; t < first[square + 1]; t++) {
+      if (segments[t].head == segments[s].tail) {
+        next[s] = t;
+        has_prev[t] = 1;
+        break;
+      }
+    }
+  }
+  auto &used = out.used;
+  used.assign(segments.size(), 0);
+  auto walk = [&](uint32_t start) {
+    ContourChain chain{segments[start].level, segments[start].head, 0, false,
+                       out.points.size(), 0};
+    out.points.push_back(segments[start].a);
+    uint32_t s = start;
+    while (true) {
+      used[s] = 1;
+      out.points.push_back(segments[s].b);
+      chain.tail = segments[s].tail;
+      s = next[s];
+      if (s == NONE) {
+        break;
+      }
+      if (s == start) {
+        chain.closed = true;
+        break;
+      }
+    }
+    chain.end = out.points.size();
+    out.chains.push_back(chain);
+  };
+  for (uint32_t s = 0; s < segments.size(); s++) {
+    if (!has_prev[s]) {
+      walk(s);
+    }
+  }
+  // what is left are rings
+  for (uint32_t s = 0; s < segments.size(); s++) {
+    if (!used[s]) {
+      walk(s);
+    }
+  }
+}
+} // namespace
+
+size_t trace_contours(const TiledGrid<float> &elevations, float interval,
+                      ContourSink &sink, double base,
+                      unsigned int thread_count) {
+  int cols = elevations.get_cols();
+  int rows = elevations.get_rows();
+  if (!(interval > 0.0f)) {
+    std::cerr << "Error: Contour interval must be positive." << std::endl;
+    return 0;
+  }
+  if (2 * static_cast<uint64_t>(cols) * rows > EDGE_MASK) {
+    std::cerr << "Error: DEM is too large to contour." << std::endl;
+    return 0;
+  }
+  size_t count = 0;
+  std::vector<glm::vec2> points{};
+  auto emit = [&](float level, auto begin, auto end, bool closed) {
+    points.assign(begin, end);
+    sink.add_contour(level, points, closed);
+    count++;
+  };
+  // contours crossing the seams, by the key of their head and tail
+  std::vector<OpenContour> open{};
+  std::vector<size_t> free_slots{};
+  std::unordered_map<uint64_t, size_t> heads{};
+  std::unordered_map<uint64_t, size_t> tails{};
+  auto release = [&](size_t slot) {
+    heads.erase(open[slot].head);
+    tails.erase(open[slot].tail);
+    open[slot].points.clear();
+    free_slots.push_back(slot);
+  };
+  auto stitch = [&](const ContourChain &chain, const glm::vec2 *begin,
+                    const glm::vec2 *end) {
+    auto before = tails.find(chain.head);
+    auto after = heads.find(chain.tail);
+    if (before != tails.end()) {
+      // grow the contour ending where the chain starts
+      size_t slot = before->second;
+      OpenContour &contour = open[slot];
+      tails.erase(before);
+      contour.points.insert(contour.points.end(), begin + 1, end);
+      contour.tail = chain.tail;
+      if (after == heads.end()) {
+        tails[contour.tail] = slot;
+      } else if (after->second == slot) {
+        emit(contour.level, contour.points.begin(), contour.points.end(),
+             true);
+        release(slot);
+      } else {
+        // the chain joins two contours
+        OpenContour &joined = open[after->second];
+        contour.points.insert(contour.points.end(), joined.points.begin() + 1,
+                              joined.points.end());
+        contour.tail = joined.tail;
+        release(after->second);
+        tails[contour.tail] = slot;
+      }
+    } else if (after != heads.end()) {
+      // grow the contour starting where the chain ends
+      size_t slot = after->second;
+      OpenContour &contour = open[slot];
+      heads.erase(after);
+      contour.points.insert(contour.points.begin(), begin, end - 1);
+      contour.head = chain.head;
+      heads[contour.head] = slot;
+    } else {
+      size_t slot = open.size();
+      if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+      } else {
+        open.emplace_back();
+      }
+      OpenContour &contour = open[slot];
+      contour.level = chain.level;
+      contour.head = chain.head;
+      contour.tail = chain.tail;
+      contour.points.assign(begin, end);
+      heads[contour.head] = slot;
+      tails[contour.tail] = slot;
+    }
+  };
+  int tiles_x = elevations.get_tiles_x();
+  int tiles_y = elevations.get_tiles_y();
+  std::vector<TileContours> traced(tiles_x);
+  for (int ty = 0; ty < tiles_y; ty++) {
+    parallel_for(
+        0, tiles_x,
+        [&](size_t tx) {
+          trace_tile(
+              elevations,
+              elevations.get_tile_rect(static_cast<size_t>(ty) * tiles_x + tx),
+              interval, base, traced[tx]);
+        },
+        thread_count);
+    for (const TileContours &tile : traced) {
+      for (const ContourChain &chain : tile.chains) {
+        const glm::vec2 *begin = tile.points.data() + chain.begin;
+        const glm::vec2 *end = tile.points.data() + chain.end;
+        if (chain.closed) {
+          emit(chain.level, begin, end, true);
+        } else {
+          stitch(chain, begin, end);
+        }
+      }
+    }
+    // only contours ending on the edges between this row of tiles and the
+    // next can still grow
+    int seam = (ty + 1) * TS;
+    auto can_grow = [&](uint64_t key) {
+      uint64_t edge = key & EDGE_MASK;
+      return seam < rows - 1 && !(edge & 1) &&
+             static_cast<int>((edge >> 1) / cols) == seam;
+    };
+    for (size_t slot = 0; slot < open.size(); slot++) {
+      OpenContour &contour = open[slot];
+      if (contour.points.empty() || can_grow(contour.head) ||
+          can_grow(contour.tail)) {
+        continue;
+      }
+      emit(contour.level, contour.points.begin(), contour.points.end(), false);
+      release(slot);
+    }
+  }
+  return count;
+}
+} // namespace math_3dh
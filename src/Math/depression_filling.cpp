@@ -0,0 +1,547 @@
+#include "Math/depression_filling.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace math_3dh {
+namespace {
+constexpr uint32_t NO_LABEL = std::numeric_limits<uint32_t>::max();
+constexpr uint32_t OCEAN = 0; /**< The label of cells that drain off the DEM.*/
+const float infinity = std::numeric_limits<float>::infinity();
+using OpenCell = std::pair<float, size_t>;
+using OpenQueue =
+    std::priority_queue<OpenCell, std::vector<OpenCell>, std::greater<OpenCell>>;
+/**
+ * @brief The lowest elevation at which water spills between two watersheds.
+ */
+struct SpillEdge {
+  uint32_t a;
+  uint32_t b;
+  float elevation;
+};
+/**
+ * @brief One chunk of the DEM with a one cell halo, flooded from its border.
+ */
+struct ChunkFlood {
+  int col = 0;
+  int row = 0;
+  int width = 0;
+  int height = 0;
+  std::vector<float> z{};        /**< Halo included, filled in place.*/
+  std::vector<uint32_t> label{}; /**< Chunk local labels, OCEAN or 1...*/
+  uint32_t label_count = 0;
+  std::vector<SpillEdge> edges{}; /**< Between labels of the chunk.*/
+  inline int stride() const { return width + 2; }
+  inline size_t at(int i, int j) const {
+    return static_cast<size_t>(j + 1) * stride() + i + 1;
+  }
+};
+/**
+ * @brief The labels and elevations of the border cells of a flooded chunk,
+ * all that pass 1 keeps of it.
+ */
+struct ChunkBorder {
+  int col = 0;
+  int row = 0;
+  int width = 0;
+  int height = 0;
+  uint32_t label_base = 0;
+  std::vector<uint32_t> label{}; /**< Top, bottom, left then right.*/
+  std::vector<float> z{};
+  size_t slot(int i, int j) const {
+    if (j == 0) {
+      return i;
+    }
+    if (j == height - 1) {
+      return width + i;
+    }
+    if (i == 0) {
+      return 2 * width + j;
+    }
+    return 2 * width + height + j;
+  }
+  uint32_t global_label(uint32_t local) const {
+    return local == OCEAN || local == NO_LABEL ? local : label_base + local;
+  }
+};
+void read_chunk(ChunkSource &dem, ChunkFlood &chunk) {
+  chunk.z.resize(static_cast<size_t>(chunk.stride()) * (chunk.height + 2));
+  dem.read(chunk.col - 1, chunk.row - 1, chunk.stride(), chunk.height + 2,
+           chunk.z.data());
+}
+/**
+ * @brief Priority-flood a chunk from its border and the cells next to no data,
+ * labelling each cell with the watershed it is flooded from.
+ * @details The queue breaks ties by cell, so flooding the same chunk twice
+ * gives the same labels.
+ */
+void flood_chunk(ChunkFlood &chunk) {
+  int w = chunk.width;
+  int h = chunk.height;
+  int stride = chunk.stride();
+  chunk.label.assign(chunk.z.size(), NO_LABEL);
+  chunk.label_count = 0;
+  chunk.edges.clear();
+  std::vector<uint8_t> closed(chunk.z.size(), 0);
+  OpenQueue open{};
+  for (int j = 0; j < h; j++) {
+    for (int i = 0; i < w; i++) {
+      size_t k = chunk.at(i, j);
+      if (std::isnan(chunk.z[k])) {
+        continue;
+      }
+      bool outlet = false;
+      for (int d = 0; d < 8; d++) {
+        outlet |= std::isnan(chunk.z[k + D8_DY[d] * stride + D8_DX[d]]);
+      }
+      if (outlet) {
+        chunk.label[k] = OCEAN;
+        open.push({chunk.z[k], k});
+      } else if (i == 0 || j == 0 || i == w - 1 || j == h - 1) {
+        open.push({chunk.z[k], k});
+      }
+    }
+  }
+  while (!open.empty()) {
+    size_t k = open.top().second;
+    open.pop();
+    if (closed[k]) {
+      continue;
+    }
+    closed[k] = 1;
+    if (chunk.label[k] == NO_LABEL) {
+      chunk.label[k] = ++chunk.label_count;
+    }
+    int i = static_cast<int>(k % stride) - 1;
+    int j = static_cast<int>(k / stride) - 1;
+    for (int d = 0; d < 8; d++) {
+      int ni = i + D8_DX[d];
+      int nj = j + D8_DY[d];
+      size_t n = chunk.at(ni, nj);
+      if (ni < 0 || nj < 0 || ni >= w || nj >= h || std::isnan(chunk.z[n])) {
+        continue;
+      }
+      if (chunk.label[n] == NO_LABEL) {
+        chunk.label[n] = chunk.label[k];
+        chunk.z[n] = std::max(chunk.z[n], chunk.z[k]);
+        open.push({chunk.z[n], n});
+      } else if (chunk.label[n] != chunk.label[k]) {
+        chunk.edges.push_back({std::min(chunk.label[k], chunk.label[n]),
+                               std::max(chunk.label[k], chunk.label[n]),
+                               std::max(chunk.z[k], chunk.z[n])});
+      }
+    }
+  }
+  // keep the lowest spill between each pair of labels
+  std::sort(chunk.edges.begin(), chunk.edges.end(),
+            [](const SpillEdge &x, const SpillEdge &y) {
+              return std::tie(x.a, x.b, x.elevation) <
+                     std::tie(y.a, y.b, y.elevation);
+            });
+  chunk.edges.erase(std::unique(chunk.edges.begin(), chunk.edges.end(),
+                                [](const SpillEdge &x, const SpillEdge &y) {
+                                  return x.a == y.a && x.b == y.b;
+                                }),
+                    chunk.edges.end());
+}
+/**
+ * @brief Priority-flood the graph of watersheds from the ocean.
+ *
+ * @return The water level of each label.
+ */
+std::vector<float> flood_labels(size_t label_count,
+                                const std::vector<SpillEdge> &edges) {
+  std::vector<size_t> first(label_count + 1, 0);
+  for (const SpillEdge &edge : edges) {
+    first[edge.a + 1]++;
+    first[edge.b + 1]++;
+  }
+  for (size_t l = 0; l < label_count; l++) {
+    first[l + 1] += first[l];
+  }
+  std::vector<std::pair<uint32_t, float>> links(first[label_count]);
+  std::vector<size_t> fill = first;
+  for (const SpillEdge &edge : edges) {
+    links[fill[edge.a]++] = {edge.b, edge.elevation};
+    links[fill[edge.b]++] = {edge.a, edge.elevation};
+  }
+  std::vector<float> level(label_count, infinity);
+  std::vector<uint8_t> settled(label_count, 0);
+  OpenQueue open{};
+  level[OCEAN] = -infinity;
+  open.push({-infinity, OCEAN});
+  while (!open.empty()) {
+    size_t l = open.top().second;
+    open.pop();
+    if (settled[l]) {
+      continue;
+    }
+    settled[l] = 1;
+    for (size_t e = first[l]; e < first[l + 1]; e++) {
+      uint32_t m = links[e].first;
+      float candidate = std::max(level[l], links[e].second);
+      if (!settled[m] && candidate < level[m]) {
+        level[m] = candidate;
+        open.push({candidate, m});
+      }
+    }
+  }
+  return level;
+}
+/**
+ * @brief Raise the flat cells of a filled DEM so every cell drains down a
+ * strictly descending path.
+ */
+void apply_epsilon(TiledGrid<float> &elevations, float epsilon) {
+  TiledGrid<uint8_t> closed(elevations.get_cols(), elevations.get_rows(), 0);
+  OpenQueue open{};
+  std::deque<size_t> pits{};
+  float no_data = std::nanf("");
+  for (const auto &cell : elevations) {
+    if (std::isnan(cell.value)) {
+      continue;
+    }
+    auto cells = elevations.neighbourhood(cell.col, cell.row, no_data);
+    for (int d = 0; d < 8; d++) {
+      if (std::isnan(cells.neighbour(d))) {
+        closed(cell.col, cell.row) = 1;
+        open.push({cell.value, elevations.index(cell.col, cell.row)});
+        break;
+      }
+    }
+  }
+  while (!open.empty() || !pits.empty()) {
+    size_t c;
+    if (!pits.empty()) {
+      c = pits.front();
+      pits.pop_front();
+    } else {
+      c = open.top().second;
+      open.pop();
+    }
+    int col, row;
+    elevations.get_cell(c, col, row);
+    float z = elevations.data()[c];
+    float rise = std::max(z + epsilon, std::nextafter(z, infinity));
+    elevations.for_each_neighbour(col, row, [&](int nc, int nr, int) {
+      float &nz = elevations(nc, nr);
+      if (closed(nc, nr) || std::isnan(nz)) {
+        return;
+      }
+      closed(nc, nr) = 1;
+      if (nz < rise) {
+        nz = rise;
+        pits.push_back(elevations.index(nc, nr));
+      } else {
+        open.push({nz, elevations.index(nc, nr)});
+      }
+    });
+  }
+}
+} // namespace
+
+void TiledGridChunks::read(int col, int row, int width, int height,
+                           float *dst) {
+  float no_data = std::nanf("");
+  for (int j = 0; j < height; j++) {
+    for (int i = 0; i < width; i++) {
+      dst[static_cast<size_t>(j) * width + i] =
+          grid->get(col + i, row + j, no_data);
+    }
+  }
+}
+void TiledGridChunks::write(int col, int row, int width, int height,
+                            const float *src) {
+  for (int j = 0; j < height; j++) {
+    for (int i = 0; i < width; i++) {
+      (*grid)(col + i, row + j) = src[static_cast<size_t>(j) * width + i];
+    }
+  }
+}
+void fill_depressions(ChunkSource &dem, int chunk_size,
+                      unsigned int thread_count) {
+  int cols = dem.get_cols();
+  int rows = dem.get_rows();
+  int chunks_x = (cols + chunk_size - 1) / chunk_size;
+  int chunks_y = (rows + chunk_size - 1) / chunk_size;
+  size_t chunk_count = static_cast<size_t>(chunks_x) * chunks_y;
+  auto make_chunk = [&](size_t c) {
+    ChunkFlood chunk{};
+    chunk.col = static_cast<int>(c % chunks_x) * chunk_size;
+    chunk.row = static_cast<int>(c / chunks_x) * chunk_size;
+    chunk.width = std::min(chunk_size, cols - chunk.col);
+    chunk.height = std::min(chunk_size, rows - chunk.row);
+    return chunk;
+  };
+  // pass 1, flood each chunk and keep its spill edges and border
+  std::vector<ChunkBorder> borders(chunk_count);
+  std::vector<std::vector<SpillEdge>> chunk_edges(chunk_count);
+  parallel_for(
+      0, chunk_count,
+      [&](size_t c) {
+        ChunkFlood chunk = make_chunk(c);
+        read_chunk(dem, chunk);
+        flood_chunk(chunk);
+        ChunkBorder &border = borders[c];
+        border.col = chunk.col;
+        border.row = chunk.row;
+        border.width = chunk.width;
+        border.height = chunk.height;
+        border.label_base = chunk.label_count;
+        size_t slots = 2 * static_cast<size_t>(chunk.width + chunk.height);
+        border.label.assign(slots, NO_LABEL);
+        border.z.assign(slots, 0.0f);
+        for (int j = 0; j < chunk.height; j++) {
+          for (int i = 0; i < chunk.width; i++) {
+            if (i == 0 || j == 0 || i == chunk.width - 1 ||
+                j == chunk.height - 1) {
+              border.label[border.slot(i, j)] = chunk.label[chunk.at(i, j)];
+              border.z[border.slot(i, j)] = chunk.z[chunk.at(i, j)];
+            }
+          }
+        }
+        chunk_edges[c] = std::move(chunk.edges);
+      },
+      thread_count);
+  // number the labels of all chunks, 0 is the ocean
+  size_t label_count = 1;
+  for (ChunkBorder &border : borders) {
+    uint32_t count = border.label_base;
+    border.label_base = static_cast<uint32_t>(label_count - 1);
+    label_count += count;
+  }
+  std::vector<SpillEdge> edges{};
+  for (size_t c = 0; c < chunk_count; c++) {
+    for (const SpillEdge &edge : chunk_edges[c]) {
+      edges.push_back({borders[c].global_label(edge.a),
+                       borders[c].global_label(edge.b), edge.elevation});
+    }
+    std::vector<SpillEdge>().swap(chunk_edges[c]);
+  }
+  // spills between border cells of neighbouring chunks
+  auto border_cell = [&](int col, int row, uint32_t &label, float &z) {
+    if (col < 0 || row < 0 || col >= cols || row >= rows) {
+      return false;
+    }
+    const ChunkBorder &border =
+        borders[static_cast<size_t>(row / chunk_size) * chunks_x +
+                col / chunk_size];
+    size_t slot = border.slot(col - border.col, row - border.row);
+    label = border.global_label(border.label[slot]);
+    z = border.z[slot];
+    return label != NO_LABEL;
+  };
+  auto link = [&](int col, int row, int other_col, int other_row) {
+    uint32_t a, b;
+    float za, zb;
+    if (border_cell(col, row, a, za) &&
+        border_cell(other_col, other_row, b, zb) && a != b) {
+      edges.push_back({a, b, std::max(za, zb)});
+    }
+  };
+  for (const ChunkBorder &border : borders) {
+    int right = border.col + border.width - 1;
+    int bottom = border.row + border.height - 1;
+    for (int row = border.row; row <= bottom; row++) {
+      for (int dy = -1; dy <= 1; dy++) {
+        link(right, row, right + 1, row + dy);
+      }
+    }
+    for (int col = border.col; col <= right; col++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        link(col, bottom, col + dx, bottom + 1);
+      }
+    }
+  }
+  std::vector<float> level = flood_labels(label_count, edges);
+  std::vector<SpillEdge>().swap(edges);
+  // pass 2, flood each chunk again and raise it to the level of its labels,
+  // neighbouring chunks never run at once so reads of the halo never race
+  // writes of the neighbour
+  for (int phase = 0; phase < 4; phase++) {
+    std::vector<size_t> phase_chunks{};
+    for (size_t c = 0; c < chunk_count; c++) {
+      int cx = static_cast<int>(c % chunks_x);
+      int cy = static_cast<int>(c / chunks_x);
+      if ((cx % 2) + 2 * (cy % 2) == phase) {
+        phase_chunks.push_back(c);
+      }
+    }
+    parallel_for(
+        0, phase_chunks.size(),
+        [&](size_t p) {
+          size_t c = phase_chunks[p];
+          ChunkFlood chunk = make_chunk(c);
+          read_chunk(dem, chunk);
+          flood_chunk(chunk);
+          std::vector<float> filled(static_cast<size_t>(chunk.width) *
+                                    chunk.height);
+          for (int j = 0; j < chunk.height; j++) {
+            for (int i = 0; i < chunk.width; i++) {
+              size_t k = chunk.at(i, j);
+              float z = chunk.z[k];
+              uint32_t label = borders[c].global_label(chunk.label[k]);
+              if (!std::isnan(z) && level[label] < infinity) {
+                z = std::max(z, level[label]);
+              }
+              filled[static_cast<size_t>(j) * chunk.width + i] = z;
+            }
+          }
+          dem.write(chunk.col, chunk.row, chunk.width, chunk.height,
+                    filled.data());
+        },
+        thread_count);
+  }
+}
+void fill_depressions(TiledGrid<float> &elevations, float epsilon,
+                      unsigned int thread_count) {
+  TiledGridChunks chunks(&elevations);
+  fill_depressions(chunks, 512, thread_count);
+  if (epsilon > 0.0f) {
+    apply_epsilon(elevations, epsilon);
+  }
+}
+size_t breach_depressions(TiledGrid<float> &elevations, int max_length,
+                          float max_depth) {
+  float no_data = std::nanf("");
+  auto is_pit = [&](int col, int row) {
+    auto cells = elevations.neighbourhood(col, row, no_data);
+    if (std::isnan(cells.center())) {
+      return false;
+    }
+    for (int d = 0; d < 8; d++) {
+      float neighbour = cells.neighbour(d);
+      if (std::isnan(neighbour) || neighbour <= cells.center()) {
+        return false;
+      }
+    }
+    return true;
+  };
+  std::vector<std::pair<float, size_t>> pits{};
+  for (const auto &cell : elevations) {
+    if (is_pit(cell.col, cell.row)) {
+      pits.push_back({cell.value, elevations.index(cell.col, cell.row)});
+    }
+  }
+  std::sort(pits.begin(), pits.end());
+  // a window of cells around the pit being breached
+  int side = 2 * max_length + 1;
+  size_t window = static_cast<size_t>(side) * side;
+  std::vector<float> cost(window, infinity);
+  std::vector<int> parent(window, -1);
+  std::vector<int> steps(window, 0);
+  std::vector<size_t> touched{};
+  size_t breached = 0;
+  for (const auto &pit : pits) {
+    int pc, pr;
+    elevations.get_cell(pit.second, pc, pr);
+    if (!is_pit(pc, pr)) {
+      continue;
+    }
+    float pz = elevations(pc, pr);
+    auto local = [&](int col, int row) {
+      return static_cast<size_t>(row - pr + max_length) * side + col - pc +
+             max_length;
+    };
+    // Dijkstra on the depth that has to be cut to pass through each cell
+    OpenQueue open{};
+    size_t start = local(pc, pr);
+    cost[start] = 0.0f;
+    touched.push_back(start);
+    open.push({0.0f, start});
+    int target = -1;
+    while (!open.empty()) {
+      auto top = open.top();
+      open.pop();
+      size_t k = top.second;
+      if (top.first > cost[k]) {
+        continue;
+      }
+      int col = pc + static_cast<int>(k % side) - max_length;
+      int row = pr + static_cast<int>(k / side) - max_length;
+      float z = elevations.get(col, row, no_data);
+      if (k != start && (z < pz || std::isnan(z))) {
+        target = static_cast<int>(k);
+        break;
+      }
+      if (steps[k] >= max_length) {
+        continue;
+      }
+      for (int d = 0; d < 8; d++) {
+        int nc = col + D8_DX[d];
+        int nr = row + D8_DY[d];
+        // cells off the DEM and no data end the channel
+        float nz = elevations.get(nc, nr, no_data);
+        float cut = std::isnan(nz) ? 0.0f : std::max(nz - pz, 0.0f);
+        if (cut > max_depth) {
+          continue;
+        }
+        size_t n = local(nc, nr);
+        if (top.first + cut < cost[n]) {
+          if (cost[n] == infinity) {
+            touched.push_back(n);
+          }
+          cost[n] = top.first + cut;
+          parent[n] = static_cast<int>(k);
+          steps[n] = steps[k] + 1;
+          open.push({cost[n], n});
+        }
+      }
+    }
+    if (target >= 0) {
+      std::vector<size_t> path{};
+      for (int k = parent[target]; k >= 0 && static_cast<size_t>(k) != start;
+           k = parent[k]) {
+        path.push_back(static_cast<size_t>(k));
+      }
+      std::reverse(path.begin(), path.end());
+      int tc = pc + target % side - max_length;
+      int tr = pr + target / side - max_length;
+      float tz = elevations.get(tc, tr, no_data);
+      float end = std::isnan(tz) ? pz : std::min(tz, pz);
+      // the channel descends below the pit, so the search's cut relative to
+      // the pit underestimates the real one, check the carved channel too
+      std::vector<float> carved{};
+      float previous = pz;
+      bool too_deep = false;
+      for (size_t m = 0; m < path.size() && !too_deep; m++) {
+        int col = pc + static_cast<int>(path[m] % side) - max_length;
+        int row = pr + static_cast<int>(path[m] / side) - max_length;
+        float line = pz - (pz - end) * static_cast<float>(m + 1) /
+                              static_cast<float>(path.size() + 1);
+        float z = std::min(
+            {elevations(col, row), line, std::nextafter(previous, -infinity)});
+        too_deep = elevations(col, row) - z > max_depth;
+        carved.push_back(z);
+        previous = z;
+      }
+      if (!too_deep) {
+        for (size_t m = 0; m < path.size(); m++) {
+          int col = pc + static_cast<int>(path[m] % side) - max_length;
+          int row = pr + static_cast<int>(path[m] / side) - max_length;
+          elevations(col, row) = carved[m];
+        }
+        if (!std::isnan(tz) && tz >= previous) {
+          elevations(tc, tr) = std::nextafter(previous, -infinity);
+        }
+        breached++;
+      }
+    }
+    for (size_t k : touched) {
+      cost[k] = infinity;
+      parent[k] = -1;
+      steps[k] = 0;
+    }
+    touched.clear();
+  }
+  return breached;
+}
+} // namespace math_3dh
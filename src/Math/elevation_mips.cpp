@@ -0,0 +1,108 @@
+#include "Math/elevation_mips.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+// 3DH
+#include "Math/parallel.hpp"
+
+namespace math_3dh {
+namespace {
+float reduce(const float values[4], MipReduction reduction) {
+  float result = std::numeric_limits<float>::quiet_NaN();
+  float sum = 0.0f;
+  int count = 0;
+  for (int i = 0; i < 4; i++) {
+    float value = values[i];
+    if (std::isnan(value)) {
+      continue;
+    }
+    if (count == 0) {
+      result = value;
+    } else if (reduction == MipReduction::MIN) {
+      result = std::min(result, value);
+    } else if (reduction == MipReduction::MAX) {
+      result = std::max(result, value);
+    }
+    sum += value;
+    count++;
+  }
+  if (reduction == MipReduction::AVERAGE && count > 0) {
+    result = sum / static_cast<float>(count);
+  }
+  return result;
+}
+} // namespace
+
+ElevationMips::ElevationMips(const QuantizedGrid &grid, int max_levels,
+                             MipReduction reduction) {
+  int T = grid.get_tile_size();
+  // lay out every level first so the packed storage is allocated once
+  int cols = grid.get_cols();
+  int rows = grid.get_rows();
+  size_t tile_count = 0;
+  for (int level = 1; level <= max_levels && (cols > 1 || rows > 1);
+       level++) {
+    cols = (cols + 1) / 2;
+    rows = (rows + 1) / 2;
+    MipInfo info{};
+    info.cols = cols;
+    info.rows = rows;
+    info.tiles_x = (cols + T - 1) / T;
+    info.tile_size = T;
+    info.tile_offset = static_cast<int32_t>(tile_count);
+    info.word_offset = static_cast<int32_t>(tile_count * T * T / 2);
+    tile_count += static_cast<size_t>(info.tiles_x) * ((rows + T - 1) / T);
+    infos.push_back(info);
+  }
+  tiles.resize(tile_count);
+  samples.resize(tile_count * T * T, QuantizedGrid::NO_DATA);
+  for (const MipInfo &info : infos) {
+    levels.emplace_back(info.cols, info.rows, T, &tiles[info.tile_offset],
+                        &samples[static_cast<size_t>(info.tile_offset) * T * T]);
+  }
+  for (size_t l = 0; l < levels.size(); l++) {
+    const QuantizedGrid &source = l == 0 ? grid : levels[l - 1];
+    const QuantizedGrid &level = levels[l];
+    const MipInfo &info = infos[l];
+    // each tile is reduced and encoded by one thread
+    parallel_for(0, level.get_tile_count(), [&](size_t tile) {
+      int tx = static_cast<int>(tile % level.get_tiles_x());
+      int ty = static_cast<int>(tile / level.get_tiles_x());
+      int width = std::min(T, level.get_cols() - tx * T);
+      int height = std::min(T, level.get_rows() - ty * T);
+      std::vector<float> block(static_cast<size_t>(T) * T);
+      for (int j = 0; j < height; j++) {
+        int row = ty * T + j;
+        for (int i = 0; i < width; i++) {
+          int col = tx * T + i;
+          float values[4] = {source.get(2 * col, 2 * row),
+                             source.get(2 * col + 1, 2 * row),
+                             source.get(2 * col, 2 * row + 1),
+                             source.get(2 * col + 1, 2 * row + 1)};
+          block[static_cast<size_t>(j) * T + i] = reduce(values, reduction);
+        }
+      }
+      size_t packed_tile = info.tile_offset + tile;
+      tiles[packed_tile] = QuantizedGrid::encode_tile(
+          block.data(), width, height, T, std::nanf(""), T,
+          &samples[packed_tile * T * T]);
+    });
+  }
+}
+ElevationMips::ElevationMips(std::vector<MipInfo> infos,
+                             std::vector<QuantizedTile> tiles,
+                             std::vector<uint16_t> samples)
+    : infos(std::move(infos)), tiles(std::move(tiles)),
+      samples(std::move(samples)) {
+  for (const MipInfo &info : this->infos) {
+    int T = info.tile_size;
+    levels.emplace_back(
+        info.cols, info.rows, T, &this->tiles[info.tile_offset],
+        &this->samples[static_cast<size_t>(info.tile_offset) * T * T]);
+  }
+}
+} // namespace math_3dh
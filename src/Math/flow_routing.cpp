@@ -0,0 +1,382 @@
+#include "Math/flow_routing.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace math_3dh {
+namespace {
+using DirectionGrid = TiledGrid<uint8_t>;
+constexpr int TS = DirectionGrid::TILE_SIZE;
+constexpr int TILE_CELLS = TS * TS;
+constexpr float PI = 3.14159265358979f;
+constexpr float QUARTER_PI = PI / 4.0f;
+constexpr uint16_t NO_EXIT = 0xFFFF;
+constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+/**
+ * @brief The slot of a cell on the border of its tile, where flow from other
+ * tiles can enter. Cells shared by two borders have one slot.
+ */
+inline int border_slot(int i, int j) {
+  if (j == 0) {
+    return i;
+  }
+  if (j == TS - 1) {
+    return TS + i;
+  }
+  if (i == 0) {
+    return 2 * TS + j;
+  }
+  return 3 * TS + j;
+}
+inline bool on_border(int i, int j) {
+  return i == 0 || j == 0 || i == TS - 1 || j == TS - 1;
+}
+/**
+ * @brief Check if a cell drains to a cell of the grid with data and find that
+ * receiver.
+ */
+inline bool find_receiver(const DirectionGrid &directions, int col, int row,
+                          int &receiver_col, int &receiver_row) {
+  uint8_t d = directions(col, row);
+  if (d >= 8) {
+    return false;
+  }
+  receiver_col = col + D8_DX[d];
+  receiver_row = row + D8_DY[d];
+  return directions.contains(receiver_col, receiver_row) &&
+         directions(receiver_col, receiver_row) != FLOW_NO_DATA;
+}
+/**
+ * @brief The D8 graph restricted to one tile: the receiver of each cell within
+ * the tile and the cells in topological order, upstream first.
+ */
+struct TileGraph {
+  int16_t receiver[TILE_CELLS]; /**< Local index, -1 leaves the tile or ends.*/
+  uint16_t order[TILE_CELLS];
+  int count = 0; /**< The number of cells in order.*/
+  TileGraph(const DirectionGrid &directions, TileRect rect) {
+    uint8_t donors[TILE_CELLS] = {};
+    for (int j = 0; j < rect.height; j++) {
+      for (int i = 0; i < rect.width; i++) {
+        int local = j * TS + i;
+        receiver[local] = -1;
+        int rc, rr;
+        if (find_receiver(directions, rect.col + i, rect.row + j, rc, rr) &&
+            rc >= rect.col && rc < rect.col + rect.width && rr >= rect.row &&
+            rr < rect.row + rect.height) {
+          receiver[local] =
+              static_cast<int16_t>((rr - rect.row) * TS + rc - rect.col);
+          donors[receiver[local]]++;
+        }
+      }
+    }
+    // Kahn's algorithm, order doubles as the queue
+    for (int j = 0; j < rect.height; j++) {
+      for (int i = 0; i < rect.width; i++) {
+        int local = j * TS + i;
+        if (donors[local] == 0 &&
+            directions(rect.col + i, rect.row + j) != FLOW_NO_DATA) {
+          order[count++] = static_cast<uint16_t>(local);
+        }
+      }
+    }
+    for (int head = 0; head < count; head++) {
+      int r = receiver[order[head]];
+      if (r >= 0 && --donors[r] == 0) {
+        order[count++] = static_cast<uint16_t>(r);
+      }
+    }
+  }
+};
+/**
+ * @brief Where flow crosses a tile border: the last cell of a path in one tile
+ * and the first cell of the path in the next.
+ */
+struct TileExit {
+  size_t cell;    /**< The index of the exit cell.*/
+  size_t entry;   /**< The tile of the receiver.*/
+  int entry_slot; /**< The border slot of the receiver in its tile.*/
+};
+} // namespace
+
+TiledGrid<uint8_t> compute_d8(const TiledGrid<float> &elevations,
+                              glm::vec2 cell_size) {
+  DirectionGrid directions(elevations.get_cols(), elevations.get_rows(),
+                           FLOW_NO_DATA);
+  float distance[8];
+  for (int d = 0; d < 8; d++) {
+    distance[d] = std::sqrt(D8_DX[d] * D8_DX[d] * cell_size.x * cell_size.x +
+                            D8_DY[d] * D8_DY[d] * cell_size.y * cell_size.y);
+  }
+  float no_data = std::nanf("");
+  elevations.for_each_tile([&](TileRect rect) {
+    for (int row = rect.row; row < rect.row + rect.height; row++) {
+      for (int col = rect.col; col < rect.col + rect.width; col++) {
+        auto cells = elevations.neighbourhood(col, row, no_data);
+        float center = cells.center();
+        if (std::isnan(center)) {
+          continue;
+        }
+        uint8_t direction = FLOW_NONE;
+        uint8_t outlet = FLOW_NONE;
+        float steepest = 0.0f;
+        for (int d = 0; d < 8; d++) {
+          float neighbour = cells.neighbour(d);
+          if (std::isnan(neighbour)) {
+            if (outlet == FLOW_NONE) {
+              outlet = static_cast<uint8_t>(d);
+            }
+            continue;
+          }
+          float drop = (center - neighbour) / distance[d];
+          if (drop > steepest) {
+            steepest = drop;
+            direction = static_cast<uint8_t>(d);
+          }
+        }
+        directions(col, row) = direction != FLOW_NONE ? direction : outlet;
+      }
+    }
+  });
+  return directions;
+}
+TiledGrid<float> compute_dinf(const TiledGrid<float> &elevations,
+                              glm::vec2 cell_size) {
+  float no_data = std::nanf("");
+  TiledGrid<float> angles(elevations.get_cols(), elevations.get_rows(),
+                          no_data);
+  glm::vec2 offsets[8];
+  for (int d = 0; d < 8; d++) {
+    offsets[d] = {D8_DX[d] * cell_size.x, D8_DY[d] * cell_size.y};
+  }
+  elevations.for_each_tile([&](TileRect rect) {
+    for (int row = rect.row; row < rect.row + rect.height; row++) {
+      for (int col = rect.col; col < rect.col + rect.width; col++) {
+        auto cells = elevations.neighbourhood(col, row, no_data);
+        float e0 = cells.center();
+        if (std::isnan(e0)) {
+          continue;
+        }
+        float steepest = 0.0f;
+        float best = DINF_NONE;
+        int outlet = -1;
+        for (int k = 0; k < 8; k++) {
+          int k2 = (k + 1) % 8;
+          float e1 = cells.neighbour(k);
+          float e2 = cells.neighbour(k2);
+          if (std::isnan(e1)) {
+            outlet = outlet < 0 ? k : outlet;
+            continue;
+          }
+          glm::vec2 v1 = offsets[k];
+          glm::vec2 v2 = offsets[k2];
+          float span = std::atan2(v1.x * v2.y - v1.y * v2.x,
+                                  v1.x * v2.x + v1.y * v2.y);
+          // the edge towards e1 on its own
+          float edge = (e0 - e1) / glm::length(v1);
+          if (edge > steepest) {
+            steepest = edge;
+            best = static_cast<float>(k);
+          }
+          if (std::isnan(e2)) {
+            continue;
+          }
+          // the plane through the three cells, g . v = rise along v
+          float det = v1.x * v2.y - v1.y * v2.x;
+          glm::vec2 g = {((e1 - e0) * v2.y - (e2 - e0) * v1.y) / det,
+                         ((e2 - e0) * v1.x - (e1 - e0) * v2.x) / det};
+          glm::vec2 s = {-g.x, -g.y};
+          float slope = glm::length(g);
+          float rel = std::atan2(v1.x * s.y - v1.y * s.x,
+                                 v1.x * s.x + v1.y * s.y);
+          if (slope > steepest && rel > 0.0f && rel < span) {
+            steepest = slope;
+            best = static_cast<float>(k) + rel / span;
+          }
+        }
+        if (best == DINF_NONE && outlet >= 0) {
+          best = static_cast<float>(outlet);
+        }
+        angles(col, row) = best == DINF_NONE ? DINF_NONE : best * QUARTER_PI;
+      }
+    }
+  });
+  return angles;
+}
+TiledGrid<uint32_t> accumulate_d8(const TiledGrid<uint8_t> &directions) {
+  TiledGrid<uint32_t> accumulation(directions.get_cols(),
+                                   directions.get_rows(), 0);
+  size_t tile_count = directions.get_tile_count();
+  // pass 1, accumulate each tile on its own and link its border cells to the
+  // exit their flow leaves the tile through
+  std::vector<std::vector<TileExit>> exits(tile_count);
+  std::vector<uint16_t> border_exit(tile_count * 4 * TS, NO_EXIT);
+  parallel_for(0, tile_count, [&](size_t tile) {
+    TileRect rect = directions.get_tile_rect(tile);
+    auto graph = std::make_unique<TileGraph>(directions, rect);
+    uint32_t *acc = &accumulation.data()[tile * TILE_CELLS];
+    for (int k = 0; k < graph->count; k++) {
+      int local = graph->order[k];
+      acc[local] += 1;
+      if (graph->receiver[local] >= 0) {
+        acc[graph->receiver[local]] += acc[local];
+      }
+    }
+    // downstream first, so the exit of each receiver is already known
+    std::vector<uint16_t> exit_of(TILE_CELLS, NO_EXIT);
+    for (int k = graph->count - 1; k >= 0; k--) {
+      int local = graph->order[k];
+      int i = local % TS;
+      int j = local / TS;
+      if (graph->receiver[local] >= 0) {
+        exit_of[local] = exit_of[graph->receiver[local]];
+      } else {
+        int rc, rr;
+        if (find_receiver(directions, rect.col + i, rect.row + j, rc, rr)) {
+          size_t entry_tile =
+              static_cast<size_t>(rr / TS) * directions.get_tiles_x() + rc / TS;
+          exit_of[local] = static_cast<uint16_t>(exits[tile].size());
+          exits[tile].push_back({tile * TILE_CELLS + local, entry_tile,
+                                 border_slot(rc % TS, rr % TS)});
+        }
+      }
+      if (on_border(i, j)) {
+        border_exit[tile * 4 * TS + border_slot(i, j)] = exit_of[local];
+      }
+    }
+  });
+  // pass 2, accumulate the graph of exits serially
+  std::vector<size_t> first_node(tile_count + 1, 0);
+  for (size_t tile = 0; tile < tile_count; tile++) {
+    first_node[tile + 1] = first_node[tile] + exits[tile].size();
+  }
+  size_t node_count = first_node[tile_count];
+  std::vector<uint32_t> total(node_count);
+  std::vector<uint32_t> target(node_count, NO_NODE);
+  std::vector<uint16_t> donors(node_count, 0);
+  for (size_t tile = 0; tile < tile_count; tile++) {
+    for (size_t e = 0; e < exits[tile].size(); e++) {
+      const TileExit &exit = exits[tile][e];
+      size_t node = first_node[tile] + e;
+      total[node] = accumulation.data()[exit.cell];
+      uint16_t next = border_exit[exit.entry * 4 * TS + exit.entry_slot];
+      if (next != NO_EXIT) {
+        target[node] = static_cast<uint32_t>(first_node[exit.entry] + next);
+        donors[target[node]]++;
+      }
+    }
+  }
+  std::vector<uint32_t> inflow(tile_count * 4 * TS, 0);
+  std::vector<uint32_t> ready{};
+  for (size_t node = 0; node < node_count; node++) {
+    if (donors[node] == 0) {
+      ready.push_back(static_cast<uint32_t>(node));
+    }
+  }
+  while (!ready.empty()) {
+    uint32_t node = ready.back();
+    ready.pop_back();
+    // find the tile of the node, nodes are numbered tile by tile
+    size_t tile = std::upper_bound(first_node.begin(), first_node.end(), node) -
+           first_node.begin() - 1;
+    const TileExit &exit = exits[tile][node - first_node[tile]];
+    inflow[exit.entry * 4 * TS + exit.entry_slot] += total[node];
+    if (target[node] != NO_NODE) {
+      total[target[node]] += total[node];
+      if (--donors[target[node]] == 0) {
+        ready.push_back(target[node]);
+      }
+    }
+  }
+  // pass 3, carry the inflow of each tile down its paths
+  parallel_for(0, tile_count, [&](size_t tile) {
+    const uint32_t *tile_inflow = &inflow[tile * 4 * TS];
+    if (std::all_of(tile_inflow, tile_inflow + 4 * TS,
+                    [](uint32_t value) { return value == 0; })) {
+      return;
+    }
+    TileRect rect = directions.get_tile_rect(tile);
+    auto graph = std::make_unique<TileGraph>(directions, rect);
+    std::vector<uint32_t> extra(TILE_CELLS, 0);
+    for (int j = 0; j < rect.height; j++) {
+      for (int i = 0; i < rect.width; i++) {
+        if (on_border(i, j)) {
+          extra[j * TS + i] = tile_inflow[border_slot(i, j)];
+        }
+      }
+    }
+    uint32_t *acc = &accumulation.data()[tile * TILE_CELLS];
+    for (int k = 0; k < graph->count; k++) {
+      int local = graph->order[k];
+      acc[local] += extra[local];
+      if (graph->receiver[local] >= 0) {
+        extra[graph->receiver[local]] += extra[local];
+      }
+    }
+  });
+  return accumulation;
+}
+TiledGrid<float> accumulate_dinf(const TiledGrid<float> &angles) {
+  TiledGrid<float> accumulation(angles.get_cols(), angles.get_rows(), 0.0f);
+  TiledGrid<uint8_t> donors(angles.get_cols(), angles.get_rows(), 0);
+  // the two receivers of a cell and the share of its flow each gets
+  auto for_each_receiver = [&](int col, int row, auto &&f) {
+    float angle = angles(col, row);
+    if (std::isnan(angle) || angle == DINF_NONE) {
+      return;
+    }
+    float a = angle / QUARTER_PI;
+    int k = static_cast<int>(std::floor(a));
+    float share = a - static_cast<float>(k);
+    int ds[2] = {k % 8, (k + 1) % 8};
+    float shares[2] = {1.0f - share, share};
+    for (int n = 0; n < 2; n++) {
+      int rc = col + D8_DX[ds[n]];
+      int rr = row + D8_DY[ds[n]];
+      if (shares[n] > 1e-6f && angles.contains(rc, rr) &&
+          !std::isnan(angles(rc, rr))) {
+        f(rc, rr, shares[n]);
+      }
+    }
+  };
+  for (size_t tile = 0; tile < angles.get_tile_count(); tile++) {
+    TileRect rect = angles.get_tile_rect(tile);
+    for (int row = rect.row; row < rect.row + rect.height; row++) {
+      for (int col = rect.col; col < rect.col + rect.width; col++) {
+        for_each_receiver(col, row,
+                          [&](int rc, int rr, float) { donors(rc, rr)++; });
+      }
+    }
+  }
+  std::vector<size_t> ready{};
+  for (size_t tile = 0; tile < angles.get_tile_count(); tile++) {
+    TileRect rect = angles.get_tile_rect(tile);
+    for (int row = rect.row; row < rect.row + rect.height; row++) {
+      for (int col = rect.col; col < rect.col + rect.width; col++) {
+        if (donors(col, row) == 0 && !std::isnan(angles(col, row))) {
+          ready.push_back(angles.index(col, row));
+        }
+      }
+    }
+  }
+  while (!ready.empty()) {
+    size_t index = ready.back();
+    ready.pop_back();
+    int col, row;
+    angles.get_cell(index, col, row);
+    float &acc = accumulation.data()[index];
+    acc += 1.0f;
+    for_each_receiver(col, row, [&](int rc, int rr, float share) {
+      accumulation(rc, rr) += acc * share;
+      if (--donors(rc, rr) == 0) {
+        ready.push_back(angles.index(rc, rr));
+      }
+    });
+  }
+  return accumulation;
+}
+} // namespace math_3dh
@@ -0,0 +1,271 @@
+#include "Math/inundation.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+// 3DH
+#include "Math/parallel.hpp"
+
+namespace math_3dh {
+namespace {
+constexpr int TS = TiledGrid<float>::TILE_SIZE;
+constexpr int TILE_CELLS = TS * TS;
+constexpr int TILE_SHIFT = TiledGrid<float>::TILE_SHIFT;
+constexpr int EDGE_DIRECTIONS[4] = {0, 2, 4, 6};
+constexpr float NO_WATER = -std::numeric_limits<float>::infinity();
+/**
+ * @brief Water reaching a cell of a tile, flooded in the next round of its
+ * level.
+ */
+struct FloodMessage {
+  int col;
+  int row;
+  float level;
+  int32_t seed;
+};
+/**
+ * @brief Water wins a cell with a higher level, or the same level from an
+ * earlier seed, so the result does not depend on the order of the fill.
+ */
+inline bool raises(float level, int32_t seed, float current,
+                   int32_t current_seed) {
+  return level > current ||
+         (level == current && current_seed >= 0 && seed < current_seed);
+}
+} // namespace
+
+float InundationMap::get_depth(int col, int row) const {
+  if (col < 0 || col >= cols || row < 0 || row >= rows) {
+    return 0.0f;
+  }
+  const auto &tile = tiles[static_cast<size_t>(row >> TILE_SHIFT) * tiles_x +
+                           (col >> TILE_SHIFT)];
+  return tile ? tile->depth[((row & (TS - 1)) << TILE_SHIFT) | (col & (TS - 1))]
+              : 0.0f;
+}
+int32_t InundationMap::get_seed(int col, int row) const {
+  if (col < 0 || col >= cols || row < 0 || row >= rows) {
+    return -1;
+  }
+  const auto &tile = tiles[static_cast<size_t>(row >> TILE_SHIFT) * tiles_x +
+                           (col >> TILE_SHIFT)];
+  return tile ? tile->seed[((row & (TS - 1)) << TILE_SHIFT) | (col & (TS - 1))]
+              : -1;
+}
+void InundationMap::read_depth_rows(int first_row, int row_count,
+                                    float *dst) const {
+  for (int j = 0; j < row_count; j++) {
+    int row = first_row + j;
+    for (int tx = 0; tx < tiles_x; tx++) {
+      int col = tx << TILE_SHIFT;
+      int width = std::min(TS, cols - col);
+      float *row_dst = dst + static_cast<size_t>(j) * cols + col;
+      const auto &tile =
+          tiles[static_cast<size_t>(row >> TILE_SHIFT) * tiles_x + tx];
+      if (tile) {
+        const float *src = tile->depth + ((row & (TS - 1)) << TILE_SHIFT);
+        std::copy(src, src + width, row_dst);
+      } else {
+        std::fill(row_dst, row_dst + width, 0.0f);
+      }
+    }
+  }
+}
+size_t InundationMap::get_flooded_tile_count() const {
+  return static_cast<size_t>(std::count_if(
+      tiles.begin(), tiles.end(), [](const auto &tile) { return !!tile; }));
+}
+
+InundationMap map_inundation(const TiledGrid<float> &elevations,
+                             const std::vector<FloodSeed> &seeds,
+                             glm::vec2 cell_size, unsigned int thread_count) {
+  using Tile = InundationMap::Tile;
+  InundationMap map;
+  map.cols = elevations.get_cols();
+  map.rows = elevations.get_rows();
+  map.tiles_x = elevations.get_tiles_x();
+  map.tiles.resize(elevations.get_tile_count());
+  map.stats.resize(seeds.size());
+  size_t tile_count = map.tiles.size();
+  auto tile_of = [&](int col, int row) {
+    return static_cast<size_t>(row >> TILE_SHIFT) * map.tiles_x +
+           (col >> TILE_SHIFT);
+  };
+  // the seed levels highest first, each level floods in its own rounds
+  std::vector<float> levels{};
+  for (const FloodSeed &seed : seeds) {
+    levels.push_back(seed.level);
+  }
+  std::sort(levels.begin(), levels.end(), std::greater<float>());
+  levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+  std::vector<int> seed_rank(seeds.size());
+  for (size_t s = 0; s < seeds.size(); s++) {
+    seed_rank[s] = static_cast<int>(
+        std::lower_bound(levels.begin(), levels.end(), seeds[s].level,
+                         std::greater<float>()) -
+        levels.begin());
+  }
+  std::vector<std::vector<FloodMessage>> inbox(tile_count);
+  std::vector<std::vector<FloodMessage>> outbox(tile_count);
+  std::vector<int> last_rank(tile_count, -1);
+  std::vector<std::vector<size_t>> pending(levels.size());
+  auto post = [&](const FloodMessage &message) {
+    size_t tile = tile_of(message.col, message.row);
+    if (auto &water = map.tiles[tile]) {
+      int cell = ((message.row & (TS - 1)) << TILE_SHIFT) |
+                 (message.col & (TS - 1));
+      if (!raises(message.level, message.seed, water->depth[cell],
+                  water->seed[cell])) {
+        return;
+      }
+    }
+    int rank = seed_rank[message.seed];
+    if (last_rank[tile] != rank) {
+      last_rank[tile] = rank;
+      pending[rank].push_back(tile);
+    }
+    inbox[tile].push_back(message);
+  };
+  for (size_t s = 0; s < seeds.size(); s++) {
+    const FloodSeed &seed = seeds[s];
+    if (elevations.contains(seed.col, seed.row) &&
+        elevations(seed.col, seed.row) < seed.level) {
+      post({seed.col, seed.row, seed.level, static_cast<int32_t>(s)});
+    }
+  }
+  // each round floods the tiles that received water of the level in the last
+  // one, so water never floods a cell before higher water can reach it from
+  // its tile
+  for (int rank = 0; rank < static_cast<int>(levels.size()); rank++) {
+    while (!pending[rank].empty()) {
+      std::vector<size_t> flooding = std::move(pending[rank]);
+      pending[rank].clear();
+      std::sort(flooding.begin(), flooding.end());
+      flooding.erase(std::unique(flooding.begin(), flooding.end()),
+                     flooding.end());
+      for (size_t tile : flooding) {
+        last_rank[tile] = -1;
+        if (!map.tiles[tile]) {
+          map.tiles[tile] = std::make_unique<Tile>();
+          std::fill_n(map.tiles[tile]->depth, TILE_CELLS, NO_WATER);
+          std::fill_n(map.tiles[tile]->seed, TILE_CELLS, -1);
+        }
+      }
+      parallel_for(
+          0, flooding.size(),
+          [&](size_t i) {
+            size_t tile = flooding[i];
+            Tile &water = *map.tiles[tile];
+            TileRect rect = elevations.get_tile_rect(tile);
+            const float *ground = elevations.data() + tile * TILE_CELLS;
+            // keep the water of lower levels for later rounds
+            auto &messages = inbox[tile];
+            auto lower = std::partition(
+                messages.begin(), messages.end(),
+                [&](const FloodMessage &message) {
+                  return seed_rank[message.seed] == rank;
+                });
+            std::vector<FloodMessage> arrived(messages.begin(), lower);
+            messages.erase(messages.begin(), lower);
+            std::sort(arrived.begin(), arrived.end(),
+                      [](const FloodMessage &a, const FloodMessage &b) {
+                        return a.seed < b.seed;
+                      });
+            // flood the earliest seed first, so seeds sharing the level take
+            // each cell once
+            float level = levels[rank];
+            std::vector<int> queue{};
+            for (size_t first = 0; first < arrived.size();) {
+              int32_t seed = arrived[first].seed;
+              queue.clear();
+              size_t last = first;
+              for (; last < arrived.size() && arrived[last].seed == seed;
+                   last++) {
+                int cell = ((arrived[last].row - rect.row) << TILE_SHIFT) |
+                           (arrived[last].col - rect.col);
+                if (raises(level, seed, water.depth[cell], water.seed[cell])) {
+                  water.depth[cell] = level;
+                  water.seed[cell] = seed;
+                  queue.push_back(cell);
+                }
+              }
+              first = last;
+              for (size_t q = 0; q < queue.size(); q++) {
+                int i = queue[q] & (TS - 1);
+                int j = queue[q] >> TILE_SHIFT;
+                for (int d : EDGE_DIRECTIONS) {
+                  int ni = i + D8_DX[d];
+                  int nj = j + D8_DY[d];
+                  // NaN cells never compare below the water
+                  if (ni < 0 || ni >= rect.width || nj < 0 ||
+                      nj >= rect.height) {
+                    int c = rect.col + ni;
+                    int r = rect.row + nj;
+                    if (elevations.contains(c, r) && elevations(c, r) < level) {
+                      outbox[tile].push_back({c, r, level, seed});
+                    }
+                    continue;
+                  }
+                  int cell = (nj << TILE_SHIFT) | ni;
+                  if (ground[cell] < level &&
+                      raises(level, seed, water.depth[cell],
+                             water.seed[cell])) {
+                    water.depth[cell] = level;
+                    water.seed[cell] = seed;
+                    queue.push_back(cell);
+                  }
+                }
+              }
+            }
+          },
+          thread_count);
+      for (size_t tile : flooding) {
+        for (auto &message : outbox[tile]) {
+          post(message);
+        }
+        outbox[tile].clear();
+      }
+    }
+  }
+  // turn the water levels into depths
+  parallel_for(
+      0, tile_count,
+      [&](size_t tile) {
+        if (!map.tiles[tile]) {
+          return;
+        }
+        Tile &water = *map.tiles[tile];
+        TileRect rect = elevations.get_tile_rect(tile);
+        for (int cell = 0; cell < TILE_CELLS; cell++) {
+          int i = cell & (TS - 1);
+          int j = cell >> TILE_SHIFT;
+          water.depth[cell] =
+              water.seed[cell] >= 0
+                  ? water.depth[cell] - elevations(rect.col + i, rect.row + j)
+                  : 0.0f;
+        }
+      },
+      thread_count);
+  double cell_area = static_cast<double>(cell_size.x) * cell_size.y;
+  for (size_t tile = 0; tile < tile_count; tile++) {
+    if (!map.tiles[tile]) {
+      continue;
+    }
+    const Tile &water = *map.tiles[tile];
+    for (int cell = 0; cell < TILE_CELLS; cell++) {
+      if (water.seed[cell] >= 0) {
+        FloodStats &stats = map.stats[water.seed[cell]];
+        stats.cells++;
+        stats.volume += water.depth[cell];
+      }
+    }
+  }
+  for (auto &stats : map.stats) {
+    stats.area = static_cast<double>(stats.cells) * cell_area;
+    stats.volume *= cell_area;
+  }
+  return map;
+}
+} // namespace math_3dh
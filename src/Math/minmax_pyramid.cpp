@@ -0,0 +1,249 @@
+#include "Math/minmax_pyramid.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// 3DH
+#include "Math/parallel.hpp"
+
+namespace math_3dh {
+namespace {
+const float infinity = std::numeric_limits<float>::infinity();
+/**
+ * @brief Intersect a ray with an axis aligned box using the slab method.
+ */
+bool intersect_box(glm::vec3 origin, glm::vec3 direction, glm::vec3 lo,
+                   glm::vec3 hi, float &t_enter, float &t_exit) {
+  t_enter = 0.0f;
+  t_exit = infinity;
+  for (int axis = 0; axis < 3; axis++) {
+    if (direction[axis] == 0.0f) {
+      if (origin[axis] < lo[axis] || origin[axis] > hi[axis]) {
+        return false;
+      }
+      continue;
+    }
+    float t0 = (lo[axis] - origin[axis]) / direction[axis];
+    float t1 = (hi[axis] - origin[axis]) / direction[axis];
+    if (t0 > t1) {
+      std::swap(t0, t1);
+    }
+    t_enter = std::max(t_enter, t0);
+    t_exit = std::min(t_exit, t1);
+    if (t_enter > t_exit) {
+      return false;
+    }
+  }
+  return true;
+}
+glm::vec2 empty_range() { return {infinity, -infinity}; }
+} // namespace
+
+MinMaxPyramid::MinMaxPyramid(const QuantizedGrid *grid, float shift,
+                             int block_size)
+    : grid(grid), shift(shift), block_size(block_size) {
+  patches_x = std::max(grid->get_cols() - 1, 0);
+  patches_y = std::max(grid->get_rows() - 1, 0);
+  if (patches_x == 0 || patches_y == 0) {
+    return;
+  }
+  // level 0, the range of the corner samples of each block of patches
+  glm::ivec2 dims = {(patches_x + block_size - 1) / block_size,
+                     (patches_y + block_size - 1) / block_size};
+  std::vector<glm::vec2> base(static_cast<size_t>(dims.x) * dims.y);
+  parallel_for(0, dims.y, [&](size_t by) {
+    for (int bx = 0; bx < dims.x; bx++) {
+      glm::vec2 range = empty_range();
+      int i_end = std::min((bx + 1) * block_size, patches_x);
+      int j_end = std::min((static_cast<int>(by) + 1) * block_size, patches_y);
+      for (int j = static_cast<int>(by) * block_size; j <= j_end; j++) {
+        for (int i = bx * block_size; i <= i_end; i++) {
+          float h = corner(i, j);
+          if (!std::isnan(h)) {
+            range.x = std::min(range.x, h);
+            range.y = std::max(range.y, h);
+          }
+        }
+      }
+      base[by * dims.x + bx] = range;
+    }
+  });
+  levels.push_back(std::move(base));
+  level_dims.push_back(dims);
+  // merge 2x2 nodes until a single node covers the DEM
+  while (dims.x > 1 || dims.y > 1) {
+    glm::ivec2 parent_dims = {(dims.x + 1) / 2, (dims.y + 1) / 2};
+    const std::vector<glm::vec2> &children = levels.back();
+    std::vector<glm::vec2> parents(static_cast<size_t>(parent_dims.x) *
+                                   parent_dims.y);
+    for (int y = 0; y < parent_dims.y; y++) {
+      for (int x = 0; x < parent_dims.x; x++) {
+        glm::vec2 range = empty_range();
+        for (int cy = 2 * y; cy < std::min(2 * y + 2, dims.y); cy++) {
+          for (int cx = 2 * x; cx < std::min(2 * x + 2, dims.x); cx++) {
+            glm::vec2 child = children[static_cast<size_t>(cy) * dims.x + cx];
+            range.x = std::min(range.x, child.x);
+            range.y = std::max(range.y, child.y);
+          }
+        }
+        parents[static_cast<size_t>(y) * parent_dims.x + x] = range;
+      }
+    }
+    levels.push_back(std::move(parents));
+    level_dims.push_back(parent_dims);
+    dims = parent_dims;
+  }
+}
+float MinMaxPyramid::corner(int i, int j) const {
+  return grid->get(i, j) - shift;
+}
+bool MinMaxPyramid::intersect(glm::vec3 origin, glm::vec3 direction,
+                              float vert_exag, float &t) const {
+  if (levels.empty()) {
+    return false;
+  }
+  struct Node {
+    int level;
+    int x;
+    int y;
+  };
+  float best = infinity;
+  std::vector<Node> stack{{static_cast<int>(levels.size()) - 1, 0, 0}};
+  while (!stack.empty()) {
+    Node node = stack.back();
+    stack.pop_back();
+    glm::vec2 range =
+        levels[node.level][static_cast<size_t>(node.y) *
+                               level_dims[node.level].x +
+                           node.x];
+    if (range.x > range.y) {
+      // only no data below this node
+      continue;
+    }
+    int span = block_size << node.level;
+    glm::vec3 lo = {static_cast<float>(node.x * span),
+                    static_cast<float>(node.y * span),
+                    std::min(range.x * vert_exag, range.y * vert_exag)};
+    glm::vec3 hi = {static_cast<float>(std::min((node.x + 1) * span, patches_x)),
+                    static_cast<float>(std::min((node.y + 1) * span, patches_y)),
+                    std::max(range.x * vert_exag, range.y * vert_exag)};
+    float t_enter, t_exit;
+    if (!intersect_box(origin, direction, lo, hi, t_enter, t_exit) ||
+        t_enter >= best) {
+      continue;
+    }
+    if (node.level == 0) {
+      int i_end = static_cast<int>(hi.x);
+      int j_end = static_cast<int>(hi.y);
+      for (int j = static_cast<int>(lo.y); j < j_end; j++) {
+        for (int i = static_cast<int>(lo.x); i < i_end; i++) {
+          float t_patch;
+          if (intersect_patch(i, j, origin, direction, vert_exag, best,
+                              t_patch)) {
+            best = t_patch;
+          }
+        }
+      }
+      continue;
+    }
+    // push the children far to near so the nearest is visited first
+    std::pair<float, Node> children[4];
+    int child_count = 0;
+    const glm::ivec2 &child_dims = level_dims[node.level - 1];
+    for (int cy = 2 * node.y; cy < std::min(2 * node.y + 2, child_dims.y);
+         cy++) {
+      for (int cx = 2 * node.x; cx < std::min(2 * node.x + 2, child_dims.x);
+           cx++) {
+        int child_span = span / 2;
+        glm::vec3 child_lo = {static_cast<float>(cx * child_span),
+                              static_cast<float>(cy * child_span), lo.z};
+        glm::vec3 child_hi = {
+            static_cast<float>(std::min((cx + 1) * child_span, patches_x)),
+            static_cast<float>(std::min((cy + 1) * child_span, patches_y)),
+            hi.z};
+        float child_enter, child_exit;
+        if (intersect_box(origin, direction, child_lo, child_hi, child_enter,
+                          child_exit)) {
+          children[child_count++] = {child_enter,
+                                     Node{node.level - 1, cx, cy}};
+        }
+      }
+    }
+    std::sort(children, children + child_count,
+              [](const std::pair<float, Node> &a,
+                 const std::pair<float, Node> &b) { return a.first > b.first; });
+    for (int c = 0; c < child_count; c++) {
+      stack.push_back(children[c].second);
+    }
+  }
+  if (best == infinity) {
+    return false;
+  }
+  t = best;
+  return true;
+}
+bool MinMaxPyramid::intersect_patch(int i, int j, glm::vec3 origin,
+                                    glm::vec3 direction, float vert_exag,
+                                    float t_max, float &t) const {
+  float h00 = corner(i, j) * vert_exag;
+  float h10 = corner(i + 1, j) * vert_exag;
+  float h01 = corner(i, j + 1) * vert_exag;
+  float h11 = corner(i + 1, j + 1) * vert_exag;
+  if (std::isnan(h00) || std::isnan(h10) || std::isnan(h01) ||
+      std::isnan(h11)) {
+    return false;
+  }
+  glm::vec3 lo = {static_cast<float>(i), static_cast<float>(j),
+                  std::min(std::min(h00, h10), std::min(h01, h11))};
+  glm::vec3 hi = {static_cast<float>(i + 1), static_cast<float>(j + 1),
+                  std::max(std::max(h00, h10), std::max(h01, h11))};
+  float t_enter, t_exit;
+  if (!intersect_box(origin, direction, lo, hi, t_enter, t_exit) ||
+      t_enter >= t_max) {
+    return false;
+  }
+  // H(s, q) = A + B s + C q + D s q with s, q linear in t
+  double A = h00;
+  double B = h10 - h00;
+  double C = h01 - h00;
+  double D = h00 - h10 - h01 + h11;
+  double s0 = origin.x - i, ds = direction.x;
+  double q0 = origin.y - j, dq = direction.y;
+  double a = D * ds * dq;
+  double b = B * ds + C * dq + D * (s0 * dq + q0 * ds) - direction.z;
+  double c = A + B * s0 + C * q0 + D * s0 * q0 - origin.z;
+  double roots[2];
+  int root_count = 0;
+  if (std::abs(a) < 1e-12) {
+    if (std::abs(b) > 1e-12) {
+      roots[root_count++] = -c / b;
+    }
+  } else {
+    double discriminant = b * b - 4.0 * a * c;
+    if (discriminant >= 0.0) {
+      double sq = std::sqrt(discriminant);
+      // numerically stable form of the quadratic formula
+      double k = -0.5 * (b + (b < 0.0 ? -sq : sq));
+      roots[root_count++] = k / a;
+      if (k != 0.0) {
+        roots[root_count++] = c / k;
+      }
+    }
+  }
+  const double eps = 1e-5;
+  double nearest = infinity;
+  for (int r = 0; r < root_count; r++) {
+    if (roots[r] >= t_enter - eps && roots[r] <= t_exit + eps &&
+        roots[r] < nearest) {
+      nearest = roots[r];
+    }
+  }
+  if (nearest >= t_max || nearest == infinity) {
+    return false;
+  }
+  t = static_cast<float>(std::max(nearest, 0.0));
+  return true;
+}
+} // namespace math_3dh
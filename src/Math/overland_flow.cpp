@@ -0,0 +1,519 @@
+#include "Math/overland_flow.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// 3DH
+#include "Math/bilinear_sampler.hpp"
+#include "Math/parallel.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define OVERLAND_FLOW_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define OVERLAND_FLOW_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(OVERLAND_FLOW_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace math_3dh {
+namespace {
+constexpr int TS = TiledGrid<float>::TILE_SIZE;
+constexpr int TILE_SHIFT = 2 * TiledGrid<float>::TILE_SHIFT;
+/**
+ * @brief The elevation of cells with no data and of the padding of edge tiles.
+ * No water surface reaches over it, so no face next to a wall ever flows.
+ */
+constexpr float WALL = 1.0e30f;
+constexpr int32_t CBRT_MAGIC = 709921077;
+/**
+ * @brief The constants of the face discharge update.
+ */
+struct FluxParams {
+  float g_dt;          /**< Gravity times the time step.*/
+  float g_dt_n2;       /**< Gravity times the time step times n squared.*/
+  float inv_spacing;   /**< One over the distance between the cells.*/
+  float dry_depth;     /**< Faces with shallower flow depth are dry.*/
+  float limit;         /**< The distance between the cells over 4 dt.*/
+};
+/**
+ * @brief Update the discharge through faces between cells a[i] and b[i].
+ */
+using FluxKernel = void (*)(const float *, const float *, const float *,
+                            const float *, float *, int, int,
+                            const FluxParams &);
+/**
+ * @brief Update the depth of cells from the discharges through their faces.
+ * @return The deepest updated cell.
+ */
+using DepthKernel = float (*)(float *, const float *, const float *,
+                              const float *, const float *, int, int, float,
+                              float);
+/**
+ * @brief A cube root accurate to a few ulps for positive values, from an
+ * exponent third guess and two Newton steps, so the vector kernels can share
+ * it.
+ */
+inline float cube_root(float x) {
+  int32_t bits;
+  std::memcpy(&bits, &x, sizeof(float));
+  bits = static_cast<int32_t>(static_cast<float>(bits) * (1.0f / 3.0f)) +
+         CBRT_MAGIC;
+  float y;
+  std::memcpy(&y, &bits, sizeof(float));
+  y = (y + y + x / (y * y)) * (1.0f / 3.0f);
+  return (y + y + x / (y * y)) * (1.0f / 3.0f);
+}
+void flux_scalar(const float *za, const float *ha, const float *zb,
+                 const float *hb, float *q, int begin, int end,
+                 const FluxParams &p) {
+  for (int i = begin; i < end; i++) {
+    float eta_a = za[i] + ha[i];
+    float eta_b = zb[i] + hb[i];
+    // the depth of water that can flow between the cells
+    float hf = std::max(eta_a, eta_b) - std::max(za[i], zb[i]);
+    if (!(hf > p.dry_depth)) {
+      q[i] = 0.0f;
+      continue;
+    }
+    float friction = hf * hf * cube_root(hf);
+    float flux = (q[i] - (p.g_dt * hf) * ((eta_b - eta_a) * p.inv_spacing)) /
+                 (1.0f + p.g_dt_n2 * std::abs(q[i]) / friction);
+    // no face drains more than a quarter of the water of the upwind cell
+    q[i] = std::min(std::max(flux, -hb[i] * p.limit), ha[i] * p.limit);
+  }
+}
+float depth_scalar(float *h, const float *qx_west, const float *qx,
+                   const float *qy_north, const float *qy, int begin, int end,
+                   float dt_dx, float dt_dy) {
+  float h_max = 0.0f;
+  for (int i = begin; i < end; i++) {
+    float depth = h[i] + dt_dx * (qx_west[i] - qx[i]) +
+                  dt_dy * (qy_north[i] - qy[i]);
+    h[i] = std::max(depth, 0.0f);
+    h_max = std::max(h_max, h[i]);
+  }
+  return h_max;
+}
+
+#if defined(OVERLAND_FLOW_X86)
+TARGET_AVX2 __m256 cube_root_avx2(__m256 x) {
+  __m256i bits = _mm256_add_epi32(
+      _mm256_cvttps_epi32(_mm256_mul_ps(
+          _mm256_cvtepi32_ps(_mm256_castps_si256(x)),
+          _mm256_set1_ps(1.0f / 3.0f))),
+      _mm256_set1_epi32(CBRT_MAGIC));
+  __m256 y = _mm256_castsi256_ps(bits);
+  __m256 third = _mm256_set1_ps(1.0f / 3.0f);
+  y = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(y, y),
+                                  _mm256_div_ps(x, _mm256_mul_ps(y, y))),
+                    third);
+  return _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(y, y),
+                                     _mm256_div_ps(x, _mm256_mul_ps(y, y))),
+                       third);
+}
+TARGET_AVX2 void flux_avx2(const float *za, const float *ha, const float *zb,
+                           const float *hb, float *q, int begin, int end,
+                           const FluxParams &p) {
+  __m256 g_dt = _mm256_set1_ps(p.g_dt);
+  __m256 g_dt_n2 = _mm256_set1_ps(p.g_dt_n2);
+  __m256 inv_spacing = _mm256_set1_ps(p.inv_spacing);
+  __m256 dry = _mm256_set1_ps(p.dry_depth);
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 limit = _mm256_set1_ps(p.limit);
+  int i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 z0 = _mm256_loadu_ps(za + i);
+    __m256 z1 = _mm256_loadu_ps(zb + i);
+    __m256 h0 = _mm256_loadu_ps(ha + i);
+    __m256 h1 = _mm256_loadu_ps(hb + i);
+    __m256 eta0 = _mm256_add_ps(z0, h0);
+    __m256 eta1 = _mm256_add_ps(z1, h1);
+    __m256 hf = _mm256_sub_ps(_mm256_max_ps(eta0, eta1), _mm256_max_ps(z0, z1));
+    __m256 flowing = _mm256_cmp_ps(hf, dry, _CMP_GT_OQ);
+    // dry faces are masked out, keep their friction term finite
+    __m256 hf_safe = _mm256_max_ps(hf, dry);
+    __m256 friction = _mm256_mul_ps(_mm256_mul_ps(hf_safe, hf_safe),
+                                    cube_root_avx2(hf_safe));
+    __m256 q0 = _mm256_loadu_ps(q + i);
+    __m256 numerator = _mm256_sub_ps(
+        q0, _mm256_mul_ps(_mm256_mul_ps(g_dt, hf),
+                          _mm256_mul_ps(_mm256_sub_ps(eta1, eta0),
+                                        inv_spacing)));
+    __m256 denominator = _mm256_add_ps(
+        one, _mm256_div_ps(_mm256_mul_ps(g_dt_n2, _mm256_andnot_ps(sign, q0)),
+                           friction));
+    __m256 flux = _mm256_min_ps(
+        _mm256_max_ps(_mm256_div_ps(numerator, denominator),
+                      _mm256_xor_ps(sign, _mm256_mul_ps(h1, limit))),
+        _mm256_mul_ps(h0, limit));
+    _mm256_storeu_ps(q + i, _mm256_and_ps(flowing, flux));
+  }
+  flux_scalar(za, ha, zb, hb, q, i, end, p);
+}
+TARGET_AVX2 float depth_avx2(float *h, const float *qx_west, const float *qx,
+                             const float *qy_north, const float *qy,
+                             int begin, int end, float dt_dx, float dt_dy) {
+  __m256 vdt_dx = _mm256_set1_ps(dt_dx);
+  __m256 vdt_dy = _mm256_set1_ps(dt_dy);
+  __m256 zero = _mm256_setzero_ps();
+  __m256 h_max = zero;
+  int i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 depth = _mm256_add_ps(
+        _mm256_loadu_ps(h + i),
+        _mm256_add_ps(
+            _mm256_mul_ps(vdt_dx, _mm256_sub_ps(_mm256_loadu_ps(qx_west + i),
+                                                _mm256_loadu_ps(qx + i))),
+            _mm256_mul_ps(vdt_dy, _mm256_sub_ps(_mm256_loadu_ps(qy_north + i),
+                                                _mm256_loadu_ps(qy + i)))));
+    depth = _mm256_max_ps(depth, zero);
+    _mm256_storeu_ps(h + i, depth);
+    h_max = _mm256_max_ps(h_max, depth);
+  }
+  float lanes[8];
+  _mm256_storeu_ps(lanes, h_max);
+  float tail = depth_scalar(h, qx_west, qx, qy_north, qy, i, end, dt_dx, dt_dy);
+  return std::max(tail, *std::max_element(lanes, lanes + 8));
+}
+#endif
+
+#if defined(OVERLAND_FLOW_NEON)
+float32x4_t cube_root_neon(float32x4_t x) {
+  int32x4_t bits = vaddq_s32(
+      vcvtq_s32_f32(vmulq_n_f32(vcvtq_f32_s32(vreinterpretq_s32_f32(x)),
+                                1.0f / 3.0f)),
+      vdupq_n_s32(CBRT_MAGIC));
+  float32x4_t y = vreinterpretq_f32_s32(bits);
+  y = vmulq_n_f32(vaddq_f32(vaddq_f32(y, y), vdivq_f32(x, vmulq_f32(y, y))),
+                  1.0f / 3.0f);
+  return vmulq_n_f32(
+      vaddq_f32(vaddq_f32(y, y), vdivq_f32(x, vmulq_f32(y, y))), 1.0f / 3.0f);
+}
+void flux_neon(const float *za, const float *ha, const float *zb,
+               const float *hb, float *q, int begin, int end,
+               const FluxParams &p) {
+  float32x4_t dry = vdupq_n_f32(p.dry_depth);
+  float32x4_t one = vdupq_n_f32(1.0f);
+  int i = begin;
+  for (; i + 4 <= end; i += 4) {
+    float32x4_t z0 = vld1q_f32(za + i);
+    float32x4_t z1 = vld1q_f32(zb + i);
+    float32x4_t h0 = vld1q_f32(ha + i);
+    float32x4_t h1 = vld1q_f32(hb + i);
+    float32x4_t eta0 = vaddq_f32(z0, h0);
+    float32x4_t eta1 = vaddq_f32(z1, h1);
+    float32x4_t hf = vsubq_f32(vmaxq_f32(eta0, eta1), vmaxq_f32(z0, z1));
+    uint32x4_t flowing = vcgtq_f32(hf, dry);
+    float32x4_t hf_safe = vmaxq_f32(hf, dry);
+    float32x4_t friction =
+        vmulq_f32(vmulq_f32(hf_safe, hf_safe), cube_root_neon(hf_safe));
+    float32x4_t q0 = vld1q_f32(q + i);
+    float32x4_t numerator = vsubq_f32(
+        q0, vmulq_f32(vmulq_n_f32(hf, p.g_dt),
+                      vmulq_n_f32(vsubq_f32(eta1, eta0), p.inv_spacing)));
+    float32x4_t denominator = vaddq_f32(
+        one, vdivq_f32(vmulq_n_f32(vabsq_f32(q0), p.g_dt_n2), friction));
+    float32x4_t flux =
+        vminq_f32(vmaxq_f32(vdivq_f32(numerator, denominator),
+                            vnegq_f32(vmulq_n_f32(h1, p.limit))),
+                  vmulq_n_f32(h0, p.limit));
+    vst1q_f32(q + i, vbslq_f32(flowing, flux, vdupq_n_f32(0.0f)));
+  }
+  flux_scalar(za, ha, zb, hb, q, i, end, p);
+}
+float depth_neon(float *h, const float *qx_west, const float *qx,
+                 const float *qy_north, const float *qy, int begin, int end,
+                 float dt_dx, float dt_dy) {
+  float32x4_t zero = vdupq_n_f32(0.0f);
+  float32x4_t h_max = zero;
+  int i = begin;
+  for (; i + 4 <= end; i += 4) {
+    float32x4_t depth = vaddq_f32(
+        vld1q_f32(h + i),
+        vaddq_f32(
+            vmulq_n_f32(vsubq_f32(vld1q_f32(qx_west + i), vld1q_f32(qx + i)),
+                        dt_dx),
+            vmulq_n_f32(vsubq_f32(vld1q_f32(qy_north + i), vld1q_f32(qy + i)),
+                        dt_dy)));
+    depth = vmaxq_f32(depth, zero);
+    vst1q_f32(h + i, depth);
+    h_max = vmaxq_f32(h_max, depth);
+  }
+  float tail = depth_scalar(h, qx_west, qx, qy_north, qy, i, end, dt_dx, dt_dy);
+  return std::max(tail, vmaxvq_f32(h_max));
+}
+#endif
+
+FluxKernel select_flux_kernel(SimdLevel level) {
+  switch (level) {
+#if defined(OVERLAND_FLOW_X86)
+  case SimdLevel::AVX2:
+    return flux_avx2;
+#elif defined(OVERLAND_FLOW_NEON)
+  case SimdLevel::NEON:
+    return flux_neon;
+#endif
+  default:
+    return flux_scalar;
+  }
+}
+DepthKernel select_depth_kernel(SimdLevel level) {
+  switch (level) {
+#if defined(OVERLAND_FLOW_X86)
+  case SimdLevel::AVX2:
+    return depth_avx2;
+#elif defined(OVERLAND_FLOW_NEON)
+  case SimdLevel::NEON:
+    return depth_neon;
+#endif
+  default:
+    return depth_scalar;
+  }
+}
+} // namespace
+
+OverlandFlowSettings flow_settings_for_unit(double metres_per_unit) {
+  OverlandFlowSettings settings{};
+  settings.gravity = static_cast<float>(settings.gravity / metres_per_unit);
+  settings.dry_depth = static_cast<float>(settings.dry_depth / metres_per_unit);
+  settings.manning_factor =
+      static_cast<float>(std::cbrt(1.0 / metres_per_unit));
+  return settings;
+}
+OverlandFlow::OverlandFlow(const TiledGrid<float> &elevations,
+                           glm::vec2 cell_size, OverlandFlowSettings settings)
+    : elevations(elevations.get_cols(), elevations.get_rows(), WALL),
+      depths(elevations.get_cols(), elevations.get_rows(), 0.0f),
+      flux_x(elevations.get_cols(), elevations.get_rows(), 0.0f),
+      flux_y(elevations.get_cols(), elevations.get_rows(), 0.0f),
+      cell_size(cell_size), settings(settings),
+      wet(this->elevations.get_tile_count(), 0),
+      active(this->elevations.get_tile_count(), 0),
+      tile_max_depth(this->elevations.get_tile_count(), 0.0f) {
+  this->elevations.for_each_tile(
+      [&](TileRect rect) {
+        for (int row = rect.row; row < rect.row + rect.height; row++) {
+          for (int col = rect.col; col < rect.col + rect.width; col++) {
+            float z = elevations(col, row);
+            this->elevations(col, row) = std::isnan(z) ? WALL : z;
+          }
+        }
+      },
+      settings.thread_count);
+}
+size_t OverlandFlow::add_source(int col, int row, float discharge) {
+  sources.push_back({col, row, discharge});
+  return sources.size() - 1;
+}
+void OverlandFlow::set_inflow(size_t source, float discharge) {
+  if (source < sources.size()) {
+    sources[source].discharge = discharge;
+  }
+}
+void OverlandFlow::update_active_tiles() {
+  size_t tile_count = elevations.get_tile_count();
+  for (size_t tile = 0; tile < tile_count; tile++) {
+    wet[tile] = tile_max_depth[tile] > settings.dry_depth;
+  }
+  for (auto &source : sources) {
+    if (source.discharge > 0.0f && elevations.contains(source.col, source.row)) {
+      wet[static_cast<size_t>(source.row / TS) * elevations.get_tiles_x() +
+          source.col / TS] = 1;
+    }
+  }
+  int tiles_x = elevations.get_tiles_x();
+  int tiles_y = elevations.get_tiles_y();
+  active_tiles.clear();
+  for (int ty = 0; ty < tiles_y; ty++) {
+    for (int tx = 0; tx < tiles_x; tx++) {
+      size_t tile = static_cast<size_t>(ty) * tiles_x + tx;
+      // water can only reach a tile through the faces it shares with another
+      bool now_active = wet[tile] || (tx > 0 && wet[tile - 1]) ||
+                        (tx + 1 < tiles_x && wet[tile + 1]) ||
+                        (ty > 0 && wet[tile - tiles_x]) ||
+                        (ty + 1 < tiles_y && wet[tile + tiles_x]);
+      if (active[tile] && !now_active) {
+        // the faces of a tile that goes dry stop flowing
+        std::fill_n(flux_x.data() + (tile << TILE_SHIFT), TS * TS, 0.0f);
+        std::fill_n(flux_y.data() + (tile << TILE_SHIFT), TS * TS, 0.0f);
+      }
+      active[tile] = now_active;
+      if (now_active) {
+        active_tiles.push_back(static_cast<uint32_t>(tile));
+      }
+    }
+  }
+}
+void OverlandFlow::update_fluxes(size_t tile, float dt) {
+  static const FluxKernel flux = select_flux_kernel(get_simd_level());
+  int tiles_x = elevations.get_tiles_x();
+  TileRect rect = elevations.get_tile_rect(tile);
+  bool has_east = rect.col + TS < elevations.get_cols();
+  bool has_south = rect.row + TS < elevations.get_rows();
+  size_t base = tile << TILE_SHIFT;
+  const float *z = elevations.data() + base;
+  const float *h = depths.data() + base;
+  size_t east = has_east ? (tile + 1) << TILE_SHIFT : base;
+  size_t south = has_south ? (tile + tiles_x) << TILE_SHIFT : base;
+  const float *z_east = elevations.data() + east;
+  const float *h_east = depths.data() + east;
+  const float *z_south = elevations.data() + south;
+  const float *h_south = depths.data() + south;
+  float *qx = flux_x.data() + base;
+  float *qy = flux_y.data() + base;
+  float n = settings.roughness / settings.manning_factor;
+  float g = settings.gravity;
+  FluxParams px{g * dt, g * dt * n * n, 1.0f / cell_size.x, settings.dry_depth,
+                0.25f * cell_size.x / dt};
+  FluxParams py{g * dt, g * dt * n * n, 1.0f / cell_size.y, settings.dry_depth,
+                0.25f * cell_size.y / dt};
+  // rows past the edge of the DEM are walls and never flow
+  for (int j = 0; j < rect.height; j++) {
+    int row = j * TS;
+    flux(z + row, h + row, z + row + 1, h + row + 1, qx + row, 0, TS - 1, px);
+    if (has_east) {
+      flux(z + row + TS - 1, h + row + TS - 1, z_east + row, h_east + row,
+           qx + row + TS - 1, 0, 1, px);
+    }
+    if (j + 1 < TS) {
+      flux(z + row, h + row, z + row + TS, h + row + TS, qy + row, 0, TS, py);
+    } else if (has_south) {
+      flux(z + row, h + row, z_south, h_south, qy + row, 0, TS, py);
+    }
+  }
+}
+void OverlandFlow::update_depths(size_t tile, float dt) {
+  static const DepthKernel depth = select_depth_kernel(get_simd_level());
+  static const float no_flux[TS] = {};
+  int tiles_x = elevations.get_tiles_x();
+  TileRect rect = elevations.get_tile_rect(tile);
+  bool has_west = rect.col > 0;
+  bool has_north = rect.row > 0;
+  size_t base = tile << TILE_SHIFT;
+  float *h = depths.data() + base;
+  const float *qx = flux_x.data() + base;
+  const float *qy = flux_y.data() + base;
+  const float *qx_west =
+      flux_x.data() + (has_west ? (tile - 1) << TILE_SHIFT : base);
+  const float *qy_north =
+      flux_y.data() + (has_north ? (tile - tiles_x) << TILE_SHIFT : base);
+  float dt_dx = dt / cell_size.x;
+  float dt_dy = dt / cell_size.y;
+  float h_max = 0.0f;
+  for (int j = 0; j < rect.height; j++) {
+    int row = j * TS;
+    const float *north = j > 0       ? qy + row - TS
+                         : has_north ? qy_north + (TS - 1) * TS
+                                     : no_flux;
+    float west = has_west ? qx_west[row + TS - 1] : 0.0f;
+    h_max = std::max(h_max, depth(h + row, &west, qx + row, north, qy + row, 0,
+                                  1, dt_dx, dt_dy));
+    h_max = std::max(h_max, depth(h + row + 1, qx + row, qx + row + 1,
+                                  north + 1, qy + row + 1, 0, TS - 1, dt_dx,
+                                  dt_dy));
+  }
+  tile_max_depth[tile] = h_max;
+}
+float OverlandFlow::step(float max_step) {
+  update_active_tiles();
+  float h_max = 0.0f;
+  for (uint32_t tile : active_tiles) {
+    h_max = std::max(h_max, tile_max_depth[tile]);
+  }
+  float dt = std::min(max_step, settings.max_time_step);
+  if (h_max > settings.dry_depth) {
+    dt = std::min(dt, settings.cfl * std::min(cell_size.x, cell_size.y) /
+                          std::sqrt(settings.gravity * h_max));
+  }
+  parallel_for(
+      0, active_tiles.size(),
+      [&](size_t i) { update_fluxes(active_tiles[i], dt); },
+      settings.thread_count);
+  parallel_for(
+      0, active_tiles.size(),
+      [&](size_t i) { update_depths(active_tiles[i], dt); },
+      settings.thread_count);
+  float cell_area = cell_size.x * cell_size.y;
+  for (auto &source : sources) {
+    if (source.discharge > 0.0f && depths.contains(source.col, source.row) &&
+        elevations(source.col, source.row) != WALL) {
+      float &h = depths(source.col, source.row);
+      h += source.discharge * dt / cell_area;
+      float &tile_max =
+          tile_max_depth[static_cast<size_t>(source.row / TS) *
+                             elevations.get_tiles_x() +
+                         source.col / TS];
+      tile_max = std::max(tile_max, h);
+    }
+  }
+  time += dt;
+  return dt;
+}
+size_t OverlandFlow::advance(float duration) {
+  double end = time + duration;
+  size_t steps = 0;
+  while (end - time > 1.0e-6) {
+    step(static_cast<float>(end - time));
+    steps++;
+  }
+  return steps;
+}
+void OverlandFlow::compute_velocity(TiledGrid<float> &u,
+                                    TiledGrid<float> &v) const {
+  int cols = depths.get_cols();
+  int rows = depths.get_rows();
+  if (u.get_cols() != cols || u.get_rows() != rows) {
+    u = TiledGrid<float>(cols, rows);
+  }
+  if (v.get_cols() != cols || v.get_rows() != rows) {
+    v = TiledGrid<float>(cols, rows);
+  }
+  depths.for_each_tile(
+      [&](TileRect rect) {
+        for (int row = rect.row; row < rect.row + rect.height; row++) {
+          for (int col = rect.col; col < rect.col + rect.width; col++) {
+            float h = depths(col, row);
+            if (h <= settings.dry_depth) {
+              u(col, row) = 0.0f;
+              v(col, row) = 0.0f;
+              continue;
+            }
+            float west = flux_x.get(col - 1, row, 0.0f);
+            float north = flux_y.get(col, row - 1, 0.0f);
+            u(col, row) = 0.5f * (west + flux_x(col, row)) / h;
+            v(col, row) = 0.5f * (north + flux_y(col, row)) / h;
+          }
+        }
+      },
+      settings.thread_count);
+}
+void OverlandFlow::mask_walls(TiledGrid<float> &grid, float value) const {
+  grid.for_each_tile(
+      [&](TileRect rect) {
+        for (int row = rect.row; row < rect.row + rect.height; row++) {
+          for (int col = rect.col; col < rect.col + rect.width; col++) {
+            if (elevations(col, row) == WALL) {
+              grid(col, row) = value;
+            }
+          }
+        }
+      },
+      settings.thread_count);
+}
+double OverlandFlow::get_volume() const {
+  double volume = 0.0;
+  for (auto cell : depths) {
+    volume += cell.value;
+  }
+  return volume * cell_size.x * cell_size.y;
+}
+} // namespace math_3dh
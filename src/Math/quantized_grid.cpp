@@ -0,0 +1,102 @@
+#include "Math/quantized_grid.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace math_3dh {
+namespace {
+bool is_no_data(float value, float no_data_value) {
+  return std::isnan(value) || value == no_data_value;
+}
+} // namespace
+
+QuantizedGrid::QuantizedGrid(int cols, int rows, int tile_size)
+    : cols(cols), rows(rows), tile_size(tile_size),
+      tiles_x((cols + tile_size - 1) / tile_size),
+      tiles_y((rows + tile_size - 1) / tile_size) {
+  owned_tiles.resize(get_tile_count());
+  owned_samples.resize(get_sample_count(), NO_DATA);
+  tiles = owned_tiles.data();
+  samples = owned_samples.data();
+}
+QuantizedGrid::QuantizedGrid(int cols, int rows, int tile_size,
+                             const QuantizedTile *tiles,
+                             const uint16_t *samples)
+    : cols(cols), rows(rows), tile_size(tile_size),
+      tiles_x((cols + tile_size - 1) / tile_size),
+      tiles_y((rows + tile_size - 1) / tile_size), tiles(tiles),
+      samples(samples) {}
+QuantizedGrid::QuantizedGrid(const QuantizedGrid &other) { *this = other; }
+QuantizedGrid &QuantizedGrid::operator=(const QuantizedGrid &other) {
+  cols = other.cols;
+  rows = other.rows;
+  tile_size = other.tile_size;
+  tiles_x = other.tiles_x;
+  tiles_y = other.tiles_y;
+  owned_tiles = other.owned_tiles;
+  owned_samples = other.owned_samples;
+  // an owning copy must point at its own storage, a view shares the original
+  tiles = owned_tiles.empty() ? other.tiles : owned_tiles.data();
+  samples = owned_samples.empty() ? other.samples : owned_samples.data();
+  return *this;
+}
+QuantizedTile QuantizedGrid::encode_tile(const float *src, int width,
+                                         int height, int64_t line_stride,
+                                         float no_data_value, int tile_size,
+                                         uint16_t *dst) {
+  float min_value = std::numeric_limits<float>::max();
+  float max_value = std::numeric_limits<float>::lowest();
+  for (int j = 0; j < height; j++) {
+    for (int i = 0; i < width; i++) {
+      float value = src[j * line_stride + i];
+      if (!is_no_data(value, no_data_value)) {
+        min_value = std::min(min_value, value);
+        max_value = std::max(max_value, value);
+      }
+    }
+  }
+  std::fill(dst, dst + tile_size * tile_size, NO_DATA);
+  QuantizedTile tile{};
+  if (min_value > max_value) {
+    // the whole tile is no data
+    return tile;
+  }
+  tile.bias = min_value;
+  tile.scale = (max_value - min_value) / static_cast<float>(NO_DATA - 1);
+  float inverse_scale = tile.scale > 0.0f ? 1.0f / tile.scale : 0.0f;
+  for (int j = 0; j < height; j++) {
+    for (int i = 0; i < width; i++) {
+      float value = src[j * line_stride + i];
+      if (!is_no_data(value, no_data_value)) {
+        float q = std::round((value - tile.bias) * inverse_scale);
+        dst[j * tile_size + i] = static_cast<uint16_t>(
+            std::min(q, static_cast<float>(NO_DATA - 1)));
+      }
+    }
+  }
+  return tile;
+}
+void QuantizedGrid::set_tile(int tile_x, int tile_y, const float *src,
+                             int64_t line_stride, float no_data_value) {
+  size_t tile = static_cast<size_t>(tile_y) * tiles_x + tile_x;
+  int width = std::min(tile_size, cols - tile_x * tile_size);
+  int height = std::min(tile_size, rows - tile_y * tile_size);
+  owned_tiles[tile] = encode_tile(
+      src, width, height, line_stride, no_data_value, tile_size,
+      &owned_samples[tile * tile_size * tile_size]);
+}
+float QuantizedGrid::get(int col, int row) const {
+  if (col < 0 || col >= cols || row < 0 || row >= rows) {
+    return std::nanf("");
+  }
+  uint16_t sample = samples[sample_index(col, row)];
+  if (sample == NO_DATA) {
+    return std::nanf("");
+  }
+  const QuantizedTile &tile =
+      tiles[static_cast<size_t>(row / tile_size) * tiles_x + col / tile_size];
+  return tile.bias + static_cast<float>(sample) * tile.scale;
+}
+} // namespace math_3dh
@@ -0,0 +1,109 @@
+#include "Math/rtree.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+
+namespace math_3dh {
+namespace {
+Box2D merge(const Box2D &a, const Box2D &b) {
+  return {{std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y)},
+          {std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y)}};
+}
+glm::dvec2 center(const Box2D &box) { return 0.5 * (box.min + box.max); }
+/**
+ * @brief Order entries for Sort-Tile-Recursive packing, sorted into vertical
+ * slices by x and each slice sorted by y.
+ */
+template <typename GetBox>
+void str_sort(std::vector<size_t> &order, int node_size, GetBox get_box) {
+  size_t count = order.size();
+  size_t node_count = (count + node_size - 1) / node_size;
+  size_t slice_count =
+      static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(node_count))));
+  size_t slice_size = slice_count * node_size;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return center(get_box(a)).x < center(get_box(b)).x;
+  });
+  for (size_t begin = 0; begin < count; begin += slice_size) {
+    size_t end = std::min(begin + slice_size, count);
+    std::sort(order.begin() + begin, order.begin() + end,
+              [&](size_t a, size_t b) {
+                return center(get_box(a)).y < center(get_box(b)).y;
+              });
+  }
+}
+} // namespace
+
+RTree::RTree(const std::vector<Box2D> &boxes, int node_size) : boxes(boxes) {
+  if (boxes.empty()) {
+    return;
+  }
+  items.resize(boxes.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    items[i] = i;
+  }
+  str_sort(items, node_size,
+           [&](size_t i) -> const Box2D & { return boxes[i]; });
+  // pack the leaves, then each level above until a single root
+  std::vector<Node> level{};
+  for (size_t first = 0; first < items.size(); first += node_size) {
+    Node node{boxes[items[first]], first,
+              std::min<size_t>(node_size, items.size() - first)};
+    for (size_t i = first + 1; i < first + node.count; i++) {
+      node.bounds = merge(node.bounds, boxes[items[i]]);
+    }
+    level.push_back(node);
+  }
+  levels.push_back(level);
+  while (levels.back().size() > 1) {
+    std::vector<Node> &children = levels.back();
+    std::vector<size_t> order(children.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    str_sort(order, node_size,
+             [&](size_t i) -> const Box2D & { return children[i].bounds; });
+    std::vector<Node> sorted(children.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      sorted[i] = children[order[i]];
+    }
+    children = sorted;
+    std::vector<Node> parents{};
+    for (size_t first = 0; first < children.size(); first += node_size) {
+      Node node{children[first].bounds, first,
+                std::min<size_t>(node_size, children.size() - first)};
+      for (size_t i = first + 1; i < first + node.count; i++) {
+        node.bounds = merge(node.bounds, children[i].bounds);
+      }
+      parents.push_back(node);
+    }
+    levels.push_back(parents);
+  }
+}
+void RTree::query(const Box2D &box, std::vector<size_t> &result) const {
+  if (levels.empty()) {
+    return;
+  }
+  // (level, node) pairs still to visit
+  std::vector<std::pair<size_t, size_t>> stack{{levels.size() - 1, 0}};
+  while (!stack.empty()) {
+    auto [level, index] = stack.back();
+    stack.pop_back();
+    const Node &node = levels[level][index];
+    if (!node.bounds.intersects(box)) {
+      continue;
+    }
+    for (size_t i = node.first; i < node.first + node.count; i++) {
+      if (level > 0) {
+        stack.push_back({level - 1, i});
+      } else if (boxes[items[i]].intersects(box)) {
+        result.push_back(items[i]);
+      }
+    }
+  }
+}
+void RTree::query(glm::dvec2 point, std::vector<size_t> &result) const {
+  query(Box2D{point, point}, result);
+}
+} // namespace math_3dh
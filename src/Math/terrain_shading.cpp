@@ -0,0 +1,169 @@
+#include "Math/terrain_shading.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <cmath>
+
+namespace math_3dh {
+namespace {
+float sign_not_zero(float value) { return value < 0.0f ? -1.0f : 1.0f; }
+/**
+ * @brief Encode -1 to 1 as a two's complement byte, the layout GLSL's
+ * unpackSnorm4x8() decodes, so 0 is exact.
+ */
+uint8_t encode_snorm8(float value) {
+  return static_cast<uint8_t>(static_cast<int8_t>(
+      std::round(std::clamp(value, -1.0f, 1.0f) * 127.0f)));
+}
+float decode_snorm8(uint8_t value) {
+  return std::max(static_cast<float>(static_cast<int8_t>(value)) / 127.0f,
+                  -1.0f);
+}
+/**
+ * @brief The slope along one axis from the cells before and after a cell,
+ * falling back to one sided differences at no data and the grid edge.
+ */
+float slope(float before, float center, float after, float spacing) {
+  bool has_before = !std::isnan(before);
+  bool has_after = !std::isnan(after);
+  if (has_before && has_after) {
+    return (after - before) / (2.0f * spacing);
+  }
+  if (has_after) {
+    return (after - center) / spacing;
+  }
+  if (has_before) {
+    return (center - before) / spacing;
+  }
+  return 0.0f;
+}
+/**
+ * @brief The encoded normal of a cell from a row major block of elevations.
+ *
+ * @param cell The cell in the block, its neighbours must be in the block too.
+ * @param stride The number of floats between rows of the block.
+ * @param cell_size The world space width and height of a cell.
+ */
+uint16_t block_normal(const float *cell, int stride, glm::vec2 cell_size) {
+  // rows grow southwards, world y grows northwards
+  float dzdx = slope(cell[-1], cell[0], cell[1], cell_size.x);
+  float dzdy = slope(cell[stride], cell[0], cell[-stride], cell_size.y);
+  return encode_normal(glm::normalize(glm::vec3(-dzdx, -dzdy, 1.0f)));
+}
+} // namespace
+
+uint16_t encode_normal(glm::vec3 normal) {
+  float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if (l1 == 0.0f) {
+    return encode_normal({0.0f, 0.0f, 1.0f});
+  }
+  float x = normal.x / l1;
+  float y = normal.y / l1;
+  if (normal.z < 0.0f) {
+    // fold the lower hemisphere over the diagonals
+    float folded_x = (1.0f - std::abs(y)) * sign_not_zero(x);
+    float folded_y = (1.0f - std::abs(x)) * sign_not_zero(y);
+    x = folded_x;
+    y = folded_y;
+  }
+  return static_cast<uint16_t>(encode_snorm8(x) | (encode_snorm8(y) << 8));
+}
+glm::vec3 decode_normal(uint16_t encoded) {
+  float x = decode_snorm8(static_cast<uint8_t>(encoded & 0xFF));
+  float y = decode_snorm8(static_cast<uint8_t>(encoded >> 8));
+  float z = 1.0f - std::abs(x) - std::abs(y);
+  if (z < 0.0f) {
+    float unfolded_x = (1.0f - std::abs(y)) * sign_not_zero(x);
+    float unfolded_y = (1.0f - std::abs(x)) * sign_not_zero(y);
+    x = unfolded_x;
+    y = unfolded_y;
+  }
+  return glm::normalize(glm::vec3(x, y, z));
+}
+TiledGrid<uint16_t> compute_normals(const TiledGrid<float> &elevations,
+                                    glm::vec2 cell_size) {
+  uint16_t up = encode_normal({0.0f, 0.0f, 1.0f});
+  TiledGrid<uint16_t> normals(elevations.get_cols(), elevations.get_rows(), up);
+  float no_data = std::nanf("");
+  elevations.for_each_tile([&](TileRect rect) {
+    for (int row = rect.row; row < rect.row + rect.height; row++) {
+      for (int col = rect.col; col < rect.col + rect.width; col++) {
+        auto cells = elevations.neighbourhood(col, row, no_data);
+        if (std::isnan(cells.center())) {
+          continue;
+        }
+        normals(col, row) = block_normal(&cells.cells[4], 3, cell_size);
+      }
+    }
+  });
+  return normals;
+}
+TiledGrid<uint16_t> compute_normals(const QuantizedGrid &elevations,
+                                    glm::vec2 cell_size) {
+  using Grid = TiledGrid<uint16_t>;
+  const int stride = Grid::TILE_SIZE + 2;
+  uint16_t up = encode_normal({0.0f, 0.0f, 1.0f});
+  Grid normals(elevations.get_cols(), elevations.get_rows(), up);
+  normals.for_each_tile([&](TileRect rect) {
+    // the tile with a one cell border from its neighbours, NaN off the grid
+    std::vector<float> block(static_cast<size_t>(stride) * stride);
+    for (int j = -1; j <= rect.height; j++) {
+      float *dst = &block[static_cast<size_t>(j + 1) * stride + 1];
+      for (int i = -1; i <= rect.width; i++) {
+        dst[i] = elevations.get(rect.col + i, rect.row + j);
+      }
+    }
+    for (int j = 0; j < rect.height; j++) {
+      const float *src = &block[static_cast<size_t>(j + 1) * stride + 1];
+      for (int i = 0; i < rect.width; i++) {
+        if (!std::isnan(src[i])) {
+          normals(rect.col + i, rect.row + j) =
+              block_normal(&src[i], stride, cell_size);
+        }
+      }
+    }
+  });
+  return normals;
+}
+TiledGrid<uint8_t> compute_hillshade(const TiledGrid<uint16_t> &normals,
+                                     float azimuth, float altitude) {
+  float a = glm::radians(azimuth);
+  float h = glm::radians(altitude);
+  glm::vec3 light = {std::sin(a) * std::cos(h), std::cos(a) * std::cos(h),
+                     std::sin(h)};
+  // only 65536 distinct normals, shade each of them once
+  std::vector<uint8_t> table(65536);
+  for (size_t i = 0; i < table.size(); i++) {
+    float shade = glm::dot(decode_normal(static_cast<uint16_t>(i)), light);
+    table[i] = static_cast<uint8_t>(std::round(std::max(shade, 0.0f) * 255.0f));
+  }
+  TiledGrid<uint8_t> hillshade(normals.get_cols(), normals.get_rows());
+  normals.for_each_tile([&](TileRect rect) {
+    for (int row = rect.row; row < rect.row + rect.height; row++) {
+      for (int col = rect.col; col < rect.col + rect.width; col++) {
+        hillshade(col, row) = table[normals(col, row)];
+      }
+    }
+  });
+  return hillshade;
+}
+std::vector<uint32_t> hillshade_to_rgba(const TiledGrid<uint8_t> &hillshade) {
+  int cols = hillshade.get_cols();
+  std::vector<uint32_t> pixels(hillshade.get_cell_count());
+  parallel_for(0, hillshade.get_rows(), [&](size_t row) {
+    uint32_t *dst = &pixels[row * cols];
+    for (int col = 0; col < cols; col++) {
+      uint32_t grey = hillshade(col, static_cast<int>(row));
+      dst[col] = grey | (grey << 8) | (grey << 16) | 0xFF000000u;
+    }
+  });
+  return pixels;
+}
+std::vector<uint32_t> shade_block(const float *elevations, int width,
+                                  int height, glm::vec2 cell_size) {
+  TiledGrid<float> block(width, height);
+  block.write_rows(0, height, elevations);
+  return hillshade_to_rgba(
+      compute_hillshade(compute_normals(block, cell_size)));
+}
+} // namespace math_3dh
@@ -0,0 +1,37 @@
+#include "Math/tiled_grid.hpp"
+
+// Standard Library
+#include <cmath>
+
+namespace math_3dh {
+TiledGrid<float> decode_elevations(const QuantizedGrid &grid, float shift) {
+  using Grid = TiledGrid<float>;
+  Grid result(grid.get_cols(), grid.get_rows(), std::nanf(""));
+  float *cells = result.data();
+  if (grid.get_tile_size() == Grid::TILE_SIZE) {
+    const QuantizedTile *tiles = grid.get_tiles();
+    const uint16_t *samples = grid.get_samples();
+    size_t tile_cells = Grid::TILE_SIZE * Grid::TILE_SIZE;
+    parallel_for(0, result.get_tile_count(), [&](size_t tile) {
+      QuantizedTile params = tiles[tile];
+      float bias = params.bias - shift;
+      const uint16_t *src = samples + tile * tile_cells;
+      float *dst = cells + tile * tile_cells;
+      for (size_t i = 0; i < tile_cells; i++) {
+        dst[i] = src[i] == QuantizedGrid::NO_DATA
+                     ? std::nanf("")
+                     : bias + static_cast<float>(src[i]) * params.scale;
+      }
+    });
+    return result;
+  }
+  result.for_each_tile([&](TileRect rect) {
+    for (int row = rect.row; row < rect.row + rect.height; row++) {
+      for (int col = rect.col; col < rect.col + rect.width; col++) {
+        cells[result.index(col, row)] = grid.get(col, row) - shift;
+      }
+    }
+  });
+  return result;
+}
+} // namespace math_3dh
@@ -0,0 +1,207 @@
+#include "Math/watershed.hpp"
+
+// Standard Library
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+// 3DH
+#include "Math/flow_routing.hpp"
+#include "Math/parallel.hpp"
+
+namespace math_3dh {
+namespace {
+using LabelGrid = TiledGrid<int32_t>;
+constexpr int TS = LabelGrid::TILE_SIZE;
+constexpr int BORDER_SLOTS = 4 * TS;
+constexpr int32_t UNSET = std::numeric_limits<int32_t>::min();
+constexpr int32_t VISITING = UNSET + 1;
+/**
+ * @brief The slot of a cell on the border of its tile, where paths from other
+ * tiles can enter. Cells shared by two borders have one slot.
+ */
+inline int border_slot(int i, int j) {
+  if (j == 0) {
+    return i;
+  }
+  if (j == TS - 1) {
+    return TS + i;
+  }
+  if (i == 0) {
+    return 2 * TS + j;
+  }
+  return 3 * TS + j;
+}
+inline void slot_cell(int slot, int &i, int &j) {
+  switch (slot / TS) {
+  case 0:
+    i = slot;
+    j = 0;
+    break;
+  case 1:
+    i = slot - TS;
+    j = TS - 1;
+    break;
+  case 2:
+    i = 0;
+    j = slot - 2 * TS;
+    break;
+  default:
+    i = TS - 1;
+    j = slot - 3 * TS;
+  }
+}
+/**
+ * @brief Links to border cells are stored in the labels as -2 - key, below
+ * every label and WATERSHED_NONE.
+ */
+inline bool is_link(int32_t value) {
+  return value < WATERSHED_NONE && value > VISITING;
+}
+inline int32_t link_to_key(int32_t value) { return -2 - value; }
+} // namespace
+
+std::vector<glm::ivec2>
+snap_pour_points(const TiledGrid<uint32_t> &accumulation,
+                 const std::vector<glm::ivec2> &points, int radius) {
+  std::vector<glm::ivec2> snapped(points);
+  int radius2 = radius * radius;
+  parallel_for(0, points.size(), [&](size_t p) {
+    glm::ivec2 point = points[p];
+    if (!accumulation.contains(point.x, point.y)) {
+      return;
+    }
+    uint32_t best = accumulation(point.x, point.y);
+    int row_end = std::min(point.y + radius, accumulation.get_rows() - 1);
+    int col_end = std::min(point.x + radius, accumulation.get_cols() - 1);
+    for (int row = std::max(point.y - radius, 0); row <= row_end; row++) {
+      for (int col = std::max(point.x - radius, 0); col <= col_end; col++) {
+        int dx = col - point.x;
+        int dy = row - point.y;
+        if (dx * dx + dy * dy <= radius2 && accumulation(col, row) > best) {
+          best = accumulation(col, row);
+          snapped[p] = {col, row};
+        }
+      }
+    }
+  });
+  return snapped;
+}
+
+TiledGrid<int32_t> label_watersheds(const TiledGrid<uint8_t> &directions,
+                                    const std::vector<glm::ivec2> &pour_points,
+                                    unsigned int thread_count) {
+  int cols = directions.get_cols();
+  int rows = directions.get_rows();
+  LabelGrid labels(cols, rows, UNSET);
+  size_t tile_count = labels.get_tile_count();
+  if (tile_count * BORDER_SLOTS >
+      static_cast<size_t>(std::numeric_limits<int32_t>::max() / 2)) {
+    std::cerr << "Error: Grid is too large to label watersheds." << std::endl;
+    return labels;
+  }
+  for (size_t p = 0; p < pour_points.size(); p++) {
+    glm::ivec2 point = pour_points[p];
+    if (labels.contains(point.x, point.y) && labels(point.x, point.y) == UNSET) {
+      labels(point.x, point.y) = static_cast<int32_t>(p);
+    }
+  }
+  // link every cell to its root or to where its path leaves the tile
+  labels.for_each_tile(
+      [&](TileRect rect) {
+        std::vector<size_t> path{};
+        for (int row = rect.row; row < rect.row + rect.height; row++) {
+          for (int col = rect.col; col < rect.col + rect.width; col++) {
+            int c = col;
+            int r = row;
+            int32_t value;
+            while (true) {
+              value = labels(c, r);
+              if (value != UNSET) {
+                break;
+              }
+              labels(c, r) = VISITING;
+              path.push_back(labels.index(c, r));
+              uint8_t d = directions(c, r);
+              int next_c = c + D8_DX[d & 7];
+              int next_r = r + D8_DY[d & 7];
+              if (d >= 8 || !labels.contains(next_c, next_r)) {
+                value = WATERSHED_NONE;
+                break;
+              }
+              c = next_c;
+              r = next_r;
+              if (c < rect.col || c >= rect.col + rect.width || r < rect.row ||
+                  r >= rect.row + rect.height) {
+                size_t tile = static_cast<size_t>(r / TS) * labels.get_tiles_x() +
+                              c / TS;
+                value = -2 - static_cast<int32_t>(tile * BORDER_SLOTS +
+                                                  border_slot(c % TS, r % TS));
+                break;
+              }
+            }
+            if (value == VISITING) {
+              value = WATERSHED_NONE; // a cycle in the directions
+            }
+            for (size_t index : path) {
+              labels.data()[index] = value;
+            }
+            path.clear();
+          }
+        }
+      },
+      thread_count);
+  // resolve the links between tiles, they only start at tile borders
+  std::vector<int32_t> roots(tile_count * BORDER_SLOTS, UNSET);
+  std::vector<int32_t> chain{};
+  auto border_value = [&](int32_t key) {
+    TileRect rect = labels.get_tile_rect(key / BORDER_SLOTS);
+    int i, j;
+    slot_cell(key % BORDER_SLOTS, i, j);
+    return labels(rect.col + i, rect.row + j);
+  };
+  for (size_t key = 0; key < roots.size(); key++) {
+    int32_t k = static_cast<int32_t>(key);
+    while (roots[k] == UNSET) {
+      int32_t value = border_value(k);
+      if (!is_link(value)) {
+        // slots past the edge of the grid are never linked to
+        roots[k] = value == UNSET ? WATERSHED_NONE : value;
+        break;
+      }
+      roots[k] = VISITING;
+      chain.push_back(k);
+      k = link_to_key(value);
+    }
+    int32_t root = roots[k] == VISITING ? WATERSHED_NONE : roots[k];
+    for (int32_t c : chain) {
+      roots[c] = root;
+    }
+    chain.clear();
+  }
+  labels.for_each_tile(
+      [&](TileRect rect) {
+        for (int row = rect.row; row < rect.row + rect.height; row++) {
+          for (int col = rect.col; col < rect.col + rect.width; col++) {
+            int32_t &value = labels(col, row);
+            if (is_link(value)) {
+              value = roots[link_to_key(value)];
+            }
+          }
+        }
+      },
+      thread_count);
+  return labels;
+}
+
+std::vector<size_t> count_watershed_cells(const TiledGrid<int32_t> &labels,
+                                          size_t watershed_count) {
+  std::vector<size_t> counts(watershed_count, 0);
+  for (auto cell : labels) {
+    if (cell.value >= 0 && static_cast<size_t>(cell.value) < watershed_count) {
+      counts[cell.value]++;
+    }
+  }
+  return counts;
+}
+} // namespace math_3dh
@@ -1,10 +1,56 @@
 #include "Entities/RibbonTools/NodeTool.hpp"
 #include "Entities/HydraulicNetwork.hpp"
+#include "Entities/Terrain.hpp"
 #include "Entities/UI/RibbonUI.hpp"
 #include "Meshes/CircleMesh.hpp"
 #include "Scene.hpp"
 #include "Systems/Controls/OrbitControls.hpp"
 
+// Standard Library
+#include <cstdio>
+
+namespace {
+/**
+ * @brief The scale from a unit selected in the UI to the units of the
+ * HydraulicNetwork.
+ */
+float to_network_units(std::string units) {
+  double metres = gdal_input::metres_per_unit(units);
+  // without a unit the value is taken as already in network units
+  return metres > 0.0 ? HydraulicNetwork::from_units(metres) : 1.0f;
+}
+/**
+ * @brief Find the world space position on the terrain under the cursor.
+ * @details The scene is orthographic, so the view ray through the cursor is
+ * the forward vector offset in the view plane by the cursor's position in the
+ * window, which the ribbon layer already tracks. It is intersected with the
+ * full resolution DEM on the CPU, without reading back the depth buffer.
+ * Renderer::raycast() is only used when no terrain is under the cursor.
+ */
+glm::vec3 pick_position(NodeTool *tool) {
+  Scene *scene = Renderer::get_info().scene;
+  Terrain *terrain = scene->get_entity<Terrain>();
+  RibbonUI *ribbon = tool->base_layer->get_entity<RibbonUI>();
+  if (terrain && ribbon) {
+    // the layer and the scene both span the window, centered on their cameras
+    float aspect = Renderer::get_info().window_aspect;
+    float layer_scale = ribbon->get_layer()->get_ortho_scale();
+    glm::vec2 cursor = ribbon->get_model_coords() / layer_scale;
+    float scale = scene->get_ortho_scale();
+    glm::vec3 direction = scene->get_forward_vector();
+    glm::vec3 up = scene->get_up_vector();
+    glm::vec3 right = glm::normalize(glm::cross(direction, up));
+    glm::vec3 origin = scene->get_position() + right * (cursor.x * scale) +
+                       up * (cursor.y * scale);
+    glm::vec3 hit;
+    if (terrain->raycast(origin, direction, hit)) {
+      return hit;
+    }
+  }
+  return Renderer::raycast(scene);
+}
+} // namespace
+
 NodeTool::NodeTool(Layer *layer) : RibbonTool(layer) {
   // The Tool's Icon
   icon = gen_ref<InstancedMesh>(3);
@@ -66,6 +112,8 @@ void NodeTool::init_flyout_elements(uint32_t ribbon_width) {
   create_button = gen_ref<Button<NodeTool>>(base_layer, bounds, "CREATE");
   create_button->set_on_click_callback(open_create_flyout, this);
   move_button = gen_ref<Button<NodeTool>>(base_layer, bounds, "MOVE");
+  drape_button = gen_ref<Button<NodeTool>>(base_layer, bounds, "DRAPE");
+  drape_button->set_on_click_callback(drape_nodes, this);
   // Create Flyout
   create_guide = gen_ref<FlyoutGuide<NodeTool>>(base_layer, "CREATE");
   create_guide->back_button->set_on_click_callback(open_edit_flyout, this);
@@ -160,8 +208,46 @@ void NodeTool::open_edit_flyout(NodeTool *tool) {
   tool->push_flyout_element(tool->select_button, standard_slot);
   tool->push_flyout_element(tool->create_button, standard_slot);
   tool->push_flyout_element(tool->move_button, standard_slot);
+  tool->push_flyout_element(tool->drape_button, standard_slot);
+  for (auto &result : tool->drape_results) {
+    tool->push_flyout_element(result, standard_slot);
+  }
   tool->rescale(tool->ribbon_width_world);
 }
+void NodeTool::drape_nodes(NodeTool *tool) {
+  tool->drape_results.clear();
+  auto push_result = [tool](std::string text) {
+    tool->drape_results.push_back(
+        gen_ref<Button<NodeTool>>(tool->base_layer, util::Rect(), text));
+  };
+  Terrain *terrain = Renderer::get_info().scene->get_entity<Terrain>();
+  if (!terrain) {
+    push_result("NO TERRAIN");
+    open_edit_flyout(tool);
+    return;
+  }
+  DrapeReport report = HydraulicNetwork::LoadedNetwork->drape_to_terrain(
+      terrain, NodeTool::rim_tolerance);
+  push_result("FILLED: " + std::to_string(report.filled));
+  push_result("CHECKED: " + std::to_string(report.checked));
+  push_result("OFF TERRAIN: " + std::to_string(report.off_terrain));
+  push_result("ABOVE GROUND: " + std::to_string(report.above_ground.size()));
+  push_result("RIM MISMATCH: " + std::to_string(report.mismatches.size()));
+  // name the first few nodes that need attention, by rim minus ground in ft
+  size_t listed = 0;
+  for (const auto *nodes : {&report.above_ground, &report.mismatches}) {
+    for (const RimMismatch &node : *nodes) {
+      if (listed++ == max_drape_nodes) {
+        break;
+      }
+      char difference[32];
+      std::snprintf(difference, sizeof(difference), "%+.2f",
+                    node.rim_elevation - node.ground_elevation);
+      push_result(node.ID + ": " + difference);
+    }
+  }
+  open_edit_flyout(tool);
+}
 // Import callback
 void NodeTool::on_file_select(NodeTool *tool) {
   tool->imported_nodes = gen_ref<VectorDataset>(tool->file_browser->file_name);
@@ -205,7 +291,61 @@ void NodeTool::on_layer_select(NodeTool *tool) {
           tool->layer_selection->field_dropdown->get_value()));
   tool->depth_selection->set_unit_dropdown_selection_options({"m", "ft", "in"});
 }
-void NodeTool::import_nodes(NodeTool *tool) {}
+void NodeTool::import_nodes(NodeTool *tool) {
+  if (!tool->imported_nodes) {
+    return;
+  }
+  std::string ID_field = tool->ID_selection->field_dropdown->get_value();
+  std::string d1_field = tool->d1_selection->field_dropdown->get_value();
+  std::string invert_field =
+      tool->invert_selection->field_dropdown->get_value();
+  std::string depth_field = tool->depth_selection->field_dropdown->get_value();
+  // read the whole layer in one pass per worker
+  FeatureBatch batch = tool->imported_nodes->read_features_parallel(
+      tool->layer_selection->field_dropdown->get_value(),
+      {ID_field, d1_field, invert_field, depth_field});
+  if (batch.geometry_type != GeometryType::POINT) {
+    return;
+  }
+  const FieldColumn *IDs = batch.get_column(ID_field);
+  const FieldColumn *d1s = batch.get_column(d1_field);
+  const FieldColumn *inverts = batch.get_column(invert_field);
+  const FieldColumn *depths = batch.get_column(depth_field);
+  float d1_scale =
+      to_network_units(tool->d1_selection->unit_dropdown->get_value());
+  float invert_scale =
+      to_network_units(tool->invert_selection->unit_dropdown->get_value());
+  float depth_scale =
+      to_network_units(tool->depth_selection->unit_dropdown->get_value());
+  HydraulicNetwork *network = HydraulicNetwork::LoadedNetwork.get();
+  if (batch.size() == 0) {
+    return;
+  }
+  // the nodes keep their projected coordinates, a scene without a terrain
+  // is centered on the first of them
+  network->get_offset({batch.x[0], batch.y[0]});
+  network->reserve_nodes(batch.size());
+  for (size_t i = 0; i < batch.size(); i++) {
+    Referenced<CylinderNode> node = gen_ref<CylinderNode>();
+    node->easting = batch.x[i];
+    node->northing = batch.y[i];
+    if (IDs) {
+      node->ID = IDs->get_as_string(i);
+    }
+    if (d1s) {
+      node->inner_diameter = d1s->get_as_double(i) * d1_scale;
+    }
+    if (inverts) {
+      node->invert_elevation = inverts->get_as_double(i) * invert_scale;
+    }
+    // missing depths are read as 0, leave them to be draped on the terrain
+    node->has_depth = depths && depths->get_as_double(i) > 0.0;
+    if (node->has_depth) {
+      node->node_depth = depths->get_as_double(i) * depth_scale;
+    }
+    network->add_node(node);
+  }
+}
 
 // Edit
 void NodeTool::open_create_flyout(NodeTool *tool) {
@@ -255,17 +395,20 @@ bool NodeToolControls::on_mouse_button(RendererInput const &input,
     float dia, depth, elev;
     std::string ID;
     try {
-      dia = tool->create_diameter_input_box->get_input_value_as_float();
+      dia = tool->create_diameter_input_box->get_input_value_as_float() *
+            to_network_units(tool->create_diameter_input_box->get_units());
     } catch (const std::exception &e) {
       dia = 4.0f; // default value
     }
     try {
-      depth = tool->create_depth_input_box->get_input_value_as_float();
+      depth = tool->create_depth_input_box->get_input_value_as_float() *
+              to_network_units(tool->create_depth_input_box->get_units());
     } catch (const std::exception &e) {
       depth = 8.0f; // default value
     }
     try {
-      elev = tool->create_elev_input_box->get_input_value_as_float();
+      elev = tool->create_elev_input_box->get_input_value_as_float() *
+             to_network_units(tool->create_elev_input_box->get_units());
     } catch (const std::exception &e) {
       elev = 0.0f; // default value
     }
@@ -274,10 +417,11 @@ bool NodeToolControls::on_mouse_button(RendererInput const &input,
     } catch (const std::exception &e) {
       ID = ""; // default value
     }
-    glm::vec3 position = Renderer::raycast(Renderer::get_info().scene);
+    glm::vec3 position = pick_position(tool);
     HydraulicNetwork *network = HydraulicNetwork::LoadedNetwork.get();
-    double easting = position.x + network->offset.x;
-    double northing = position.y + network->offset.y;
+    glm::dvec2 offset = network->get_offset();
+    double easting = position.x + offset.x;
+    double northing = position.y + offset.y;
     Referenced<CylinderNode> node = gen_ref<CylinderNode>();
     node->easting = easting;
     node->northing = northing;
@@ -2,27 +2,106 @@
 #include "Scenes/MainScene.hpp"
 
 Terrain::Terrain(RasterDataset *dem, RasterDataset *image, uint32_t k,
-                 uint32_t L)
+                 uint32_t L, TerrainMode mode, TerrainCache *cache)
     : L(L) {
 
   glm::dvec2 dem_upper_left = dem->get_top_left_coord();
   dem_pixel_scale = dem->get_pixel_scale();
   dem_pixels = {dem->get_cols(), dem->get_rows()};
   dem_no_data_value = dem->get_no_data_float(1);
+  dem_vertical_unit = dem->get_vertical_unit(1);
+  dem_projection = dem->get_projection();
 
-  glm::dvec2 image_upper_left = image->get_top_left_coord();
-  image_pixel_scale = image->get_pixel_scale();
-  image_pixels = {image->get_cols(), image->get_rows()};
+  // without an image a hillshade is draped on the grid of the DEM
+  has_image = image != nullptr;
+  glm::dvec2 image_upper_left =
+      has_image ? image->get_top_left_coord() : dem_upper_left;
+  image_pixel_scale =
+      has_image ? image->get_pixel_scale() : dem->get_pixel_scale();
+  image_pixels = has_image ? glm::ivec2(image->get_cols(), image->get_rows())
+                           : dem_pixels;
 
-  auto main_scene = dynamic_cast<MainScene *>(Renderer::get_info().scene);
-  if (main_scene) {
-    if (std::isnan(main_scene->get_world_offset().x)) {
-      main_scene->set_world_offset(calc_offset(dem, image));
+  if (!init_world_offset(dem_upper_left, image_upper_left)) {
+    // MainScene is not active
+    return;
+  }
+
+  std::string image_path = has_image ? image->get_filepath() : "";
+  dem_mapping = dem->map_band(1);
+  if (mode == TerrainMode::STREAMING) {
+    init_clipmap(k);
+    // each ring covers the footprint of its level with a margin to move in
+    stream = std::make_unique<ClipmapStream>(
+        dem->get_filepath(), image_path, L, n + 1 + 2 * m, offset.z);
+    return;
+  }
+  if (mode == TerrainMode::PROGRESSIVE) {
+    init_clipmap(k);
+    loader = std::make_unique<TerrainLoader>(dem->get_filepath(), image_path,
+                                             static_cast<int>(L) - 1);
+    return;
+  }
+  if (TerrainCache *mapped = select_cache(cache, dem, image)) {
+    // the cache was written from these rasters, map it instead of decoding
+    init_elevations(mapped);
+    if (has_image) {
+      init_image(mapped);
+    } else {
+      init_hillshade();
     }
   } else {
+    init_elevations(dem);
+    if (has_image) {
+      init_image(image);
+    } else {
+      init_hillshade();
+    }
+  }
+  init_clipmap(k);
+}
+Terrain::Terrain(TerrainCache *cache, RasterDataset *dem, RasterDataset *image,
+                 uint32_t k, uint32_t L)
+    : Terrain(dem, image, k, L, TerrainMode::RESIDENT, cache) {}
+Terrain::Terrain(RasterMosaic *dem, RasterMosaic *image, uint32_t k,
+                 uint32_t L)
+    : L(L) {
+  glm::dvec2 dem_upper_left = dem->get_top_left_coord();
+  dem_pixel_scale = dem->get_pixel_scale();
+  dem_pixels = {dem->get_cols(), dem->get_rows()};
+  dem_no_data_value = dem->get_no_data_float(1);
+  dem_vertical_unit = dem->get_vertical_unit();
+  dem_projection = dem->get_projection();
+
+  has_image = image != nullptr;
+  glm::dvec2 image_upper_left =
+      has_image ? image->get_top_left_coord() : dem_upper_left;
+  image_pixel_scale =
+      has_image ? image->get_pixel_scale() : dem->get_pixel_scale();
+  image_pixels = has_image ? glm::ivec2(image->get_cols(), image->get_rows())
+                           : dem_pixels;
+
+  if (!init_world_offset(dem_upper_left, image_upper_left)) {
     // MainScene is not active
     return;
   }
+
+  init_elevations(dem);
+  if (has_image) {
+    init_image(image);
+  } else {
+    init_hillshade();
+  }
+  init_clipmap(k);
+}
+bool Terrain::init_world_offset(glm::dvec2 dem_upper_left,
+                                glm::dvec2 image_upper_left) {
+  auto main_scene = dynamic_cast<MainScene *>(Renderer::get_info().scene);
+  if (!main_scene) {
+    return false;
+  }
+  if (std::isnan(main_scene->get_world_offset().x)) {
+    main_scene->set_world_offset(calc_offset(dem_upper_left, image_upper_left));
+  }
   offset = main_scene->get_world_offset();
 
   dem_upper_left_world_space = {
@@ -33,10 +112,35 @@ Terrain::Terrain(RasterDataset *dem, RasterDataset *image, uint32_t k,
       static_cast<float>(image_upper_left.y - offset.y)};
   dem_grid_offset = {fmodf(dem_upper_left_world_space.x, dem_pixel_scale.x),
                      fmodf(dem_upper_left_world_space.y, dem_pixel_scale.y)};
-
-  init_elevations(dem);
-  init_image(image);
-
+  return true;
+}
+TerrainCache *Terrain::select_cache(TerrainCache *cache, RasterDataset *dem,
+                                    RasterDataset *image) {
+  if (cache) {
+    if (cache->is_open() && cache->is_current(dem, image)) {
+      return cache;
+    }
+    std::cerr << "Warning: The terrain cache is stale, reading the DEM instead."
+              << std::endl;
+    return nullptr;
+  }
+  std::string path = TerrainCache::get_cache_path(dem);
+  owned_cache = std::make_unique<TerrainCache>(path);
+  if (!owned_cache->is_open() || !owned_cache->is_current(dem, image)) {
+    // unmap the stale cache before it is rewritten
+    owned_cache = nullptr;
+    if (TerrainCache::write(path, dem, image, offset.z,
+                            static_cast<int>(L) - 1)) {
+      owned_cache = std::make_unique<TerrainCache>(path);
+    }
+  }
+  if (!owned_cache || !owned_cache->is_open()) {
+    owned_cache = nullptr;
+    return nullptr;
+  }
+  return owned_cache.get();
+}
+void Terrain::init_clipmap(uint32_t k) {
   n = pow(2, k) - 1; // clipmap size
   m = (n + 1) / 4;   // footprint size
   for (int i = 0; i < L; i++) {
@@ -64,20 +168,227 @@ Terrain::Terrain(RasterDataset *dem, RasterDataset *image, uint32_t k,
   gen_system<TerrainRenderer>();
 }
 float Terrain::get_terrain_elevation(glm::vec2 center) {
-  glm::ivec2 col_row = world_to_dem(center);
+  return get_dem_elevation(world_to_dem(center));
+}
+float Terrain::get_dem_elevation(glm::ivec2 col_row) {
   if (col_row.x >= dem_pixels.x || col_row.x < 0 || col_row.y >= dem_pixels.y ||
       col_row.y < 0) {
     return std::nanf("");
   }
-  float elevation = (*elev_buffer)[col_row.y * dem_pixels.x + col_row.x];
-  if (elevation == dem_no_data_value) {
-    return std::nanf("");
+  if (dem_mapping) {
+    // only the touched pages of the DEM are read
+    float elevation = dem_mapping->get(col_row.x, col_row.y);
+    if (elevation == dem_no_data_value) {
+      return std::nanf("");
+    }
+    return elevation - static_cast<float>(offset.z);
+  }
+  if (stream) {
+    // the streamed rings are already relative to the world offset
+    return stream->get_elevation(col_row);
+  }
+  return dem_grid.get(col_row.x / dem_grid_factor,
+                      col_row.y / dem_grid_factor) -
+         dem_grid_shift;
+}
+void Terrain::get_terrain_elevations(const float *x, const float *y, float *z,
+                                     size_t count) {
+  if (stream) {
+    // no resident grid, interpolate the DEM pixels the same way one at a time
+    for (size_t i = 0; i < count; i++) {
+      float u =
+          (x[i] - dem_upper_left_world_space.x) / dem_pixel_scale.x - 0.5f;
+      float v =
+          (dem_upper_left_world_space.y - y[i]) / dem_pixel_scale.y - 0.5f;
+      if (u < -0.5f || v < -0.5f || u > dem_pixels.x - 0.5f ||
+          v > dem_pixels.y - 0.5f) {
+        z[i] = std::nanf("");
+        continue;
+      }
+      // within half a cell of the edge the edge cells are used
+      u = std::clamp(u, 0.0f, static_cast<float>(dem_pixels.x - 1));
+      v = std::clamp(v, 0.0f, static_cast<float>(dem_pixels.y - 1));
+      int col = std::min(static_cast<int>(u), dem_pixels.x - 2);
+      int row = std::min(static_cast<int>(v), dem_pixels.y - 2);
+      col = std::max(col, 0);
+      row = std::max(row, 0);
+      float fu = u - col;
+      float fv = v - row;
+      float z00 = get_dem_elevation({col, row});
+      float z10 = get_dem_elevation({col + 1, row});
+      float z01 = get_dem_elevation({col, row + 1});
+      float z11 = get_dem_elevation({col + 1, row + 1});
+      float top = z00 + (z10 - z00) * fu;
+      float bottom = z01 + (z11 - z01) * fu;
+      z[i] = top + (bottom - top) * fv;
+    }
+    return;
+  }
+  // integer grid coordinates are the DEM cell centers
+  glm::vec2 scale = get_grid_scale();
+  math_3dh::GridTransform transform;
+  transform.scale_x = 1.0f / scale.x;
+  transform.offset_x = -dem_upper_left_world_space.x / scale.x - 0.5f;
+  transform.scale_y = -1.0f / scale.y;
+  transform.offset_y = dem_upper_left_world_space.y / scale.y - 0.5f;
+  math_3dh::sample_bilinear(dem_grid, dem_grid_shift, transform, x, y, z,
+                            count);
+}
+bool Terrain::raycast(glm::vec3 origin, glm::vec3 direction, glm::vec3 &hit) {
+  if (stream) {
+    return raycast_stream(origin, direction, hit);
+  }
+  // the pyramid works in columns and rows of DEM cell centers
+  glm::vec2 scale = get_grid_scale();
+  glm::vec3 grid_origin = {
+      (origin.x - dem_upper_left_world_space.x) / scale.x - 0.5f,
+      (dem_upper_left_world_space.y - origin.y) / scale.y - 0.5f, origin.z};
+  glm::vec3 grid_direction = {direction.x / scale.x, -direction.y / scale.y,
+                              direction.z};
+  float t;
+  if (!dem_pyramid.intersect(grid_origin, grid_direction, vert_exag, t)) {
+    return false;
+  }
+  hit = origin + t * direction;
+  return true;
+}
+bool Terrain::raycast_stream(glm::vec3 origin, glm::vec3 direction,
+                             glm::vec3 &hit) {
+  // clip the ray to the footprint of the DEM
+  glm::vec2 lower = {dem_upper_left_world_space.x,
+                     dem_upper_left_world_space.y -
+                         dem_pixels.y * dem_pixel_scale.y};
+  glm::vec2 upper = {dem_upper_left_world_space.x +
+                         dem_pixels.x * dem_pixel_scale.x,
+                     dem_upper_left_world_space.y};
+  float t_enter = 0.0f;
+  float t_exit = std::numeric_limits<float>::max();
+  for (int axis = 0; axis < 2; axis++) {
+    if (direction[axis] == 0.0f) {
+      if (origin[axis] < lower[axis] || origin[axis] > upper[axis]) {
+        return false;
+      }
+      continue;
+    }
+    float t0 = (lower[axis] - origin[axis]) / direction[axis];
+    float t1 = (upper[axis] - origin[axis]) / direction[axis];
+    t_enter = std::max(t_enter, std::min(t0, t1));
+    t_exit = std::min(t_exit, std::max(t0, t1));
+  }
+  if (t_enter > t_exit) {
+    return false;
+  }
+  // march the streamed rings one DEM pixel at a time
+  float step_length = glm::length(glm::vec2(direction));
+  float dt = step_length > 0.0f
+                 ? std::min(dem_pixel_scale.x, dem_pixel_scale.y) / step_length
+                 : 0.0f;
+  if (dt == 0.0f) {
+    // a vertical ray hits the cell below or above it
+    float elevation = vert_exag * get_terrain_elevation(glm::vec2(origin));
+    float t = (elevation - origin.z) / direction.z;
+    if (std::isnan(elevation) || !(t >= 0.0f)) {
+      return false;
+    }
+    hit = origin + t * direction;
+    return true;
   }
-  return elevation;
+  float previous_t = std::nanf("");
+  float previous_height = std::nanf("");
+  for (float t = t_enter; t <= t_exit; t += dt) {
+    glm::vec3 point = origin + t * direction;
+    float height =
+        point.z - vert_exag * get_terrain_elevation(glm::vec2(point));
+    if (std::isnan(height)) {
+      previous_t = std::nanf("");
+      continue;
+    }
+    if (height <= 0.0f) {
+      if (!std::isnan(previous_t)) {
+        // the surface crossed between the two samples
+        t = previous_t + dt * previous_height / (previous_height - height);
+      }
+      hit = origin + t * direction;
+      return true;
+    }
+    previous_t = t;
+    previous_height = height;
+  }
+  return false;
+}
+const math_3dh::TiledGrid<float> &Terrain::get_elevation_grid() {
+  if (stream) {
+    if (elevation_grid_stale) {
+      std::cerr << "Warning: Terrain analysis needs a resident DEM, there is "
+                   "no elevation grid in streaming mode."
+                << std::endl;
+      elevation_grid_stale = false;
+    }
+    return elevation_grid;
+  }
+  if (elevation_grid_stale) {
+    elevation_grid = math_3dh::decode_elevations(dem_grid, dem_grid_shift);
+    elevation_grid_stale = false;
+  }
+  return elevation_grid;
+}
+math_3dh::TiledGrid<float> Terrain::condition_elevations(float epsilon,
+                                                        int breach_length,
+                                                        float breach_depth) {
+  math_3dh::TiledGrid<float> elevations = get_elevation_grid();
+  if (breach_length > 0) {
+    math_3dh::breach_depressions(elevations, breach_length, breach_depth);
+  }
+  math_3dh::fill_depressions(elevations, epsilon);
+  return elevations;
+}
+RasterGeoreference Terrain::get_grid_georeference() {
+  RasterGeoreference georeference;
+  georeference.top_left = {dem_upper_left_world_space.x + offset.x,
+                           dem_upper_left_world_space.y + offset.y};
+  georeference.pixel_scale = get_grid_scale();
+  georeference.projection = dem_projection;
+  return georeference;
+}
+size_t Terrain::trace_contours(float interval, math_3dh::ContourSink &sink) {
+  // contour the absolute elevations at whole intervals
+  return math_3dh::trace_contours(get_elevation_grid(), interval, sink,
+                                  -offset.z);
+}
+bool Terrain::write_contours(std::string filepath, float interval,
+                             std::string driver) {
+  return gdal_input::write_contours(filepath, get_elevation_grid(),
+                                    get_grid_georeference(), interval,
+                                    offset.z, driver);
+}
+Referenced<ContourLines> Terrain::build_contour_lines(float interval,
+                                                      glm::vec4 color) {
+  ContourLineBuilder builder(dem_upper_left_world_space, get_grid_scale(),
+                             vert_exag);
+  trace_contours(interval, builder);
+  return gen_ref<ContourLines>(builder.vertices, color);
+}
+glm::ivec2 Terrain::world_to_grid(glm::vec2 world) {
+  glm::vec2 scale = get_grid_scale();
+  // floor, truncating would pull the cells left of and above the grid onto it
+  float x = floorf((world.x - dem_upper_left_world_space.x) / scale.x);
+  float y = floorf((dem_upper_left_world_space.y - world.y) / scale.y);
+  if (!(x >= 0.0f && x < dem_grid.get_cols() && y >= 0.0f &&
+        y < dem_grid.get_rows())) {
+    return {-1, -1};
+  }
+  return {static_cast<int>(x), static_cast<int>(y)};
+}
+glm::vec2 Terrain::grid_to_world(glm::ivec2 col_row) {
+  glm::vec2 scale = get_grid_scale();
+  return {dem_upper_left_world_space.x + (col_row.x + 0.5f) * scale.x,
+          dem_upper_left_world_space.y - (col_row.y + 0.5f) * scale.y};
 }
 glm::dvec3 Terrain::calc_offset(RasterDataset *dem, RasterDataset *image) {
-  glm::dvec2 dem_upper_left = dem->get_top_left_coord();
-  glm::dvec2 image_upper_left = image->get_top_left_coord();
+  return calc_offset(dem->get_top_left_coord(), image->get_top_left_coord());
+}
+glm::dvec3 Terrain::calc_offset(glm::dvec2 dem_upper_left,
+                                glm::dvec2 image_upper_left) {
   glm::dvec2 dem_bottom_right =
       dem_upper_left + glm::dvec2(static_cast<double>(dem_pixels.x) *
                                       static_cast<double>(dem_pixel_scale.x),
@@ -118,12 +429,24 @@ void Terrain::update_footprints(Camera *camera) {
     glm::vec2 level_grid_center =
         world_center - center_offset + level_scale + dem_grid_offset;
 
+    if (stream) {
+      glm::ivec2 center_cell = {
+          static_cast<int>(floorf((world_center.x -
+                                   dem_upper_left_world_space.x) /
+                                  level_scale.x)),
+          static_cast<int>(floorf((dem_upper_left_world_space.y -
+                                   world_center.y) /
+                                  level_scale.y))};
+      stream->set_center(l, center_cell);
+    }
+
     if (l == L - 1 || distance_to_center > 2.5f * level_width.x) {
       glm::mat4 scale =
           glm::scale(glm::mat4(1.0f), {level_width.x, level_width.y, 1.0f});
       glm::mat4 translation = glm::translate(
           glm::mat4(1.0f), {level_grid_center.x, level_grid_center.y, 0.0f});
       (*interior_block_instance)[0] = (translation * scale);
+      interior_level = l;
       block_instances->set_instance_render_count(12 * l);
       break;
     }
@@ -161,37 +484,177 @@ void Terrain::update_footprints(Camera *camera) {
  * @return The column and row of the DEM.
  */
 glm::ivec2 Terrain::world_to_dem(glm::vec2 world) {
-  int x, y;
-  x = (world.x - dem_upper_left_world_space.x) / dem_pixel_scale.x;
-  y = (dem_upper_left_world_space.y - world.y) / dem_pixel_scale.y;
+  // floor, truncating would pull the pixels left of and above the DEM onto it
+  int x = static_cast<int>(
+      floorf((world.x - dem_upper_left_world_space.x) / dem_pixel_scale.x));
+  int y = static_cast<int>(
+      floorf((dem_upper_left_world_space.y - world.y) / dem_pixel_scale.y));
   return {x, y};
 }
 void Terrain::init_elevations(RasterDataset *dem) {
-  auto elevations =
-      dem->read_floats(1, 0, dem_pixels.x - 1, 0, dem_pixels.y - 1,
-                       dem_pixels.x, dem_pixels.y, offset.z);
-  elev_buffer = Renderer::gen_buffer<float>(
-      &elevations[0], sizeof(float) * dem_pixels.x * dem_pixels.y,
+  dem_grid = TerrainLoader::read_elevations(dem, 1);
+  dem_grid_shift = static_cast<float>(offset.z);
+  dem_pyramid = math_3dh::MinMaxPyramid(&dem_grid, dem_grid_shift);
+  elevation_grid_stale = true;
+  upload_elevations();
+  init_elevation_mips();
+  init_normals();
+}
+void Terrain::init_elevations(RasterMosaic *dem) {
+  dem_grid = TerrainLoader::read_elevations(dem, 1);
+  dem_grid_shift = static_cast<float>(offset.z);
+  dem_pyramid = math_3dh::MinMaxPyramid(&dem_grid, dem_grid_shift);
+  elevation_grid_stale = true;
+  upload_elevations();
+  init_elevation_mips();
+  init_normals();
+}
+void Terrain::init_elevations(TerrainCache *cache) {
+  dem_grid = cache->get_elevations();
+  // the cache was written with its own world offset already applied
+  dem_grid_shift =
+      static_cast<float>(offset.z - cache->get_header().z_offset);
+  dem_pyramid = math_3dh::MinMaxPyramid(&dem_grid, dem_grid_shift);
+  elevation_grid_stale = true;
+  upload_elevations();
+  // a cache written for another number of levels has no usable mips
+  if (cache->get_mips(static_cast<int>(L) - 1, dem_mips)) {
+    upload_elevation_mips();
+  } else {
+    init_elevation_mips();
+  }
+  if (cache->get_normals(dem_normals)) {
+    upload_normals();
+  } else {
+    init_normals();
+  }
+}
+void Terrain::upload_elevations() {
+  elev_buffer = Renderer::gen_buffer<uint16_t>(
+      const_cast<uint16_t *>(dem_grid.get_samples()),
+      sizeof(uint16_t) * dem_grid.get_sample_count(), BufferType::READ_WRITE);
+  elev_tile_buffer = Renderer::gen_buffer<math_3dh::QuantizedTile>(
+      const_cast<math_3dh::QuantizedTile *>(dem_grid.get_tiles()),
+      sizeof(math_3dh::QuantizedTile) * dem_grid.get_tile_count(),
+      BufferType::READ_WRITE);
+}
+void Terrain::init_elevation_mips() {
+  // clipmap level l has 2^(L - l - 1) DEM cells per vertex
+  dem_mips = math_3dh::ElevationMips(dem_grid, static_cast<int>(L) - 1);
+  upload_elevation_mips();
+}
+void Terrain::upload_elevation_mips() {
+  if (dem_mips.get_level_count() == 0) {
+    elev_mip_buffer = nullptr;
+    elev_mip_tile_buffer = nullptr;
+    elev_mip_info_buffer = nullptr;
+    return;
+  }
+  elev_mip_buffer = Renderer::gen_buffer<uint16_t>(
+      const_cast<uint16_t *>(dem_mips.get_samples().data()),
+      sizeof(uint16_t) * dem_mips.get_samples().size(),
+      BufferType::READ_WRITE);
+  elev_mip_tile_buffer = Renderer::gen_buffer<math_3dh::QuantizedTile>(
+      const_cast<math_3dh::QuantizedTile *>(dem_mips.get_tiles().data()),
+      sizeof(math_3dh::QuantizedTile) * dem_mips.get_tiles().size(),
+      BufferType::READ_WRITE);
+  elev_mip_info_buffer = Renderer::gen_buffer<math_3dh::MipInfo>(
+      const_cast<math_3dh::MipInfo *>(dem_mips.get_infos().data()),
+      sizeof(math_3dh::MipInfo) * dem_mips.get_infos().size(),
+      BufferType::READ_WRITE);
+}
+void Terrain::apply_stage(std::unique_ptr<TerrainStage> stage) {
+  dem_grid = std::move(stage->elevations);
+  dem_grid_factor = stage->dem_factor;
+  dem_grid_shift = static_cast<float>(offset.z);
+  dem_pyramid = math_3dh::MinMaxPyramid(&dem_grid, dem_grid_shift);
+  elevation_grid_stale = true;
+  upload_elevations();
+  dem_mips = std::move(stage->mips);
+  upload_elevation_mips();
+  dem_normals = std::move(stage->normals);
+  upload_normals();
+  image_grid_factor = stage->image_factor;
+  image_grid_pixels = stage->image_pixels;
+  image_buffer = Renderer::gen_buffer<uint32_t>(
+      stage->image.data(), sizeof(uint32_t) * stage->image.size(),
+      BufferType::READ_WRITE);
+}
+void Terrain::upload_stream() {
+  stream->poll();
+  std::vector<ClipmapStrip> changes = stream->take_changes();
+  const std::vector<float> &elevations = stream->get_elevations();
+  const std::vector<uint32_t> &colors = stream->get_colors();
+  const std::vector<glm::ivec2> &origins = stream->get_origins();
+  if (!clip_elev_buffer) {
+    // the rings keep their size, later changes are written in place
+    clip_elev_buffer = Renderer::gen_buffer<float>(
+        const_cast<float *>(elevations.data()),
+        sizeof(float) * elevations.size(), BufferType::READ_WRITE);
+    clip_color_buffer = Renderer::gen_buffer<uint32_t>(
+        const_cast<uint32_t *>(colors.data()),
+        sizeof(uint32_t) * colors.size(), BufferType::READ_WRITE);
+    clip_origin_buffer = Renderer::gen_buffer<glm::ivec2>(
+        const_cast<glm::ivec2 *>(origins.data()),
+        sizeof(glm::ivec2) * origins.size(), BufferType::READ_WRITE);
+    return;
+  }
+  // the fence at the start of the frame keeps the GPU off the mapped rings
+  for (const ClipmapStrip &change : changes) {
+    for (int y = change.y0; y < change.y0 + change.height; y++) {
+      for (int x = change.x0; x < change.x0 + change.width; x++) {
+        size_t index = stream->ring_index(change.level, x, y);
+        (*clip_elev_buffer)[index] = elevations[index];
+        (*clip_color_buffer)[index] = colors[index];
+      }
+    }
+  }
+  for (size_t l = 0; l < origins.size(); l++) {
+    (*clip_origin_buffer)[l] = origins[l];
+  }
+}
+void Terrain::init_image(TerrainCache *cache) {
+  image_grid_pixels = image_pixels;
+  image_buffer = Renderer::gen_buffer<uint32_t>(
+      const_cast<uint32_t *>(cache->get_image()),
+      sizeof(uint32_t) * image_pixels.x * image_pixels.y,
       BufferType::READ_WRITE);
 }
 void Terrain::init_image(RasterDataset *image) {
-  auto reds =
-      image->read_floats(1, 0, image_pixels.x - 1, 0, image_pixels.y - 1,
-                         image_pixels.x, image_pixels.y);
-  auto greens =
-      image->read_floats(2, 0, image_pixels.x - 1, 0, image_pixels.y - 1,
-                         image_pixels.x, image_pixels.y);
-  auto blues =
-      image->read_floats(3, 0, image_pixels.x - 1, 0, image_pixels.y - 1,
-                         image_pixels.x, image_pixels.y);
-  red_buffer = Renderer::gen_buffer<float>(
-      &reds[0], sizeof(float) * image_pixels.x * image_pixels.y,
+  image_grid_pixels = image_pixels;
+  // packed RGBA8, one interleaved read of all bands
+  auto pixels = image->read_rgba8(0, image_pixels.x - 1, 0, image_pixels.y - 1,
+                                  image_pixels.x, image_pixels.y);
+  image_buffer = Renderer::gen_buffer<uint32_t>(
+      &pixels[0], sizeof(uint32_t) * image_pixels.x * image_pixels.y,
       BufferType::READ_WRITE);
-  green_buffer = Renderer::gen_buffer<float>(
-      &greens[0], sizeof(float) * image_pixels.x * image_pixels.y,
+}
+void Terrain::init_image(RasterMosaic *image) {
+  image_grid_pixels = image_pixels;
+  auto pixels = image->read_rgba8(0, image_pixels.x - 1, 0, image_pixels.y - 1,
+                                  image_pixels.x, image_pixels.y);
+  image_buffer = Renderer::gen_buffer<uint32_t>(
+      &pixels[0], sizeof(uint32_t) * image_pixels.x * image_pixels.y,
       BufferType::READ_WRITE);
-  blue_buffer = Renderer::gen_buffer<float>(
-      &blues[0], sizeof(float) * image_pixels.x * image_pixels.y,
+}
+void Terrain::init_hillshade() {
+  image_grid_factor = dem_grid_factor;
+  image_grid_pixels = {dem_grid.get_cols(), dem_grid.get_rows()};
+  auto pixels =
+      math_3dh::hillshade_to_rgba(math_3dh::compute_hillshade(dem_normals));
+  image_buffer = Renderer::gen_buffer<uint32_t>(
+      pixels.data(), sizeof(uint32_t) * pixels.size(), BufferType::READ_WRITE);
+}
+void Terrain::init_normals() {
+  // shaded tile by tile, the analysis grid is built when needed
+  dem_normals = math_3dh::compute_normals(dem_grid, get_grid_scale());
+  upload_normals();
+}
+void Terrain::upload_normals() {
+  normal_buffer = Renderer::gen_buffer<uint16_t>(
+      dem_normals.data(), sizeof(uint16_t) * dem_normals.get_tile_count() *
+                              math_3dh::TiledGrid<uint16_t>::TILE_SIZE *
+                              math_3dh::TiledGrid<uint16_t>::TILE_SIZE,
       BufferType::READ_WRITE);
 }
 void Terrain::render(Camera *camera) {
@@ -211,39 +674,105 @@ void Terrain::render(Camera *camera) {
     }
   }
   update_footprints(camera);
+  if (stream) {
+    upload_stream();
+  }
+  if (loader && !loader->is_done()) {
+    if (auto stage = loader->poll()) {
+      apply_stage(std::move(stage));
+    }
+    if (!elev_buffer) {
+      // nothing to draw until the coarsest stage arrives
+      fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      return;
+    }
+  }
   material->bind();
-  material->upload_storage("elevations", elev_buffer.get());
-  material->upload_storage("reds", red_buffer.get());
-  material->upload_storage("greens", green_buffer.get());
-  material->upload_storage("blues", blue_buffer.get());
+  if (!stream) {
+    material->upload_storage("elevations", elev_buffer.get());
+    material->upload_storage("elevation_tiles", elev_tile_buffer.get());
+    material->upload_storage("image", image_buffer.get());
+    material->upload_storage("normals", normal_buffer.get());
+  }
+  // a draped hillshade is already shaded and the stream has no normals
+  material->upload_int("shade", !stream && has_image ? 1 : 0);
   material->upload_vec2("dem_upper_left", dem_upper_left_world_space);
-  material->upload_vec2("dem_scale", dem_pixel_scale);
-  material->upload_int("dem_n", dem_pixels.x);
-  material->upload_int("dem_m", dem_pixels.y);
+  material->upload_vec2("dem_scale", get_grid_scale());
+  material->upload_int("dem_n", dem_grid.get_cols());
+  material->upload_int("dem_m", dem_grid.get_rows());
+  material->upload_int("grid_level", grid_level());
+  material->upload_int("dem_tile_size", dem_grid.get_tile_size());
+  material->upload_int("dem_tiles_x", dem_grid.get_tiles_x());
+  material->upload_float("elev_shift", dem_grid_shift);
+  if (elev_mip_buffer) {
+    material->upload_storage("elevation_mips", elev_mip_buffer.get());
+    material->upload_storage("elevation_mip_tiles", elev_mip_tile_buffer.get());
+    material->upload_storage("elevation_mip_info", elev_mip_info_buffer.get());
+  }
+  material->upload_int("mip_count", dem_mips.get_level_count());
+  if (stream) {
+    material->upload_storage("clip_elevations", clip_elev_buffer.get());
+    material->upload_storage("clip_colors", clip_color_buffer.get());
+    material->upload_storage("clip_origins", clip_origin_buffer.get());
+    material->upload_int("clip_size", stream->get_size());
+  }
+  material->upload_int("streaming", stream ? 1 : 0);
+  material->upload_int("clipmap_levels", L);
   material->upload_vec2("image_upper_left", image_upper_left_world_space);
-  material->upload_vec2("image_scale", image_pixel_scale);
-  material->upload_int("image_n", image_pixels.x);
-  material->upload_int("image_m", image_pixels.y);
+  material->upload_vec2("image_scale",
+                        image_pixel_scale * static_cast<float>(image_grid_factor));
+  material->upload_int("image_n", image_grid_pixels.x);
+  material->upload_int("image_m", image_grid_pixels.y);
   material->upload_float("vert_exag", vert_exag);
   material->upload_float("alpha", alpha);
+  // the clipmap level of an instance selects the mip it samples
+  material->upload_int("first_level", 0);
+  material->upload_int("level_instances", 12);
   block_instances->render(camera, material.get());
+  material->upload_int("level_instances", 4);
   ring_fix_up_instances->render(camera, material.get());
+  material->upload_int("level_instances", 2);
   interior_trim_instances->render(camera, material.get());
   material->bind();
-  material->upload_storage("elevations", elev_buffer.get());
-  material->upload_storage("reds", red_buffer.get());
-  material->upload_storage("greens", green_buffer.get());
-  material->upload_storage("blues", blue_buffer.get());
+  if (!stream) {
+    material->upload_storage("elevations", elev_buffer.get());
+    material->upload_storage("elevation_tiles", elev_tile_buffer.get());
+    material->upload_storage("image", image_buffer.get());
+    material->upload_storage("normals", normal_buffer.get());
+  }
+  // a draped hillshade is already shaded
+  material->upload_int("shade", !stream && has_image ? 1 : 0);
   material->upload_vec2("dem_upper_left", dem_upper_left_world_space);
-  material->upload_vec2("dem_scale", dem_pixel_scale);
-  material->upload_int("dem_n", dem_pixels.x);
-  material->upload_int("dem_m", dem_pixels.y);
+  material->upload_vec2("dem_scale", get_grid_scale());
+  material->upload_int("dem_n", dem_grid.get_cols());
+  material->upload_int("dem_m", dem_grid.get_rows());
+  material->upload_int("grid_level", grid_level());
+  material->upload_int("dem_tile_size", dem_grid.get_tile_size());
+  material->upload_int("dem_tiles_x", dem_grid.get_tiles_x());
+  material->upload_float("elev_shift", dem_grid_shift);
+  if (elev_mip_buffer) {
+    material->upload_storage("elevation_mips", elev_mip_buffer.get());
+    material->upload_storage("elevation_mip_tiles", elev_mip_tile_buffer.get());
+    material->upload_storage("elevation_mip_info", elev_mip_info_buffer.get());
+  }
+  material->upload_int("mip_count", dem_mips.get_level_count());
+  if (stream) {
+    material->upload_storage("clip_elevations", clip_elev_buffer.get());
+    material->upload_storage("clip_colors", clip_color_buffer.get());
+    material->upload_storage("clip_origins", clip_origin_buffer.get());
+    material->upload_int("clip_size", stream->get_size());
+  }
+  material->upload_int("streaming", stream ? 1 : 0);
+  material->upload_int("clipmap_levels", L);
   material->upload_vec2("image_upper_left", image_upper_left_world_space);
-  material->upload_vec2("image_scale", image_pixel_scale);
-  material->upload_int("image_n", image_pixels.x);
-  material->upload_int("image_m", image_pixels.y);
+  material->upload_vec2("image_scale",
+                        image_pixel_scale * static_cast<float>(image_grid_factor));
+  material->upload_int("image_n", image_grid_pixels.x);
+  material->upload_int("image_m", image_grid_pixels.y);
   material->upload_float("vert_exag", vert_exag);
   material->upload_float("alpha", alpha);
+  material->upload_int("first_level", interior_level);
+  material->upload_int("level_instances", 1);
   interior_block_instance->render(camera, material.get());
   fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 }
\ No newline at end of file